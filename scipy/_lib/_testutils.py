@@ -11,7 +11,8 @@ import inspect
 import sysconfig
 
 
-__all__ = ['PytestTester', 'check_free_memory', '_TestPythranFunc', 'IS_MUSL']
+__all__ = ['PytestTester', 'check_free_memory', '_TestPythranFunc', 'IS_MUSL',
+           'check_workers']
 
 
 IS_MUSL = False
@@ -216,6 +217,18 @@ def check_free_memory(free_mb):
         pytest.skip(msg)
 
 
+def check_workers(func, set_workers, workers=4):
+    """
+    Check that *func()* gives the same result on 1 and on *workers*
+    threads, as set by the context manager *set_workers*, and return it
+    """
+    with set_workers(1):
+        expected = func()
+    with set_workers(workers):
+        np.testing.assert_equal(func(), expected)
+    return expected
+
+
 def _parse_size(size_str):
     suffixes = {'': 1e6,
                 'b': 1.0,
@@ -0,0 +1,53 @@
+"""Number of worker threads used by the compiled SciPy routines.
+
+`scipy.fft`, `scipy.sparse` and `scipy.ndimage` each keep the number of
+workers of the calling thread, and their ``set_workers`` context managers
+are all built from `workers_context` so that they accept and validate the
+same values.
+"""
+import contextlib
+import operator
+import os
+
+__all__ = ['normalize_workers', 'workers_context']
+
+
+_cpu_count = os.cpu_count()
+
+
+def normalize_workers(workers):
+    """Return the number of workers for a `workers` argument.
+
+    Negative values wrap around from ``os.cpu_count()``, so that ``-1``
+    means one worker per CPU.
+
+    Raises
+    ------
+    ValueError
+        If `workers` is zero or less than ``-os.cpu_count()``.
+    """
+    workers = operator.index(workers)
+    if workers < 0:
+        if workers >= -_cpu_count:
+            workers += 1 + _cpu_count
+        else:
+            raise ValueError("workers value out of range; got {}, must not be"
+                             " less than {}".format(workers, -_cpu_count))
+    elif workers == 0:
+        raise ValueError("workers must not be zero")
+
+    return workers
+
+
+@contextlib.contextmanager
+def workers_context(workers, set_workers):
+    """Context manager for a per-thread number of workers.
+
+    ``set_workers(n)`` must store the number of workers of the calling
+    thread and return the previous one, which is restored on exit.
+    """
+    old_workers = set_workers(normalize_workers(workers))
+    try:
+        yield
+    finally:
+        set_workers(old_workers)
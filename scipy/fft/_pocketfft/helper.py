@@ -1,15 +1,13 @@
 from numbers import Number
 import operator
-import os
 import threading
-import contextlib
 
 import numpy as np
+from scipy._lib._workers import normalize_workers, workers_context
 # good_size is exposed (and used) from this import
 from .pypocketfft import good_size  # noqa: F401
 
 _config = threading.local()
-_cpu_count = os.cpu_count()
 
 
 def _iterable_of_int(x, name=None):
@@ -162,19 +160,15 @@ def _workers(workers):
     if workers is None:
         return getattr(_config, 'default_workers', 1)
 
-    if workers < 0:
-        if workers >= -_cpu_count:
-            workers += 1 + _cpu_count
-        else:
-            raise ValueError("workers value out of range; got {}, must not be"
-                             " less than {}".format(workers, -_cpu_count))
-    elif workers == 0:
-        raise ValueError("workers must not be zero")
+    return normalize_workers(workers)
+
 
-    return workers
+def _set_default_workers(workers):
+    old_workers = get_workers()
+    _config.default_workers = workers
+    return old_workers
 
 
-@contextlib.contextmanager
 def set_workers(workers):
     """Context manager for the default number of workers used in `scipy.fft`
 
@@ -193,12 +187,7 @@ def set_workers(workers):
     ...     y = signal.fftconvolve(x, x)
 
     """
-    old_workers = get_workers()
-    _config.default_workers = _workers(operator.index(workers))
-    try:
-        yield
-    finally:
-        _config.default_workers = old_workers
+    return workers_context(workers, _set_default_workers)
 
 
 def get_workers():
@@ -51,6 +51,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POCKETFFT_CACHE_SIZE 16
 #endif
 
+// Allows compiling the library several times into one binary, e.g. for
+// different instruction sets, without the copies clashing at link time
+#ifndef POCKETFFT_NAMESPACE
+#define POCKETFFT_NAMESPACE pocketfft
+#endif
+
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
@@ -88,7 +94,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POCKETFFT_RESTRICT
 #endif
 
-namespace pocketfft {
+namespace POCKETFFT_NAMESPACE {
 
 namespace detail {
 using std::size_t;
@@ -129,7 +135,13 @@ constexpr bool FORWARD  = true,
 template<typename T> struct VLEN { static constexpr size_t val=1; };
 
 #ifndef POCKETFFT_NO_VECTORS
-#if (defined(__AVX512F__))
+#if defined(POCKETFFT_VECTOR_BYTES)
+// explicit vector width, for code compiled under a target attribute/pragma
+template<> struct VLEN<float>
+  { static constexpr size_t val=POCKETFFT_VECTOR_BYTES/sizeof(float); };
+template<> struct VLEN<double>
+  { static constexpr size_t val=POCKETFFT_VECTOR_BYTES/sizeof(double); };
+#elif (defined(__AVX512F__))
 template<> struct VLEN<float> { static constexpr size_t val=16; };
 template<> struct VLEN<double> { static constexpr size_t val=8; };
 #elif (defined(__AVX__))
@@ -675,8 +687,23 @@ class thread_pool
     std::vector<worker, aligned_allocator<worker>> workers_;
     std::atomic<bool> shutdown_;
     std::atomic<size_t> unscheduled_tasks_;
+    std::vector<size_t> cpus_;
     using lock_t = std::lock_guard<std::mutex>;
 
+    // Restrict worker i to cpus_[i % cpus_.size()], if any are given
+    void pin(worker &w, size_t i)
+      {
+      if (cpus_.empty()) return;
+#if defined(POCKETFFT_PTHREADS) && defined(__linux__)
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus_[i%cpus_.size()], &set);
+      pthread_setaffinity_np(w.thread.native_handle(), sizeof(set), &set);
+#else
+      (void)w; (void)i;
+#endif
+      }
+
     void create_threads()
       {
       lock_t lock(mut_);
@@ -692,6 +719,7 @@ class thread_pool
             {
             worker->worker_main(shutdown_, unscheduled_tasks_, overflow_work_);
             });
+          pin(*worker, i);
           }
         catch (...)
           {
@@ -757,6 +785,38 @@ class thread_pool
       shutdown_ = false;
       create_threads();
       }
+
+#if defined(POCKETFFT_PTHREADS) && defined(__linux__)
+    static constexpr bool can_pin = true;
+#else
+    static constexpr bool can_pin = false;
+#endif
+
+    size_t size() const { return workers_.size(); }
+    const std::vector<size_t> &affinity() const { return cpus_; }
+
+    /** Replaces the workers by \a nthreads new ones. If \a cpus is not
+        empty, worker i is pinned to cpus[i % cpus.size()].
+        \note Must not be called while work items are pending. */
+    void reconfigure(size_t nthreads, std::vector<size_t> cpus)
+      {
+#if defined(POCKETFFT_PTHREADS) && defined(__linux__)
+      for (auto cpu : cpus)
+        if (cpu >= CPU_SETSIZE)
+          throw std::invalid_argument("CPU index out of range");
+#else
+      if (!cpus.empty())
+        throw std::runtime_error("thread affinity is not supported");
+#endif
+      {
+      lock_t lock(mut_);
+      shutdown_locked();
+      workers_ = std::vector<worker, aligned_allocator<worker>>(nthreads);
+      cpus_ = std::move(cpus);
+      shutdown_ = false;
+      }
+      create_threads();
+      }
   };
 
 inline thread_pool & get_pool()
@@ -777,6 +837,17 @@ inline thread_pool & get_pool()
   return pool;
   }
 
+/** Where thread_map sends its work items. Defaults to get_pool(); several
+    copies of the library in one binary (see POCKETFFT_NAMESPACE) can be
+    made to share a single pool by replacing it before any transform runs. */
+using executor = std::function<void(std::function<void()>)>;
+inline executor &get_executor()
+  {
+  static executor ex([](std::function<void()> work)
+    { get_pool().submit(std::move(work)); });
+  return ex;
+  }
+
 /** Map a function f over nthreads */
 template <typename Func>
 void thread_map(size_t nthreads, Func f)
@@ -787,25 +858,28 @@ void thread_map(size_t nthreads, Func f)
   if (nthreads == 1)
     { f(); return; }
 
-  auto & pool = get_pool();
+  auto & submit = get_executor();
   latch counter(nthreads);
   std::exception_ptr ex;
   std::mutex ex_mut;
-  for (size_t i=0; i<nthreads; ++i)
-    {
-    pool.submit(
-      [&f, &counter, &ex, &ex_mut, i, nthreads] {
-      thread_id() = i;
-      num_threads() = nthreads;
-      try { f(); }
-      catch (...)
-        {
-        std::lock_guard<std::mutex> lock(ex_mut);
-        ex = std::current_exception();
-        }
-      counter.count_down();
-      });
-    }
+  auto run = [&f, &counter, &ex, &ex_mut, nthreads] (size_t i) {
+    thread_id() = i;
+    num_threads() = nthreads;
+    try { f(); }
+    catch (...)
+      {
+      std::lock_guard<std::mutex> lock(ex_mut);
+      ex = std::current_exception();
+      }
+    counter.count_down();
+    };
+  for (size_t i=1; i<nthreads; ++i)
+    submit([&run, i] { run(i); });
+  // the calling thread takes the first share instead of idling
+  auto old_id = thread_id(), old_num = num_threads();
+  run(0);
+  thread_id() = old_id;
+  num_threads() = old_num;
   counter.wait();
   if (ex)
     std::rethrow_exception(ex);
@@ -1326,10 +1400,9 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
   auto CH2 = [ch, idl1](size_t a, size_t b) -> const T&
     { return ch[a+idl1*b]; };
 
-  arr<cmplx<T0>> wal(ip);
-  wal[0] = cmplx<T0>(1., 0.);
-  for (size_t i=1; i<ip; ++i)
-    wal[i]=cmplx<T0>(csarr[i].r,fwd ? -csarr[i].i : csarr[i].i);
+  // twiddles of the current direction, taken from csarr without a copy
+  auto wal = [csarr](size_t i)
+    { return cmplx<T0>(csarr[i].r, fwd ? -csarr[i].i : csarr[i].i); };
 
   for (size_t k=0; k<l1; ++k)
     for (size_t i=0; i<ido; ++i)
@@ -1349,12 +1422,13 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
   for (size_t l=1, lc=ip-1; l<ipph; ++l, --lc)
     {
     // j=0
+    cmplx<T0> wal1=wal(l), wal2=wal(2*l);
     for (size_t ik=0; ik<idl1; ++ik)
       {
-      CX2(ik,l).r = CH2(ik,0).r+wal[l].r*CH2(ik,1).r+wal[2*l].r*CH2(ik,2).r;
-      CX2(ik,l).i = CH2(ik,0).i+wal[l].r*CH2(ik,1).i+wal[2*l].r*CH2(ik,2).i;
-      CX2(ik,lc).r=-wal[l].i*CH2(ik,ip-1).i-wal[2*l].i*CH2(ik,ip-2).i;
-      CX2(ik,lc).i=wal[l].i*CH2(ik,ip-1).r+wal[2*l].i*CH2(ik,ip-2).r;
+      CX2(ik,l).r = CH2(ik,0).r+wal1.r*CH2(ik,1).r+wal2.r*CH2(ik,2).r;
+      CX2(ik,l).i = CH2(ik,0).i+wal1.r*CH2(ik,1).i+wal2.r*CH2(ik,2).i;
+      CX2(ik,lc).r=-wal1.i*CH2(ik,ip-1).i-wal2.i*CH2(ik,ip-2).i;
+      CX2(ik,lc).i=wal1.i*CH2(ik,ip-1).r+wal2.i*CH2(ik,ip-2).r;
       }
 
     size_t iwal=2*l;
@@ -1362,9 +1436,9 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     for (; j<ipph-1; j+=2, jc-=2)
       {
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal=wal[iwal];
+      cmplx<T0> xwal=wal(iwal);
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal2=wal[iwal];
+      cmplx<T0> xwal2=wal(iwal);
       for (size_t ik=0; ik<idl1; ++ik)
         {
         CX2(ik,l).r += CH2(ik,j).r*xwal.r+CH2(ik,j+1).r*xwal2.r;
@@ -1376,7 +1450,7 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     for (; j<ipph; ++j, --jc)
       {
       iwal+=l; if (iwal>ip) iwal-=ip;
-      cmplx<T0> xwal=wal[iwal];
+      cmplx<T0> xwal=wal(iwal);
       for (size_t ik=0; ik<idl1; ++ik)
         {
         CX2(ik,l).r += CH2(ik,j).r*xwal.r;
@@ -1415,12 +1489,11 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     }
   }
 
-template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
+template<bool fwd, typename T> void pass_all(T c[], T ch[], T0 fct) const
   {
   if (length==1) { c[0]*=fct; return; }
   size_t l1=1;
-  arr<T> ch(length);
-  T *p1=c, *p2=ch.data();
+  T *p1=c, *p2=ch;
 
   for(size_t k1=0; k1<fact.size(); k1++)
     {
@@ -1464,8 +1537,17 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
   }
 
   public:
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return length; }
+
+    template<typename T> void exec(T c[], T buf[], T0 fct, bool fwd) const
+      { fwd ? pass_all<true>(c, buf, fct) : pass_all<false>(c, buf, fct); }
+
     template<typename T> void exec(T c[], T0 fct, bool fwd) const
-      { fwd ? pass_all<true>(c, fct) : pass_all<false>(c, fct); }
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, fwd);
+      }
 
   private:
     POCKETFFT_NOINLINE void factorize()
@@ -2220,12 +2302,20 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
       }
 
   public:
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return length; }
+
     template<typename T> void exec(T c[], T0 fct, bool r2hc) const
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, r2hc);
+      }
+
+    template<typename T> void exec(T c[], T ch[], T0 fct, bool r2hc) const
       {
       if (length==1) { c[0]*=fct; return; }
       size_t n=length, nf=fact.size();
-      arr<T> ch(n);
-      T *p1=c, *p2=ch.data();
+      T *p1=c, *p2=ch;
 
       if (r2hc)
         for(size_t k1=0, l1=n; k1<nf;++k1)
@@ -2362,9 +2452,10 @@ template<typename T0> class fftblue
     arr<cmplx<T0>> mem;
     cmplx<T0> *bk, *bkf;
 
-    template<bool fwd, typename T> void fft(cmplx<T> c[], T0 fct) const
+    template<bool fwd, typename T> void fft(cmplx<T> c[], cmplx<T> buf[],
+      T0 fct) const
       {
-      arr<cmplx<T>> akf(n2);
+      cmplx<T> *akf = buf, *pbuf = buf+n2;
 
       /* initialize a_k and FFT it */
       for (size_t m=0; m<n; ++m)
@@ -2373,7 +2464,7 @@ template<typename T0> class fftblue
       for (size_t m=n; m<n2; ++m)
         akf[m]=zero;
 
-      plan.exec (akf.data(),1.,true);
+      plan.exec (akf,pbuf,1.,true);
 
       /* do the convolution */
       akf[0] = akf[0].template special_mul<!fwd>(bkf[0]);
@@ -2386,7 +2477,7 @@ template<typename T0> class fftblue
         akf[n2/2] = akf[n2/2].template special_mul<!fwd>(bkf[n2/2]);
 
       /* inverse FFT */
-      plan.exec (akf.data(),1.,false);
+      plan.exec (akf,pbuf,1.,false);
 
       /* multiply by b_k */
       for (size_t m=0; m<n; ++m)
@@ -2423,34 +2514,52 @@ template<typename T0> class fftblue
         bkf[i] = tbkf[i];
       }
 
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return n2+plan.bufsize(); }
+    /** Number of elements of the scratch buffer of exec_r(). */
+    size_t bufsize_r() const { return 2*(n+bufsize()); }
+
+    template<typename T> void exec(cmplx<T> c[], cmplx<T> buf[], T0 fct,
+      bool fwd) const
+      { fwd ? fft<true>(c,buf,fct) : fft<false>(c,buf,fct); }
+
     template<typename T> void exec(cmplx<T> c[], T0 fct, bool fwd) const
-      { fwd ? fft<true>(c,fct) : fft<false>(c,fct); }
+      {
+      arr<cmplx<T>> buf(bufsize());
+      exec(c, buf.data(), fct, fwd);
+      }
 
-    template<typename T> void exec_r(T c[], T0 fct, bool fwd)
+    template<typename T> void exec_r(T c[], T buf[], T0 fct, bool fwd) const
       {
-      arr<cmplx<T>> tmp(n);
+      cmplx<T> *tmp = reinterpret_cast<cmplx<T> *>(buf), *fbuf = tmp+n;
       if (fwd)
         {
         auto zero = T0(0)*c[0];
         for (size_t m=0; m<n; ++m)
           tmp[m].Set(c[m], zero);
-        fft<true>(tmp.data(),fct);
+        fft<true>(tmp,fbuf,fct);
         c[0] = tmp[0].r;
-        memcpy (c+1, tmp.data()+1, (n-1)*sizeof(T));
+        memcpy (c+1, tmp+1, (n-1)*sizeof(T));
         }
       else
         {
         tmp[0].Set(c[0],c[0]*0);
-        memcpy (reinterpret_cast<void *>(tmp.data()+1),
+        memcpy (reinterpret_cast<void *>(tmp+1),
                 reinterpret_cast<void *>(c+1), (n-1)*sizeof(T));
         if ((n&1)==0) tmp[n/2].i=T0(0)*c[0];
         for (size_t m=1; 2*m<n; ++m)
           tmp[n-m].Set(tmp[m].r, -tmp[m].i);
-        fft<false>(tmp.data(),fct);
+        fft<false>(tmp,fbuf,fct);
         for (size_t m=0; m<n; ++m)
           c[m] = tmp[m].r;
         }
       }
+
+    template<typename T> void exec_r(T c[], T0 fct, bool fwd) const
+      {
+      arr<T> buf(bufsize_r());
+      exec_r(c, buf.data(), fct, fwd);
+      }
   };
 
 //
@@ -2484,6 +2593,17 @@ template<typename T0> class pocketfft_c
         packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
       }
 
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const
+      { return packplan ? packplan->bufsize() : blueplan->bufsize(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(cmplx<T> c[],
+      cmplx<T> buf[], T0 fct, bool fwd) const
+      {
+      packplan ? packplan->exec(c,buf,fct,fwd)
+               : blueplan->exec(c,buf,fct,fwd);
+      }
+
     template<typename T> POCKETFFT_NOINLINE void exec(cmplx<T> c[], T0 fct, bool fwd) const
       { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec(c,fct,fwd); }
 
@@ -2521,6 +2641,17 @@ template<typename T0> class pocketfft_r
         packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
       }
 
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const
+      { return packplan ? packplan->bufsize() : blueplan->bufsize_r(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T buf[], T0 fct,
+      bool fwd) const
+      {
+      packplan ? packplan->exec(c,buf,fct,fwd)
+               : blueplan->exec_r(c,buf,fct,fwd);
+      }
+
     template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool fwd) const
       { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec_r(c,fct,fwd); }
 
@@ -2541,18 +2672,21 @@ template<typename T0> class T_dct1
     POCKETFFT_NOINLINE T_dct1(size_t length)
       : fftplan(2*(length-1)) {}
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
-      int /*type*/, bool /*cosine*/) const
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return fftplan.length()+fftplan.bufsize(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T buf[], T0 fct,
+      bool ortho, int /*type*/, bool /*cosine*/) const
       {
       constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
       size_t N=fftplan.length(), n=N/2+1;
       if (ortho)
         { c[0]*=sqrt2; c[n-1]*=sqrt2; }
-      arr<T> tmp(N);
+      T *tmp = buf;
       tmp[0] = c[0];
       for (size_t i=1; i<n; ++i)
         tmp[i] = tmp[N-i] = c[i];
-      fftplan.exec(tmp.data(), fct, true);
+      fftplan.exec(tmp, buf+N, fct, true);
       c[0] = tmp[0];
       for (size_t i=1; i<n; ++i)
         c[i] = tmp[2*i-1];
@@ -2560,6 +2694,13 @@ template<typename T0> class T_dct1
         { c[0]*=sqrt2*T0(0.5); c[n-1]*=sqrt2*T0(0.5); }
       }
 
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine) const
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, ortho, type, cosine);
+      }
+
     size_t length() const { return fftplan.length()/2+1; }
   };
 
@@ -2572,19 +2713,29 @@ template<typename T0> class T_dst1
     POCKETFFT_NOINLINE T_dst1(size_t length)
       : fftplan(2*(length+1)) {}
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return fftplan.length()+fftplan.bufsize(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T buf[], T0 fct,
       bool /*ortho*/, int /*type*/, bool /*cosine*/) const
       {
       size_t N=fftplan.length(), n=N/2-1;
-      arr<T> tmp(N);
+      T *tmp = buf;
       tmp[0] = tmp[n+1] = c[0]*0;
       for (size_t i=0; i<n; ++i)
         { tmp[i+1]=c[i]; tmp[N-1-i]=-c[i]; }
-      fftplan.exec(tmp.data(), fct, true);
+      fftplan.exec(tmp, buf+N, fct, true);
       for (size_t i=0; i<n; ++i)
         c[i] = -tmp[2*i+2];
       }
 
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine) const
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, ortho, type, cosine);
+      }
+
     size_t length() const { return fftplan.length()/2-1; }
   };
 
@@ -2603,8 +2754,11 @@ template<typename T0> class T_dcst23
         twiddle[i] = tw[i+1].r;
       }
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
-      int type, bool cosine) const
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const { return fftplan.bufsize(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T buf[], T0 fct,
+      bool ortho, int type, bool cosine) const
       {
       constexpr T0 sqrt2=T0(1.414213562373095048801688724209698L);
       size_t N=length();
@@ -2618,7 +2772,7 @@ template<typename T0> class T_dcst23
         if ((N&1)==0) c[N-1]*=2;
         for (size_t k=1; k<N-1; k+=2)
           MPINPLACE(c[k+1], c[k]);
-        fftplan.exec(c, fct, false);
+        fftplan.exec(c, buf, fct, false);
         for (size_t k=1, kc=N-1; k<NS2; ++k, --kc)
           {
           T t1 = twiddle[k-1]*c[kc]+twiddle[kc-1]*c[k];
@@ -2648,7 +2802,7 @@ template<typename T0> class T_dcst23
           }
         if ((N&1)==0)
           c[NS2] *= 2*twiddle[NS2-1];
-        fftplan.exec(c, fct, true);
+        fftplan.exec(c, buf, fct, true);
         for (size_t k=1; k<N-1; k+=2)
           MPINPLACE(c[k], c[k+1]);
         if (!cosine)
@@ -2657,6 +2811,13 @@ template<typename T0> class T_dcst23
         }
       }
 
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine) const
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, ortho, type, cosine);
+      }
+
     size_t length() const { return fftplan.length(); }
   };
 
@@ -2683,7 +2844,11 @@ template<typename T0> class T_dcst4
         }
       }
 
-    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct,
+    /** Number of elements of the scratch buffer of exec(). */
+    size_t bufsize() const
+      { return (N&1) ? N+rfft->bufsize() : N+2*fft->bufsize(); }
+
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T buf[], T0 fct,
       bool /*ortho*/, int /*type*/, bool cosine) const
       {
       size_t n2 = N/2;
@@ -2696,7 +2861,7 @@ template<typename T0> class T_dcst4
         // and is released under the 3-clause BSD license with friendly
         // permission of Matteo Frigo and Steven G. Johnson.
 
-        arr<T> y(N);
+        T *y = buf;
         {
         size_t i=0, m=n2;
         for (; m<N; ++i, m+=4)
@@ -2710,7 +2875,7 @@ template<typename T0> class T_dcst4
         for (; i<N; ++i, m+=4)
           y[i] = c[m-4*N];
         }
-        rfft->exec(y.data(), fct, true);
+        rfft->exec(y, buf+N, fct, true);
         {
         auto SGN = [](size_t i)
            {
@@ -2739,13 +2904,13 @@ template<typename T0> class T_dcst4
         {
         // even length algorithm from
         // https://www.appletonaudio.com/blog/2013/derivation-of-fast-dct-4-algorithm-based-on-dft/
-        arr<cmplx<T>> y(n2);
+        cmplx<T> *y = reinterpret_cast<cmplx<T> *>(buf);
         for(size_t i=0; i<n2; ++i)
           {
           y[i].Set(c[2*i],c[N-1-2*i]);
           y[i] *= C2[i];
           }
-        fft->exec(y.data(), fct, true);
+        fft->exec(y, y+n2, fct, true);
         for(size_t i=0, ic=n2-1; i<n2; ++i, --ic)
           {
           c[2*i  ] =  2*(y[i ].r*C2[i ].r-y[i ].i*C2[i ].i);
@@ -2757,6 +2922,13 @@ template<typename T0> class T_dcst4
           c[k] = -c[k];
       }
 
+    template<typename T> POCKETFFT_NOINLINE void exec(T c[], T0 fct, bool ortho,
+      int type, bool cosine) const
+      {
+      arr<T> buf(bufsize());
+      exec(c, buf.data(), fct, ortho, type, cosine);
+      }
+
     size_t length() const { return N; }
   };
 
@@ -2865,9 +3037,40 @@ template<size_t N> class multi_iter
     const arr_info &iarr, &oarr;
     ptrdiff_t p_ii, p_i[N], str_i, p_oi, p_o[N], str_o;
     size_t idim, rem;
+    // If all axes except idim can be traversed as a single strided batch
+    // axis (e.g. the rows of a 2D array), lines are bstr_i/bstr_o apart.
+    bool batched;
+    ptrdiff_t bstr_i, bstr_o;
+
+    bool collapse()
+      {
+      bstr_i = bstr_o = 0;
+      size_t inner = 1;
+      for (int i_=int(pos.size())-1; i_>=0; --i_)
+        {
+        auto i = size_t(i_);
+        if ((i==idim) || (iarr.shape(i)==1)) continue;
+        if (inner==1)
+          {
+          bstr_i = iarr.stride(i);
+          bstr_o = oarr.stride(i);
+          }
+        else if ((iarr.stride(i)!=bstr_i*ptrdiff_t(inner))
+              || (oarr.stride(i)!=bstr_o*ptrdiff_t(inner)))
+          return false;
+        inner *= iarr.shape(i);
+        }
+      return true;
+      }
 
     void advance_i()
       {
+      if (batched)
+        {
+        p_ii += bstr_i;
+        p_oi += bstr_o;
+        return;
+        }
       for (int i_=int(pos.size())-1; i_>=0; --i_)
         {
         auto i = size_t(i_);
@@ -2883,15 +3086,14 @@ template<size_t N> class multi_iter
       }
 
   public:
-    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_)
+    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_,
+      size_t nshares, size_t myshare)
       : pos(iarr_.ndim(), 0), iarr(iarr_), oarr(oarr_), p_ii(0),
         str_i(iarr.stride(idim_)), p_oi(0), str_o(oarr.stride(idim_)),
-        idim(idim_), rem(iarr.size()/iarr.shape(idim))
+        idim(idim_), rem(iarr.size()/iarr.shape(idim)), batched(collapse())
       {
-      auto nshares = threading::num_threads();
       if (nshares==1) return;
       if (nshares==0) throw std::runtime_error("can't run with zero threads");
-      auto myshare = threading::thread_id();
       if (myshare>=nshares) throw std::runtime_error("impossible share requested");
       size_t nbase = rem/nshares;
       size_t additional = rem%nshares;
@@ -2899,6 +3101,13 @@ template<size_t N> class multi_iter
       size_t hi = lo+nbase+(myshare<additional);
       size_t todo = hi-lo;
 
+      if (batched)
+        {
+        p_ii = ptrdiff_t(lo)*bstr_i;
+        p_oi = ptrdiff_t(lo)*bstr_o;
+        rem = todo;
+        return;
+        }
       size_t chunk = rem;
       for (size_t i=0; i<pos.size(); ++i)
         {
@@ -2912,6 +3121,9 @@ template<size_t N> class multi_iter
         }
       rem = todo;
       }
+    multi_iter(const arr_info &iarr_, const arr_info &oarr_, size_t idim_)
+      : multi_iter(iarr_, oarr_, idim_, threading::num_threads(),
+                   threading::thread_id()) {}
     void advance(size_t n)
       {
       if (rem<n) throw std::runtime_error("underrun");
@@ -2932,6 +3144,14 @@ template<size_t N> class multi_iter
     ptrdiff_t stride_in() const { return str_i; }
     ptrdiff_t stride_out() const { return str_o; }
     size_t remaining() const { return rem; }
+    // true if the N current lines are better gathered one after the other
+    // than element by element, i.e. if each line is contiguous in memory
+    // relative to the distance between lines
+    bool line_major() const
+      {
+      return (N>1) && (std::abs(str_i)<std::abs(p_i[1]-p_i[0]))
+                   && (std::abs(str_o)<std::abs(p_o[1]-p_o[0]));
+      }
   };
 
 class simple_iter
@@ -3043,15 +3263,19 @@ template<> struct VTYPE<long double>
   };
 #endif
 
+// The temporary storage of a transform along an axis holds the lines being
+// transformed, followed by `bufsize` elements per line of scratch space for
+// the 1D plan (see line_scratch).
 template<typename T> arr<char> alloc_tmp(const shape_t &shape,
-  size_t axsize, size_t elemsize)
+  size_t axsize, size_t elemsize, size_t bufsize=0)
   {
   auto othersize = util::prod(shape)/axsize;
-  auto tmpsize = axsize*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
+  auto tmpsize = (axsize+bufsize)
+    *((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
   return arr<char>(tmpsize*elemsize);
   }
 template<typename T> arr<char> alloc_tmp(const shape_t &shape,
-  const shape_t &axes, size_t elemsize)
+  const shape_t &axes, size_t elemsize, const shape_t &bufsizes={})
   {
   size_t fullsize=util::prod(shape);
   size_t tmpsize=0;
@@ -3059,29 +3283,49 @@ template<typename T> arr<char> alloc_tmp(const shape_t &shape,
     {
     auto axsize = shape[axes[i]];
     auto othersize = fullsize/axsize;
-    auto sz = axsize*((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
+    auto bufsize = (i<bufsizes.size()) ? bufsizes[i] : 0;
+    auto sz = (axsize+bufsize)
+      *((othersize>=VLEN<T>::val) ? VLEN<T>::val : 1);
     if (sz>tmpsize) tmpsize=sz;
     }
   return arr<char>(tmpsize*elemsize);
   }
 
+// Scratch space of the 1D plan behind the `len` elements of the line buffer
+// at the start of `tmp`
+template<typename T> T *line_scratch(char *tmp, size_t len)
+  { return reinterpret_cast<T *>(tmp)+len; }
+
 template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
   const cndarr<cmplx<T>> &src, cmplx<vtype_t<T>> *POCKETFFT_RESTRICT dst)
   {
-  for (size_t i=0; i<it.length_in(); ++i)
+  if (it.line_major())
     for (size_t j=0; j<vlen; ++j)
-      {
-      dst[i].r[j] = src[it.iofs(j,i)].r;
-      dst[i].i[j] = src[it.iofs(j,i)].i;
-      }
+      for (size_t i=0; i<it.length_in(); ++i)
+        {
+        dst[i].r[j] = src[it.iofs(j,i)].r;
+        dst[i].i[j] = src[it.iofs(j,i)].i;
+        }
+  else
+    for (size_t i=0; i<it.length_in(); ++i)
+      for (size_t j=0; j<vlen; ++j)
+        {
+        dst[i].r[j] = src[it.iofs(j,i)].r;
+        dst[i].i[j] = src[it.iofs(j,i)].i;
+        }
   }
 
 template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
   const cndarr<T> &src, vtype_t<T> *POCKETFFT_RESTRICT dst)
   {
-  for (size_t i=0; i<it.length_in(); ++i)
+  if (it.line_major())
     for (size_t j=0; j<vlen; ++j)
-      dst[i][j] = src[it.iofs(j,i)];
+      for (size_t i=0; i<it.length_in(); ++i)
+        dst[i][j] = src[it.iofs(j,i)];
+  else
+    for (size_t i=0; i<it.length_in(); ++i)
+      for (size_t j=0; j<vlen; ++j)
+        dst[i][j] = src[it.iofs(j,i)];
   }
 
 template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
@@ -3095,17 +3339,27 @@ template <typename T, size_t vlen> void copy_input(const multi_iter<vlen> &it,
 template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
   const cmplx<vtype_t<T>> *POCKETFFT_RESTRICT src, ndarr<cmplx<T>> &dst)
   {
-  for (size_t i=0; i<it.length_out(); ++i)
+  if (it.line_major())
     for (size_t j=0; j<vlen; ++j)
-      dst[it.oofs(j,i)].Set(src[i].r[j],src[i].i[j]);
+      for (size_t i=0; i<it.length_out(); ++i)
+        dst[it.oofs(j,i)].Set(src[i].r[j],src[i].i[j]);
+  else
+    for (size_t i=0; i<it.length_out(); ++i)
+      for (size_t j=0; j<vlen; ++j)
+        dst[it.oofs(j,i)].Set(src[i].r[j],src[i].i[j]);
   }
 
 template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
   const vtype_t<T> *POCKETFFT_RESTRICT src, ndarr<T> &dst)
   {
-  for (size_t i=0; i<it.length_out(); ++i)
+  if (it.line_major())
     for (size_t j=0; j<vlen; ++j)
-      dst[it.oofs(j,i)] = src[i][j];
+      for (size_t i=0; i<it.length_out(); ++i)
+        dst[it.oofs(j,i)] = src[i][j];
+  else
+    for (size_t i=0; i<it.length_out(); ++i)
+      for (size_t j=0; j<vlen; ++j)
+        dst[it.oofs(j,i)] = src[i][j];
   }
 
 template<typename T, size_t vlen> void copy_output(const multi_iter<vlen> &it,
@@ -3121,57 +3375,143 @@ template <typename T> struct add_vec<cmplx<T>>
   { using type = cmplx<vtype_t<T>>; };
 template <typename T> using add_vec_t = typename add_vec<T>::type;
 
+template<typename T, typename T0, typename Tplan, typename Exec, size_t vlen>
+void exec_lines(multi_iter<vlen> &it, const cndarr<T> &tin, ndarr<T> &out,
+  char *tmp, const Tplan &plan, T0 fct, const Exec &exec,
+  const bool allow_inplace)
+  {
+#ifndef POCKETFFT_NO_VECTORS
+  if (vlen>1)
+    while (it.remaining()>=vlen)
+      {
+      it.advance(vlen);
+      auto tdatav = reinterpret_cast<add_vec_t<T> *>(tmp);
+      exec(it, tin, out, tdatav,
+        line_scratch<add_vec_t<T>>(tmp, it.length_in()), plan, fct);
+      }
+#endif
+  while (it.remaining()>0)
+    {
+    it.advance(1);
+    auto buf = allow_inplace && it.stride_out() == sizeof(T) ?
+      &out[it.oofs(0)] : reinterpret_cast<T *>(tmp);
+    exec(it, tin, out, buf, line_scratch<T>(tmp, it.length_in()), plan, fct);
+    }
+  }
+
+// Upper limit for the size of the block buffer used by exec_blocked
+constexpr size_t block_bytes = size_t(1)<<20;
+
+// Returns true if lines along `axis` are better processed in blocks, i.e.
+// if the array is large and neighbouring lines are closer in memory than
+// neighbouring elements of a line.
+inline bool use_blocks(const arr_info &a, size_t axis, size_t elemsize)
+  {
+  if (a.size()*elemsize < block_bytes) return false;
+  for (size_t i=0; i<a.ndim(); ++i)
+    if ((i!=axis) && (a.shape(i)>1)
+      && (std::abs(a.stride(i))<std::abs(a.stride(axis))))
+      return true;
+  return false;
+  }
+
+// Like exec_lines, but first copies blocks of up to `nblock` lines into a
+// compact buffer.  For strided axes this turns the gather/scatter of each
+// group of vlen lines into streaming copies of whole cache lines, and the
+// per-group work then runs on cache-resident data.
+template<typename T, typename T0, typename Tplan, typename Exec>
+void exec_blocked(const cndarr<T> &tin, ndarr<T> &out, size_t axis,
+  size_t nshares, size_t myshare, char *tmp, const Tplan &plan, T0 fct,
+  const Exec &exec)
+  {
+  constexpr auto vlen = VLEN<T0>::val;
+  constexpr size_t nblock = (1024/sizeof(T) > vlen) ? 1024/sizeof(T) : vlen;
+  size_t len = tin.shape(axis);
+  size_t nmax = std::min(nblock,
+    std::max(vlen, block_bytes/(len*sizeof(T))/vlen*vlen));
+  multi_iter<nblock> it(tin, out, axis, nshares, myshare);
+  arr<T> blk(len*nmax);
+  while (it.remaining()>0)
+    {
+    size_t n = std::min(nmax, it.remaining());
+    it.advance(n);
+    for (size_t i=0; i<len; ++i)
+      for (size_t j=0; j<n; ++j)
+        blk[i*n+j] = tin[it.iofs(j,i)];
+    ndarr<T> ablk(blk.data(), shape_t{len, n},
+      stride_t{ptrdiff_t(n*sizeof(T)), ptrdiff_t(sizeof(T))});
+    multi_iter<vlen> bit(ablk, ablk, 0, 1, 0);
+    exec_lines(bit, ablk, ablk, tmp, plan, fct, exec, false);
+    for (size_t i=0; i<len; ++i)
+      for (size_t j=0; j<n; ++j)
+        out[it.oofs(j,i)] = blk[i*n+j];
+    }
+  }
+
 template<typename Tplan, typename T, typename T0, typename Exec>
 POCKETFFT_NOINLINE void general_nd(const cndarr<T> &in, ndarr<T> &out,
-  const shape_t &axes, T0 fct, size_t nthreads, const Exec & exec,
-  const bool allow_inplace=true)
+  const shape_t &axes, const std::vector<std::shared_ptr<Tplan>> &plans,
+  T0 fct, size_t nthreads, const Exec & exec, const bool allow_inplace=true,
+  char *scratch=nullptr)
   {
-  std::shared_ptr<Tplan> plan;
-
   for (size_t iax=0; iax<axes.size(); ++iax)
     {
-    size_t len=in.shape(axes[iax]);
-    if ((!plan) || (len!=plan->length()))
-      plan = get_plan<Tplan>(len);
+    const Tplan &plan(*plans[iax]);
+    size_t len=plan.length();
+    const auto &tin(iax==0? in : out);
+    const bool blocked = use_blocks(tin, axes[iax], sizeof(T))
+                      && use_blocks(out, axes[iax], sizeof(T));
 
     threading::thread_map(
       util::thread_count(nthreads, in.shape(), axes[iax], VLEN<T>::val),
       [&] {
         constexpr auto vlen = VLEN<T0>::val;
-        auto storage = alloc_tmp<T0>(in.shape(), len, sizeof(T));
-        const auto &tin(iax==0? in : out);
-        multi_iter<vlen> it(tin, out, axes[iax]);
-#ifndef POCKETFFT_NO_VECTORS
-        if (vlen>1)
-          while (it.remaining()>=vlen)
-            {
-            it.advance(vlen);
-            auto tdatav = reinterpret_cast<add_vec_t<T> *>(storage.data());
-            exec(it, tin, out, tdatav, *plan, fct);
-            }
-#endif
-        while (it.remaining()>0)
+        // a caller-provided scratch buffer, sized by alloc_tmp for the line
+        // buffer and the plan's scratch space, can only serve a single thread
+        const bool own = (scratch==nullptr) || (threading::num_threads()>1);
+        auto storage = own ? alloc_tmp<T0>(in.shape(), len, sizeof(T),
+                                           plan.bufsize())
+                           : arr<char>();
+        char *tmp = own ? storage.data() : scratch;
+        if (blocked)
           {
-          it.advance(1);
-          auto buf = allow_inplace && it.stride_out() == sizeof(T) ?
-            &out[it.oofs(0)] : reinterpret_cast<T *>(storage.data());
-          exec(it, tin, out, buf, *plan, fct);
+          exec_blocked(tin, out, axes[iax], threading::num_threads(),
+            threading::thread_id(), tmp, plan, fct, exec);
+          return;
           }
+        multi_iter<vlen> it(tin, out, axes[iax]);
+        exec_lines(it, tin, out, tmp, plan, fct, exec, allow_inplace);
       });  // end of parallel region
     fct = T0(1); // factor has been applied, use 1 for remaining axes
     }
   }
 
+template<typename Tplan, typename T, typename T0, typename Exec>
+POCKETFFT_NOINLINE void general_nd(const cndarr<T> &in, ndarr<T> &out,
+  const shape_t &axes, T0 fct, size_t nthreads, const Exec & exec,
+  const bool allow_inplace=true)
+  {
+  std::vector<std::shared_ptr<Tplan>> plans(axes.size());
+  for (size_t iax=0; iax<axes.size(); ++iax)
+    {
+    size_t len=in.shape(axes[iax]);
+    plans[iax] = ((iax>0) && (len==plans[iax-1]->length())) ?
+      plans[iax-1] : get_plan<Tplan>(len);
+    }
+  general_nd(in, out, axes, plans, fct, nthreads, exec, allow_inplace);
+  }
+
 struct ExecC2C
   {
   bool forward;
 
   template <typename T0, typename T, size_t vlen> void operator () (
     const multi_iter<vlen> &it, const cndarr<cmplx<T0>> &in,
-    ndarr<cmplx<T0>> &out, T * buf, const pocketfft_c<T0> &plan, T0 fct) const
+    ndarr<cmplx<T0>> &out, T * buf, T * scratch, const pocketfft_c<T0> &plan,
+    T0 fct) const
     {
     copy_input(it, in, buf);
-    plan.exec(buf, fct, forward);
+    plan.exec(buf, scratch, fct, forward);
     copy_output(it, buf, out);
     }
   };
@@ -3211,10 +3551,10 @@ struct ExecHartley
   {
   template <typename T0, typename T, size_t vlen> void operator () (
     const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out,
-    T * buf, const pocketfft_r<T0> &plan, T0 fct) const
+    T * buf, T * scratch, const pocketfft_r<T0> &plan, T0 fct) const
     {
     copy_input(it, in, buf);
-    plan.exec(buf, fct, true);
+    plan.exec(buf, scratch, fct, true);
     copy_hartley(it, buf, out);
     }
   };
@@ -3227,34 +3567,37 @@ struct ExecDcst
 
   template <typename T0, typename T, typename Tplan, size_t vlen>
   void operator () (const multi_iter<vlen> &it, const cndarr<T0> &in,
-    ndarr<T0> &out, T * buf, const Tplan &plan, T0 fct) const
+    ndarr<T0> &out, T * buf, T * scratch, const Tplan &plan, T0 fct) const
     {
     copy_input(it, in, buf);
-    plan.exec(buf, fct, ortho, type, cosine);
+    plan.exec(buf, scratch, fct, ortho, type, cosine);
     copy_output(it, buf, out);
     }
   };
 
 template<typename T> POCKETFFT_NOINLINE void general_r2c(
   const cndarr<T> &in, ndarr<cmplx<T>> &out, size_t axis, bool forward, T fct,
-  size_t nthreads)
+  size_t nthreads, const pocketfft_r<T> &plan, char *scratch=nullptr)
   {
-  auto plan = get_plan<pocketfft_r<T>>(in.shape(axis));
   size_t len=in.shape(axis);
   threading::thread_map(
     util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val),
     [&] {
     constexpr auto vlen = VLEN<T>::val;
-    auto storage = alloc_tmp<T>(in.shape(), len, sizeof(T));
+    const bool own = (scratch==nullptr) || (threading::num_threads()>1);
+    auto storage = own ? alloc_tmp<T>(in.shape(), len, sizeof(T),
+                                      plan.bufsize())
+                       : arr<char>();
+    char *tmp = own ? storage.data() : scratch;
     multi_iter<vlen> it(in, out, axis);
 #ifndef POCKETFFT_NO_VECTORS
     if (vlen>1)
       while (it.remaining()>=vlen)
         {
         it.advance(vlen);
-        auto tdatav = reinterpret_cast<vtype_t<T> *>(storage.data());
+        auto tdatav = reinterpret_cast<vtype_t<T> *>(tmp);
         copy_input(it, in, tdatav);
-        plan->exec(tdatav, fct, true);
+        plan.exec(tdatav, line_scratch<vtype_t<T>>(tmp, len), fct, true);
         for (size_t j=0; j<vlen; ++j)
           out[it.oofs(j,0)].Set(tdatav[0][j]);
         size_t i=1, ii=1;
@@ -3274,9 +3617,9 @@ template<typename T> POCKETFFT_NOINLINE void general_r2c(
     while (it.remaining()>0)
       {
       it.advance(1);
-      auto tdata = reinterpret_cast<T *>(storage.data());
+      auto tdata = reinterpret_cast<T *>(tmp);
       copy_input(it, in, tdata);
-      plan->exec(tdata, fct, true);
+      plan.exec(tdata, line_scratch<T>(tmp, len), fct, true);
       out[it.oofs(0)].Set(tdata[0]);
       size_t i=1, ii=1;
       if (forward)
@@ -3290,24 +3633,34 @@ template<typename T> POCKETFFT_NOINLINE void general_r2c(
       }
     });  // end of parallel region
   }
+template<typename T> POCKETFFT_NOINLINE void general_r2c(
+  const cndarr<T> &in, ndarr<cmplx<T>> &out, size_t axis, bool forward, T fct,
+  size_t nthreads)
+  {
+  auto plan = get_plan<pocketfft_r<T>>(in.shape(axis));
+  general_r2c(in, out, axis, forward, fct, nthreads, *plan);
+  }
 template<typename T> POCKETFFT_NOINLINE void general_c2r(
   const cndarr<cmplx<T>> &in, ndarr<T> &out, size_t axis, bool forward, T fct,
-  size_t nthreads)
+  size_t nthreads, const pocketfft_r<T> &plan, char *scratch=nullptr)
   {
-  auto plan = get_plan<pocketfft_r<T>>(out.shape(axis));
   size_t len=out.shape(axis);
   threading::thread_map(
     util::thread_count(nthreads, in.shape(), axis, VLEN<T>::val),
     [&] {
       constexpr auto vlen = VLEN<T>::val;
-      auto storage = alloc_tmp<T>(out.shape(), len, sizeof(T));
+      const bool own = (scratch==nullptr) || (threading::num_threads()>1);
+      auto storage = own ? alloc_tmp<T>(out.shape(), len, sizeof(T),
+                                        plan.bufsize())
+                         : arr<char>();
+      char *tmp = own ? storage.data() : scratch;
       multi_iter<vlen> it(in, out, axis);
 #ifndef POCKETFFT_NO_VECTORS
       if (vlen>1)
         while (it.remaining()>=vlen)
           {
           it.advance(vlen);
-          auto tdatav = reinterpret_cast<vtype_t<T> *>(storage.data());
+          auto tdatav = reinterpret_cast<vtype_t<T> *>(tmp);
           for (size_t j=0; j<vlen; ++j)
             tdatav[0][j]=in[it.iofs(j,0)].r;
           {
@@ -3330,14 +3683,14 @@ template<typename T> POCKETFFT_NOINLINE void general_c2r(
             for (size_t j=0; j<vlen; ++j)
               tdatav[i][j] = in[it.iofs(j,ii)].r;
           }
-          plan->exec(tdatav, fct, false);
+          plan.exec(tdatav, line_scratch<vtype_t<T>>(tmp, len), fct, false);
           copy_output(it, tdatav, out);
           }
 #endif
       while (it.remaining()>0)
         {
         it.advance(1);
-        auto tdata = reinterpret_cast<T *>(storage.data());
+        auto tdata = reinterpret_cast<T *>(tmp);
         tdata[0]=in[it.iofs(0)].r;
         {
         size_t i=1, ii=1;
@@ -3356,11 +3709,18 @@ template<typename T> POCKETFFT_NOINLINE void general_c2r(
         if (i<len)
           tdata[i] = in[it.iofs(ii)].r;
         }
-        plan->exec(tdata, fct, false);
+        plan.exec(tdata, line_scratch<T>(tmp, len), fct, false);
         copy_output(it, tdata, out);
         }
     });  // end of parallel region
   }
+template<typename T> POCKETFFT_NOINLINE void general_c2r(
+  const cndarr<cmplx<T>> &in, ndarr<T> &out, size_t axis, bool forward, T fct,
+  size_t nthreads)
+  {
+  auto plan = get_plan<pocketfft_r<T>>(out.shape(axis));
+  general_c2r(in, out, axis, forward, fct, nthreads, *plan);
+  }
 
 struct ExecR2R
   {
@@ -3368,13 +3728,13 @@ struct ExecR2R
 
   template <typename T0, typename T, size_t vlen> void operator () (
     const multi_iter<vlen> &it, const cndarr<T0> &in, ndarr<T0> &out, T * buf,
-    const pocketfft_r<T0> &plan, T0 fct) const
+    T * scratch, const pocketfft_r<T0> &plan, T0 fct) const
     {
     copy_input(it, in, buf);
     if ((!r2c) && forward)
       for (size_t i=2; i<it.length_out(); i+=2)
         buf[i] = -buf[i];
-    plan.exec(buf, fct, forward);
+    plan.exec(buf, scratch, fct, forward);
     if (r2c && (!forward))
       for (size_t i=2; i<it.length_out(); i+=2)
         buf[i] = -buf[i];
@@ -0,0 +1,101 @@
+/*
+ *  One copy of pocketfft for a specific instruction set.
+ *
+ *  This file is compiled once per entry of the instruction set list in
+ *  meson.build, with POCKETFFT_ISA set to the entry's name.  Each copy
+ *  lives in its own namespace so that the copies (and the baseline one in
+ *  pypocketfft.cxx) do not clash at link time.
+ *
+ *  The instruction set is enabled with a target pragma around the pocketfft
+ *  code only, not with command line flags: otherwise the standard library
+ *  templates instantiated here could be emitted with wide instructions, and
+ *  the linker may pick those copies for the baseline code as well.
+ */
+
+#ifndef POCKETFFT_ISA
+#error "POCKETFFT_ISA must be defined"
+#endif
+
+#define POCKETFFT_CAT_(a, b) a##b
+#define POCKETFFT_CAT(a, b) POCKETFFT_CAT_(a, b)
+#define POCKETFFT_STR_(a) #a
+#define POCKETFFT_STR(a) POCKETFFT_STR_(a)
+
+// everything pocketfft_hdronly.h includes, outside of the target region
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#ifdef POCKETFFT_PTHREADS
+#  include <pthread.h>
+#endif
+
+#include "pocketfft_isa.h"
+
+#if !defined(__GNUC__)
+#error "instruction set dispatch needs gcc or clang"
+#elif defined(__clang__)
+#  define POCKETFFT_TARGET_POP _Pragma("clang attribute pop")
+#else
+#  define POCKETFFT_TARGET_POP _Pragma("GCC pop_options")
+#endif
+
+#if defined(POCKETFFT_ISA_AVX512F)
+#  define POCKETFFT_VECTOR_BYTES 64
+#  if defined(__clang__)
+#    pragma clang attribute push \
+       (__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#  else
+#    pragma GCC push_options
+#    pragma GCC target("avx512f,avx2,fma")
+#  endif
+#elif defined(POCKETFFT_ISA_AVX2)
+#  define POCKETFFT_VECTOR_BYTES 32
+#  if defined(__clang__)
+#    pragma clang attribute push \
+       (__attribute__((target("avx2,fma"))), apply_to = function)
+#  else
+#    pragma GCC push_options
+#    pragma GCC target("avx2,fma")
+#  endif
+#else
+#error "unknown POCKETFFT_ISA"
+#endif
+
+#define POCKETFFT_NAMESPACE POCKETFFT_CAT(pocketfft_, POCKETFFT_ISA)
+#include "pocketfft_hdronly.h"
+
+namespace {
+
+void use_executor(const pocketfft_executor &ex)
+  {
+#ifndef POCKETFFT_NO_MULTITHREADING
+  POCKETFFT_NAMESPACE::detail::threading::get_executor() = ex;
+#else
+  (void)ex;
+#endif
+  }
+
+}
+
+const pocketfft_isa &POCKETFFT_CAT(pocketfft_isa_, POCKETFFT_ISA)()
+  {
+  static const pocketfft_isa isa{POCKETFFT_STR(POCKETFFT_ISA),
+    POCKETFFT_KERNELS(POCKETFFT_NAMESPACE, float),
+    POCKETFFT_KERNELS(POCKETFFT_NAMESPACE, double), &use_executor};
+  return isa;
+  }
+
+POCKETFFT_TARGET_POP
@@ -0,0 +1,63 @@
+/*
+ *  Runtime dispatch of the pocketfft transforms to copies of the library
+ *  compiled for wider SIMD instruction sets (see pocketfft_isa.cxx).
+ */
+
+#ifndef POCKETFFT_ISA_H
+#define POCKETFFT_ISA_H
+
+#include <complex>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// The public transforms of one copy of pocketfft, for data type T
+template<typename T> struct pocketfft_kernels
+  {
+  using shape_t = std::vector<std::size_t>;
+  using stride_t = std::vector<std::ptrdiff_t>;
+
+  void (*c2c)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, bool, const std::complex<T> *, std::complex<T> *, T,
+    std::size_t);
+  void (*r2c)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, bool, const T *, std::complex<T> *, T, std::size_t);
+  void (*c2r)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, bool, const std::complex<T> *, T *, T, std::size_t);
+  void (*r2r_fftpack)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, bool, bool, const T *, T *, T, std::size_t);
+  void (*r2r_separable_hartley)(const shape_t &, const stride_t &,
+    const stride_t &, const shape_t &, const T *, T *, T, std::size_t);
+  void (*r2r_genuine_hartley)(const shape_t &, const stride_t &,
+    const stride_t &, const shape_t &, const T *, T *, T, std::size_t);
+  void (*dct)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, int, const T *, T *, T, bool, std::size_t);
+  void (*dst)(const shape_t &, const stride_t &, const stride_t &,
+    const shape_t &, int, const T *, T *, T, bool, std::size_t);
+  };
+
+// Kernel table for the pocketfft copy in namespace `ns`
+#define POCKETFFT_KERNELS(ns, T) pocketfft_kernels<T>{ \
+  &ns::c2c<T>, &ns::r2c<T>, &ns::c2r<T>, &ns::r2r_fftpack<T>, \
+  &ns::r2r_separable_hartley<T>, &ns::r2r_genuine_hartley<T>, \
+  &ns::dct<T>, &ns::dst<T>}
+
+// Submits work items to a thread pool (see threading::get_executor())
+using pocketfft_executor = std::function<void(std::function<void()>)>;
+
+// Long double transforms are never vectorized and are not dispatched
+struct pocketfft_isa
+  {
+  const char *name;
+  pocketfft_kernels<float> f;
+  pocketfft_kernels<double> d;
+  // makes this copy run its multithreaded work on the given executor
+  void (*use_executor)(const pocketfft_executor &);
+  };
+
+// Defined by pocketfft_isa.cxx; only linked in if POCKETFFT_DISPATCH_<ISA>
+// is defined for the code calling them
+const pocketfft_isa &pocketfft_isa_avx2();
+const pocketfft_isa &pocketfft_isa_avx512f();
+
+#endif
@@ -16,7 +16,15 @@
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#ifndef POCKETFFT_NO_MULTITHREADING
+#include <shared_mutex>
+#endif
+
 #include "pocketfft_hdronly.h"
+#include "pocketfft_isa.h"
 
 namespace {
 
@@ -77,6 +85,107 @@ shape_t makeaxes(const py::array &in, const py::object &axes)
   return shape_t(tmp.begin(), tmp.end());
   }
 
+// Fastest copy of the transforms the CPU supports; chosen at import
+const pocketfft_isa &select_isa()
+  {
+  static const pocketfft_isa baseline{"baseline",
+    POCKETFFT_KERNELS(pocketfft, float), POCKETFFT_KERNELS(pocketfft, double),
+    nullptr};
+#if defined(POCKETFFT_DISPATCH_AVX2) || defined(POCKETFFT_DISPATCH_AVX512F)
+  __builtin_cpu_init();
+#endif
+#ifdef POCKETFFT_DISPATCH_AVX512F
+  if (__builtin_cpu_supports("avx512f"))
+    return pocketfft_isa_avx512f();
+#endif
+#ifdef POCKETFFT_DISPATCH_AVX2
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return pocketfft_isa_avx2();
+#endif
+  return baseline;
+  }
+
+const pocketfft_isa &active_isa()
+  {
+  static const pocketfft_isa &isa = []() -> const pocketfft_isa &
+    {
+    auto &res = select_isa();
+#ifndef POCKETFFT_NO_MULTITHREADING
+    // all copies of the transforms share the worker pool of the baseline one
+    if (res.use_executor)
+      res.use_executor([](std::function<void()> work)
+        { pocketfft::detail::threading::get_executor()(std::move(work)); });
+#endif
+    return res;
+    }();
+  return isa;
+  }
+
+// Upper limit for the number of threads of a single transform; 0: no limit
+std::atomic<size_t> thread_limit(0);
+
+#ifndef POCKETFFT_NO_MULTITHREADING
+// Held shared by running transforms and exclusively while the worker pool
+// is reconfigured
+std::shared_timed_mutex pool_mutex;
+#endif
+
+// Statistics of the last transform run by the calling thread
+struct call_info
+  {
+  double seconds = 0;
+  size_t nthreads = 0;
+  };
+thread_local call_info last_call;
+
+// Scope of a single transform: applies thread_limit, keeps the worker pool
+// from being reconfigured and records the run time in last_call.
+// Must be created with the GIL released.
+class pool_call
+  {
+  private:
+    using clock = std::chrono::steady_clock;
+#ifndef POCKETFFT_NO_MULTITHREADING
+    std::shared_lock<std::shared_timed_mutex> lock;
+#endif
+    clock::time_point start;
+
+  public:
+    const size_t nthreads;
+
+    explicit pool_call(size_t nthreads_)
+      :
+#ifndef POCKETFFT_NO_MULTITHREADING
+        lock(pool_mutex),
+#endif
+        start(clock::now()), nthreads([nthreads_]
+          {
+#ifdef POCKETFFT_NO_MULTITHREADING
+          (void)nthreads_;
+          return size_t(1);
+#else
+          size_t n = (nthreads_==0) ?
+            pocketfft::detail::threading::max_threads : nthreads_;
+          size_t limit = thread_limit;
+          return (limit==0) ? n : std::min(n, limit);
+#endif
+          }()) {}
+
+    ~pool_call()
+      {
+      last_call.seconds =
+        std::chrono::duration<double>(clock::now()-start).count();
+      last_call.nthreads = nthreads;
+      }
+  };
+
+template<typename T> pocketfft_kernels<T> kernels()
+  { return POCKETFFT_KERNELS(pocketfft, T); }
+template<> pocketfft_kernels<float> kernels<float>()
+  { return active_isa().f; }
+template<> pocketfft_kernels<double> kernels<double>()
+  { return active_isa().d; }
+
 #define DISPATCH(arr, T1, T2, T3, func, args) \
   { \
   if (py::isinstance<py::array_t<T1>>(arr)) return func<double> args; \
@@ -126,8 +235,10 @@ template<typename T> py::array c2c_internal(const py::array &in,
   auto d_out=reinterpret_cast<std::complex<T> *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims, axes);
-  pocketfft::c2c(dims, s_in, s_out, axes, forward, d_in, d_out, fct, nthreads);
+  kernels<T>().c2c(dims, s_in, s_out, axes, forward, d_in, d_out, fct,
+    call.nthreads);
   }
   return std::move(res);
   }
@@ -145,8 +256,10 @@ template<typename T> py::array c2c_sym_internal(const py::array &in,
   auto d_out=reinterpret_cast<std::complex<T> *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims, axes);
-  pocketfft::r2c(dims, s_in, s_out, axes, forward, d_in, d_out, fct, nthreads);
+  kernels<T>().r2c(dims, s_in, s_out, axes, forward, d_in, d_out, fct,
+    call.nthreads);
   // now fill in second half
   using namespace pocketfft::detail;
   ndarr<std::complex<T>> ares(res.mutable_data(), dims, s_out);
@@ -186,9 +299,10 @@ template<typename T> py::array r2c_internal(const py::array &in,
   auto d_out=reinterpret_cast<std::complex<T> *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims_in, axes);
-  pocketfft::r2c(dims_in, s_in, s_out, axes, forward, d_in, d_out, fct,
-    nthreads);
+  kernels<T>().r2c(dims_in, s_in, s_out, axes, forward, d_in, d_out, fct,
+    call.nthreads);
   }
   return res;
   }
@@ -213,9 +327,10 @@ template<typename T> py::array r2r_fftpack_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims, axes);
-  pocketfft::r2r_fftpack(dims, s_in, s_out, axes, real2hermitian, forward,
-    d_in, d_out, fct, nthreads);
+  kernels<T>().r2r_fftpack(dims, s_in, s_out, axes, real2hermitian, forward,
+    d_in, d_out, fct, call.nthreads);
   }
   return res;
   }
@@ -241,10 +356,11 @@ template<typename T> py::array dct_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = (type==1) ? norm_fct<T>(inorm, dims, axes, 2, -1)
                     : norm_fct<T>(inorm, dims, axes, 2);
-  pocketfft::dct(dims, s_in, s_out, axes, type, d_in, d_out, fct, ortho,
-    nthreads);
+  kernels<T>().dct(dims, s_in, s_out, axes, type, d_in, d_out, fct, ortho,
+    call.nthreads);
   }
   return res;
   }
@@ -274,10 +390,11 @@ template<typename T> py::array dst_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = (type==1) ? norm_fct<T>(inorm, dims, axes, 2, 1)
                     : norm_fct<T>(inorm, dims, axes, 2);
-  pocketfft::dst(dims, s_in, s_out, axes, type, d_in, d_out, fct, ortho,
-    nthreads);
+  kernels<T>().dst(dims, s_in, s_out, axes, type, d_in, d_out, fct, ortho,
+    call.nthreads);
   }
   return res;
   }
@@ -312,9 +429,10 @@ template<typename T> py::array c2r_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims_out, axes);
-  pocketfft::c2r(dims_out, s_in, s_out, axes, forward, d_in, d_out, fct,
-    nthreads);
+  kernels<T>().c2r(dims_out, s_in, s_out, axes, forward, d_in, d_out, fct,
+    call.nthreads);
   }
   return res;
   }
@@ -338,9 +456,10 @@ template<typename T> py::array separable_hartley_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims, axes);
-  pocketfft::r2r_separable_hartley(dims, s_in, s_out, axes, d_in, d_out, fct,
-    nthreads);
+  kernels<T>().r2r_separable_hartley(dims, s_in, s_out, axes, d_in, d_out, fct,
+    call.nthreads);
   }
   return res;
   }
@@ -364,9 +483,10 @@ template<typename T> py::array genuine_hartley_internal(const py::array &in,
   auto d_out=reinterpret_cast<T *>(res.mutable_data());
   {
   py::gil_scoped_release release;
+  pool_call call(nthreads);
   T fct = norm_fct<T>(inorm, dims, axes);
-  pocketfft::r2r_genuine_hartley(dims, s_in, s_out, axes, d_in, d_out, fct,
-    nthreads);
+  kernels<T>().r2r_genuine_hartley(dims, s_in, s_out, axes, d_in, d_out, fct,
+    call.nthreads);
   }
   return res;
   }
@@ -378,6 +498,524 @@ py::array genuine_hartley(const py::array &in, const py::object &axes_,
     out_, nthreads))
   }
 
+//
+// Reusable transform plans
+//
+// A plan is bound to the shape, data type and axes of its input.  The 1D
+// plans for all transformed axes are created once, outside the global plan
+// cache, so executing a plan needs neither a cache lookup nor its lock.
+// Scratch memory is owned by the plan as well and covers both the line
+// buffers and the work space of the 1D plans; it is reused unless the same
+// plan is executed from several threads at once or with nthreads>1, in which
+// case temporary buffers are allocated as usual.
+//
+
+using pocketfft::detail::arr;
+using pocketfft::detail::cmplx;
+using pocketfft::detail::cndarr;
+using pocketfft::detail::ndarr;
+using pocketfft::detail::util;
+using pocketfft::detail::pocketfft_c;
+using pocketfft::detail::pocketfft_r;
+
+template<typename Tplan> std::vector<std::shared_ptr<Tplan>> make_plans(
+  const shape_t &shape, const shape_t &axes)
+  {
+  std::vector<std::shared_ptr<Tplan>> plans(axes.size());
+  for (size_t iax=0; iax<axes.size(); ++iax)
+    {
+    size_t len=shape[axes[iax]];
+    for (size_t j=0; j<iax; ++j)
+      if (plans[j]->length()==len)
+        { plans[iax] = plans[j]; break; }
+    if (!plans[iax])
+      plans[iax] = std::make_shared<Tplan>(len);
+    }
+  return plans;
+  }
+
+template<typename Tplan> shape_t plan_bufsizes(
+  const std::vector<std::shared_ptr<Tplan>> &plans)
+  {
+  shape_t res;
+  for (const auto &plan: plans)
+    res.push_back(plan->bufsize());
+  return res;
+  }
+
+template<typename T> size_t scratch_size(const shape_t &shape,
+  const shape_t &axes, size_t elemsize, const shape_t &bufsizes)
+  {
+  if (util::prod(shape)==0) return 0;
+  return pocketfft::detail::alloc_tmp<T>(shape, axes, elemsize, bufsizes)
+    .size();
+  }
+
+// Grants exclusive use of a plan's scratch memory for one execution
+class scratch_lease
+  {
+  private:
+    std::atomic<bool> &busy;
+    bool mine;
+
+  public:
+    scratch_lease(std::atomic<bool> &busy_)
+      : busy(busy_), mine(!busy_.exchange(true, std::memory_order_acquire)) {}
+    ~scratch_lease()
+      { if (mine) busy.store(false, std::memory_order_release); }
+    template<typename T> T *get(arr<T> &buf) const
+      { return mine ? buf.data() : nullptr; }
+  };
+
+class plan_base
+  {
+  protected:
+    shape_t dims_in, dims_out, axes;
+    size_t nthreads;
+    std::atomic<bool> busy;
+
+    plan_base(const py::array &in, const py::object &axes_, size_t nthreads_)
+      : dims_in(copy_shape(in)), dims_out(dims_in), axes(makeaxes(in, axes_)),
+        nthreads(nthreads_), busy(false) {}
+
+    template<typename T> void check_input(const py::array &in) const
+      {
+      if (!py::isinstance<py::array_t<T>>(in))
+        throw std::invalid_argument("input data type does not match the plan");
+      if (copy_shape(in)!=dims_in)
+        throw std::invalid_argument("input shape does not match the plan");
+      }
+
+    template<typename T> py::array_t<T> output(py::object &out_)
+      {
+      auto res = prepare_output<T>(out_, dims_out);
+      if (copy_shape(res)!=dims_out)
+        throw std::invalid_argument("output shape does not match the plan");
+      return res;
+      }
+
+  public:
+    virtual ~plan_base() {}
+    virtual py::array execute(const py::array &in, py::object &out_) = 0;
+
+    const shape_t &shape_in() const { return dims_in; }
+    const shape_t &shape_out() const { return dims_out; }
+    const shape_t &plan_axes() const { return axes; }
+  };
+
+template<typename T> class c2c_plan: public plan_base
+  {
+  private:
+    bool forward;
+    T fct;
+    std::vector<std::shared_ptr<pocketfft_c<T>>> plans;
+    arr<char> scratch;
+
+  public:
+    c2c_plan(const py::array &in, const py::object &axes_, bool forward_,
+      int inorm, size_t nthreads_)
+      : plan_base(in, axes_, nthreads_), forward(forward_),
+        fct(norm_fct<T>(inorm, dims_in, axes))
+      {
+      if (util::prod(dims_in)==0) return;
+      plans = make_plans<pocketfft_c<T>>(dims_in, axes);
+      scratch.resize(scratch_size<T>(dims_in, axes, sizeof(cmplx<T>),
+        plan_bufsizes(plans)));
+      }
+
+    py::array execute(const py::array &in, py::object &out_) override
+      {
+      check_input<std::complex<T>>(in);
+      auto res = output<std::complex<T>>(out_);
+      auto s_in=copy_strides(in);
+      auto s_out=copy_strides(res);
+      auto d_in=reinterpret_cast<const std::complex<T> *>(in.data());
+      auto d_out=reinterpret_cast<std::complex<T> *>(res.mutable_data());
+      {
+      py::gil_scoped_release release;
+      pool_call call(nthreads);
+      if (util::prod(dims_in)==0) return std::move(res);
+      util::sanity_check(dims_in, s_in, s_out, d_in==d_out, axes);
+      cndarr<cmplx<T>> ain(d_in, dims_in, s_in);
+      ndarr<cmplx<T>> aout(d_out, dims_out, s_out);
+      scratch_lease lease(busy);
+      pocketfft::detail::general_nd(ain, aout, axes, plans, fct, call.nthreads,
+        pocketfft::detail::ExecC2C{forward}, true, lease.get(scratch));
+      }
+      return std::move(res);
+      }
+  };
+
+template<typename T> class r2c_plan: public plan_base
+  {
+  private:
+    bool forward;
+    T fct;
+    shape_t c2c_axes;
+    std::shared_ptr<pocketfft_r<T>> rplan;
+    std::vector<std::shared_ptr<pocketfft_c<T>>> cplans;
+    arr<char> scratch;
+
+  public:
+    r2c_plan(const py::array &in, const py::object &axes_, bool forward_,
+      int inorm, size_t nthreads_)
+      : plan_base(in, axes_, nthreads_), forward(forward_),
+        fct(norm_fct<T>(inorm, dims_in, axes)),
+        c2c_axes(axes.begin(), --axes.end())
+      {
+      dims_out[axes.back()] = (dims_out[axes.back()]>>1)+1;
+      if (util::prod(dims_in)==0) return;
+      rplan = std::make_shared<pocketfft_r<T>>(dims_in[axes.back()]);
+      cplans = make_plans<pocketfft_c<T>>(dims_out, c2c_axes);
+      scratch.resize(std::max(
+        scratch_size<T>(dims_in, {axes.back()}, sizeof(T),
+          {rplan->bufsize()}),
+        scratch_size<T>(dims_out, c2c_axes, sizeof(cmplx<T>),
+          plan_bufsizes(cplans))));
+      }
+
+    py::array execute(const py::array &in, py::object &out_) override
+      {
+      check_input<T>(in);
+      auto res = output<std::complex<T>>(out_);
+      auto s_in=copy_strides(in);
+      auto s_out=copy_strides(res);
+      auto d_in=reinterpret_cast<const T *>(in.data());
+      auto d_out=reinterpret_cast<std::complex<T> *>(res.mutable_data());
+      {
+      py::gil_scoped_release release;
+      pool_call call(nthreads);
+      if (util::prod(dims_in)==0) return std::move(res);
+      util::sanity_check(dims_in, s_in, s_out, false, axes);
+      cndarr<T> ain(d_in, dims_in, s_in);
+      ndarr<cmplx<T>> aout(d_out, dims_out, s_out);
+      scratch_lease lease(busy);
+      pocketfft::detail::general_r2c(ain, aout, axes.back(), forward, fct,
+        call.nthreads, *rplan, lease.get(scratch));
+      if (c2c_axes.empty()) return std::move(res);
+      pocketfft::detail::general_nd(aout, aout, c2c_axes, cplans, T(1),
+        call.nthreads, pocketfft::detail::ExecC2C{forward}, true,
+        lease.get(scratch));
+      }
+      return std::move(res);
+      }
+  };
+
+template<typename T> class c2r_plan: public plan_base
+  {
+  private:
+    bool forward;
+    T fct;
+    shape_t c2c_axes;
+    stride_t s_inter;
+    std::shared_ptr<pocketfft_r<T>> rplan;
+    std::vector<std::shared_ptr<pocketfft_c<T>>> cplans;
+    arr<char> scratch;
+    arr<cmplx<T>> inter;
+
+  public:
+    c2r_plan(const py::array &in, const py::object &axes_, size_t lastsize,
+      bool forward_, int inorm, size_t nthreads_)
+      : plan_base(in, axes_, nthreads_), forward(forward_),
+        c2c_axes(axes.begin(), --axes.end()), s_inter(dims_in.size())
+      {
+      size_t axis = axes.back();
+      if (lastsize==0) lastsize=2*dims_in[axis]-1;
+      if ((lastsize/2) + 1 != dims_in[axis])
+        throw std::invalid_argument("bad lastsize");
+      dims_out[axis] = lastsize;
+      fct = norm_fct<T>(inorm, dims_out, axes);
+      if (util::prod(dims_out)==0) return;
+      rplan = std::make_shared<pocketfft_r<T>>(lastsize);
+      scratch.resize(scratch_size<T>(dims_out, {axis}, sizeof(T),
+        {rplan->bufsize()}));
+      if (c2c_axes.empty()) return;
+      // the inner c2c passes go to a contiguous intermediate array
+      cplans = make_plans<pocketfft_c<T>>(dims_in, c2c_axes);
+      scratch.resize(std::max(scratch.size(),
+        scratch_size<T>(dims_in, c2c_axes, sizeof(cmplx<T>),
+          plan_bufsizes(cplans))));
+      inter.resize(util::prod(dims_in));
+      s_inter.back() = sizeof(cmplx<T>);
+      for (size_t i=s_inter.size()-1; i>0; --i)
+        s_inter[i-1] = s_inter[i]*ptrdiff_t(dims_in[i]);
+      }
+
+    py::array execute(const py::array &in, py::object &out_) override
+      {
+      check_input<std::complex<T>>(in);
+      auto res = output<T>(out_);
+      auto s_in=copy_strides(in);
+      auto s_out=copy_strides(res);
+      auto d_in=reinterpret_cast<const std::complex<T> *>(in.data());
+      auto d_out=reinterpret_cast<T *>(res.mutable_data());
+      {
+      py::gil_scoped_release release;
+      pool_call call(nthreads);
+      if (util::prod(dims_out)==0) return std::move(res);
+      util::sanity_check(dims_out, s_in, s_out, false, axes);
+      ndarr<T> aout(d_out, dims_out, s_out);
+      scratch_lease lease(busy);
+      if (c2c_axes.empty())
+        {
+        cndarr<cmplx<T>> ain(d_in, dims_in, s_in);
+        pocketfft::detail::general_c2r(ain, aout, axes.back(), forward, fct,
+          call.nthreads, *rplan, lease.get(scratch));
+        return std::move(res);
+        }
+      arr<cmplx<T>> own_inter(lease.get(inter) ? 0 : inter.size());
+      cmplx<T> *d_inter = lease.get(inter) ? inter.data() : own_inter.data();
+      cndarr<cmplx<T>> ain(d_in, dims_in, s_in);
+      ndarr<cmplx<T>> ainter(d_inter, dims_in, s_inter);
+      pocketfft::detail::general_nd(ain, ainter, c2c_axes, cplans, T(1),
+        call.nthreads, pocketfft::detail::ExecC2C{forward}, true,
+        lease.get(scratch));
+      pocketfft::detail::general_c2r(ainter, aout, axes.back(), forward, fct,
+        call.nthreads, *rplan, lease.get(scratch));
+      }
+      return std::move(res);
+      }
+  };
+
+template<typename T> class r2r_fftpack_plan: public plan_base
+  {
+  private:
+    bool real2hermitian, forward;
+    T fct;
+    std::vector<std::shared_ptr<pocketfft_r<T>>> plans;
+    arr<char> scratch;
+
+  public:
+    r2r_fftpack_plan(const py::array &in, const py::object &axes_,
+      bool real2hermitian_, bool forward_, int inorm, size_t nthreads_)
+      : plan_base(in, axes_, nthreads_), real2hermitian(real2hermitian_),
+        forward(forward_), fct(norm_fct<T>(inorm, dims_in, axes))
+      {
+      if (util::prod(dims_in)==0) return;
+      plans = make_plans<pocketfft_r<T>>(dims_in, axes);
+      scratch.resize(scratch_size<T>(dims_in, axes, sizeof(T),
+        plan_bufsizes(plans)));
+      }
+
+    py::array execute(const py::array &in, py::object &out_) override
+      {
+      check_input<T>(in);
+      auto res = output<T>(out_);
+      auto s_in=copy_strides(in);
+      auto s_out=copy_strides(res);
+      auto d_in=reinterpret_cast<const T *>(in.data());
+      auto d_out=reinterpret_cast<T *>(res.mutable_data());
+      {
+      py::gil_scoped_release release;
+      pool_call call(nthreads);
+      if (util::prod(dims_in)==0) return std::move(res);
+      util::sanity_check(dims_in, s_in, s_out, d_in==d_out, axes);
+      cndarr<T> ain(d_in, dims_in, s_in);
+      ndarr<T> aout(d_out, dims_out, s_out);
+      scratch_lease lease(busy);
+      pocketfft::detail::general_nd(ain, aout, axes, plans, fct, call.nthreads,
+        pocketfft::detail::ExecR2R{real2hermitian, forward}, true,
+        lease.get(scratch));
+      }
+      return std::move(res);
+      }
+  };
+
+template<typename T, typename Tplan> class dcst_plan: public plan_base
+  {
+  private:
+    pocketfft::detail::ExecDcst exec;
+    T fct;
+    std::vector<std::shared_ptr<Tplan>> plans;
+    arr<char> scratch;
+
+  public:
+    dcst_plan(const py::array &in, const py::object &axes_, int type,
+      bool cosine, int inorm, bool ortho, size_t nthreads_)
+      : plan_base(in, axes_, nthreads_), exec{ortho, type, cosine}
+      {
+      int delta = (type!=1) ? 0 : (cosine ? -1 : 1);
+      fct = norm_fct<T>(inorm, dims_in, axes, 2, delta);
+      if (util::prod(dims_in)==0) return;
+      plans = make_plans<Tplan>(dims_in, axes);
+      scratch.resize(scratch_size<T>(dims_in, axes, sizeof(T),
+        plan_bufsizes(plans)));
+      }
+
+    py::array execute(const py::array &in, py::object &out_) override
+      {
+      check_input<T>(in);
+      auto res = output<T>(out_);
+      auto s_in=copy_strides(in);
+      auto s_out=copy_strides(res);
+      auto d_in=reinterpret_cast<const T *>(in.data());
+      auto d_out=reinterpret_cast<T *>(res.mutable_data());
+      {
+      py::gil_scoped_release release;
+      pool_call call(nthreads);
+      if (util::prod(dims_in)==0) return std::move(res);
+      util::sanity_check(dims_in, s_in, s_out, d_in==d_out, axes);
+      cndarr<T> ain(d_in, dims_in, s_in);
+      ndarr<T> aout(d_out, dims_out, s_out);
+      scratch_lease lease(busy);
+      pocketfft::detail::general_nd(ain, aout, axes, plans, fct, call.nthreads,
+        exec, true, lease.get(scratch));
+      }
+      return std::move(res);
+      }
+  };
+
+using plan_ptr = std::unique_ptr<plan_base>;
+
+template<typename T> plan_ptr c2c_plan_internal(const py::array &in,
+  const py::object &axes_, bool forward, int inorm, size_t nthreads)
+  { return plan_ptr(new c2c_plan<T>(in, axes_, forward, inorm, nthreads)); }
+
+plan_ptr plan_c2c(const py::array &a, const py::object &axes_, bool forward,
+  int inorm, size_t nthreads)
+  {
+  DISPATCH(a, c128, c64, clong, c2c_plan_internal, (a, axes_, forward, inorm,
+    nthreads))
+  }
+
+template<typename T> plan_ptr r2c_plan_internal(const py::array &in,
+  const py::object &axes_, bool forward, int inorm, size_t nthreads)
+  { return plan_ptr(new r2c_plan<T>(in, axes_, forward, inorm, nthreads)); }
+
+plan_ptr plan_r2c(const py::array &a, const py::object &axes_, bool forward,
+  int inorm, size_t nthreads)
+  {
+  DISPATCH(a, f64, f32, flong, r2c_plan_internal, (a, axes_, forward, inorm,
+    nthreads))
+  }
+
+template<typename T> plan_ptr c2r_plan_internal(const py::array &in,
+  const py::object &axes_, size_t lastsize, bool forward, int inorm,
+  size_t nthreads)
+  {
+  return plan_ptr(new c2r_plan<T>(in, axes_, lastsize, forward, inorm,
+    nthreads));
+  }
+
+plan_ptr plan_c2r(const py::array &a, const py::object &axes_,
+  size_t lastsize, bool forward, int inorm, size_t nthreads)
+  {
+  DISPATCH(a, c128, c64, clong, c2r_plan_internal, (a, axes_, lastsize,
+    forward, inorm, nthreads))
+  }
+
+template<typename T> plan_ptr r2r_fftpack_plan_internal(const py::array &in,
+  const py::object &axes_, bool real2hermitian, bool forward, int inorm,
+  size_t nthreads)
+  {
+  return plan_ptr(new r2r_fftpack_plan<T>(in, axes_, real2hermitian, forward,
+    inorm, nthreads));
+  }
+
+plan_ptr plan_r2r_fftpack(const py::array &a, const py::object &axes_,
+  bool real2hermitian, bool forward, int inorm, size_t nthreads)
+  {
+  DISPATCH(a, f64, f32, flong, r2r_fftpack_plan_internal, (a, axes_,
+    real2hermitian, forward, inorm, nthreads))
+  }
+
+template<typename T> plan_ptr dcst_plan_internal(const py::array &in,
+  const py::object &axes_, int type, bool cosine, int inorm, bool ortho,
+  size_t nthreads)
+  {
+  using namespace pocketfft::detail;
+  if (type==1 && cosine)
+    return plan_ptr(new dcst_plan<T, T_dct1<T>>(in, axes_, type, cosine,
+      inorm, ortho, nthreads));
+  if (type==1)
+    return plan_ptr(new dcst_plan<T, T_dst1<T>>(in, axes_, type, cosine,
+      inorm, ortho, nthreads));
+  if (type==4)
+    return plan_ptr(new dcst_plan<T, T_dcst4<T>>(in, axes_, type, cosine,
+      inorm, ortho, nthreads));
+  return plan_ptr(new dcst_plan<T, T_dcst23<T>>(in, axes_, type, cosine,
+    inorm, ortho, nthreads));
+  }
+
+plan_ptr plan_dct(const py::array &a, int type, const py::object &axes_,
+  int inorm, size_t nthreads, const py::object &ortho_obj)
+  {
+  bool ortho=inorm==1;
+  if (!ortho_obj.is_none())
+    ortho=ortho_obj.cast<bool>();
+
+  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DCT type");
+  DISPATCH(a, f64, f32, flong, dcst_plan_internal, (a, axes_, type, true,
+    inorm, ortho, nthreads))
+  }
+
+plan_ptr plan_dst(const py::array &a, int type, const py::object &axes_,
+  int inorm, size_t nthreads, const py::object &ortho_obj)
+  {
+  bool ortho=inorm==1;
+  if (!ortho_obj.is_none())
+    ortho=ortho_obj.cast<bool>();
+
+  if ((type<1) || (type>4)) throw std::invalid_argument("invalid DST type");
+  DISPATCH(a, f64, f32, flong, dcst_plan_internal, (a, axes_, type, false,
+    inorm, ortho, nthreads))
+  }
+
+void set_thread_pool(size_t nthreads, const py::object &cpus_)
+  {
+  std::vector<size_t> cpus;
+  if (!cpus_.is_none())
+    cpus = cpus_.cast<std::vector<size_t>>();
+#ifdef POCKETFFT_NO_MULTITHREADING
+  if ((nthreads>0) || (!cpus.empty()))
+    throw std::runtime_error("pypocketfft was built without multithreading");
+#else
+  using namespace pocketfft::detail::threading;
+  if (nthreads==0)
+    nthreads = cpus.empty() ? max_threads : cpus.size();
+  py::gil_scoped_release release;
+  // waits for running transforms to finish
+  std::unique_lock<std::shared_timed_mutex> lock(pool_mutex);
+  get_pool().reconfigure(nthreads, std::move(cpus));
+#endif
+  }
+
+size_t set_thread_limit(size_t limit)
+  { return thread_limit.exchange(limit); }
+
+py::dict thread_pool_info()
+  {
+  py::dict res;
+#ifdef POCKETFFT_NO_MULTITHREADING
+  res["size"] = 0;
+  res["cpus"] = py::list();
+  res["can_pin"] = false;
+#else
+  using namespace pocketfft::detail::threading;
+  std::vector<size_t> cpus;
+  size_t size;
+  {
+  py::gil_scoped_release release;
+  std::shared_lock<std::shared_timed_mutex> lock(pool_mutex);
+  size = get_pool().size();
+  cpus = get_pool().affinity();
+  }
+  res["size"] = size;
+  res["cpus"] = py::cast(cpus);
+  res["can_pin"] = thread_pool::can_pin;
+#endif
+  res["limit"] = size_t(thread_limit);
+  return res;
+  }
+
+py::dict last_call_info()
+  {
+  py::dict res;
+  res["seconds"] = last_call.seconds;
+  res["nthreads"] = last_call.nthreads;
+  return res;
+  }
+
 // Export good_size in raw C-API to reduce overhead (~4x faster)
 PyObject * good_size(PyObject * /*self*/, PyObject * args, PyObject * kwargs)
   {
@@ -414,7 +1052,9 @@ This module supports
 
 For two- and higher-dimensional transforms the code will use SSE2 and AVX
 vector instructions for faster execution if these are supported by the CPU and
-were enabled during compilation.
+were enabled during compilation.  On x86-64, builds with gcc or clang also
+contain AVX2 and AVX-512 versions of the transforms; the widest one supported
+by the CPU is selected at import and reported by `isa`.
 )""";
 
 const char *c2c_DS = R"""(Performs a complex FFT.
@@ -694,6 +1334,173 @@ numpy.ndarray (same shape and data type as `a`)
     The transformed data
 )""";
 
+const char *plan_DS = R"""(A precomputed transform.
+
+Plans are created by `plan_c2c`, `plan_r2c`, `plan_c2r`, `plan_r2r_fftpack`,
+`plan_dct` and `plan_dst` for arrays of a fixed shape and data type, and can
+then be executed any number of times.  Executing a plan does not consult the
+global plan cache and, for ``nthreads=1``, reuses the scratch memory
+allocated when the plan was created.
+)""";
+
+const char *plan_call_DS = R"""(Executes the plan.
+
+Parameters
+----------
+a : numpy.ndarray
+    The input data. Must have the shape and data type the plan was created
+    for; its strides are arbitrary.
+out : numpy.ndarray
+    The output array. Must have the output shape of the plan, see
+    `shape_out`. The same restrictions on overlap with `a` apply as for the
+    corresponding transform function.
+    If None, a new array is allocated to store the output.
+
+Returns
+-------
+numpy.ndarray
+    The transformed data.
+)""";
+
+const char *plan_c2c_DS = R"""(Creates a reusable plan for `c2c`.
+
+Parameters
+----------
+a : numpy.ndarray (any complex type)
+    An array with the shape and data type of the future inputs.
+axes : list of integers
+    The axes along which the FFT is carried out.
+    If not set, all axes will be transformed.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type, see `c2c`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
+const char *plan_r2c_DS = R"""(Creates a reusable plan for `r2c`.
+
+Parameters
+----------
+a : numpy.ndarray (any real type)
+    An array with the shape and data type of the future inputs.
+axes : list of integers
+    The axes along which the FFT is carried out.
+    If not set, all axes will be transformed in ascending order.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type, see `r2c`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
+const char *plan_c2r_DS = R"""(Creates a reusable plan for `c2r`.
+
+Parameters
+----------
+a : numpy.ndarray (any complex type)
+    An array with the shape and data type of the future inputs.
+axes : list of integers
+    The axes along which the FFT is carried out.
+    If not set, all axes will be transformed in ascending order.
+lastsize : the output size of the last axis to be transformed.
+    If the corresponding input axis has size n, this can be 2*n-2 or 2*n-1.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type, see `c2r`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
+const char *plan_r2r_fftpack_DS = R"""(Creates a reusable plan for `r2r_fftpack`.
+
+Parameters
+----------
+a : numpy.ndarray (any real type)
+    An array with the shape and data type of the future inputs.
+axes : list of integers
+    The axes along which the FFT is carried out.
+real2hermitian : bool
+    See `r2r_fftpack`.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type, see `r2r_fftpack`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
+const char *plan_dct_DS = R"""(Creates a reusable plan for `dct`.
+
+Parameters
+----------
+a : numpy.ndarray (any real type)
+    An array with the shape and data type of the future inputs.
+type : integer
+    the type of DCT. Must be in [1; 4].
+axes : list of integers
+    The axes along which the transform is carried out.
+    If not set, all axes will be transformed.
+inorm : int
+    Normalization type, see `dct`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+ortho: bool
+    Orthogonalize transform (defaults to ``inorm=1``)
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
+const char *plan_dst_DS = R"""(Creates a reusable plan for `dst`.
+
+Parameters
+----------
+a : numpy.ndarray (any real type)
+    An array with the shape and data type of the future inputs.
+type : integer
+    the type of DST. Must be in [1; 4].
+axes : list of integers
+    The axes along which the transform is carried out.
+    If not set, all axes will be transformed.
+inorm : int
+    Normalization type, see `dst`.
+nthreads : int
+    Number of threads to use. If 0, use the system default.
+ortho: bool
+    Orthogonalize transform (defaults to ``inorm=1``)
+
+Returns
+-------
+plan
+    Callable as ``plan(a, out=None)``.
+)""";
+
 const char * good_size_DS = R"""(Returns a good length to pad an FFT to.
 
 Parameters
@@ -710,6 +1517,57 @@ out : int
 
 )""";
 
+const char *set_thread_pool_DS = R"""(Replaces the worker threads of the module.
+
+All transforms of the module, including the ones of plans, share one
+pool of worker threads; the thread calling a transform always
+works on it as well. This waits until running transforms have finished.
+
+Parameters
+----------
+nthreads : int
+    Number of worker threads. If 0, use ``len(cpus)`` if `cpus` is given,
+    else the number of hardware threads.
+cpus : sequence of int, optional
+    If given, worker ``i`` is pinned to CPU ``cpus[i % len(cpus)]``, e.g.
+    to keep the pool on one NUMA node. Only supported on Linux.
+)""";
+
+const char *set_thread_limit_DS = R"""(Limits the threads used by one transform.
+
+Parameters
+----------
+limit : int
+    Maximum number of threads (including the calling one) any single
+    transform may use, whatever its `nthreads` argument. 0 means no limit.
+
+Returns
+-------
+int
+    The previous limit.
+)""";
+
+const char *thread_pool_info_DS = R"""(Returns the threading configuration.
+
+Returns
+-------
+dict
+    ``size``: number of worker threads, ``cpus``: the CPUs they are pinned
+    to (empty if not pinned), ``can_pin``: whether pinning is supported,
+    ``limit``: the limit set by `set_thread_limit`.
+)""";
+
+const char *last_call_info_DS = R"""(Statistics of the last transform.
+
+Only transforms called from the current thread are considered.
+
+Returns
+-------
+dict
+    ``seconds``: wall time of the transform, without the conversion of the
+    arguments, ``nthreads``: number of threads it was allowed to use.
+)""";
+
 } // unnamed namespace
 
 PYBIND11_MODULE(pypocketfft, m)
@@ -719,6 +1577,7 @@ PYBIND11_MODULE(pypocketfft, m)
   auto None = py::none();
 
   m.doc() = pypocketfft_DS;
+  m.attr("isa") = active_isa().name;
   m.def("c2c", c2c, c2c_DS, "a"_a, "axes"_a=None, "forward"_a=true,
     "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
   m.def("r2c", r2c, r2c_DS, "a"_a, "axes"_a=None, "forward"_a=true,
@@ -736,6 +1595,33 @@ PYBIND11_MODULE(pypocketfft, m)
   m.def("dst", dst, dst_DS, "a"_a, "type"_a, "axes"_a=None, "inorm"_a=0,
     "out"_a=None, "nthreads"_a=1, "ortho"_a=None);
 
+  py::class_<plan_base>(m, "plan", plan_DS)
+    .def("__call__", &plan_base::execute, plan_call_DS, "a"_a, "out"_a=None)
+    .def_property_readonly("shape_in", [](const plan_base &self)
+      { return py::tuple(py::cast(self.shape_in())); })
+    .def_property_readonly("shape_out", [](const plan_base &self)
+      { return py::tuple(py::cast(self.shape_out())); })
+    .def_property_readonly("axes", [](const plan_base &self)
+      { return py::tuple(py::cast(self.plan_axes())); });
+  m.def("plan_c2c", plan_c2c, plan_c2c_DS, "a"_a, "axes"_a=None,
+    "forward"_a=true, "inorm"_a=0, "nthreads"_a=1);
+  m.def("plan_r2c", plan_r2c, plan_r2c_DS, "a"_a, "axes"_a=None,
+    "forward"_a=true, "inorm"_a=0, "nthreads"_a=1);
+  m.def("plan_c2r", plan_c2r, plan_c2r_DS, "a"_a, "axes"_a=None,
+    "lastsize"_a=0, "forward"_a=true, "inorm"_a=0, "nthreads"_a=1);
+  m.def("plan_r2r_fftpack", plan_r2r_fftpack, plan_r2r_fftpack_DS, "a"_a,
+    "axes"_a, "real2hermitian"_a, "forward"_a, "inorm"_a=0, "nthreads"_a=1);
+  m.def("plan_dct", plan_dct, plan_dct_DS, "a"_a, "type"_a, "axes"_a=None,
+    "inorm"_a=0, "nthreads"_a=1, "ortho"_a=None);
+  m.def("plan_dst", plan_dst, plan_dst_DS, "a"_a, "type"_a, "axes"_a=None,
+    "inorm"_a=0, "nthreads"_a=1, "ortho"_a=None);
+
+  m.def("set_thread_pool", set_thread_pool, set_thread_pool_DS,
+    "nthreads"_a=0, "cpus"_a=None);
+  m.def("set_thread_limit", set_thread_limit, set_thread_limit_DS, "limit"_a);
+  m.def("thread_pool_info", thread_pool_info, thread_pool_info_DS);
+  m.def("last_call_info", last_call_info, last_call_info_DS);
+
   static PyMethodDef good_size_meth[] =
     {{"good_size", (PyCFunction)good_size,
       METH_VARARGS | METH_KEYWORDS, good_size_DS}, {0}};
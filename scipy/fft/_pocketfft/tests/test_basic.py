@@ -1,5 +1,9 @@
 # Created by Pearu Peterson, September 2002
 
+import subprocess
+import sys
+import textwrap
+
 from numpy.testing import (assert_, assert_equal, assert_array_almost_equal,
                            assert_array_almost_equal_nulp, assert_array_less,
                            assert_allclose)
@@ -8,6 +12,7 @@ from pytest import raises as assert_raises
 from scipy.fft._pocketfft import (ifft, fft, fftn, ifftn,
                                   rfft, irfft, rfftn, irfftn,
                                   hfft, ihfft, hfftn, ihfftn)
+from scipy.fft._pocketfft import pypocketfft as pfft
 
 from numpy import (arange, array, asarray, zeros, dot, exp, pi,
                    swapaxes, cdouble)
@@ -1004,3 +1009,148 @@ def test_swapped_byte_order_real(func):
     rng = np.random.RandomState(1234)
     x = rng.rand(10)
     assert_allclose(func(swap_byteorder(x)), func(x))
+
+
+@pytest.mark.parametrize('workers', [1, 4])
+@pytest.mark.parametrize('view', [np.s_[:, :], np.s_[::3, :], np.s_[:, ::2],
+                                  np.s_[::-1, 1:]])
+def test_many_short_rows(workers, view):
+    # batches of short transforms, with and without collapsible batch axes
+    rng = np.random.default_rng(1234)
+    x = rng.random((3, 1000, 16)) + 1j*rng.random((3, 1000, 16))
+    x = x[(slice(None),) + view]
+    expect = np.fft.fft(x, axis=-1)
+    assert_allclose(fft(x, workers=workers), expect, rtol=1e-12, atol=1e-12)
+    expect = np.fft.fft(x, axis=1)
+    assert_allclose(fft(x, axis=1, workers=workers), expect,
+                    rtol=1e-12, atol=1e-12)
+    expect = np.fft.rfft(x.real, axis=-1)
+    assert_allclose(rfft(x.real, workers=workers), expect,
+                    rtol=1e-12, atol=1e-12)
+
+
+@pytest.mark.parametrize('dtype', [np.complex64, np.complex128])
+@pytest.mark.parametrize('workers', [1, 3])
+def test_large_nd_strided_axes(dtype, workers):
+    # large enough for the strided axes to be processed in blocks of lines
+    rng = np.random.default_rng(1234)
+    x = (rng.random((40, 50, 70)) + 1j*rng.random((40, 50, 70))).astype(dtype)
+    rtol = 1e-4 if dtype == np.complex64 else 1e-10
+    for y in [x, x.transpose(2, 0, 1), x[:, ::-2, 3:]]:
+        expect = np.fft.fftn(y.astype(np.complex128))
+        assert_allclose(fftn(y, workers=workers), expect,
+                        rtol=rtol, atol=rtol*abs(expect).max())
+        expect = np.fft.ifft(y.astype(np.complex128), axis=0)
+        assert_allclose(ifft(y, axis=0, workers=workers), expect,
+                        rtol=rtol, atol=rtol*abs(expect).max())
+
+
+@pytest.mark.parametrize('dtype', [np.float32, np.float64])
+def test_isa_dispatch(dtype):
+    # whichever instruction set was selected, vectorized n-D transforms of
+    # both precisions must agree with numpy
+    assert pfft.isa in ('baseline', 'avx2', 'avx512f')
+    rng = np.random.default_rng(1234)
+    x = rng.random((33, 64, 20)).astype(dtype)
+    rtol = 1e-4 if dtype == np.float32 else 1e-10
+    expect = np.fft.rfftn(x.astype(np.float64))
+    assert_allclose(rfftn(x), expect, rtol=rtol, atol=rtol*abs(expect).max())
+    expect = np.fft.fftn(x.astype(np.float64), axes=(0, 2))
+    assert_allclose(fftn(x + 0j, axes=(0, 2)), expect,
+                    rtol=rtol, atol=rtol*abs(expect).max())
+
+
+def test_thread_pool_config():
+    x = np.random.default_rng(1234).random((64, 256)) + 0j
+    expect = np.fft.fft(x)
+    old = pfft.set_thread_limit(2)
+    try:
+        pfft.set_thread_pool(3)
+        info = pfft.thread_pool_info()
+        assert_equal(info['size'], 3)
+        assert_equal(info['limit'], 2)
+        assert_allclose(pfft.c2c(x, (1,), nthreads=8), expect, rtol=1e-12)
+        call = pfft.last_call_info()
+        assert_equal(call['nthreads'], 2)
+        assert_(call['seconds'] >= 0)
+
+        pfft.set_thread_limit(0)
+        plan = pfft.plan_c2c(x, (1,), nthreads=4)
+        assert_allclose(plan(x), expect, rtol=1e-12)
+        assert_equal(pfft.last_call_info()['nthreads'], 4)
+    finally:
+        pfft.set_thread_limit(old)
+        pfft.set_thread_pool()
+
+
+def test_thread_pool_affinity():
+    # Pinning the pool affects every transform of the process, so it is
+    # checked in a separate interpreter.
+    if not pfft.thread_pool_info()['can_pin']:
+        pytest.skip("thread affinity is not supported")
+    code = textwrap.dedent('''
+        import numpy as np
+        from numpy.testing import assert_allclose, assert_equal
+        from scipy.fft._pocketfft import pypocketfft as pfft
+
+        x = np.random.default_rng(1234).random((64, 256)) + 0j
+        pfft.set_thread_pool(cpus=[0])
+        assert_equal(pfft.thread_pool_info()['cpus'], [0])
+        assert_equal(pfft.thread_pool_info()['size'], 1)
+        assert_allclose(pfft.c2c(x, (1,), nthreads=3), np.fft.fft(x),
+                        rtol=1e-12)
+        ''')
+    subprocess.run([sys.executable, '-c', code], check=True)
+
+
+class TestPlan:
+    def setup_method(self):
+        self.rng = np.random.default_rng(1234)
+
+    @pytest.mark.parametrize('dtype', [np.complex64, np.complex128])
+    @pytest.mark.parametrize('axes', [None, (0,), (1,), (0, 2)])
+    def test_c2c(self, dtype, axes):
+        x = (self.rng.random((4, 6, 5)) +
+             1j*self.rng.random((4, 6, 5))).astype(dtype)
+        plan = pfft.plan_c2c(x, axes, False, 2)
+        rtol = 1e-5 if dtype == np.complex64 else 1e-12
+        for _ in range(3):
+            y = x[::-1] * 2
+            assert_allclose(plan(y), pfft.c2c(y, axes, False, 2), rtol=rtol)
+        out = np.empty_like(x)
+        assert plan(x, out) is out
+        assert_allclose(out, pfft.c2c(x, axes, False, 2), rtol=rtol)
+
+    @pytest.mark.parametrize('axes', [(1,), (0, 1), (1, 0)])
+    def test_r2c_c2r(self, axes):
+        x = self.rng.random((8, 9))
+        fwd = pfft.plan_r2c(x, axes, True, 0)
+        y = fwd(x)
+        assert fwd.shape_out == y.shape
+        assert_allclose(y, pfft.r2c(x, axes, True, 0), rtol=1e-12)
+        bwd = pfft.plan_c2r(y, axes, x.shape[axes[-1]], False, 2)
+        assert_allclose(bwd(y), x, rtol=1e-12)
+        assert_allclose(bwd(y), x, rtol=1e-12)
+
+    @pytest.mark.parametrize('type', [1, 2, 3, 4])
+    def test_dct_dst(self, type):
+        x = self.rng.random((7, 10)).astype(np.float32)
+        for plan, func in [(pfft.plan_dct, pfft.dct),
+                           (pfft.plan_dst, pfft.dst)]:
+            p = plan(x, type, None, 1)
+            assert_allclose(p(x), func(x, type, None, 1), rtol=1e-5)
+
+    def test_r2r_fftpack(self):
+        x = self.rng.random(12)
+        p = pfft.plan_r2r_fftpack(x, (0,), True, True, 0)
+        assert_allclose(p(x), pfft.r2r_fftpack(x, (0,), True, True, 0))
+
+    def test_mismatch(self):
+        x = np.zeros((4, 8), dtype=np.complex128)
+        plan = pfft.plan_c2c(x)
+        with assert_raises(ValueError, match='shape'):
+            plan(np.zeros((4, 9), dtype=np.complex128))
+        with assert_raises(ValueError, match='data type'):
+            plan(np.zeros((4, 8), dtype=np.complex64))
+        with assert_raises(ValueError, match='shape'):
+            plan(x, np.zeros((8, 4), dtype=np.complex128))
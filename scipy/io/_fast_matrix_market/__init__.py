@@ -29,6 +29,23 @@ Whether mmwrite() with symmetry='AUTO' will always search for symmetry inside th
 This is scipy.io._mmio.mmwrite()'s default behavior, but has a significant performance cost on large matrices.
 """
 
+WRITE_CACHE = False
+"""
+Whether mmread() saves the coordinates and values it parses from a file to a binary cache file
+next to it, named like the file plus a ``.fmmcache`` extension, and reads a file from its cache
+if the cache is up to date. The cache is ignored once the size or modification time of the file
+changes, or if its contents do not match the checksum it was written with.
+"""
+
+WRITE_INDEX = False
+"""
+Whether mmread() saves an index of the rows and columns held by each part of a file when it reads only
+some rows or columns of the file, named like the file plus a ``.fmmindex`` extension.
+Later reads of a block of the same file, while this is set, use the index to skip the parts that do
+not hold any of the block. As with the cache, an index is ignored once the size or modification time
+of the file changes.
+"""
+
 _field_to_dtype = {
     "integer": "int64",
     "unsigned-integer": "uint64",
@@ -132,6 +149,11 @@ def _read_body_coo(cursor, generalize_symmetry=True):
     """
     from . import _fmm_core
 
+    if cursor.cached:
+        # The arrays map the cache file, nothing to parse
+        i, j, data = _fmm_core.read_cache_coo(cursor)
+        return _generalize_symmetry(cursor.header, i, j, data, generalize_symmetry)
+
     index_dtype = "int32"
     if cursor.header.nrows >= 2**31 or cursor.header.ncols >= 2**31:
         # Dimensions are too large to fit in int32
@@ -143,22 +165,88 @@ def _read_body_coo(cursor, generalize_symmetry=True):
 
     _fmm_core.read_body_coo(cursor, i, j, data)
 
-    if generalize_symmetry and cursor.header.symmetry != "general":
+    if WRITE_CACHE:
+        _fmm_core.write_cache_coo(cursor, i, j, data)
+
+    return _generalize_symmetry(cursor.header, i, j, data, generalize_symmetry)
+
+
+def _generalize_symmetry(header, i, j, data, generalize_symmetry):
+    """
+    Add the mirrored off-diagonal elements of a symmetric coordinate body
+    """
+    if generalize_symmetry and header.symmetry != "general":
         off_diagonal_mask = (i != j)
         off_diagonal_rows = i[off_diagonal_mask]
         off_diagonal_cols = j[off_diagonal_mask]
         off_diagonal_data = data[off_diagonal_mask]
 
-        if cursor.header.symmetry == "skew-symmetric":
+        if header.symmetry == "skew-symmetric":
             off_diagonal_data *= -1
-        elif cursor.header.symmetry == "hermitian":
+        elif header.symmetry == "hermitian":
             off_diagonal_data = off_diagonal_data.conjugate()
 
         i = np.concatenate((i, off_diagonal_cols))
         j = np.concatenate((j, off_diagonal_rows))
         data = np.concatenate((data, off_diagonal_data))
 
-    return (data, (i, j)), cursor.header.shape
+    return (data, (i, j)), header.shape
+
+
+def _read_body_csr(cursor, csc=False):
+    """
+    Read MatrixMarket coordinate body directly into CSR (or CSC) arrays.
+    Only the final arrays are allocated. Requires a memory-mapped cursor.
+    """
+    from . import _fmm_core
+
+    header = cursor.header
+    max_nnz = header.nnz if header.symmetry == "general" else 2 * header.nnz
+    index_dtype = "int32"
+    if max(header.nrows, header.ncols, max_nnz) >= 2**31:
+        # Dimensions or element count are too large to fit in int32
+        index_dtype = "int64"
+
+    indptr = np.zeros((header.ncols if csc else header.nrows) + 1, dtype=index_dtype)
+    indices, data = _fmm_core.read_body_csr(cursor, indptr, csc)
+    return (data, indices, indptr), header.shape
+
+
+def _subset_range(r, n, name):
+    """
+    Bounds [start, stop) of a range of rows or columns given as a (start, stop) pair or a slice.
+    """
+    if r is None:
+        return 0, n
+    if not isinstance(r, slice):
+        r = slice(*r)
+    start, stop, step = r.indices(n)
+    if step != 1:
+        raise ValueError(f"{name} must be a contiguous range.")
+    return start, max(start, stop)
+
+
+def _read_body_subset(cursor, rows, cols):
+    """
+    Read the elements of a MatrixMarket coordinate body in a block of rows and columns.
+    Returns triplets relative to the corner of the block, and the shape of the block.
+    """
+    from . import _fmm_core
+
+    header = cursor.header
+    row_begin, row_end = _subset_range(rows, header.nrows, "rows")
+    col_begin, col_end = _subset_range(cols, header.ncols, "cols")
+    shape = (row_end - row_begin, col_end - col_begin)
+
+    if cursor.mapped:
+        # Only parses the parts of the file that may hold elements of the block
+        i, j, data = _fmm_core.read_body_subset(cursor, row_begin, row_end, col_begin, col_end,
+                                                WRITE_INDEX)
+        return (data, (i, j)), shape
+
+    (data, (i, j)), _ = _read_body_coo(cursor, generalize_symmetry=True)
+    mask = (i >= row_begin) & (i < row_end) & (j >= col_begin) & (j < col_end)
+    return (data[mask], (i[mask] - row_begin, j[mask] - col_begin)), shape
 
 
 def _get_read_cursor(source, parallelism=None):
@@ -180,7 +268,7 @@ def _get_read_cursor(source, parallelism=None):
 
     if is_path:
         path = str(source)
-        if path.endswith('.gz'):
+        if path.endswith('.gz') and 'gzip' not in _fmm_core.codecs:
             import gzip
             source = gzip.GzipFile(path, 'r')
             ret_stream_to_close = source
@@ -189,7 +277,8 @@ def _get_read_cursor(source, parallelism=None):
             source = bz2.BZ2File(path, 'rb')
             ret_stream_to_close = source
         else:
-            return _fmm_core.open_read_file(path, parallelism), ret_stream_to_close
+            return (_fmm_core.open_read_file(path, parallelism, WRITE_CACHE),
+                    ret_stream_to_close)
 
     # Stream object.
     if hasattr(source, "read"):
@@ -285,19 +374,29 @@ def _validate_symmetry(symmetry):
     return symmetry
 
 
-def mmread(source):
+def mmread(source, *, sparse_format="coo", rows=None, cols=None):
     """
     Reads the contents of a Matrix Market file-like 'source' into a matrix.
 
     Parameters
     ----------
     source : str or file-like
-        Matrix Market filename (extensions .mtx, .mtz.gz)
+        Matrix Market filename (extensions .mtx, .mtz.gz, .mtx.zst)
         or open file-like object.
+    sparse_format : {'coo', 'csr', 'csc'}, optional
+        Sparse format to return coordinate files in. Uncompressed files
+        are read directly into CSR or CSC without building a COO matrix
+        first, which needs much less memory.
+    rows, cols : (start, stop) tuple or slice, optional
+        Read only this block of rows and columns. Indices of the
+        result are relative to the block. Only the parts of an
+        uncompressed coordinate file that may hold elements of the
+        block are parsed once the file has an index, which is used
+        while `WRITE_INDEX` is set.
 
     Returns
     -------
-    a : ndarray or coo_matrix
+    a : ndarray, coo_matrix, csr_matrix or csc_matrix
         Dense or sparse matrix depending on the matrix format in the
         Matrix Market file.
 
@@ -344,19 +443,42 @@ def mmread(source):
     ...     m = mmread(StringIO(text))
 
     """
+    if sparse_format not in ("coo", "csr", "csc"):
+        raise ValueError("sparse_format must be one of 'coo', 'csr', 'csc'.")
+
     cursor, stream_to_close = _get_read_cursor(source)
 
     if cursor.header.format == "array":
         mat = _read_body_array(cursor)
         if stream_to_close:
             stream_to_close.close()
+        if rows is not None or cols is not None:
+            row_begin, row_end = _subset_range(rows, mat.shape[0], "rows")
+            col_begin, col_end = _subset_range(cols, mat.shape[1], "cols")
+            mat = mat[row_begin:row_end, col_begin:col_end]
+        return mat
+    elif rows is not None or cols is not None:
+        from scipy.sparse import coo_matrix
+        triplet, shape = _read_body_subset(cursor, rows, cols)
+        if stream_to_close:
+            stream_to_close.close()
+        mat = coo_matrix(triplet, shape=shape)
+        return mat if sparse_format == "coo" else mat.asformat(sparse_format)
+    elif sparse_format != "coo" and cursor.mapped:
+        from scipy.sparse import csr_matrix, csc_matrix
+        arrays, shape = _read_body_csr(cursor, csc=(sparse_format == "csc"))
+        mat = (csc_matrix if sparse_format == "csc" else csr_matrix)(arrays, shape=shape)
+        # indices are sorted within each row/column, duplicates are summed like tocsr() does
+        mat.has_sorted_indices = True
+        mat.sum_duplicates()
         return mat
     else:
         from scipy.sparse import coo_matrix
         triplet, shape = _read_body_coo(cursor, generalize_symmetry=True)
         if stream_to_close:
             stream_to_close.close()
-        return coo_matrix(triplet, shape=shape)
+        mat = coo_matrix(triplet, shape=shape)
+        return mat if sparse_format == "coo" else mat.asformat(sparse_format)
 
 
 def mmwrite(target, a, comment=None, field=None, precision=None, symmetry="AUTO"):
@@ -367,6 +489,8 @@ def mmwrite(target, a, comment=None, field=None, precision=None, symmetry="AUTO"
     ----------
     target : str or file-like
         Matrix Market filename (extension .mtx) or open file-like object.
+        Filenames ending in .gz or .zst are written gzip or zstd compressed
+        if SciPy was built with zlib or zstd.
     a : array like
         Sparse or dense 2-D array.
     comment : str, optional
@@ -504,6 +628,11 @@ def mmwrite(target, a, comment=None, field=None, precision=None, symmetry="AUTO"
         a = _apply_field(a, field, no_pattern=True)
         _fmm_core.write_body_array(cursor, a)
 
+    elif scipy.sparse.issparse(a) and a.format in ("csr", "csc") and symmetry == "general":
+        # Write CSR/CSC matrices directly, without a COO copy
+        data = _apply_field(a.data, field)
+        _fmm_core.write_body_csc(cursor, a.shape, a.indptr, a.indices, data, a.format == "csr")
+
     elif scipy.sparse.issparse(a):
         # Write sparse scipy matrices
         a = a.tocoo()
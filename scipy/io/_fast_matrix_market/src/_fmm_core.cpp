@@ -112,14 +112,53 @@ void open_read_rest(read_cursor& cursor) {
     fmm::read_header(cursor.stream(), cursor.header);
 }
 
-read_cursor open_read_file(const std::string& filename, int num_threads) {
-    read_cursor cursor(filename);
+/**
+ * Codec of a file, from its first bytes.
+ */
+compressed::codec detect_file_codec(const std::string& filename) {
+    std::ifstream f(filename, std::ios_base::in | std::ios_base::binary);
+    char magic[4] = {};
+    f.read(magic, sizeof(magic));
+    return compressed::detect_codec(std::string_view(magic, f.gcount()));
+}
+
+/**
+ * Open a gzip or zstd compressed file. The compressed data is memory-mapped if possible, and read into memory
+ * otherwise, so that it can be split into units that are decompressed in parallel.
+ */
+std::shared_ptr<std::istream> open_decompressing_stream(const std::string& filename, compressed::codec codec,
+                                                        int num_threads) {
+    auto mapping = mapped_file::open(filename);
+    if (mapping) {
+        return std::make_shared<compressed::decompressing_istream>(codec, mapping->contents(), mapping, num_threads);
+    }
+
+    std::ifstream f(filename, std::ios_base::in | std::ios_base::binary);
+    auto data = std::make_shared<std::string>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return std::make_shared<compressed::decompressing_istream>(codec, *data, data, num_threads);
+}
+
+read_cursor open_read_file(const std::string& filename, int num_threads, bool use_cache) {
+    compressed::codec codec = detect_file_codec(filename);
+    read_cursor cursor = (codec == compressed::none) ? read_cursor(filename) :
+                         read_cursor(open_decompressing_stream(filename, codec, num_threads));
+    cursor.filename = filename;
+    file_stamp::of(filename, cursor.source);
     // Set options
     cursor.options.num_threads = num_threads;
     // Python parses 1e9999 as Inf
     cursor.options.float_out_of_range_behavior = fmm::BestMatch;
 
     open_read_rest(cursor);
+
+    // Use a binary cache of the body if caching is enabled and the cache is up to date. Otherwise parse the body in
+    // place from a memory mapping, if possible.
+    if (use_cache) {
+        open_read_cache(cursor);
+    }
+    if (!cursor.cache && codec == compressed::none) {
+        cursor.map_file(filename);
+    }
     return cursor;
 }
 
@@ -141,7 +180,15 @@ read_cursor open_read_stream(std::shared_ptr<pystream::istream>& external, int n
 
 write_cursor open_write_file(const std::string& filename, const fmm::matrix_market_header& header,
                              int num_threads, int precision) {
-    write_cursor cursor(filename);
+    // Compress .gz and .zst files if this build supports it. Without zlib, .gz files are written uncompressed as
+    // they always were, but a .zst file is never silently left uncompressed.
+    compressed::codec codec = compressed::codec_for_filename(filename);
+    if (codec == compressed::zstd && !compressed::codec_supported(codec)) {
+        throw fmm::invalid_argument("Cannot write " + filename + ": zstd compression is not supported by this build.");
+    }
+    write_cursor cursor = (codec == compressed::none || !compressed::codec_supported(codec)) ? write_cursor(filename) :
+        write_cursor(std::make_shared<compressed::compressing_ostream>(
+            codec, std::make_unique<std::ofstream>(filename, std::ios_base::out | std::ios_base::binary), num_threads));
     // Set options
     cursor.options.num_threads = num_threads;
     cursor.options.precision = precision;
@@ -226,13 +273,27 @@ PYBIND11_MODULE(_fmm_core, m) {
     // Read methods
     py::class_<read_cursor>(m, "_read_cursor")
     .def_readonly("header", &read_cursor::header)
+    .def_property_readonly("cached", [](const read_cursor& cursor) { return (bool)cursor.cache; })
+    .def_property_readonly("mapped", [](const read_cursor& cursor) { return (bool)cursor.mapping; })
     .def("close", &read_cursor::close);
 
     m.def("open_read_file", &open_read_file);
+
+    // Compression codecs that open_read_file() and open_write_file() handle natively
+    py::list codecs;
+    for (auto codec : {compressed::gzip, compressed::zstd}) {
+        if (compressed::codec_supported(codec)) {
+            codecs.append(compressed::codec_name(codec));
+        }
+    }
+    m.attr("codecs") = codecs;
     m.def("open_read_stream", &open_read_stream);
 
     init_read_array(m);
     init_read_coo(m);
+    init_read_csr(m);
+    init_read_subset(m);
+    init_cache(m);
 
     ///////////////////////////////
     // Write methods
@@ -249,10 +310,8 @@ PYBIND11_MODULE(_fmm_core, m) {
     init_write_coo_32(m);
     init_write_coo_64(m);
 
-#ifndef FMM_SCIPY_PRUNE
     init_write_csc_32(m);
     init_write_csc_64(m);
-#endif
 
     // Module version
 #ifdef VERSION_INFO
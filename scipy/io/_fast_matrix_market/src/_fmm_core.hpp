@@ -8,7 +8,17 @@
 #define FMM_NO_VECTOR
 #endif
 
+#include <cstring>
 #include <fstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FMM_SCIPY_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
@@ -24,10 +34,168 @@ namespace fast_matrix_market {
 }
 #include <fast_matrix_market/fast_matrix_market.hpp>
 
+#include "compressed_stream.h"
+#include "balanced_csc_formatter.h"
+#include "read_body_view.h"
+
 namespace py = pybind11;
 using namespace pybind11::literals;
 namespace fmm = fast_matrix_market;
 
+/**
+ * Size and modification time of a file. Used to tell whether a cache built from the file is still current.
+ */
+struct file_stamp {
+    uint64_t size = 0;
+    int64_t mtime_sec = 0;
+    int64_t mtime_nsec = 0;
+
+    bool operator==(const file_stamp& rhs) const {
+        return size == rhs.size && mtime_sec == rhs.mtime_sec && mtime_nsec == rhs.mtime_nsec;
+    }
+    bool operator!=(const file_stamp& rhs) const {
+        return !(*this == rhs);
+    }
+
+    /**
+     * Stamp of a regular file.
+     *
+     * @return false if the file does not exist, is not a regular file, or the platform does not support this.
+     */
+    static bool of(const std::string& filename, file_stamp& stamp) {
+#ifdef FMM_SCIPY_HAVE_MMAP
+        struct stat st{};
+        if (::stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        stamp.size = (uint64_t)st.st_size;
+        stamp.mtime_sec = (int64_t)st.st_mtime;
+#ifdef __APPLE__
+        stamp.mtime_nsec = (int64_t)st.st_mtimespec.tv_nsec;
+#else
+        stamp.mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+        return true;
+#else
+        (void)filename;
+        (void)stamp;
+        return false;
+#endif
+    }
+};
+
+/**
+ * FNV-1a hash. Used to check the headers of sidecar files.
+ */
+inline uint64_t fnv1a_hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * FNV-1a variant that consumes 8 bytes per step. Used to check the arrays of sidecar files, which may be large.
+ * Any change to a single word changes the hash.
+ */
+inline uint64_t fnv1a_hash_words(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    return fnv1a_hash(bytes + i, size - i, hash);
+}
+
+#ifdef FMM_SCIPY_HAVE_MMAP
+/**
+ * Name of a temporary file to write a sidecar file to before it is renamed into place.
+ * Unique to the calling process and thread, so concurrent writers do not clash.
+ */
+inline std::string sidecar_temp_filename(const std::string& target) {
+    return target + ".tmp" + std::to_string(getpid()) + "." +
+           std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+}
+#endif
+
+/**
+ * A memory mapping of a whole file.
+ */
+class mapped_file {
+public:
+    /**
+     * Map a regular file.
+     *
+     * @param writable Map the file copy-on-write, so the mapped data may be modified. Changes are never written
+     *                 back to the file.
+     * @return nullptr if the file cannot be mapped. The caller should fall back to reading it as a stream.
+     */
+    static std::shared_ptr<mapped_file> open(const std::string& filename, bool writable = false) {
+#ifdef FMM_SCIPY_HAVE_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        std::shared_ptr<mapped_file> ret;
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            auto size = (size_t)st.st_size;
+            int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            void* addr = size == 0 ? nullptr : mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+#ifdef MADV_WILLNEED
+                if (addr != nullptr) {
+                    // chunks are parsed concurrently, so start reading ahead everywhere
+                    madvise(addr, size, MADV_WILLNEED);
+                }
+#endif
+                ret.reset(new mapped_file((const char*)addr, size));
+            }
+        }
+        ::close(fd);
+        return ret;
+#else
+        (void)filename;
+        (void)writable;
+        return nullptr;
+#endif
+    }
+
+    ~mapped_file() {
+#ifdef FMM_SCIPY_HAVE_MMAP
+        if (data != nullptr) {
+            munmap((void*)data, size);
+        }
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    [[nodiscard]] std::string_view contents() const {
+        return {data, size};
+    }
+
+    /**
+     * Pointer to the mapped data. Only valid for writes if the file was opened writable.
+     */
+    [[nodiscard]] char* mutable_data() const {
+        return const_cast<char*>(data);
+    }
+
+private:
+    mapped_file(const char* data, size_t size): data(data), size(size) {}
+
+    const char* data;
+    size_t size;
+};
+
 /**
  * A structure that represents an open MatrixMarket file or stream (for reading)
  */
@@ -43,8 +211,30 @@ struct read_cursor {
      */
     read_cursor(std::shared_ptr<pystream::istream>& external): stream_ptr(external) {}
 
+    /**
+     * Use a stream opened by the caller, such as a decompressing stream.
+     */
+    explicit read_cursor(std::shared_ptr<std::istream> stream): stream_ptr(std::move(stream)) {}
+
     std::shared_ptr<std::istream> stream_ptr;
 
+    /**
+     * If set, the whole file is mapped into memory and the body is parsed from there instead of from the stream.
+     */
+    std::shared_ptr<mapped_file> mapping;
+    size_t body_offset = 0;
+
+    /**
+     * Path and stamp of the file being read, if the cursor was opened on a file.
+     */
+    std::string filename;
+    file_stamp source{};
+
+    /**
+     * If set, an up-to-date binary cache of the body. See _fmm_core_cache.cpp.
+     */
+    std::shared_ptr<mapped_file> cache;
+
     fmm::matrix_market_header header{};
     fmm::read_options options{};
 
@@ -52,6 +242,27 @@ struct read_cursor {
         return *stream_ptr;
     }
 
+    /**
+     * Map the file into memory. Must be called right after the header has been read from the stream.
+     * If the file cannot be mapped the body is read from the stream as usual.
+     */
+    void map_file(const std::string& filename) {
+        auto pos = stream().tellg();
+        if (pos < 0) {
+            return;
+        }
+        mapping = mapped_file::open(filename);
+        body_offset = (size_t)pos;
+    }
+
+    /**
+     * Text of the body of a mapped file.
+     */
+    [[nodiscard]] std::string_view body() const {
+        auto contents = mapping->contents();
+        return contents.substr(std::min(body_offset, contents.size()));
+    }
+
     /**
      * Finish using the cursor. If a file has been opened it will be closed.
      */
@@ -64,9 +275,25 @@ struct read_cursor {
 
         // Remove this reference to the stream.
         stream_ptr.reset();
+        mapping.reset();
+        cache.reset();
     }
 };
 
+/**
+ * Read the body from wherever the cursor gets it from: the memory-mapped file or the stream.
+ */
+template <typename HANDLER, fmm::compile_format FORMAT>
+void read_cursor_body(read_cursor& cursor, HANDLER& handler, typename HANDLER::value_type pattern_value) {
+    if (cursor.mapping) {
+        fmm::read_matrix_market_body<HANDLER, FORMAT>(cursor.body(), cursor.header, handler, pattern_value,
+                                                      cursor.options);
+    } else {
+        fmm::read_matrix_market_body<HANDLER, FORMAT>(cursor.stream(), cursor.header, handler, pattern_value,
+                                                      cursor.options);
+    }
+}
+
 /**
  * A structure that represents an open MatrixMarket file or stream (for writing)
  */
@@ -83,6 +310,11 @@ struct write_cursor {
      */
     write_cursor(std::shared_ptr<pystream::ostream>& external): stream_ptr(external) {}
 
+    /**
+     * Use a stream opened by the caller, such as a compressing stream.
+     */
+    explicit write_cursor(std::shared_ptr<std::ostream> stream): stream_ptr(std::move(stream)) {}
+
     std::shared_ptr<std::ostream> stream_ptr;
 
     fmm::matrix_market_header header{};
@@ -98,8 +330,12 @@ struct write_cursor {
     void close() {
         // If stream is a std::ofstream() then close the file.
         std::ofstream* f = dynamic_cast<std::ofstream*>(stream_ptr.get());
+        auto* z = dynamic_cast<compressed::compressing_ostream*>(stream_ptr.get());
         if (f != nullptr) {
             f->close();
+        } else if (z != nullptr) {
+            // Compress the rest and close the file.
+            z->close();
         } else {
             stream_ptr->flush();
         }
@@ -194,54 +430,60 @@ void write_body_coo(write_cursor& cursor, const std::tuple<int64_t, int64_t>& sh
     cursor.close();
 }
 
-#ifndef FMM_SCIPY_PRUNE
 /**
  * Write Python CSC/CSR to MatrixMarket.
+ *
+ * The body is formatted straight from the compressed arrays, without first expanding them to triplets. Chunks of
+ * columns (CSC) or rows (CSR) are formatted in parallel.
  */
 template <typename IT, typename VT>
 void write_body_csc(write_cursor& cursor, const std::tuple<int64_t, int64_t>& shape,
-                    py::array_t<IT>& indptr, py::array_t<IT>& indices, py::array_t<VT>& data, bool is_csr) {
-    if (indices.size() != data.size() && data.size() != 0) {
-        throw std::invalid_argument("len(indices) must equal len(data).");
-    }
-
+                    py::array_t<IT, py::array::c_style>& indptr, py::array_t<IT, py::array::c_style>& indices,
+                    py::array_t<VT, py::array::c_style>& data, bool is_csr) {
     cursor.header.nrows = std::get<0>(shape);
     cursor.header.ncols = std::get<1>(shape);
-    cursor.header.nnz = indices.size();
 
     if ((is_csr && indptr.size() != cursor.header.nrows + 1) ||
         (!is_csr && indptr.size() != cursor.header.ncols + 1)) {
         throw std::invalid_argument("indptr length does not match matrix shape.");
     }
 
+    // indices and data may be longer than the number of stored elements
+    const IT* indptr_ptr = indptr.data();
+    const int64_t nnz = indptr_ptr[indptr.size() - 1];
+    if (indptr_ptr[0] != 0 || nnz < 0 || indices.size() < nnz) {
+        throw std::invalid_argument("indptr does not match len(indices).");
+    }
+    if (data.size() < nnz && data.size() != 0) {
+        throw std::invalid_argument("len(indices) must equal len(data).");
+    }
+    const int64_t data_size = (data.size() == 0 ? 0 : nnz);
+
+    cursor.header.nnz = nnz;
     cursor.header.object = fmm::matrix;
-    cursor.header.field = (data.size() == 0 ? (cursor.header.nnz == 0 ? fmm::real : fmm::pattern) : fmm::get_field_type((const VT*)nullptr));
+    cursor.header.field = (data_size == 0 ? (nnz == 0 ? fmm::real : fmm::pattern) : fmm::get_field_type((const VT*)nullptr));
     cursor.header.format = fmm::coordinate;
     cursor.header.symmetry = fmm::general;
 
     fmm::write_header(cursor.stream(), cursor.header, cursor.options);
 
-    auto indptr_unchecked = indptr.unchecked();
-    auto indices_unchecked = indices.unchecked();
-    auto data_unchecked = data.unchecked();
-
     fmm::line_formatter<IT, VT> lf(cursor.header, cursor.options);
-    auto formatter = fmm::csc_formatter(lf,
-                                        py_array_iterator<decltype(indptr_unchecked), IT>(indptr_unchecked),
-                                        py_array_iterator<decltype(indptr_unchecked), IT>(indptr_unchecked, indptr_unchecked.size() - 1),
-                                        py_array_iterator<decltype(indices_unchecked), IT>(indices_unchecked),
-                                        py_array_iterator<decltype(indices_unchecked), IT>(indices_unchecked, indices_unchecked.size()),
-                                        py_array_iterator<decltype(data_unchecked), VT>(data_unchecked),
-                                        py_array_iterator<decltype(data_unchecked), VT>(data_unchecked, data_unchecked.size()),
-                                        is_csr);
+    auto formatter = fmm::balanced_csc_formatter(lf,
+                                                 indptr_ptr, indptr_ptr + indptr.size() - 1,
+                                                 indices.data(), indices.data() + nnz,
+                                                 data.data(), data.data() + data_size,
+                                                 is_csr);
     fmm::write_body(cursor.stream(), formatter, cursor.options);
     cursor.close();
 }
-#endif
 
 void init_read_array(py::module_ &);
 void init_write_array(py::module_ &);
 void init_read_coo(py::module_ &);
+void init_read_csr(py::module_ &);
+void init_read_subset(py::module_ &);
+void init_cache(py::module_ &);
+void open_read_cache(read_cursor& cursor);
 void init_write_coo_32(py::module_ &);
 void init_write_coo_64(py::module_ &);
 void init_write_csc_32(py::module_ &);
@@ -0,0 +1,316 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+/**
+ * Binary cache of coordinate Matrix Market bodies.
+ *
+ * Parsing a large text file is expensive, so the triplets read from a file may be saved in a sidecar file
+ * `<filename>.fmmcache`. A later read of the same file maps the cache and hands the arrays to NumPy without copying.
+ *
+ * Layout: a cache_header, followed by the row, column and value arrays in native byte order, each starting at a
+ * multiple of cache_alignment. The header records the size and modification time of the source file and a checksum
+ * of the arrays; a cache that does not match the source, or fails any other check, is ignored. The cache is only
+ * read while mmread() is asked to write caches.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "_fmm_core.hpp"
+
+namespace {
+    constexpr char cache_magic[8] = {'F', 'M', 'M', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t cache_version = 2;
+    constexpr uint32_t cache_byte_order = 0x01020304;
+    constexpr uint64_t cache_alignment = 64;
+
+    struct cache_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+
+        // source file
+        uint64_t source_size;
+        int64_t source_mtime_sec;
+        int64_t source_mtime_nsec;
+
+        // Matrix Market header
+        int64_t nrows;
+        int64_t ncols;
+        int64_t nnz;
+        int32_t object;
+        int32_t format;
+        int32_t field;
+        int32_t symmetry;
+
+        // arrays
+        uint32_t index_size;
+        uint32_t value_size;
+        uint64_t row_offset;
+        uint64_t col_offset;
+        uint64_t value_offset;
+
+        // hash of the row, column and value arrays
+        uint64_t data_checksum;
+
+        // FNV-1a hash of all the fields above
+        uint64_t checksum;
+    };
+
+    uint64_t header_checksum(const cache_header& h) {
+        return fnv1a_hash(&h, offsetof(cache_header, checksum));
+    }
+
+    uint64_t data_checksum(const void* row, const void* col, const void* values, const cache_header& h) {
+        const auto nnz = (size_t)h.nnz;
+        uint64_t hash = fnv1a_hash_words(row, nnz * h.index_size);
+        hash = fnv1a_hash_words(col, nnz * h.index_size, hash);
+        return fnv1a_hash_words(values, nnz * h.value_size, hash);
+    }
+
+    std::string cache_filename(const std::string& filename) {
+        return filename + ".fmmcache";
+    }
+
+    uint64_t align_up(uint64_t offset) {
+        return (offset + cache_alignment - 1) / cache_alignment * cache_alignment;
+    }
+
+    /**
+     * Size of the values stored for a field. These are the dtypes mmread() uses.
+     */
+    uint32_t cache_value_size(fmm::field_type field) {
+        switch (field) {
+            case fmm::integer: return sizeof(int64_t);
+            case fmm::unsigned_integer: return sizeof(uint64_t);
+            case fmm::real:
+            case fmm::double_:
+            case fmm::pattern: return sizeof(double);
+            case fmm::complex: return sizeof(std::complex<double>);
+        }
+        return 0;
+    }
+
+    /**
+     * Whether the cache at offset can hold n elements of size elt_size.
+     */
+    bool array_fits(uint64_t offset, int64_t n, uint32_t elt_size, size_t file_size) {
+        return offset % cache_alignment == 0 && offset <= file_size &&
+               (uint64_t)n <= (file_size - offset) / elt_size;
+    }
+
+    /**
+     * Sequential writer that zero-pads up to the offset of each array.
+     */
+    struct cache_writer {
+        FILE* f;
+        uint64_t pos = 0;
+
+        bool write_at(uint64_t offset, const void* ptr, size_t size) {
+            static const char zeros[cache_alignment] = {};
+            size_t padding = offset - pos;
+            if (padding > 0 && std::fwrite(zeros, 1, padding, f) != padding) {
+                return false;
+            }
+            pos = offset + size;
+            return size == 0 || std::fwrite(ptr, 1, size, f) == size;
+        }
+    };
+
+    /**
+     * NumPy array that views part of a cache mapping. The array keeps the mapping alive.
+     */
+    template <typename T>
+    py::array_t<T> cache_array(const std::shared_ptr<mapped_file>& cache, uint64_t offset, int64_t n) {
+        auto owner = new std::shared_ptr<mapped_file>(cache);
+        py::capsule base(owner, [](void* p) { delete static_cast<std::shared_ptr<mapped_file>*>(p); });
+        return py::array_t<T>({(py::ssize_t)n}, {(py::ssize_t)sizeof(T)},
+                              reinterpret_cast<T*>(cache->mutable_data() + offset), base);
+    }
+
+    template <typename IT>
+    py::tuple cache_arrays(read_cursor& cursor, const cache_header& h) {
+        auto row = cache_array<IT>(cursor.cache, h.row_offset, h.nnz);
+        auto col = cache_array<IT>(cursor.cache, h.col_offset, h.nnz);
+
+        switch (cursor.header.field) {
+            case fmm::integer:
+                return py::make_tuple(row, col, cache_array<int64_t>(cursor.cache, h.value_offset, h.nnz));
+            case fmm::unsigned_integer:
+                return py::make_tuple(row, col, cache_array<uint64_t>(cursor.cache, h.value_offset, h.nnz));
+            case fmm::complex:
+                return py::make_tuple(row, col,
+                                      cache_array<std::complex<double>>(cursor.cache, h.value_offset, h.nnz));
+            default:
+                return py::make_tuple(row, col, cache_array<double>(cursor.cache, h.value_offset, h.nnz));
+        }
+    }
+}
+
+/**
+ * Map the cache of the file the cursor was opened on, if it exists and matches both the file and its header.
+ *
+ * The arrays are checked against the checksum in the header, which reads the whole cache once.
+ */
+void open_read_cache(read_cursor& cursor) {
+    if (cursor.filename.empty() || cursor.source.size == 0 ||
+        cursor.header.object != fmm::matrix || cursor.header.format != fmm::coordinate) {
+        return;
+    }
+
+    auto cache = mapped_file::open(cache_filename(cursor.filename), true);
+    if (!cache) {
+        return;
+    }
+
+    auto contents = cache->contents();
+    cache_header h{};
+    if (contents.size() < sizeof(h)) {
+        return;
+    }
+    std::memcpy(&h, contents.data(), sizeof(h));
+
+    const file_stamp stamp{h.source_size, h.source_mtime_sec, h.source_mtime_nsec};
+    const auto& header = cursor.header;
+    bool valid = std::memcmp(h.magic, cache_magic, sizeof(cache_magic)) == 0 &&
+                 h.version == cache_version &&
+                 h.byte_order == cache_byte_order &&
+                 h.checksum == header_checksum(h) &&
+                 stamp == cursor.source &&
+                 h.nrows == header.nrows && h.ncols == header.ncols && h.nnz == header.nnz && h.nnz >= 0 &&
+                 h.object == header.object && h.format == header.format &&
+                 h.field == header.field && h.symmetry == header.symmetry &&
+                 (h.index_size == sizeof(int32_t) || h.index_size == sizeof(int64_t)) &&
+                 h.value_size == cache_value_size(header.field) &&
+                 array_fits(h.row_offset, h.nnz, h.index_size, contents.size()) &&
+                 array_fits(h.col_offset, h.nnz, h.index_size, contents.size()) &&
+                 array_fits(h.value_offset, h.nnz, h.value_size, contents.size());
+    if (!valid) {
+        return;
+    }
+
+    const char* base = contents.data();
+    bool intact;
+    {
+        py::gil_scoped_release release;
+        intact = data_checksum(base + h.row_offset, base + h.col_offset, base + h.value_offset, h) == h.data_checksum;
+    }
+    if (intact) {
+        cursor.cache = cache;
+    }
+}
+
+/**
+ * Return the (row, col, data) arrays of a cached coordinate body. The arrays map the cache file copy-on-write.
+ */
+py::tuple read_cache_coo(read_cursor& cursor) {
+    if (!cursor.cache) {
+        throw std::invalid_argument("Cursor does not have a cache.");
+    }
+
+    cache_header h{};
+    std::memcpy(&h, cursor.cache->contents().data(), sizeof(h));
+
+    py::tuple ret = (h.index_size == sizeof(int32_t)) ? cache_arrays<int32_t>(cursor, h)
+                                                       : cache_arrays<int64_t>(cursor, h);
+    cursor.close();
+    return ret;
+}
+
+/**
+ * Save triplets read from a file to its cache.
+ *
+ * The cache is written to a temporary file which is then renamed, so concurrent readers never see a partial cache.
+ *
+ * @return whether the cache was written. Failure is not an error: the source may be a stream, the directory may not
+ * be writable, or the source may have changed while it was being read.
+ */
+template <typename IT, typename VT>
+bool write_cache_coo(read_cursor& cursor, py::array_t<IT, py::array::c_style>& row,
+                     py::array_t<IT, py::array::c_style>& col, py::array_t<VT, py::array::c_style>& data) {
+    const auto& header = cursor.header;
+    if (cursor.filename.empty() || cursor.source.size == 0 || header.format != fmm::coordinate ||
+        sizeof(VT) != cache_value_size(header.field)) {
+        return false;
+    }
+    if (row.size() != header.nnz || col.size() != header.nnz || data.size() != header.nnz) {
+        throw std::invalid_argument("NumPy Array sizes need to equal matrix nnz");
+    }
+
+#ifndef FMM_SCIPY_HAVE_MMAP
+    // The cache could not be mapped when reading
+    return false;
+#else
+    file_stamp now{};
+    if (!file_stamp::of(cursor.filename, now) || now != cursor.source) {
+        return false;
+    }
+
+    cache_header h{};
+    std::memcpy(h.magic, cache_magic, sizeof(cache_magic));
+    h.version = cache_version;
+    h.byte_order = cache_byte_order;
+    h.source_size = cursor.source.size;
+    h.source_mtime_sec = cursor.source.mtime_sec;
+    h.source_mtime_nsec = cursor.source.mtime_nsec;
+    h.nrows = header.nrows;
+    h.ncols = header.ncols;
+    h.nnz = header.nnz;
+    h.object = header.object;
+    h.format = header.format;
+    h.field = header.field;
+    h.symmetry = header.symmetry;
+    h.index_size = sizeof(IT);
+    h.value_size = sizeof(VT);
+    h.row_offset = align_up(sizeof(h));
+    h.col_offset = align_up(h.row_offset + (uint64_t)header.nnz * sizeof(IT));
+    h.value_offset = align_up(h.col_offset + (uint64_t)header.nnz * sizeof(IT));
+
+    const std::string target = cache_filename(cursor.filename);
+    const std::string temp = sidecar_temp_filename(target);
+    const IT* row_ptr = row.data();
+    const IT* col_ptr = col.data();
+    const VT* data_ptr = data.data();
+    const auto nnz = (size_t)header.nnz;
+
+    bool ok;
+    {
+        py::gil_scoped_release release;
+
+        h.data_checksum = data_checksum(row_ptr, col_ptr, data_ptr, h);
+        h.checksum = header_checksum(h);
+
+        cache_writer w{std::fopen(temp.c_str(), "wb")};
+        if (w.f == nullptr) {
+            return false;
+        }
+        ok = w.write_at(0, &h, sizeof(h)) &&
+             w.write_at(h.row_offset, row_ptr, nnz * sizeof(IT)) &&
+             w.write_at(h.col_offset, col_ptr, nnz * sizeof(IT)) &&
+             w.write_at(h.value_offset, data_ptr, nnz * sizeof(VT));
+        ok = (std::fclose(w.f) == 0) && ok;
+        ok = ok && std::rename(temp.c_str(), target.c_str()) == 0;
+        if (!ok) {
+            std::remove(temp.c_str());
+        }
+    }
+    return ok;
+#endif
+}
+
+
+void init_cache(py::module_ &m) {
+    m.def("read_cache_coo", &read_cache_coo);
+
+    m.def("write_cache_coo", &write_cache_coo<int32_t, int64_t>);
+    m.def("write_cache_coo", &write_cache_coo<int32_t, uint64_t>);
+    m.def("write_cache_coo", &write_cache_coo<int32_t, double>);
+    m.def("write_cache_coo", &write_cache_coo<int32_t, std::complex<double>>);
+
+    m.def("write_cache_coo", &write_cache_coo<int64_t, int64_t>);
+    m.def("write_cache_coo", &write_cache_coo<int64_t, uint64_t>);
+    m.def("write_cache_coo", &write_cache_coo<int64_t, double>);
+    m.def("write_cache_coo", &write_cache_coo<int64_t, std::complex<double>>);
+}
@@ -21,9 +21,9 @@ void read_body_coo(read_cursor& cursor, py::array_t<IT>& row, py::array_t<IT>& c
     // The mmread() will only call this method if the matrix is a coordinate. Disable the code paths for reading
     // array matrices here to reduce final library size and compilation time.
 #ifdef FMM_SCIPY_PRUNE
-    fmm::read_matrix_market_body<decltype(handler), fmm::compile_coordinate_only>(cursor.stream(), cursor.header, handler, 1, cursor.options);
+    read_cursor_body<decltype(handler), fmm::compile_coordinate_only>(cursor, handler, 1);
 #else
-    fmm::read_matrix_market_body<decltype(handler), fmm::compile_all>(cursor.stream(), cursor.header, handler, 1, cursor.options);
+    read_cursor_body<decltype(handler), fmm::compile_all>(cursor, handler, 1);
 #endif
     cursor.close();
 }
@@ -0,0 +1,209 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <atomic>
+#include <future>
+#include <limits>
+
+#include "_fmm_core.hpp"
+
+/**
+ * First pass of reading a coordinate body into CSR/CSC: count the elements of each row (CSR) or column (CSC).
+ *
+ * Used with a pattern header so that values are skipped, not parsed.
+ */
+template <typename IT>
+class csr_count_parse_handler {
+public:
+    using coordinate_type = IT;
+    using value_type = fmm::pattern_placeholder_type;
+    static constexpr int flags = fmm::kParallelOk | fmm::kAppending;
+
+    csr_count_parse_handler(std::vector<std::atomic<IT>>& counts, bool csc) : counts(counts), csc(csc) {}
+
+    void handle(const coordinate_type row, const coordinate_type col, [[maybe_unused]] const value_type ignored) {
+        counts[csc ? col : row].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    csr_count_parse_handler get_chunk_handler([[maybe_unused]] int64_t offset_from_begin) {
+        return *this;
+    }
+
+protected:
+    std::vector<std::atomic<IT>>& counts;
+    bool csc;
+};
+
+/**
+ * Second pass of reading a coordinate body into CSR/CSC: store each element at the next free position of its row
+ * (CSR) or column (CSC).
+ */
+template <typename IT, typename VT>
+class csr_fill_parse_handler {
+public:
+    using coordinate_type = IT;
+    using value_type = VT;
+    static constexpr int flags = fmm::kParallelOk | fmm::kAppending;
+
+    csr_fill_parse_handler(std::vector<std::atomic<IT>>& next, IT* indices, VT* data, bool csc)
+        : next(next), indices(indices), data(data), csc(csc) {}
+
+    void handle(const coordinate_type row, const coordinate_type col, const value_type value) {
+        IT major = csc ? col : row;
+        IT pos = next[major].fetch_add(1, std::memory_order_relaxed);
+        indices[pos] = csc ? row : col;
+        data[pos] = value;
+    }
+
+    csr_fill_parse_handler get_chunk_handler([[maybe_unused]] int64_t offset_from_begin) {
+        return *this;
+    }
+
+protected:
+    std::vector<std::atomic<IT>>& next;
+    IT* indices;
+    VT* data;
+    bool csc;
+};
+
+/**
+ * Sort the indices of every row (CSR) or column (CSC). The second pass fills them in whatever order the threads
+ * reach them.
+ */
+template <typename IT, typename VT>
+void sort_csr_indices(const IT* indptr, int64_t nmajor, IT* indices, VT* data, int num_threads) {
+    auto sort_lines = [=](int64_t begin, int64_t end) {
+        std::vector<std::pair<IT, VT>> line;
+        for (int64_t i = begin; i < end; ++i) {
+            IT* line_indices = indices + indptr[i];
+            VT* line_data = data + indptr[i];
+            auto line_nnz = (size_t)(indptr[i + 1] - indptr[i]);
+            if (std::is_sorted(line_indices, line_indices + line_nnz)) {
+                continue;
+            }
+
+            line.resize(line_nnz);
+            for (size_t k = 0; k < line_nnz; ++k) {
+                line[k] = {line_indices[k], line_data[k]};
+            }
+            std::stable_sort(line.begin(), line.end(),
+                             [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+            for (size_t k = 0; k < line_nnz; ++k) {
+                line_indices[k] = line[k].first;
+                line_data[k] = line[k].second;
+            }
+        }
+    };
+
+    if (num_threads == 1 || nmajor < 2) {
+        sort_lines(0, nmajor);
+        return;
+    }
+
+    task_thread_pool::task_thread_pool pool(num_threads);
+    const int64_t num_blocks = 8 * (int64_t)pool.get_num_threads();
+    std::vector<std::future<void>> futures;
+    for (int64_t b = 0; b < num_blocks; ++b) {
+        int64_t begin = nmajor * b / num_blocks;
+        int64_t end = nmajor * (b + 1) / num_blocks;
+        if (begin < end) {
+            futures.push_back(pool.submit(sort_lines, begin, end));
+        }
+    }
+    for (auto& f : futures) {
+        f.get();
+    }
+}
+
+/**
+ * Read a coordinate body directly into CSR (or CSC) arrays, without first reading triplets.
+ *
+ * The body is parsed twice: the first pass counts the elements of each row, the second fills them in. Only the
+ * final arrays and one counter per row are allocated. Symmetry is generalized, so the result holds every element.
+ * The indices of each row are sorted.
+ *
+ * Requires a memory-mapped file, as the body is parsed twice.
+ *
+ * @param indptr Preallocated array of length nrows + 1 (CSR) or ncols + 1 (CSC) that is filled in.
+ * @return (indices, data)
+ */
+template <typename IT, typename VT>
+py::tuple read_body_csr_typed(read_cursor& cursor, py::array_t<IT>& indptr, bool csc) {
+    const auto& header = cursor.header;
+    const int64_t nmajor = csc ? header.ncols : header.nrows;
+    if (indptr.size() != nmajor + 1) {
+        throw std::invalid_argument("indptr length does not match matrix shape.");
+    }
+
+    fmm::read_options options = cursor.options;
+    options.generalize_symmetry = true;
+
+    // Pass 1: count. The header says pattern so that the values are not parsed.
+    std::vector<std::atomic<IT>> counts(nmajor);
+    for (auto& c : counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    {
+        fmm::matrix_market_header count_header = header;
+        count_header.field = fmm::pattern;
+        csr_count_parse_handler<IT> count_handler(counts, csc);
+        fmm::read_matrix_market_body_no_adapters<decltype(count_handler), fmm::compile_coordinate_only>(
+            cursor.body(), count_header, count_handler, options);
+    }
+
+    IT* indptr_ptr = indptr.mutable_data();
+    int64_t nnz = 0;
+    indptr_ptr[0] = 0;
+    for (int64_t i = 0; i < nmajor; ++i) {
+        nnz += counts[i].load(std::memory_order_relaxed);
+        if (nnz > std::numeric_limits<IT>::max()) {
+            throw fmm::out_of_range("Number of stored elements does not fit the index type.");
+        }
+        indptr_ptr[i + 1] = (IT)nnz;
+        // counts now hold the next free position of each row
+        counts[i].store(indptr_ptr[i], std::memory_order_relaxed);
+    }
+
+    // Pass 2: fill.
+    py::array_t<IT> indices(nnz);
+    py::array_t<VT> data(nnz);
+    {
+        csr_fill_parse_handler<IT, VT> fill_handler(counts, indices.mutable_data(), data.mutable_data(), csc);
+        fmm::read_matrix_market_body<decltype(fill_handler), fmm::compile_coordinate_only>(
+            cursor.body(), header, fill_handler, 1, options);
+    }
+
+    sort_csr_indices(indptr_ptr, nmajor, indices.mutable_data(), data.mutable_data(), options.num_threads);
+
+    cursor.close();
+    return py::make_tuple(indices, data);
+}
+
+template <typename IT>
+py::tuple read_body_csr(read_cursor& cursor, py::array_t<IT>& indptr, bool csc) {
+    if (!cursor.mapping) {
+        throw std::invalid_argument("Reading directly to CSR requires a memory-mapped file.");
+    }
+    if (cursor.header.object != fmm::matrix || cursor.header.format != fmm::coordinate) {
+        throw std::invalid_argument("Reading directly to CSR requires a coordinate matrix.");
+    }
+
+    // Value types match the dtypes chosen by mmread()
+    switch (cursor.header.field) {
+        case fmm::integer:
+            return read_body_csr_typed<IT, int64_t>(cursor, indptr, csc);
+        case fmm::unsigned_integer:
+            return read_body_csr_typed<IT, uint64_t>(cursor, indptr, csc);
+        case fmm::complex:
+            return read_body_csr_typed<IT, std::complex<double>>(cursor, indptr, csc);
+        default:
+            return read_body_csr_typed<IT, double>(cursor, indptr, csc);
+    }
+}
+
+
+void init_read_csr(py::module_ &m) {
+    m.def("read_body_csr", &read_body_csr<int32_t>);
+    m.def("read_body_csr", &read_body_csr<int64_t>);
+}
@@ -0,0 +1,444 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+/**
+ * Read a block of rows and columns of a coordinate Matrix Market file.
+ *
+ * The body of a memory-mapped file is split into blocks of lines. Each block is summarized by the bounding box of the
+ * coordinates it holds, including the mirrored elements of symmetric matrices. A read only parses the blocks whose
+ * bounding box intersects the requested block of the matrix.
+ *
+ * The summaries are only known after the whole body has been parsed once, so they may be saved to a sidecar index
+ * file `<filename>.fmmindex`. Later reads of the same file load the index and skip the other blocks entirely. This
+ * is most effective on files sorted by row or column, where each block covers a narrow range of rows or columns.
+ *
+ * Layout of the index: an index_header followed by num_blocks index_block records, in native byte order. As with the
+ * cache, an index is only used while mmread() is asked to write indexes, and is ignored if it does not match the
+ * source file.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <limits>
+
+#include "_fmm_core.hpp"
+
+namespace {
+    constexpr char index_magic[8] = {'F', 'M', 'M', 'I', 'N', 'D', 'E', 'X'};
+    constexpr uint32_t index_version = 1;
+    constexpr uint32_t index_byte_order = 0x01020304;
+
+    /**
+     * Nominal size of a block. Smaller blocks skip more precisely, larger ones make a smaller index.
+     */
+    constexpr size_t index_block_bytes = 256 << 10;
+
+    struct index_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+
+        // source file
+        uint64_t source_size;
+        int64_t source_mtime_sec;
+        int64_t source_mtime_nsec;
+        uint64_t body_offset;
+
+        // Matrix Market header
+        int64_t nrows;
+        int64_t ncols;
+        int64_t nnz;
+        int32_t object;
+        int32_t format;
+        int32_t field;
+        int32_t symmetry;
+
+        uint64_t num_blocks;
+
+        // FNV-1a hash of all the fields above and of the blocks
+        uint64_t checksum;
+    };
+
+    struct index_block {
+        // byte range of the block within the body
+        uint64_t begin;
+        uint64_t end;
+
+        // line counts at the start of the block
+        int64_t file_line;
+        int64_t element_num;
+
+        // zero-based bounding box of the coordinates in the block. Empty if row_min > row_max.
+        int64_t row_min;
+        int64_t row_max;
+        int64_t col_min;
+        int64_t col_max;
+
+        [[nodiscard]] bool intersects(int64_t row_begin, int64_t row_end, int64_t col_begin, int64_t col_end) const {
+            return row_min <= row_max &&
+                   row_min < row_end && row_begin <= row_max &&
+                   col_min < col_end && col_begin <= col_max;
+        }
+    };
+
+    std::string index_filename(const std::string& filename) {
+        return filename + ".fmmindex";
+    }
+
+    uint64_t index_checksum(const index_header& h, const std::vector<index_block>& blocks) {
+        uint64_t hash = fnv1a_hash(&h, offsetof(index_header, checksum));
+        return fnv1a_hash(blocks.data(), blocks.size() * sizeof(index_block), hash);
+    }
+
+    /**
+     * Split the body at line boundaries into blocks of about index_block_bytes, and count the lines before each.
+     */
+    std::vector<index_block> split_blocks(std::string_view body, const read_cursor& cursor) {
+        std::vector<index_block> blocks;
+        size_t start = 0;
+        while (start < body.size()) {
+            size_t stop = body.size();
+            if (body.size() - start > index_block_bytes) {
+                const char* nl = static_cast<const char*>(
+                    std::memchr(body.data() + start + index_block_bytes, '\n', body.size() - start - index_block_bytes));
+                if (nl != nullptr) {
+                    stop = (size_t)(nl - body.data()) + 1;
+                }
+            }
+            index_block block{};
+            block.begin = start;
+            block.end = stop;
+            blocks.push_back(block);
+            start = stop;
+        }
+
+        // Every block but the last ends in a newline, so the line counts of the blocks simply add up.
+        std::vector<std::pair<int64_t, int64_t>> counts(blocks.size());
+        auto count = [&](size_t b) {
+            counts[b] = fmm::count_lines(body.substr(blocks[b].begin, blocks[b].end - blocks[b].begin));
+        };
+        if (cursor.options.num_threads == 1 || blocks.size() < 2) {
+            for (size_t b = 0; b < blocks.size(); ++b) {
+                count(b);
+            }
+        } else {
+            task_thread_pool::task_thread_pool pool(cursor.options.num_threads);
+            std::vector<std::future<void>> futures;
+            for (size_t b = 0; b < blocks.size(); ++b) {
+                futures.push_back(pool.submit(count, b));
+            }
+            for (auto& f : futures) {
+                f.get();
+            }
+        }
+
+        fmm::line_counts lc{cursor.header.header_line_count, 0};
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            blocks[b].file_line = lc.file_line;
+            blocks[b].element_num = lc.element_num;
+            lc.file_line += counts[b].first;
+            lc.element_num += counts[b].first - counts[b].second;
+        }
+        return blocks;
+    }
+
+    /**
+     * Load the index of the file the cursor was opened on, if it exists and matches the file.
+     *
+     * @return whether the index was loaded into `blocks`.
+     */
+    bool load_index(const read_cursor& cursor, std::vector<index_block>& blocks) {
+        if (cursor.filename.empty() || cursor.source.size == 0) {
+            return false;
+        }
+
+        std::FILE* f = std::fopen(index_filename(cursor.filename).c_str(), "rb");
+        if (f == nullptr) {
+            return false;
+        }
+        index_header h{};
+        bool ok = std::fread(&h, sizeof(h), 1, f) == 1 &&
+                  std::memcmp(h.magic, index_magic, sizeof(index_magic)) == 0 &&
+                  h.version == index_version &&
+                  h.byte_order == index_byte_order &&
+                  h.num_blocks <= cursor.source.size;
+        if (ok) {
+            blocks.resize(h.num_blocks);
+            ok = h.num_blocks == 0 || std::fread(blocks.data(), sizeof(index_block), h.num_blocks, f) == h.num_blocks;
+        }
+        std::fclose(f);
+
+        const file_stamp stamp{h.source_size, h.source_mtime_sec, h.source_mtime_nsec};
+        const auto& header = cursor.header;
+        const uint64_t body_size = cursor.body().size();
+        ok = ok && h.checksum == index_checksum(h, blocks) &&
+             stamp == cursor.source &&
+             h.body_offset == cursor.body_offset &&
+             h.nrows == header.nrows && h.ncols == header.ncols && h.nnz == header.nnz &&
+             h.object == header.object && h.format == header.format &&
+             h.field == header.field && h.symmetry == header.symmetry;
+
+        // the blocks must cover the body exactly
+        uint64_t pos = 0;
+        for (size_t b = 0; ok && b < blocks.size(); ++b) {
+            ok = blocks[b].begin == pos && blocks[b].begin < blocks[b].end && blocks[b].end <= body_size;
+            pos = blocks[b].end;
+        }
+        ok = ok && pos == body_size;
+
+        if (!ok) {
+            blocks.clear();
+        }
+        return ok;
+    }
+
+    /**
+     * Save the index of the file the cursor was opened on.
+     *
+     * @return whether the index was written. As with the cache, failure is not an error.
+     */
+    bool write_index(const read_cursor& cursor, const std::vector<index_block>& blocks) {
+        if (cursor.filename.empty() || cursor.source.size == 0) {
+            return false;
+        }
+
+#ifndef FMM_SCIPY_HAVE_MMAP
+        // Subsets are only read from mapped files
+        (void)blocks;
+        return false;
+#else
+        file_stamp now{};
+        if (!file_stamp::of(cursor.filename, now) || now != cursor.source) {
+            return false;
+        }
+
+        const auto& header = cursor.header;
+        index_header h{};
+        std::memcpy(h.magic, index_magic, sizeof(index_magic));
+        h.version = index_version;
+        h.byte_order = index_byte_order;
+        h.source_size = cursor.source.size;
+        h.source_mtime_sec = cursor.source.mtime_sec;
+        h.source_mtime_nsec = cursor.source.mtime_nsec;
+        h.body_offset = cursor.body_offset;
+        h.nrows = header.nrows;
+        h.ncols = header.ncols;
+        h.nnz = header.nnz;
+        h.object = header.object;
+        h.format = header.format;
+        h.field = header.field;
+        h.symmetry = header.symmetry;
+        h.num_blocks = blocks.size();
+        h.checksum = index_checksum(h, blocks);
+
+        const std::string target = index_filename(cursor.filename);
+        const std::string temp = sidecar_temp_filename(target);
+
+        std::FILE* f = std::fopen(temp.c_str(), "wb");
+        if (f == nullptr) {
+            return false;
+        }
+        bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+                  (blocks.empty() || std::fwrite(blocks.data(), sizeof(index_block), blocks.size(), f) == blocks.size());
+        ok = (std::fclose(f) == 0) && ok;
+        ok = ok && std::rename(temp.c_str(), target.c_str()) == 0;
+        if (!ok) {
+            std::remove(temp.c_str());
+        }
+        return ok;
+#endif
+    }
+
+    /**
+     * Elements of the requested block of the matrix found in one block of the file.
+     */
+    template <typename IT, typename VT>
+    struct subset_part {
+        std::vector<IT> rows;
+        std::vector<IT> cols;
+        std::vector<VT> values;
+    };
+
+    /**
+     * Keeps the elements that fall into the requested block of the matrix, and tracks the bounding box of all elements.
+     */
+    template <typename IT, typename VT>
+    class subset_parse_handler {
+    public:
+        using coordinate_type = IT;
+        using value_type = VT;
+        static constexpr int flags = fmm::kAppending;
+
+        subset_parse_handler(subset_part<IT, VT>& part, index_block& block,
+                             int64_t row_begin, int64_t row_end, int64_t col_begin, int64_t col_end)
+            : part(part), block(block), row_begin(row_begin), row_end(row_end), col_begin(col_begin), col_end(col_end) {}
+
+        void handle(const coordinate_type row, const coordinate_type col, const value_type value) {
+            block.row_min = std::min(block.row_min, (int64_t)row);
+            block.row_max = std::max(block.row_max, (int64_t)row);
+            block.col_min = std::min(block.col_min, (int64_t)col);
+            block.col_max = std::max(block.col_max, (int64_t)col);
+
+            if (row_begin <= row && row < row_end && col_begin <= col && col < col_end) {
+                part.rows.push_back((IT)(row - row_begin));
+                part.cols.push_back((IT)(col - col_begin));
+                part.values.push_back(value);
+            }
+        }
+
+        subset_parse_handler get_chunk_handler([[maybe_unused]] int64_t offset_from_begin) {
+            return *this;
+        }
+
+    protected:
+        subset_part<IT, VT>& part;
+        index_block& block;
+        int64_t row_begin, row_end, col_begin, col_end;
+    };
+
+    template <typename IT, typename VT>
+    py::tuple read_body_subset_typed(read_cursor& cursor,
+                                     int64_t row_begin, int64_t row_end, int64_t col_begin, int64_t col_end,
+                                     bool use_index) {
+        const std::string_view body = cursor.body();
+
+        std::vector<index_block> blocks;
+        const bool indexed = use_index && load_index(cursor, blocks);
+        if (!indexed) {
+            blocks = split_blocks(body, cursor);
+        }
+
+        // Blocks to parse. Without an index every block is parsed, which also builds the index.
+        std::vector<size_t> selected;
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            if (!indexed || blocks[b].intersects(row_begin, row_end, col_begin, col_end)) {
+                selected.push_back(b);
+            }
+        }
+
+        fmm::read_options options = cursor.options;
+        options.generalize_symmetry = true;
+
+        std::vector<subset_part<IT, VT>> parts(selected.size());
+        auto parse = [&](size_t s) {
+            index_block& block = blocks[selected[s]];
+            block.row_min = block.col_min = std::numeric_limits<int64_t>::max();
+            block.row_max = block.col_max = -1;
+
+            std::string_view chunk = body.substr(block.begin, block.end - block.begin);
+            std::string tail;
+            if (block.end == body.size()) {
+                // number parsing may look one byte past the end of the body, see fmm::split_chunks()
+                tail.assign(chunk);
+                chunk = tail;
+            }
+
+            subset_parse_handler<IT, VT> handler(parts[s], block, row_begin, row_end, col_begin, col_end);
+            auto fwd_handler = fmm::pattern_parse_adapter<decltype(handler)>(handler, VT(1));
+            fmm::line_counts lc{block.file_line, block.element_num};
+            return fmm::read_chunk_matrix_coordinate(chunk, cursor.header, lc, fwd_handler, options);
+        };
+
+        fmm::line_counts end_lc{cursor.header.header_line_count, 0};
+        if (options.num_threads == 1 || selected.size() < 2) {
+            for (size_t s = 0; s < selected.size(); ++s) {
+                end_lc = parse(s);
+            }
+        } else {
+            task_thread_pool::task_thread_pool pool(options.num_threads);
+            std::vector<std::future<fmm::line_counts>> futures;
+            for (size_t s = 0; s < selected.size(); ++s) {
+                futures.push_back(pool.submit(parse, s));
+            }
+            for (auto& f : futures) {
+                end_lc = f.get();
+            }
+        }
+
+        if (!indexed) {
+            fmm::check_body_length(cursor.header, end_lc);
+            if (use_index) {
+                write_index(cursor, blocks);
+            }
+        }
+
+        // concatenate in file order
+        size_t nnz = 0;
+        for (const auto& part : parts) {
+            nnz += part.rows.size();
+        }
+        py::array_t<IT> rows(nnz);
+        py::array_t<IT> cols(nnz);
+        py::array_t<VT> data(nnz);
+        size_t pos = 0;
+        for (const auto& part : parts) {
+            std::copy(part.rows.begin(), part.rows.end(), rows.mutable_data() + pos);
+            std::copy(part.cols.begin(), part.cols.end(), cols.mutable_data() + pos);
+            std::copy(part.values.begin(), part.values.end(), data.mutable_data() + pos);
+            pos += part.rows.size();
+        }
+
+        cursor.close();
+        return py::make_tuple(rows, cols, data);
+    }
+
+    template <typename IT>
+    py::tuple read_body_subset_indexed(read_cursor& cursor,
+                                       int64_t row_begin, int64_t row_end, int64_t col_begin, int64_t col_end,
+                                       bool use_index) {
+        // Value types match the dtypes chosen by mmread()
+        switch (cursor.header.field) {
+            case fmm::integer:
+                return read_body_subset_typed<IT, int64_t>(cursor, row_begin, row_end, col_begin, col_end,
+                                                           use_index);
+            case fmm::unsigned_integer:
+                return read_body_subset_typed<IT, uint64_t>(cursor, row_begin, row_end, col_begin, col_end,
+                                                            use_index);
+            case fmm::complex:
+                return read_body_subset_typed<IT, std::complex<double>>(cursor, row_begin, row_end, col_begin, col_end,
+                                                                        use_index);
+            default:
+                return read_body_subset_typed<IT, double>(cursor, row_begin, row_end, col_begin, col_end,
+                                                          use_index);
+        }
+    }
+}
+
+/**
+ * Read the elements of a coordinate body in rows [row_begin, row_end) and columns [col_begin, col_end).
+ *
+ * Symmetry is generalized. The returned coordinates are relative to (row_begin, col_begin), and are int32 unless the
+ * matrix dimensions need int64, like those of read_body_coo().
+ *
+ * Requires a memory-mapped file.
+ *
+ * @param use_index Whether to use the index of the file, and to save it if it had to be built.
+ * @return (row, col, data)
+ */
+py::tuple read_body_subset(read_cursor& cursor, int64_t row_begin, int64_t row_end, int64_t col_begin, int64_t col_end,
+                           bool use_index) {
+    if (!cursor.mapping) {
+        throw std::invalid_argument("Reading a subset requires a memory-mapped file.");
+    }
+    if (cursor.header.object != fmm::matrix || cursor.header.format != fmm::coordinate) {
+        throw std::invalid_argument("Reading a subset requires a coordinate matrix.");
+    }
+    if (row_begin < 0 || row_begin > row_end || row_end > cursor.header.nrows ||
+        col_begin < 0 || col_begin > col_end || col_end > cursor.header.ncols) {
+        throw std::invalid_argument("Subset is out of the bounds of the matrix.");
+    }
+
+    if (cursor.header.nrows < (1LL << 31) && cursor.header.ncols < (1LL << 31)) {
+        return read_body_subset_indexed<int32_t>(cursor, row_begin, row_end, col_begin, col_end, use_index);
+    } else {
+        return read_body_subset_indexed<int64_t>(cursor, row_begin, row_end, col_begin, col_end, use_index);
+    }
+}
+
+
+void init_read_subset(py::module_ &m) {
+    m.def("read_body_subset", &read_body_subset);
+}
@@ -0,0 +1,112 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#pragma once
+
+#include <string>
+#include <utility>
+
+#include <fast_matrix_market/fast_matrix_market.hpp>
+
+namespace fast_matrix_market {
+    /**
+     * Format CSC structures in chunks of about options.chunk_size_values elements.
+     *
+     * fmm::csc_formatter sizes its chunks by the average number of elements per column, so a few long columns can
+     * end up in a single chunk and serialize the write. This formatter takes whole columns until a chunk holds
+     * chunk_size_values elements instead, found by a binary search over the sorted column pointers.
+     */
+    template<typename LF, typename PTR_ITER, typename IND_ITER, typename VAL_ITER>
+    class balanced_csc_formatter : public csc_formatter<LF, PTR_ITER, IND_ITER, VAL_ITER> {
+        using base = csc_formatter<LF, PTR_ITER, IND_ITER, VAL_ITER>;
+    public:
+        using base::base;
+
+        class chunk {
+        public:
+            explicit chunk(LF lf,
+                           const PTR_ITER ptr_begin, const PTR_ITER ptr_iter, const PTR_ITER ptr_end,
+                           const IND_ITER ind_begin,
+                           const VAL_ITER val_begin, const VAL_ITER val_end,
+                           bool transpose) :
+                    line_formatter(lf),
+                    ptr_begin(ptr_begin), ptr_iter(ptr_iter), ptr_end(ptr_end),
+                    ind_begin(ind_begin),
+                    val_begin(val_begin), val_end(val_end),
+                    transpose(transpose) {}
+
+            std::string operator()() {
+                std::string chunk;
+                // reserve by element count, a chunk may span many empty columns
+                chunk.reserve((*ptr_end - *ptr_iter)*25);
+
+                // emit the columns [ptr_iter, ptr_end)
+                for (; ptr_iter != ptr_end; ++ptr_iter) {
+                    auto column_number = (int64_t)(ptr_iter - ptr_begin);
+
+                    // iterate over rows in column
+                    IND_ITER row_end = ind_begin + *(ptr_iter+1);
+                    IND_ITER row_iter = ind_begin + *ptr_iter;
+                    VAL_ITER val_iter = val_begin;
+                    if (val_begin != val_end) {
+                        val_iter = val_begin + *ptr_iter;
+                    }
+                    for (; row_iter != row_end; ++row_iter) {
+                        int64_t lf_row = *row_iter;
+                        int64_t lf_col = column_number;
+                        if (transpose) {
+                            std::swap(lf_row, lf_col);
+                        }
+
+                        if (val_iter != val_end) {
+                            chunk += line_formatter.coord_matrix(lf_row, lf_col, *val_iter);
+                            ++val_iter;
+                        } else {
+                            chunk += line_formatter.coord_matrix_pattern(lf_row, lf_col);
+                        }
+                    }
+                }
+
+                return chunk;
+            }
+
+            LF line_formatter;
+            PTR_ITER ptr_begin, ptr_iter, ptr_end;
+            IND_ITER ind_begin;
+            VAL_ITER val_begin, val_end;
+            bool transpose;
+        };
+
+        chunk next_chunk(const write_options& options) {
+            // Take whole columns until the chunk holds chunk_size_values elements. The column pointers are sorted,
+            // so binary search for the first column end past that.
+            const auto target = (int64_t)*this->ptr_iter + (int64_t)options.chunk_size_values;
+            PTR_ITER lo = this->ptr_iter + 1;
+            PTR_ITER hi = this->ptr_end;
+            while (lo < hi) {
+                PTR_ITER mid = lo + (hi - lo) / 2;
+                if ((int64_t)*mid < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            PTR_ITER ptr_chunk_end = lo;
+
+            chunk c(this->line_formatter,
+                    this->ptr_begin, this->ptr_iter, ptr_chunk_end,
+                    this->ind_begin,
+                    this->val_begin, this->val_end,
+                    this->transpose);
+
+            this->ptr_iter = ptr_chunk_end;
+
+            return c;
+        }
+    };
+
+    template<typename LF, typename PTR_ITER, typename IND_ITER, typename VAL_ITER>
+    balanced_csc_formatter(LF, PTR_ITER, PTR_ITER, IND_ITER, IND_ITER, VAL_ITER, VAL_ITER, bool)
+        -> balanced_csc_formatter<LF, PTR_ITER, IND_ITER, VAL_ITER>;
+}
@@ -0,0 +1,590 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#pragma once
+
+/**
+ * gzip and zstd compressed streams that (de)compress in a thread pool.
+ *
+ * Compressed data is split into units that can be decoded independently: gzip members whose header records the
+ * member size (written by compressing_ostream, or BGZF blocks), and zstd frames. Up to a few units ahead of the
+ * reader are decompressed concurrently. Anything else, such as a single-member gzip file written by `gzip`, is
+ * decompressed sequentially in the reading thread, which is still faster than decompressing in Python.
+ *
+ * Writing compresses blocks of compressing_ostream::block_size bytes concurrently, each into its own gzip member
+ * or zstd frame, so that the files can be decompressed in parallel too.
+ *
+ * Enable codecs with FMM_SCIPY_HAVE_ZLIB and FMM_SCIPY_HAVE_ZSTD.
+ */
+
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#ifdef FMM_SCIPY_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <fast_matrix_market/fast_matrix_market.hpp>
+#include <fast_matrix_market/thirdparty/task_thread_pool.hpp>
+
+namespace compressed {
+    namespace fmm = fast_matrix_market;
+
+    enum codec {none, gzip, zstd};
+
+    /**
+     * Codec of a file from its first bytes.
+     */
+    inline codec detect_codec(std::string_view magic) {
+        if (magic.size() >= 2 && magic[0] == '\x1f' && magic[1] == '\x8b') {
+            return gzip;
+        }
+        if (magic.size() >= 4 && magic.substr(0, 4) == std::string_view("\x28\xb5\x2f\xfd", 4)) {
+            return zstd;
+        }
+        return none;
+    }
+
+    /**
+     * Codec to write a file with, from its extension.
+     */
+    inline codec codec_for_filename(const std::string& filename) {
+        auto ends_with = [&](std::string_view ext) {
+            return filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+        };
+        if (ends_with(".gz")) {
+            return gzip;
+        }
+        if (ends_with(".zst")) {
+            return zstd;
+        }
+        return none;
+    }
+
+    inline const char* codec_name(codec c) {
+        switch (c) {
+            case gzip: return "gzip";
+            case zstd: return "zstd";
+            default: return "none";
+        }
+    }
+
+    inline bool codec_supported(codec c) {
+        switch (c) {
+            case none: return true;
+#ifdef FMM_SCIPY_HAVE_ZLIB
+            case gzip: return true;
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+            case zstd: return true;
+#endif
+            default: return false;
+        }
+    }
+
+    inline uint64_t load_le(const char* p, int bytes) {
+        uint64_t ret = 0;
+        for (int i = bytes - 1; i >= 0; --i) {
+            ret = (ret << 8) | (unsigned char)p[i];
+        }
+        return ret;
+    }
+
+    inline void store_le(char* p, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            p[i] = (char)(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    /**
+     * Size of the gzip header written by compressing_ostream: the 10 byte fixed header, XLEN and one 'FM' subfield
+     * that holds the 8 byte size of the whole member.
+     */
+    constexpr size_t gzip_header_size = 10 + 2 + 4 + 8;
+
+    /**
+     * Size of the gzip member at the start of data, if its header records it.
+     *
+     * @return 0 if the header does not record the size.
+     */
+    inline size_t gzip_member_size(std::string_view data) {
+        const int FEXTRA = 4;
+        if (data.size() < 12 || detect_codec(data) != gzip || data[2] != 8 || (data[3] & FEXTRA) == 0) {
+            return 0;
+        }
+        size_t xlen = load_le(data.data() + 10, 2);
+        std::string_view extra = data.substr(12, std::min(xlen, data.size() - 12));
+
+        while (extra.size() >= 4) {
+            size_t len = load_le(extra.data() + 2, 2);
+            if (extra.size() < 4 + len) {
+                break;
+            }
+            size_t size = 0;
+            if (extra[0] == 'F' && extra[1] == 'M' && len == 8) {
+                size = load_le(extra.data() + 4, 8);
+            } else if (extra[0] == 'B' && extra[1] == 'C' && len == 2) {
+                // BGZF block
+                size = load_le(extra.data() + 4, 2) + 1;
+            }
+            if (size > 0) {
+                return (size >= 12 + xlen + 8 && size <= data.size()) ? size : 0;
+            }
+            extra = extra.substr(4 + len);
+        }
+        return 0;
+    }
+
+    /**
+     * Decompresses a compressed file held in memory, such as a memory mapping.
+     */
+    class decompressing_streambuf : public std::streambuf {
+    public:
+        /**
+         * @param input compressed data. `input_owner` keeps it alive.
+         * @param num_threads 0 for all cores.
+         */
+        decompressing_streambuf(codec c, std::string_view input, std::shared_ptr<void> input_owner, int num_threads)
+                : c(c), input(input), input_owner(std::move(input_owner)), pool(num_threads < 0 ? 0 : num_threads) {
+            if (!codec_supported(c) || c == none) {
+                throw fmm::invalid_argument(std::string(codec_name(c)) + " compression is not supported by this build.");
+            }
+            max_inflight = 2 * pool.get_num_threads();
+        }
+
+        ~decompressing_streambuf() override {
+            // Units that have not been started are not needed any more.
+            pool.clear_task_queue();
+            end_sequential();
+        }
+
+    protected:
+        int_type underflow() override {
+            while (gptr() == egptr()) {
+                if (in_sequential) {
+                    if (decode_sequential()) {
+                        break;
+                    }
+                    end_sequential();
+                    pending.pop_front();
+                    continue;
+                }
+
+                schedule();
+                if (pending.empty()) {
+                    return traits_type::eof();
+                }
+
+                unit& u = pending.front();
+                if (u.result.valid()) {
+                    buffer = u.result.get();
+                    pending.pop_front();
+                    setg(buffer.data(), buffer.data(), buffer.data() + buffer.size());
+                } else {
+                    begin_sequential(u);
+                }
+            }
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        /**
+         * A piece of the input that is decompressed either in the pool (result is valid) or sequentially.
+         */
+        struct unit {
+            std::string_view data;
+            std::future<std::string> result;
+        };
+
+        /**
+         * Split more of the input into units and start decompressing them, up to max_inflight units ahead.
+         */
+        void schedule() {
+            while (pending.size() < max_inflight && scan_pos < input.size()) {
+                std::string_view rest = input.substr(scan_pos);
+                unit u;
+                size_t size = 0;
+                bool parallel = false;
+
+                if (c == gzip) {
+                    size = gzip_member_size(rest);
+                    parallel = size > 0;
+                    if (!parallel) {
+                        // the end of this member is only known after decompressing it
+                        size = rest.size();
+                    }
+                } else {
+#ifdef FMM_SCIPY_HAVE_ZSTD
+                    size = ZSTD_findFrameCompressedSize(rest.data(), rest.size());
+                    if (ZSTD_isError(size)) {
+                        throw fmm::invalid_mm("Corrupt zstd stream.");
+                    }
+                    auto content_size = ZSTD_getFrameContentSize(rest.data(), size);
+                    parallel = content_size <= max_unit_size;
+#endif
+                }
+
+                u.data = rest.substr(0, size);
+                if (parallel) {
+                    u.result = pool.submit([this](std::string_view data) { return decompress_unit(data); }, u.data);
+                }
+                pending.push_back(std::move(u));
+                scan_pos += size;
+            }
+        }
+
+        /**
+         * Decompress one independent unit. Runs in the pool.
+         */
+        std::string decompress_unit(std::string_view data) const {
+            std::string out;
+            if (c == gzip) {
+#ifdef FMM_SCIPY_HAVE_ZLIB
+                // ISIZE: uncompressed size modulo 2^32. It is only a hint, capped by the largest expansion deflate
+                // allows, and the loop below grows the buffer if it is too small. One more byte lets inflate() see
+                // the end of the member.
+                uint64_t isize = load_le(data.data() + data.size() - 4, 4);
+                out.resize(std::min<uint64_t>(isize, max_deflate_ratio * data.size()) + 1);
+                z_stream zs{};
+                if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+                    throw fmm::fmm_error("Cannot initialize zlib.");
+                }
+                zs.next_in = (Bytef*)data.data();
+                zs.avail_in = (uInt)data.size();
+                int ret;
+                size_t produced = 0;
+                do {
+                    if (produced == out.size()) {
+                        out.resize(std::max((size_t)1024, 2 * out.size()));
+                    }
+                    zs.next_out = (Bytef*)out.data() + produced;
+                    zs.avail_out = (uInt)std::min(out.size() - produced, (size_t)UINT32_MAX);
+                    ret = inflate(&zs, Z_NO_FLUSH);
+                    produced = (char*)zs.next_out - out.data();
+                } while (ret == Z_OK);
+                inflateEnd(&zs);
+                if (ret != Z_STREAM_END || zs.avail_in != 0) {
+                    throw fmm::invalid_mm("Corrupt gzip stream.");
+                }
+                out.resize(produced);
+#endif
+            } else {
+#ifdef FMM_SCIPY_HAVE_ZSTD
+                out.resize(ZSTD_getFrameContentSize(data.data(), data.size()));
+                size_t ret = ZSTD_decompress(out.data(), out.size(), data.data(), data.size());
+                if (ZSTD_isError(ret) || ret != out.size()) {
+                    throw fmm::invalid_mm("Corrupt zstd stream.");
+                }
+#endif
+            }
+            return out;
+        }
+
+        void begin_sequential(const unit& u) {
+            in_sequential = true;
+            seq_done = false;
+            seq_input = u.data;
+            buffer.resize(sequential_piece_size);
+#ifdef FMM_SCIPY_HAVE_ZLIB
+            if (c == gzip) {
+                zs = z_stream{};
+                if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+                    throw fmm::fmm_error("Cannot initialize zlib.");
+                }
+                zs.next_in = (Bytef*)seq_input.data();
+            }
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+            if (c == zstd) {
+                zds = ZSTD_createDStream();
+                zds_in = {seq_input.data(), seq_input.size(), 0};
+            }
+#endif
+        }
+
+        void end_sequential() {
+            if (!in_sequential) {
+                return;
+            }
+            in_sequential = false;
+#ifdef FMM_SCIPY_HAVE_ZLIB
+            if (c == gzip) {
+                inflateEnd(&zs);
+            }
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+            if (c == zstd) {
+                ZSTD_freeDStream(zds);
+                zds = nullptr;
+            }
+#endif
+        }
+
+        /**
+         * Decompress the next piece of the sequential unit into the get area.
+         *
+         * @return false once the unit is exhausted.
+         */
+        bool decode_sequential() {
+            size_t produced = 0;
+#ifdef FMM_SCIPY_HAVE_ZLIB
+            if (c == gzip) {
+                while (produced == 0) {
+                    std::string_view rest = seq_input.substr((const char*)zs.next_in - seq_input.data());
+                    // avail_in is limited to 4 GiB
+                    zs.avail_in = (uInt)std::min(rest.size(), (size_t)UINT32_MAX);
+                    if (seq_done) {
+                        // The file may consist of several members. Ignore trailing garbage, like gzip does.
+                        if (detect_codec(rest) != gzip) {
+                            return false;
+                        }
+                        inflateReset(&zs);
+                        seq_done = false;
+                    }
+                    if (rest.empty()) {
+                        throw fmm::invalid_mm("Truncated gzip stream.");
+                    }
+
+                    zs.next_out = (Bytef*)buffer.data();
+                    zs.avail_out = (uInt)buffer.size();
+                    int ret = inflate(&zs, Z_NO_FLUSH);
+                    produced = (char*)zs.next_out - buffer.data();
+                    if (ret == Z_STREAM_END) {
+                        seq_done = true;
+                    } else if (ret != Z_OK) {
+                        throw fmm::invalid_mm("Corrupt gzip stream.");
+                    }
+                }
+            }
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+            if (c == zstd) {
+                while (produced == 0 && !seq_done) {
+                    ZSTD_outBuffer out = {buffer.data(), buffer.size(), 0};
+                    size_t ret = ZSTD_decompressStream(zds, &out, &zds_in);
+                    if (ZSTD_isError(ret)) {
+                        throw fmm::invalid_mm("Corrupt zstd stream.");
+                    }
+                    produced = out.pos;
+                    // 0 means the frame is complete
+                    seq_done = (ret == 0);
+                    if (!seq_done && produced == 0 && zds_in.pos == zds_in.size) {
+                        throw fmm::invalid_mm("Truncated zstd stream.");
+                    }
+                }
+            }
+#endif
+            setg(buffer.data(), buffer.data(), buffer.data() + produced);
+            return produced > 0;
+        }
+
+        static constexpr size_t max_unit_size = 256 << 20;
+        static constexpr size_t sequential_piece_size = 1 << 20;
+        // deflate expands at most 1032:1, so more output than this is never preallocated for a gzip member
+        static constexpr uint64_t max_deflate_ratio = 1032;
+
+        codec c;
+        std::string_view input;
+        std::shared_ptr<void> input_owner;
+        size_t scan_pos = 0;
+
+        std::deque<unit> pending;
+        size_t max_inflight;
+        std::string buffer;
+
+        bool in_sequential = false;
+        bool seq_done = false;
+        std::string_view seq_input;
+#ifdef FMM_SCIPY_HAVE_ZLIB
+        z_stream zs{};
+#endif
+#ifdef FMM_SCIPY_HAVE_ZSTD
+        ZSTD_DStream* zds = nullptr;
+        ZSTD_inBuffer zds_in{};
+#endif
+
+        // Declared last so that it is destroyed first, while the units it is decompressing are still alive.
+        task_thread_pool::task_thread_pool pool;
+    };
+
+    class decompressing_istream : public std::istream {
+    public:
+        decompressing_istream(codec c, std::string_view input, std::shared_ptr<void> input_owner, int num_threads)
+                : std::istream(nullptr), buf(c, input, std::move(input_owner), num_threads) {
+            rdbuf(&buf);
+            // rethrow decompression errors instead of only setting badbit
+            exceptions(std::ios::badbit);
+        }
+
+    private:
+        decompressing_streambuf buf;
+    };
+
+    /**
+     * Compresses blocks into independent gzip members or zstd frames in a thread pool, and writes them in order.
+     */
+    class compressing_streambuf : public std::streambuf {
+    public:
+        static constexpr size_t block_size = 4 << 20;
+
+        compressing_streambuf(codec c, std::unique_ptr<std::ostream> sink, int num_threads)
+                : c(c), sink(std::move(sink)), pool(num_threads < 0 ? 0 : num_threads) {
+            if (!codec_supported(c) || c == none) {
+                throw fmm::invalid_argument(std::string(codec_name(c)) + " compression is not supported by this build.");
+            }
+            max_inflight = 2 * pool.get_num_threads();
+            new_block();
+        }
+
+        ~compressing_streambuf() override {
+            try {
+                finish();
+            } catch (...) {
+                // close() reports errors
+            }
+        }
+
+        /**
+         * Compress and write everything, then flush the sink.
+         */
+        void finish() {
+            if (finished) {
+                return;
+            }
+            finished = true;
+            if (pptr() > pbase() || (blocks_written == 0 && pending.empty())) {
+                submit_block();
+            }
+            while (!pending.empty()) {
+                write_front();
+            }
+            sink->flush();
+            if (!*sink) {
+                throw fmm::fmm_error("Error writing compressed file.");
+            }
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            submit_block();
+            new_block();
+            if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+
+    private:
+        void new_block() {
+            block.resize(block_size);
+            setp(block.data(), block.data() + block.size());
+        }
+
+        void submit_block() {
+            block.resize(pptr() - pbase());
+            pending.push_back(pool.submit([this](const std::string& data) { return compress_block(data); },
+                                          std::move(block)));
+            block = std::string();
+            setp(nullptr, nullptr);
+            while (pending.size() > max_inflight) {
+                write_front();
+            }
+        }
+
+        void write_front() {
+            std::string member = pending.front().get();
+            pending.pop_front();
+            sink->write(member.data(), (std::streamsize)member.size());
+            ++blocks_written;
+        }
+
+        std::string compress_block(const std::string& data) const {
+            std::string out;
+            if (c == gzip) {
+#ifdef FMM_SCIPY_HAVE_ZLIB
+                z_stream zs{};
+                if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                    throw fmm::fmm_error("Cannot initialize zlib.");
+                }
+                out.resize(gzip_header_size + deflateBound(&zs, (uLong)data.size()) + 8);
+
+                // header with FEXTRA set and the member size in an 'FM' subfield
+                const char fixed[10] = {'\x1f', '\x8b', 8, 4, 0, 0, 0, 0, 0, '\xff'};
+                std::memcpy(out.data(), fixed, sizeof(fixed));
+                store_le(out.data() + 10, 12, 2);
+                out[12] = 'F';
+                out[13] = 'M';
+                store_le(out.data() + 14, 8, 2);
+
+                zs.next_in = (Bytef*)data.data();
+                zs.avail_in = (uInt)data.size();
+                zs.next_out = (Bytef*)out.data() + gzip_header_size;
+                zs.avail_out = (uInt)(out.size() - gzip_header_size - 8);
+                int ret = deflate(&zs, Z_FINISH);
+                size_t size = (char*)zs.next_out - out.data();
+                deflateEnd(&zs);
+                if (ret != Z_STREAM_END) {
+                    throw fmm::fmm_error("Error compressing gzip stream.");
+                }
+
+                store_le(out.data() + size, crc32(0, (const Bytef*)data.data(), (uInt)data.size()), 4);
+                store_le(out.data() + size + 4, data.size() & 0xffffffffu, 4);
+                size += 8;
+                store_le(out.data() + 16, size, 8);
+                out.resize(size);
+#endif
+            } else {
+#ifdef FMM_SCIPY_HAVE_ZSTD
+                out.resize(ZSTD_compressBound(data.size()));
+                size_t size = ZSTD_compress(out.data(), out.size(), data.data(), data.size(), 3);
+                if (ZSTD_isError(size)) {
+                    throw fmm::fmm_error("Error compressing zstd stream.");
+                }
+                out.resize(size);
+#endif
+            }
+            return out;
+        }
+
+        codec c;
+        std::unique_ptr<std::ostream> sink;
+        std::string block;
+        std::deque<std::future<std::string>> pending;
+        size_t max_inflight;
+        size_t blocks_written = 0;
+        bool finished = false;
+
+        // Declared last so that it is destroyed first, while the blocks it is compressing are still alive.
+        task_thread_pool::task_thread_pool pool;
+    };
+
+    class compressing_ostream : public std::ostream {
+    public:
+        compressing_ostream(codec c, std::unique_ptr<std::ostream> sink, int num_threads)
+                : std::ostream(nullptr), buf(c, std::move(sink), num_threads) {
+            rdbuf(&buf);
+        }
+
+        /**
+         * Compress and write everything that has been written to the stream.
+         */
+        void close() {
+            flush();
+            buf.finish();
+        }
+
+    private:
+        compressing_streambuf buf;
+    };
+}
@@ -0,0 +1,524 @@
+// Copyright (C) 2023 Adam Lugowski. All rights reserved.
+// Use of this source code is governed by the BSD 2-clause license found in the LICENSE.txt file.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#pragma once
+
+/**
+ * Read a Matrix Market body that is already in memory, such as a memory-mapped file.
+ *
+ * The body is split into chunks that are views into it, and the chunks are parsed in place instead of being copied
+ * into the std::string chunks of the std::istream reader. These are overloads of the fast_matrix_market body
+ * readers that take a std::string_view. The chunk parsers are the library's, except that they stop at the end of
+ * their chunk instead of at a terminating NUL.
+ */
+
+#include <cstring>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fast_matrix_market/fast_matrix_market.hpp>
+
+namespace fast_matrix_market {
+    ///////////////////////////////////////////
+    // Whitespace management, bounded by the end of the chunk
+    ///////////////////////////////////////////
+
+    inline const char* skip_spaces(const char* pos, const char* end) {
+        while (pos != end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    inline const char* skip_spaces_and_newlines(const char* pos, const char* end, int64_t& line_num) {
+        pos = skip_spaces(pos, end);
+        while (pos != end && *pos == '\n') {
+            ++line_num;
+            ++pos;
+            pos = skip_spaces(pos, end);
+        }
+        return pos;
+    }
+
+    inline const char* skip_to_next_line(const char* pos, const char* end) {
+        // find the newline
+        pos = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+
+        // bump to start of next line
+        return pos == nullptr ? end : pos + 1;
+    }
+
+    ///////////////////////////////////////////
+    // Chunking
+    ///////////////////////////////////////////
+
+    /**
+     * Split a body that is already in memory, such as a memory-mapped file, into chunks of about
+     * options.chunk_size_bytes that end at line boundaries. The chunks are views into `body`, no copies are made.
+     *
+     * The parsers stop at the end of a chunk, but number parsing fallbacks may look one byte past the end of a
+     * number. The last chunk is therefore copied into `tail`, which is NUL-terminated, and viewed from there.
+     */
+    inline std::vector<std::string_view> split_chunks(std::string_view body, std::string& tail,
+                                                      const read_options &options) {
+        std::vector<std::string_view> chunks;
+        const auto chunk_size = (size_t)std::max(options.chunk_size_bytes, (int64_t)1);
+
+        size_t start = 0;
+        while (body.size() - start > chunk_size) {
+            // end the chunk after the first newline past the nominal chunk size
+            const char* nl = static_cast<const char*>(
+                std::memchr(body.data() + start + chunk_size, '\n', body.size() - start - chunk_size));
+            size_t stop = (nl == nullptr) ? body.size() : (size_t)(nl - body.data()) + 1;
+            if (stop == body.size()) {
+                break;
+            }
+            chunks.push_back(body.substr(start, stop - start));
+            start = stop;
+        }
+
+        if (start < body.size()) {
+            tail.assign(body.substr(start));
+            chunks.emplace_back(tail);
+        }
+        return chunks;
+    }
+
+    /**
+     * Find the number of total lines and empty lines in a multiline string.
+     */
+    inline std::pair<int64_t, int64_t> count_lines(std::string_view chunk) {
+        int64_t num_newlines = 0;
+        int64_t num_empty_lines = 0;
+
+        auto pos = std::cbegin(chunk);
+        auto end = std::cend(chunk);
+        auto line_start = pos;
+        for (; pos != end; ++pos) {
+            if (*pos == '\n') {
+                ++num_newlines;
+                if (is_all_spaces(line_start, pos)) {
+                    ++num_empty_lines;
+                }
+                line_start = pos + 1;
+            }
+        }
+
+        if (line_start != end) {
+            // last line does not end in newline, but it might still be empty
+            if (is_all_spaces(line_start, end)) {
+                ++num_empty_lines;
+            }
+        }
+
+        if (num_newlines == 0) {
+            // single line is still a line
+            if (chunk.empty()) {
+                num_empty_lines = 1;
+            }
+            return std::make_pair(1, num_empty_lines);
+        }
+
+        if (chunk[chunk.size()-1] != '\n') {
+            ++num_newlines;
+        }
+
+        return std::make_pair(num_newlines, num_empty_lines);
+    }
+
+    ///////////////////////////////////////////
+    // Chunk parsers
+    ///////////////////////////////////////////
+
+    template<typename HANDLER>
+    line_counts read_chunk_matrix_coordinate(std::string_view chunk, const matrix_market_header &header,
+                                             line_counts line, HANDLER &handler, const read_options &options) {
+        const char *pos = chunk.data();
+        const char *end = pos + chunk.size();
+
+        while (pos != end) {
+            try {
+                typename HANDLER::coordinate_type row, col;
+                typename HANDLER::value_type value;
+
+                pos = skip_spaces_and_newlines(pos, end, line.file_line);
+                if (pos == end) {
+                    // empty line
+                    break;
+                }
+                if (line.element_num >= header.nnz) {
+                    throw invalid_mm("Too many lines in file (file too long)");
+                }
+
+                pos = read_int(pos, end, row);
+                pos = skip_spaces(pos, end);
+                pos = read_int(pos, end, col);
+                if (header.field != pattern) {
+                    pos = skip_spaces(pos, end);
+                    read_real_or_complex(value, pos, end, header, options);
+                }
+                pos = skip_to_next_line(pos, end);
+
+                // validate
+                if (row <= 0 || static_cast<int64_t>(row) > header.nrows) {
+                    throw invalid_mm("Row index out of bounds");
+                }
+                if (col <= 0 || static_cast<int64_t>(col) > header.ncols) {
+                    throw invalid_mm("Column index out of bounds");
+                }
+
+                // Matrix Market is one-based
+                row = row - 1;
+                col = col - 1;
+
+                // Generalize symmetry
+                // This appears before the regular handler call for ExtraZeroElement handling.
+                if (header.symmetry != general && options.generalize_symmetry) {
+                    if (header.field != pattern) {
+                        generalize_symmetry_coordinate(handler, header, options, row, col, value);
+                    } else {
+                        generalize_symmetry_coordinate(handler, header, options, row, col, pattern_placeholder_type());
+                    }
+                }
+
+                if (header.field != pattern) {
+                    handler.handle(row, col, value);
+                } else {
+                    handler.handle(row, col, pattern_placeholder_type());
+                }
+
+                ++line.file_line;
+                ++line.element_num;
+            } catch (invalid_mm& inv) {
+                inv.prepend_line_number(line.file_line + 1);
+                throw;
+            }
+        }
+        return line;
+    }
+
+#ifndef FMM_NO_VECTOR
+    template<typename HANDLER>
+    line_counts read_chunk_vector_coordinate(std::string_view chunk, const matrix_market_header &header,
+                                             line_counts line, HANDLER &handler, const read_options &options) {
+        const char *pos = chunk.data();
+        const char *end = pos + chunk.size();
+
+        while (pos != end) {
+            try {
+                typename HANDLER::coordinate_type row;
+                typename HANDLER::value_type value;
+
+                pos = skip_spaces_and_newlines(pos, end, line.file_line);
+                if (pos == end) {
+                    // empty line
+                    break;
+                }
+                if (line.element_num >= header.nnz) {
+                    throw invalid_mm("Too many lines in file (file too long)");
+                }
+                pos = read_int(pos, end, row);
+                if (header.field != pattern) {
+                    pos = skip_spaces(pos, end);
+                    read_real_or_complex(value, pos, end, header, options);
+                }
+                pos = skip_to_next_line(pos, end);
+
+                // validate
+                if (row <= 0 || static_cast<int64_t>(row) > header.vector_length) {
+                    throw invalid_mm("Vector index out of bounds");
+                }
+
+                // Matrix Market is one-based
+                row = row - 1;
+
+                if (header.field != pattern) {
+                    handler.handle(row, 0, value);
+                } else {
+                    handler.handle(row, 0, pattern_placeholder_type());
+                }
+
+                ++line.file_line;
+                ++line.element_num;
+            } catch (invalid_mm& inv) {
+                inv.prepend_line_number(line.file_line + 1);
+                throw;
+            }
+        }
+        return line;
+    }
+#endif
+
+    template<typename HANDLER>
+    line_counts read_chunk_array(std::string_view chunk, const matrix_market_header &header, line_counts line,
+                                 HANDLER &handler, const read_options &options,
+                                 typename HANDLER::coordinate_type &row,
+                                 typename HANDLER::coordinate_type &col) {
+        const char *pos = chunk.data();
+        const char *end = pos + chunk.size();
+
+        if (header.symmetry == skew_symmetric) {
+            if (row == 0 && col == 0 && header.nrows > 0) {
+                // skew-symmetric matrices have zero diagonals
+//                if (test_flag(HANDLER::flags, kDense)) {
+//                    handler.handle(row, col, get_zero<typename HANDLER::value_type>());
+//                }
+                row = 1;
+            }
+        }
+
+        while (pos != end) {
+            try {
+                typename HANDLER::value_type value;
+
+                pos = skip_spaces_and_newlines(pos, end, line.file_line);
+                if (pos == end) {
+                    // empty line
+                    break;
+                }
+                if (static_cast<int64_t>(col) >= header.ncols) {
+                    throw invalid_mm("Too many values in array (file too long)");
+                }
+
+                read_real_or_complex(value, pos, end, header, options);
+                pos = skip_to_next_line(pos, end);
+
+                handler.handle(row, col, value);
+
+                if (row != col && options.generalize_symmetry) {
+                    generalize_symmetry_array(handler, header, row, col, value);
+                }
+
+                // Matrix Market is column-major, advance down the column
+                ++row;
+                if (static_cast<int64_t>(row) == header.nrows) {
+                    ++col;
+                    if (header.symmetry == general) {
+                        row = 0;
+                    } else {
+                        row = col;
+                        if (header.symmetry == skew_symmetric) {
+                            // skew-symmetric matrices have zero diagonals
+//                            if (test_flag(HANDLER::flags, kDense)) {
+//                                handler.handle(row, col, get_zero<typename HANDLER::value_type>());
+//                            }
+                            if (static_cast<int64_t>(row) < header.nrows-1) {
+                                ++row;
+                            }
+                        }
+                    }
+                }
+
+                ++line.file_line;
+                ++line.element_num;
+            } catch (invalid_mm& inv) {
+                inv.prepend_line_number(line.file_line + 1);
+                throw;
+            }
+        }
+        return line;
+    }
+
+    ///////////////////////////////////////////
+    // Read the body
+    ///////////////////////////////////////////
+
+    /**
+     * Verify that a body described by `header` can be read into HANDLER, and decide whether to read it in parallel.
+     */
+    template <typename HANDLER>
+    bool select_body_threads(const matrix_market_header& header, const read_options& options) {
+#ifdef FMM_NO_VECTOR
+        if (header.object == vector) {
+            throw no_vector_support("Vector Matrix Market files not supported.");
+        }
+#endif
+
+        // Verify generalize symmetry is compatible with this file.
+        if (header.symmetry != general && options.generalize_symmetry) {
+            if (header.object != matrix) {
+                throw invalid_mm("Invalid Symmetry: vectors cannot have symmetry. Set generalize_symmetry=false to disregard this symmetry.");
+            }
+        }
+
+        if (header.format == array && header.field == pattern) {
+            throw invalid_mm("Array matrices may not be pattern.");
+        }
+
+        bool threads = options.parallel_ok && options.num_threads != 1 && test_flag(HANDLER::flags, kParallelOk);
+
+        threads = limit_parallelism_for_value_type<typename HANDLER::value_type>(threads);
+
+        if (header.symmetry != general && header.format == array) {
+            // Parallel array loader does not handle symmetry
+            threads = false;
+        }
+
+        if (header.format == coordinate && test_flag(HANDLER::flags, kDense)) {
+            // Potential race condition if the file contains duplicates.
+            threads = false;
+        }
+
+        return threads;
+    }
+
+    /**
+     * Verify the file is not truncated.
+     */
+    inline void check_body_length(const matrix_market_header& header, const line_counts& lc) {
+        if (lc.element_num < header.nnz) {
+            if (!(header.symmetry != general && header.format == array)) {
+                throw invalid_mm(std::string("Truncated file. Expected another ") +
+                                 std::to_string(header.nnz - lc.element_num) + " lines.");
+            }
+        }
+    }
+
+    /**
+     * Parse one chunk whose first line has counts `lc`. Runs in a worker thread.
+     */
+    template <typename HANDLER, compile_format FORMAT>
+    void parse_chunk(std::string_view chunk, const matrix_market_header& header, const line_counts& lc,
+                     HANDLER& chunk_handler, const read_options& options) {
+        if (header.format == array) {
+            if constexpr ((FORMAT & compile_array_only) == compile_array_only) {
+                // compute the starting row/column for this array chunk
+                typename HANDLER::coordinate_type row = lc.element_num % header.nrows;
+                typename HANDLER::coordinate_type col = lc.element_num / header.nrows;
+
+                read_chunk_array(chunk, header, lc, chunk_handler, options, row, col);
+            } else {
+                throw support_not_selected("Matrix is array but reading array files not enabled for this method.");
+            }
+        } else if (header.object == matrix) {
+            if constexpr ((FORMAT & compile_coordinate_only) == compile_coordinate_only) {
+                read_chunk_matrix_coordinate(chunk, header, lc, chunk_handler, options);
+            } else {
+                throw support_not_selected("Matrix is coordinate but reading coordinate files not enabled for this method.");
+            }
+        } else {
+#ifdef FMM_NO_VECTOR
+            throw no_vector_support("Vector Matrix Market files not supported.");
+#else
+            read_chunk_vector_coordinate(chunk, header, lc, chunk_handler, options);
+#endif
+        }
+    }
+
+    /**
+     * Parse a body that is already in memory and split by split_chunks(), such as a memory-mapped file.
+     *
+     * The chunks are parsed in place. All of them are available up front, so line counting and parsing both
+     * run in the pool and no thread is tied up reading the input.
+     */
+    template <typename HANDLER, compile_format FORMAT = compile_all>
+    line_counts read_body_threads(const std::vector<std::string_view>& chunks, const matrix_market_header& header,
+                                  HANDLER& handler, const read_options& options = {}) {
+        line_counts lc{header.header_line_count, 0};
+
+        task_thread_pool::task_thread_pool pool(options.num_threads);
+
+        int generalizing_symmetry_factor = (header.symmetry != general && options.generalize_symmetry) ? 2 : 1;
+
+        std::vector<std::future<std::pair<int64_t, int64_t>>> line_count_futures;
+        line_count_futures.reserve(chunks.size());
+        for (auto chunk : chunks) {
+            line_count_futures.push_back(pool.submit([chunk]() { return count_lines(chunk); }));
+        }
+
+        // Chunk offsets are known once the line counts of all preceding chunks are.
+        std::vector<std::future<void>> parse_futures;
+        parse_futures.reserve(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            auto [lines, empties] = line_count_futures[i].get();
+
+            if (lc.element_num > header.nnz) {
+                throw invalid_mm("File too long", lc.file_line + 1);
+            }
+            auto chunk_handler = handler.get_chunk_handler(lc.element_num * generalizing_symmetry_factor);
+            auto chunk = chunks[i];
+            parse_futures.push_back(pool.submit([=]() mutable {
+                parse_chunk<HANDLER, FORMAT>(chunk, header, lc, chunk_handler, options);
+            }));
+
+            lc.file_line += lines;
+            lc.element_num += lines - empties;
+        }
+
+        // This will throw any parse errors.
+        for (auto& f : parse_futures) {
+            f.get();
+        }
+
+        return lc;
+    }
+
+    /**
+     * Read a body that is already in memory, such as a memory-mapped file, with no automatic adaptations.
+     *
+     * The text is parsed in place, without copying it into chunk buffers first.
+     */
+    template <typename HANDLER, compile_format FORMAT = compile_all>
+    void read_matrix_market_body_no_adapters(std::string_view body, const matrix_market_header& header,
+                                             HANDLER& handler, const read_options& options = {}) {
+        bool threads = select_body_threads<HANDLER>(header, options);
+
+        std::string tail;
+        std::vector<std::string_view> chunks = split_chunks(body, tail, options);
+
+        line_counts lc{header.header_line_count, 0};
+        if (threads) {
+            lc = read_body_threads<HANDLER, FORMAT>(chunks, header, handler, options);
+        } else if (header.format == coordinate) {
+            if constexpr ((FORMAT & compile_coordinate_only) == compile_coordinate_only) {
+                for (auto chunk : chunks) {
+                    if (header.object == matrix) {
+                        lc = read_chunk_matrix_coordinate(chunk, header, lc, handler, options);
+                    } else {
+#ifdef FMM_NO_VECTOR
+                        throw no_vector_support("Vector Matrix Market files not supported.");
+#else
+                        lc = read_chunk_vector_coordinate(chunk, header, lc, handler, options);
+#endif
+                    }
+                }
+            } else {
+                throw support_not_selected("Matrix is coordinate but reading coordinate files not enabled for this method.");
+            }
+        } else {
+            if constexpr ((FORMAT & compile_array_only) == compile_array_only) {
+                typename HANDLER::coordinate_type row = 0;
+                typename HANDLER::coordinate_type col = 0;
+                for (auto chunk : chunks) {
+                    lc = read_chunk_array(chunk, header, lc, handler, options, row, col);
+                }
+            } else {
+                throw support_not_selected("Matrix is array but reading array files not enabled for this method.");
+            }
+        }
+
+        check_body_length(header, lc);
+    }
+
+    /**
+     * Main body reader entry point for a body that is already in memory, such as a memory-mapped file.
+     *
+     * Same adaptations as the std::istream version.
+     */
+    template <typename HANDLER, compile_format FORMAT = compile_all>
+    void read_matrix_market_body(std::string_view body, const matrix_market_header& header,
+                                 HANDLER& handler,
+                                 typename HANDLER::value_type pattern_value,
+                                 const read_options& options = {}) {
+        if (header.field == complex && !is_complex<typename HANDLER::value_type>::value) {
+            // the file is complex but the values are not
+            throw complex_incompatible("Matrix Market file has complex fields but passed data structure cannot handle complex values.");
+        }
+
+        auto fwd_handler = pattern_parse_adapter<HANDLER>(handler, pattern_value);
+        read_matrix_market_body_no_adapters<decltype(fwd_handler), FORMAT>(body, header, fwd_handler, options);
+    }
+}
@@ -784,6 +784,247 @@ def test_gh18123(tmp_path):
     mmread(test_file)
 
 
+@pytest.mark.parametrize('trailer', ['\n', '', '\n\n  \n'])
+def test_fmm_read_file_chunks(tmp_path, trailer):
+    # Files are memory-mapped and parsed in place, in chunks split at line
+    # boundaries. Compare with reading the same text from a stream.
+    rng = np.random.default_rng(1234)
+    n = 150000
+    rows = rng.integers(1, 1001, n)
+    cols = rng.integers(1, 801, n)
+    vals = rng.random(n)
+    lines = [f"{r} {c} {v!r}" for r, c, v in zip(rows.tolist(), cols.tolist(),
+                                                 vals.tolist())]
+    header = f"%%MatrixMarket matrix coordinate real general\n1000 800 {n}\n"
+    text = header + "\n".join(lines) + trailer
+    test_file = tmp_path / "chunks.mtx"
+    test_file.write_text(text)
+
+    from_file = fmm.mmread(test_file)
+    from_stream = fmm.mmread(io.BytesIO(text.encode('ascii')))
+    assert_array_equal(from_file.row, rows - 1)
+    assert_array_equal(from_file.col, cols - 1)
+    assert_array_equal(from_file.data, vals)
+    assert_array_equal(from_stream.data, from_file.data)
+
+    # truncated file
+    test_file.write_text(header + "\n".join(lines[:-3]) + trailer)
+    with pytest.raises(ValueError, match='Truncated'):
+        fmm.mmread(test_file)
+
+
+def _fmm_is_cached(source):
+    cursor, _ = fmm._get_read_cursor(source)
+    try:
+        return cursor.cached
+    finally:
+        cursor.close()
+
+
+def test_fmm_read_cache(tmp_path, monkeypatch):
+    a = scipy.sparse.random(20, 30, density=0.2, format='coo', random_state=1)
+    test_file = tmp_path / "cached.mtx"
+    cache_file = tmp_path / "cached.mtx.fmmcache"
+    fmm.mmwrite(test_file, a)
+
+    # only written on request
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), a.toarray())
+    assert not cache_file.exists()
+
+    monkeypatch.setattr(fmm, "WRITE_CACHE", True)
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), a.toarray())
+    assert cache_file.exists()
+
+    # read back from the cache
+    b = fmm.mmread(test_file)
+    assert _fmm_is_cached(test_file)
+    assert_array_almost_equal(b.toarray(), a.toarray())
+    b.data *= 2  # the cache is mapped copy-on-write
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), a.toarray())
+
+    # and only read while caching is enabled
+    monkeypatch.setattr(fmm, "WRITE_CACHE", False)
+    assert not _fmm_is_cached(test_file)
+    monkeypatch.setattr(fmm, "WRITE_CACHE", True)
+
+    # a modified file invalidates the cache
+    fmm.mmwrite(test_file, 3 * a)
+    os.utime(test_file, ns=(0, 0))
+    assert not _fmm_is_cached(test_file)
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), 3 * a.toarray())
+    assert _fmm_is_cached(test_file)
+
+    # so do modified arrays
+    with open(cache_file, "r+b") as f:
+        f.seek(-1, os.SEEK_END)
+        last = f.read(1)
+        f.seek(-1, os.SEEK_END)
+        f.write(bytes([last[0] ^ 1]))
+    assert not _fmm_is_cached(test_file)
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), 3 * a.toarray())
+
+    # symmetric matrices are cached before symmetry is generalized
+    s = (a @ a.T).tocoo()
+    fmm.mmwrite(test_file, s, symmetry="symmetric")
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), s.toarray())
+    assert _fmm_is_cached(test_file)
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), s.toarray())
+
+
+@pytest.mark.parametrize('symmetry', ['general', 'symmetric', 'skew-symmetric'])
+@pytest.mark.parametrize('sparse_format', ['csr', 'csc'])
+def test_fmm_read_csr(tmp_path, symmetry, sparse_format):
+    a = scipy.sparse.random(40, 40, density=0.3, format='coo', random_state=2)
+    if symmetry == 'symmetric':
+        a = a + a.T
+    elif symmetry == 'skew-symmetric':
+        a = a - a.T
+    a = a.tocoo()
+    test_file = tmp_path / "csr.mtx"
+    fmm.mmwrite(test_file, a, symmetry=symmetry)
+
+    # read directly from the memory-mapped file, and via COO from a stream
+    b = fmm.mmread(test_file, sparse_format=sparse_format)
+    with open(test_file, 'rb') as f:
+        c = fmm.mmread(f, sparse_format=sparse_format)
+    for m in (b, c):
+        assert m.format == sparse_format
+        assert m.has_canonical_format
+        assert_array_almost_equal(m.toarray(), a.toarray())
+
+    assert_raises(ValueError, fmm.mmread, test_file, sparse_format='dia')
+
+
+@pytest.mark.parametrize('symmetry', ['general', 'symmetric'])
+def test_fmm_read_subset(tmp_path, monkeypatch, symmetry):
+    a = scipy.sparse.random(3000, 2000, density=0.02, format='csr', random_state=5)
+    if symmetry == 'symmetric':
+        a = (a[:2000] + a[:2000].T).tocsr()
+    test_file = tmp_path / "subset.mtx"
+    fmm.mmwrite(test_file, a, symmetry=symmetry)
+    dense = a.toarray()
+
+    monkeypatch.setattr(fmm, "WRITE_INDEX", True)
+    for rows, cols in [((500, 700), None), (None, slice(-10, None)),
+                       ((100, 200), (1900, 2000)), ((5, 5), None)]:
+        r = slice(*rows) if isinstance(rows, tuple) else (rows or slice(None))
+        c = slice(*cols) if isinstance(cols, tuple) else (cols or slice(None))
+        expected = dense[r, c]
+        # the first read builds the index, the second one uses it
+        for _ in range(2):
+            b = fmm.mmread(test_file, rows=rows, cols=cols, sparse_format='csr')
+            assert b.format == 'csr'
+            assert_array_almost_equal(b.toarray(), expected)
+        assert (tmp_path / "subset.mtx.fmmindex").exists()
+        with open(test_file, 'rb') as f:
+            assert_array_almost_equal(fmm.mmread(f, rows=rows, cols=cols).toarray(), expected)
+
+    # array files are sliced
+    fmm.mmwrite(tmp_path / "dense.mtx", dense[:50, :40])
+    assert_array_almost_equal(fmm.mmread(tmp_path / "dense.mtx", rows=(10, 20), cols=(0, 5)),
+                              dense[10:20, :5])
+    assert_raises(ValueError, fmm.mmread, test_file, rows=slice(0, 10, 2))
+
+
+def test_fmm_read_subset_skips_blocks(tmp_path, monkeypatch):
+    a = scipy.sparse.random(3000, 2000, density=0.02, format='csr', random_state=5)
+    test_file = tmp_path / "subset.mtx"
+    fmm.mmwrite(test_file, a)
+    expected = a[:10].toarray()
+
+    monkeypatch.setattr(fmm, "WRITE_INDEX", True)
+    assert_array_almost_equal(fmm.mmread(test_file, rows=(0, 10)).toarray(), expected)
+
+    # damage the last line, without changing the size or modification time of the file
+    stat = test_file.stat()
+    text = test_file.read_bytes()
+    last = text.rstrip(b'\n').rindex(b'\n') + 1
+    test_file.write_bytes(text[:last] + b'x' + text[last + 1:])
+    os.utime(test_file, ns=(stat.st_atime_ns, stat.st_mtime_ns))
+
+    # an indexed read does not parse the part of the file that holds it
+    assert_array_almost_equal(fmm.mmread(test_file, rows=(0, 10)).toarray(), expected)
+
+    # and the index is only used while WRITE_INDEX is set
+    monkeypatch.setattr(fmm, "WRITE_INDEX", False)
+    with pytest.raises(ValueError):
+        fmm.mmread(test_file, rows=(0, 10))
+
+
+@pytest.mark.parametrize('codec, ext', [('gzip', '.gz'), ('zstd', '.zst')])
+def test_fmm_compressed_roundtrip(tmp_path, codec, ext):
+    from scipy.io._fast_matrix_market import _fmm_core
+    if codec not in _fmm_core.codecs:
+        pytest.skip(f"built without {codec}")
+
+    a = scipy.sparse.random(300, 200, density=0.1, format='coo', random_state=3)
+    test_file = tmp_path / ("compressed.mtx" + ext)
+    fmm.mmwrite(test_file, a)
+
+    magic = test_file.read_bytes()[:4]
+    assert magic.startswith(b'\x1f\x8b' if codec == 'gzip' else b'\x28\xb5\x2f\xfd')
+    assert_array_almost_equal(fmm.mmread(test_file).toarray(), a.toarray())
+    assert fmm.mminfo(test_file)[:3] == (300, 200, a.nnz)
+
+    if codec == 'gzip':
+        # the parallel gzip members are readable by any gzip reader
+        import gzip
+        with gzip.open(test_file, 'rb') as f:
+            assert_array_almost_equal(fmm.mmread(f).toarray(), a.toarray())
+
+        # and any gzip file is readable natively
+        plain = tmp_path / "plain.mtx"
+        fmm.mmwrite(plain, a)
+        with open(plain, 'rb') as f_in, gzip.open(tmp_path / "plain.mtx.gz", 'wb') as f_out:
+            f_out.write(f_in.read())
+        assert_array_almost_equal(fmm.mmread(tmp_path / "plain.mtx.gz").toarray(),
+                                  a.toarray())
+
+
+def test_fmm_write_zstd_unsupported(tmp_path):
+    from scipy.io._fast_matrix_market import _fmm_core
+    if 'zstd' in _fmm_core.codecs:
+        pytest.skip("built with zstd")
+
+    # not silently written uncompressed
+    test_file = tmp_path / "compressed.mtx.zst"
+    with pytest.raises(ValueError, match='zstd'):
+        fmm.mmwrite(test_file, scipy.sparse.eye(3, format='coo'))
+    assert not test_file.exists()
+
+
+@pytest.mark.parametrize('sparse_format', ['csr', 'csc'])
+@pytest.mark.parametrize('field', [None, 'pattern', 'integer'])
+def test_fmm_write_csr(sparse_format, field, monkeypatch):
+    # rows of very different lengths, including empty ones
+    rng = np.random.default_rng(4)
+    a = scipy.sparse.random(3000, 200, density=0.05, format='lil', random_state=rng)
+    a[:5, :] = rng.integers(1, 10, size=(5, 200))
+    a[100:400, :] = 0
+    a = a.asformat(sparse_format)
+
+    expected = io.BytesIO()
+    fmm.mmwrite(expected, a.tocoo(), field=field)
+    for parallelism in (1, 4):
+        monkeypatch.setattr(fmm, "PARALLELISM", parallelism)
+        actual = io.BytesIO()
+        fmm.mmwrite(actual, a, field=field)
+        assert actual.getvalue() == expected.getvalue()
+
+    # compressed storage with spare capacity after the last element
+    b = a.copy()
+    b.indices = np.concatenate([b.indices, np.zeros(3, dtype=b.indices.dtype)])
+    b.data = np.concatenate([b.data, np.ones(3)])
+    actual = io.BytesIO()
+    fmm.mmwrite(actual, b, field=field)
+    assert actual.getvalue() == expected.getvalue()
+
+    # empty matrix
+    actual = io.BytesIO()
+    fmm.mmwrite(actual, scipy.sparse.csr_array((0, 5)))
+    assert_equal(fmm.mmread(io.BytesIO(actual.getvalue())).shape, (0, 5))
+
+
 def test_threadpoolctl():
     try:
         import threadpoolctl
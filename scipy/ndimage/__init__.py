@@ -117,6 +117,15 @@ Morphology
    morphological_laplace
    white_tophat
 
+Parallel execution
+==================
+
+.. autosummary::
+   :toctree: generated/
+
+   set_workers - Context manager to set the number of workers
+   get_workers - Get the current number of workers
+
 """
 
 # Copyright (C) 2003-2005 Peter J. Verveer
@@ -154,6 +163,7 @@ from ._fourier import *  # noqa: F401 F403
 from ._interpolation import *  # noqa: F401 F403
 from ._measurements import *  # noqa: F401 F403
 from ._morphology import *  # noqa: F401 F403
+from ._workers import *  # noqa: F401 F403
 
 # Deprecated namespaces, to be removed in v2.0.0
 from . import filters  # noqa: F401
@@ -227,6 +227,16 @@ def _prepad_for_spline_filter(input, mode, cval):
     return padded, npad
 
 
+def _spline_filter_dtype(input, output):
+    # The spline coefficients of float32 inputs are kept in float32 when
+    # the output is float32 too, which halves the memory used and moved by
+    # the prefilter and interpolation. A float64 output keeps float64
+    # coefficients, as requested.
+    if input.dtype == numpy.float32 and output.dtype == numpy.float32:
+        return numpy.float32
+    return numpy.float64
+
+
 @docfiller
 def geometric_transform(input, mapping, output_shape=None,
                         output=None, order=3,
@@ -359,7 +369,8 @@ def geometric_transform(input, mapping, output_shape=None,
 
     if prefilter and order > 1:
         padded, npad = _prepad_for_spline_filter(input, mode, cval)
-        filtered = spline_filter(padded, order, output=numpy.float64,
+        filtered = spline_filter(padded, order,
+                                 output=_spline_filter_dtype(padded, output),
                                  mode=mode)
     else:
         npad = 0
@@ -466,7 +477,8 @@ def map_coordinates(input, coordinates, output=None, order=3,
         return output
     if prefilter and order > 1:
         padded, npad = _prepad_for_spline_filter(input, mode, cval)
-        filtered = spline_filter(padded, order, output=numpy.float64,
+        filtered = spline_filter(padded, order,
+                                 output=_spline_filter_dtype(padded, output),
                                  mode=mode)
     else:
         npad = 0
@@ -585,7 +597,8 @@ def affine_transform(input, matrix, offset=0.0, output_shape=None,
         return output
     if prefilter and order > 1:
         padded, npad = _prepad_for_spline_filter(input, mode, cval)
-        filtered = spline_filter(padded, order, output=numpy.float64,
+        filtered = spline_filter(padded, order,
+                                 output=_spline_filter_dtype(padded, output),
                                  mode=mode)
     else:
         npad = 0
@@ -726,7 +739,8 @@ def shift(input, shift, output=None, order=3, mode='constant', cval=0.0,
         return output
     if prefilter and order > 1:
         padded, npad = _prepad_for_spline_filter(input, mode, cval)
-        filtered = spline_filter(padded, order, output=numpy.float64,
+        filtered = spline_filter(padded, order,
+                                 output=_spline_filter_dtype(padded, output),
                                  mode=mode)
     else:
         npad = 0
@@ -836,7 +850,8 @@ def zoom(input, zoom, output=None, order=3, mode='constant', cval=0.0,
         return output
     if prefilter and order > 1:
         padded, npad = _prepad_for_spline_filter(input, mode, cval)
-        filtered = spline_filter(padded, order, output=numpy.float64,
+        filtered = spline_filter(padded, order,
+                                 output=_spline_filter_dtype(padded, output),
                                  mode=mode)
     else:
         npad = 0
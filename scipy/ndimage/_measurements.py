@@ -31,7 +31,6 @@
 import numpy
 import numpy as np
 from . import _ni_support
-from . import _ni_label
 from . import _nd_image
 from . import _morphology
 
@@ -41,7 +40,7 @@ __all__ = ['label', 'find_objects', 'labeled_comprehension', 'sum', 'mean',
            'histogram', 'watershed_ift', 'sum_labels', 'value_indices']
 
 
-def label(input, structure=None, output=None):
+def label(input, structure=None, output=None, *, return_objects=False):
     """
     Label features in an array.
 
@@ -71,6 +70,11 @@ def label(input, structure=None, output=None):
         operate in-place, by passing output=input.
         Note that the output must be able to store the largest label, or this
         function will raise an Exception.
+    return_objects : bool, optional
+        If True, also return the bounding box, the size and the centroid of
+        each feature, gathered while labeling. Default is False.
+
+        .. versionadded:: 1.12.0
 
     Returns
     -------
@@ -86,6 +90,20 @@ def label(input, structure=None, output=None):
         If `output` is a ndarray, then it will be updated with values in
         `labeled_array` and only `num_features` will be returned by this
         function.
+    objects : list of tuples
+        The slices of the features, as returned by ``find_objects``.
+        Only returned if `return_objects` is True.
+    sizes : ndarray
+        The number of elements of each feature.
+        Only returned if `return_objects` is True.
+    centroids : ndarray
+        The unweighted centers of mass of the features, an array of shape
+        ``(num_features, input.ndim)``.
+        Only returned if `return_objects` is True.
+
+        The feature with label ``l`` corresponds to the index ``l-1`` of
+        `objects`, `sizes` and `centroids`, which follow `num_features` in
+        the returned tuple.
 
     See Also
     --------
@@ -95,6 +113,10 @@ def label(input, structure=None, output=None):
 
     Notes
     -----
+    The array is cut in tiles that are labeled in parallel within a
+    `set_workers` context, and the labels are then merged across the
+    borders of the tiles.
+
     A centrosymmetric matrix is a matrix that is symmetric about the center.
     See [1]_ for more information.
 
@@ -178,15 +200,18 @@ def label(input, structure=None, output=None):
         raise TypeError('Complex type not supported')
     if structure is None:
         structure = _morphology.generate_binary_structure(input.ndim, 1)
-    structure = numpy.asarray(structure, dtype=bool)
+    structure = numpy.asarray(structure, dtype=bool, order='C')
     if structure.ndim != input.ndim:
         raise RuntimeError('structure and input must have equal rank')
     for ii in structure.shape:
         if ii != 3:
             raise ValueError('structure dimensions must be equal to 3')
+    if not numpy.array_equal(structure, structure[(slice(None, None, -1),) *
+                                                  structure.ndim]):
+        raise ValueError('structure must be centrosymmetric')
 
     # Use 32 bits if it's large enough for this image.
-    # _ni_label.label() needs two entries for background and
+    # The labeling needs two entries for background and
     # foreground tracking
     need_64bits = input.size >= (2**31 - 2)
 
@@ -210,30 +235,19 @@ def label(input, structure=None, output=None):
         else:
             # 0-D
             maxlabel = 0
-        if caller_provided_output:
-            return maxlabel
-        else:
-            return output, maxlabel
-
-    try:
-        max_label = _ni_label._label(input, structure, output)
-    except _ni_label.NeedMoreBits as e:
-        # Make another attempt with enough bits, then try to cast to the
-        # new type.
-        tmp_output = np.empty(input.shape, np.intp if need_64bits else np.int32)
-        max_label = _ni_label._label(input, structure, tmp_output)
-        output[...] = tmp_output[...]
-        if not np.all(output == tmp_output):
-            # refuse to return bad results
-            raise RuntimeError(
-                "insufficient bit-depth in requested output type"
-            ) from e
-
-    if caller_provided_output:
-        # result was written in-place
-        return max_label
+        result = (maxlabel,)
+        if return_objects:
+            result += ([()] * maxlabel, np.ones(maxlabel, np.intp),
+                       np.zeros((maxlabel, input.ndim)))
     else:
-        return output, max_label
+        result = _nd_image.label(input, structure, output,
+                                 bool(return_objects))
+        if not return_objects:
+            result = (result,)
+
+    if not caller_provided_output:
+        result = (output,) + result
+    return result[0] if len(result) == 1 else result
 
 
 def find_objects(input, max_label=0):
@@ -1609,7 +1623,10 @@ def watershed_ift(input, markers, structure=None, output=None):
     Parameters
     ----------
     input : array_like
-        Input.
+        Input. Boolean, integer and floating point inputs are supported.
+
+        .. versionchanged:: 1.12.0
+            Inputs other than 8 and 16 bit unsigned integers are supported.
     markers : array_like
         Markers are points within each watershed that form the beginning
         of the process. Negative markers are considered background markers
@@ -1626,6 +1643,14 @@ def watershed_ift(input, markers, structure=None, output=None):
     watershed_ift : ndarray
         Output.  Same shape as `input`.
 
+    Notes
+    -----
+    The cost of a path is the largest absolute difference of the input
+    values of neighboring elements along the path. Each element gets the
+    label of the marker it is connected to by the path of least cost.
+    The costs are computed in double precision, floating point inputs are
+    not quantized.
+
     References
     ----------
     .. [1] A.X. Falcao, J. Stolfi and R. de Alencar Lotufo, "The image
@@ -1634,8 +1659,11 @@ def watershed_ift(input, markers, structure=None, output=None):
 
     """
     input = numpy.asarray(input)
-    if input.dtype.type not in [numpy.uint8, numpy.uint16]:
-        raise TypeError('only 8 and 16 unsigned inputs are supported')
+    if input.dtype.kind not in 'biuf' or input.dtype.itemsize > 8:
+        raise TypeError('only boolean, integer and floating point inputs '
+                        'are supported')
+    if input.dtype == numpy.float16:
+        input = input.astype(numpy.float32)
 
     if structure is None:
         structure = _morphology.generate_binary_structure(input.ndim, 1)
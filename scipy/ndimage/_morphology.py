@@ -2316,7 +2316,8 @@ def distance_transform_cdt(input, metric='chessboard', return_distances=True,
 
 
 def distance_transform_edt(input, sampling=None, return_distances=True,
-                           return_indices=False, distances=None, indices=None):
+                           return_indices=False, distances=None, indices=None,
+                           squared=False):
     """
     Exact Euclidean distance transform.
 
@@ -2343,22 +2344,32 @@ def distance_transform_edt(input, sampling=None, return_distances=True,
     return_indices : bool, optional
         Whether to calculate the feature transform.
         Default is False.
-    distances : float64 ndarray, optional
+    distances : float64 or float32 ndarray, optional
         An output array to store the calculated distance transform, instead of
         returning it.
         `return_distances` must be True.
-        It must be the same shape as `input`.
+        It must be the same shape as `input`. A float32 array takes half the
+        memory of the default float64 result.
+
+        .. versionchanged:: 1.12.0
+            float32 arrays are accepted.
     indices : int32 ndarray, optional
         An output array to store the calculated feature transform, instead of
         returning it.
         `return_indicies` must be True.
         Its shape must be `(input.ndim,) + input.shape`.
+    squared : bool, optional
+        Whether to calculate the squared distances, which avoids taking
+        square roots. Default is False.
+
+        .. versionadded:: 1.12.0
 
     Returns
     -------
     distances : float64 ndarray, optional
-        The calculated distance transform. Returned only when
-        `return_distances` is True and `distances` is not supplied.
+        The calculated distance transform, squared if `squared` is True.
+        Returned only when `return_distances` is True and `distances` is not
+        supplied.
         It will have the same shape as the input array.
     indices : int32 ndarray, optional
         The calculated feature transform. It has an input-shaped array for each
@@ -2379,6 +2390,17 @@ def distance_transform_edt(input, sampling=None, return_distances=True,
     Euclidean distance to input points x[i], and n is the
     number of dimensions.
 
+    The distances are calculated separately from the feature transform,
+    with one pass over the lines along each axis [1]_. The lines of each
+    pass are processed by multiple threads for large inputs within a
+    `set_workers` context.
+
+    References
+    ----------
+    .. [1] P. F. Felzenszwalb and D. P. Huttenlocher, "Distance Transforms
+           of Sampled Functions", Theory of Computing, vol. 8, pp. 415-428,
+           2012.
+
     Examples
     --------
     >>> from scipy import ndimage
@@ -2447,7 +2469,6 @@ def distance_transform_edt(input, sampling=None, return_distances=True,
         dt_inplace, ft_inplace, return_distances, return_indices
     )
 
-    # calculate the feature transform
     input = numpy.atleast_1d(numpy.where(input, 1, 0).astype(numpy.int8))
     if sampling is not None:
         sampling = _ni_support._normalize_sequence(sampling, input.ndim)
@@ -2455,34 +2476,31 @@ def distance_transform_edt(input, sampling=None, return_distances=True,
         if not sampling.flags.contiguous:
             sampling = sampling.copy()
 
-    if ft_inplace:
-        ft = indices
-        if ft.shape != (input.ndim,) + input.shape:
-            raise RuntimeError('indices array has wrong shape')
-        if ft.dtype.type != numpy.int32:
-            raise RuntimeError('indices array must be int32')
-    else:
-        ft = numpy.zeros((input.ndim,) + input.shape, dtype=numpy.int32)
+    # if requested, calculate the feature transform
+    if return_indices:
+        if ft_inplace:
+            ft = indices
+            if ft.shape != (input.ndim,) + input.shape:
+                raise RuntimeError('indices array has wrong shape')
+            if ft.dtype.type != numpy.int32:
+                raise RuntimeError('indices array must be int32')
+        else:
+            ft = numpy.zeros((input.ndim,) + input.shape, dtype=numpy.int32)
+        _nd_image.euclidean_feature_transform(input, sampling, ft)
 
-    _nd_image.euclidean_feature_transform(input, sampling, ft)
     # if requested, calculate the distance transform
     if return_distances:
-        dt = ft - numpy.indices(input.shape, dtype=ft.dtype)
-        dt = dt.astype(numpy.float64)
-        if sampling is not None:
-            for ii in range(len(sampling)):
-                dt[ii, ...] *= sampling[ii]
-        numpy.multiply(dt, dt, dt)
         if dt_inplace:
-            dt = numpy.add.reduce(dt, axis=0)
-            if distances.shape != dt.shape:
+            dt = distances
+            if dt.shape != input.shape:
                 raise RuntimeError('distances array has wrong shape')
-            if distances.dtype.type != numpy.float64:
-                raise RuntimeError('distances array must be float64')
-            numpy.sqrt(dt, distances)
+            if dt.dtype.type not in (numpy.float64, numpy.float32):
+                raise RuntimeError('distances array must be float64 or '
+                                   'float32')
         else:
-            dt = numpy.add.reduce(dt, axis=0)
-            dt = numpy.sqrt(dt)
+            dt = numpy.empty(input.shape, dtype=numpy.float64)
+        _nd_image.euclidean_distance_transform(input, sampling, dt,
+                                               bool(squared))
 
     # construct and return the result
     result = []
@@ -0,0 +1,47 @@
+"""Number of threads used by the ndimage routines."""
+from scipy._lib._workers import workers_context
+from . import _nd_image
+
+__all__ = ['set_workers', 'get_workers']
+
+
+def set_workers(workers):
+    """Context manager for the number of workers used in `scipy.ndimage`
+
+    Large filters, interpolations, distance transforms, labelings and
+    watershed transforms split their work over up to `workers` threads.
+    Outside of this context they run on the calling thread only. The
+    setting applies to the calling thread.
+
+    Parameters
+    ----------
+    workers : int
+        The number of workers to use. Negative values wrap around from
+        ``os.cpu_count()``, as for `scipy.fft`.
+
+    Examples
+    --------
+    >>> import numpy as np
+    >>> from scipy import ndimage
+    >>> rng = np.random.default_rng()
+    >>> image = rng.standard_normal((512, 512))
+    >>> with ndimage.set_workers(4):
+    ...     smooth = ndimage.gaussian_filter(image, sigma=3)
+
+    """
+    return workers_context(workers, _nd_image.set_workers)
+
+
+def get_workers():
+    """Returns the number of workers within the current context
+
+    Examples
+    --------
+    >>> from scipy import ndimage
+    >>> ndimage.get_workers()
+    1
+    >>> with ndimage.set_workers(4):
+    ...     ndimage.get_workers()
+    4
+    """
+    return _nd_image.get_workers()
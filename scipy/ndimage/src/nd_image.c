@@ -811,36 +811,14 @@ exit:
     return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
-static PyObject *Py_FindObjects(PyObject *obj, PyObject *args)
+/* Make the list of slices of the objects found by NI_FindObjects: */
+static PyObject *_RegionsToList(npy_intp *regions, npy_intp max_label,
+                                int rank)
 {
-    PyArrayObject *input = NULL;
     PyObject *result = NULL, *tuple = NULL, *start = NULL, *end = NULL;
     PyObject *slc = NULL;
     int jj;
-    npy_intp max_label;
-    npy_intp ii, *regions = NULL;
-
-    if (!PyArg_ParseTuple(args, "O&n",
-                          NI_ObjectToInputArray, &input, &max_label))
-        goto exit;
-
-    if (max_label < 0)
-        max_label = 0;
-    if (max_label > 0) {
-        if (PyArray_NDIM(input) > 0) {
-            regions = (npy_intp*)malloc(2 * max_label * PyArray_NDIM(input) *
-                                        sizeof(npy_intp));
-        } else {
-            regions = (npy_intp*)malloc(max_label * sizeof(npy_intp));
-        }
-        if (!regions) {
-            PyErr_NoMemory();
-            goto exit;
-        }
-    }
-
-    if (!NI_FindObjects(input, max_label, regions))
-        goto exit;
+    npy_intp ii;
 
     result = PyList_New(max_label);
     if (!result) {
@@ -849,18 +827,16 @@ static PyObject *Py_FindObjects(PyObject *obj, PyObject *args)
     }
 
     for(ii = 0; ii < max_label; ii++) {
-        npy_intp idx =
-                PyArray_NDIM(input) > 0 ? 2 * PyArray_NDIM(input) * ii : ii;
+        npy_intp idx = rank > 0 ? 2 * rank * ii : ii;
         if (regions[idx] >= 0) {
-            tuple = PyTuple_New(PyArray_NDIM(input));
+            tuple = PyTuple_New(rank);
             if (!tuple) {
                 PyErr_NoMemory();
                 goto exit;
             }
-            for(jj = 0; jj < PyArray_NDIM(input); jj++) {
+            for(jj = 0; jj < rank; jj++) {
                 start = PyLong_FromSsize_t(regions[idx + jj]);
-                end = PyLong_FromSsize_t(regions[idx + jj +
-                                             PyArray_NDIM(input)]);
+                end = PyLong_FromSsize_t(regions[idx + jj + rank]);
                 if (!start || !end) {
                     PyErr_NoMemory();
                     goto exit;
@@ -884,23 +860,109 @@ static PyObject *Py_FindObjects(PyObject *obj, PyObject *args)
         }
     }
 
-    Py_INCREF(result);
-
  exit:
-    Py_XDECREF(input);
-    Py_XDECREF(result);
     Py_XDECREF(tuple);
     Py_XDECREF(start);
     Py_XDECREF(end);
     Py_XDECREF(slc);
-    free(regions);
     if (PyErr_Occurred()) {
+        Py_XDECREF(result);
         return NULL;
     } else {
         return result;
     }
 }
 
+static PyObject *Py_FindObjects(PyObject *obj, PyObject *args)
+{
+    PyArrayObject *input = NULL;
+    PyObject *result = NULL;
+    npy_intp max_label;
+    npy_intp *regions = NULL;
+
+    if (!PyArg_ParseTuple(args, "O&n",
+                          NI_ObjectToInputArray, &input, &max_label))
+        goto exit;
+
+    if (max_label < 0)
+        max_label = 0;
+    if (max_label > 0) {
+        if (PyArray_NDIM(input) > 0) {
+            regions = (npy_intp*)malloc(2 * max_label * PyArray_NDIM(input) *
+                                        sizeof(npy_intp));
+        } else {
+            regions = (npy_intp*)malloc(max_label * sizeof(npy_intp));
+        }
+        if (!regions) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+    }
+
+    if (!NI_FindObjects(input, max_label, regions))
+        goto exit;
+
+    result = _RegionsToList(regions, max_label, PyArray_NDIM(input));
+
+ exit:
+    Py_XDECREF(input);
+    free(regions);
+    return result;
+}
+
+static PyObject *Py_Label(PyObject *obj, PyObject *args)
+{
+    PyArrayObject *input = NULL, *strct = NULL, *output = NULL;
+    PyArrayObject *counts_arr = NULL, *centroids_arr = NULL;
+    PyObject *objects = NULL, *result = NULL;
+    npy_intp max_label = 0, *regions = NULL, *counts = NULL, dims[2];
+    double *centroids = NULL;
+    int return_objects;
+
+    if (!PyArg_ParseTuple(args, "O&O&O&i",
+                          NI_ObjectToInputArray, &input,
+                          NI_ObjectToInputArray, &strct,
+                          NI_ObjectToOutputArray, &output,
+                          &return_objects))
+        goto exit;
+
+    if (!NI_Label(input, strct, output, &max_label,
+                  return_objects ? &regions : NULL, &counts, &centroids))
+        goto exit;
+    PyArray_ResolveWritebackIfCopy(output);
+
+    if (!return_objects) {
+        result = PyLong_FromSsize_t(max_label);
+        goto exit;
+    }
+    objects = _RegionsToList(regions, max_label, PyArray_NDIM(input));
+    if (!objects)
+        goto exit;
+    dims[0] = max_label;
+    dims[1] = PyArray_NDIM(input);
+    counts_arr = (PyArrayObject *)PyArray_SimpleNew(1, dims, NPY_INTP);
+    centroids_arr = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    if (!counts_arr || !centroids_arr)
+        goto exit;
+    memcpy(PyArray_DATA(counts_arr), counts, max_label * sizeof(npy_intp));
+    memcpy(PyArray_DATA(centroids_arr), centroids,
+           max_label * dims[1] * sizeof(double));
+    result = Py_BuildValue("nOOO", max_label, objects, counts_arr,
+                           centroids_arr);
+
+ exit:
+    Py_XDECREF(input);
+    Py_XDECREF(strct);
+    Py_XDECREF(output);
+    Py_XDECREF(objects);
+    Py_XDECREF(counts_arr);
+    Py_XDECREF(centroids_arr);
+    free(regions);
+    free(counts);
+    free(centroids);
+    return PyErr_Occurred() ? NULL : result;
+}
+
 /*
    Implement the ndimage.value_indices() function.
    Makes 3 passes through the array data. We use ndimage's NI_Iterator to
@@ -1209,6 +1271,29 @@ exit:
     return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_EuclideanDistanceTransform(PyObject *obj,
+                                               PyObject *args)
+{
+    PyArrayObject *input = NULL, *distances = NULL, *sampling = NULL;
+    int squared;
+
+    if (!PyArg_ParseTuple(args, "O&O&O&i",
+                          NI_ObjectToInputArray, &input,
+                          NI_ObjectToOptionalInputArray, &sampling,
+                          NI_ObjectToOutputArray, &distances,
+                          &squared))
+        goto exit;
+
+    NI_EuclideanDistanceTransform(input, sampling, distances, squared);
+    PyArray_ResolveWritebackIfCopy(distances);
+
+exit:
+    Py_XDECREF(input);
+    Py_XDECREF(sampling);
+    Py_XDECREF(distances);
+    return PyErr_Occurred() ? NULL : Py_BuildValue("");
+}
+
 static void _FreeCoordinateList(PyObject *obj)
 {
     NI_FreeCoordinateList((NI_CoordinateList*)PyCapsule_GetPointer(obj, NULL));
@@ -1302,6 +1387,25 @@ exit:
     return PyErr_Occurred() ? NULL : Py_BuildValue("");
 }
 
+static PyObject *Py_SetWorkers(PyObject *obj, PyObject *args)
+{
+    int workers, previous = NI_GetMaxThreads();
+
+    if (!PyArg_ParseTuple(args, "i", &workers))
+        return NULL;
+    if (workers < 1) {
+        PyErr_SetString(PyExc_ValueError, "workers must be positive");
+        return NULL;
+    }
+    NI_SetMaxThreads(workers);
+    return PyLong_FromLong(previous);
+}
+
+static PyObject *Py_GetWorkers(PyObject *obj, PyObject *args)
+{
+    return PyLong_FromLong(NI_GetMaxThreads());
+}
+
 static PyMethodDef methods[] = {
     {"correlate1d",           (PyCFunction)Py_Correlate1D,
      METH_VARARGS, NULL},
@@ -1331,6 +1435,8 @@ static PyMethodDef methods[] = {
      METH_VARARGS, NULL},
     {"find_objects",          (PyCFunction)Py_FindObjects,
      METH_VARARGS, NULL},
+    {"label",                 (PyCFunction)Py_Label,
+     METH_VARARGS, NULL},
     {"value_indices",         (PyCFunction)NI_ValueIndices,
      METH_VARARGS, NULL},
     {"watershed_ift",         (PyCFunction)Py_WatershedIFT,
@@ -1342,10 +1448,17 @@ static PyMethodDef methods[] = {
     {"euclidean_feature_transform",
      (PyCFunction)Py_EuclideanFeatureTransform,
      METH_VARARGS, NULL},
+    {"euclidean_distance_transform",
+     (PyCFunction)Py_EuclideanDistanceTransform,
+     METH_VARARGS, NULL},
     {"binary_erosion",        (PyCFunction)Py_BinaryErosion,
      METH_VARARGS, NULL},
     {"binary_erosion2",       (PyCFunction)Py_BinaryErosion2,
      METH_VARARGS, NULL},
+    {"set_workers",           (PyCFunction)Py_SetWorkers,
+     METH_VARARGS, NULL},
+    {"get_workers",           (PyCFunction)Py_GetWorkers,
+     METH_NOARGS, NULL},
     {NULL, NULL, 0, NULL}
 };
 
@@ -32,19 +32,58 @@
 #include "ni_support.h"
 #include "ni_filters.h"
 #include <math.h>
+#include <string.h>
 
 #define BUFFER_SIZE 256000
 
+typedef struct {
+    npy_double *fw;
+    npy_intp size1, size2;
+    int symmetric;
+} NI_Correlate1DData;
+
+static int NI_Correlate1DLine(double *iline, double *oline, npy_intp length,
+                              void *data, void *scratch)
+{
+    NI_Correlate1DData *d = (NI_Correlate1DData *)data;
+    npy_intp jj, ll, size1 = d->size1, size2 = d->size2;
+    npy_double *fw = d->fw;
+
+    iline += size1;
+    /* the correlation calculation: */
+    if (d->symmetric > 0) {
+        for(ll = 0; ll < length; ll++) {
+            oline[ll] = iline[0] * fw[0];
+            for(jj = -size1 ; jj < 0; jj++)
+                oline[ll] += (iline[jj] + iline[-jj]) * fw[jj];
+            ++iline;
+        }
+    } else if (d->symmetric < 0) {
+        for(ll = 0; ll < length; ll++) {
+            oline[ll] = iline[0] * fw[0];
+            for(jj = -size1 ; jj < 0; jj++)
+                oline[ll] += (iline[jj] - iline[-jj]) * fw[jj];
+            ++iline;
+        }
+    } else {
+        for(ll = 0; ll < length; ll++) {
+            oline[ll] = iline[size2] * fw[size2];
+            for(jj = -size1; jj < size2; jj++)
+                oline[ll] += iline[jj] * fw[jj];
+            ++iline;
+        }
+    }
+    return 1;
+}
+
 int NI_Correlate1D(PyArrayObject *input, PyArrayObject *weights,
                    int axis, PyArrayObject *output, NI_ExtendMode mode,
                    double cval, npy_intp origin)
 {
-    int symmetric = 0, more;
-    npy_intp ii, jj, ll, lines, length, size1, size2, filter_size;
-    double *ibuffer = NULL, *obuffer = NULL;
+    int symmetric = 0;
+    npy_intp ii, size1, size2, filter_size;
     npy_double *fw;
-    NI_LineBuffer iline_buffer, oline_buffer;
-    NPY_BEGIN_THREADS_DEF;
+    NI_Correlate1DData data;
 
     /* test for symmetry or anti-symmetry: */
     filter_size = PyArray_SIZE(weights);
@@ -69,88 +108,15 @@ int NI_Correlate1D(PyArrayObject *input, PyArrayObject *weights,
             }
         }
     }
-    /* allocate and initialize the line buffers: */
-    lines = -1;
-    if (!NI_AllocateLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                                         &lines, BUFFER_SIZE, &ibuffer))
-        goto exit;
-    if (!NI_AllocateLineBuffer(output, axis, 0, 0, &lines, BUFFER_SIZE,
-                                                         &obuffer))
-        goto exit;
-    if (!NI_InitLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                                            lines, ibuffer, mode, cval, &iline_buffer))
-        goto exit;
-    if (!NI_InitLineBuffer(output, axis, 0, 0, lines, obuffer, mode, 0.0,
-                                                 &oline_buffer))
-        goto exit;
-
-    NPY_BEGIN_THREADS;
-    length = PyArray_NDIM(input) > 0 ? PyArray_DIM(input, axis) : 1;
-    fw += size1;
-    /* iterate over all the array lines: */
-    do {
-        /* copy lines from array to buffer: */
-        if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more)) {
-            goto exit;
-        }
-        /* iterate over the lines in the buffers: */
-        for(ii = 0; ii < lines; ii++) {
-            /* get lines: */
-            double *iline = NI_GET_LINE(iline_buffer, ii) + size1;
-            double *oline = NI_GET_LINE(oline_buffer, ii);
-            /* the correlation calculation: */
-            if (symmetric > 0) {
-                for(ll = 0; ll < length; ll++) {
-                    oline[ll] = iline[0] * fw[0];
-                    for(jj = -size1 ; jj < 0; jj++)
-                        oline[ll] += (iline[jj] + iline[-jj]) * fw[jj];
-                    ++iline;
-                }
-            } else if (symmetric < 0) {
-                for(ll = 0; ll < length; ll++) {
-                    oline[ll] = iline[0] * fw[0];
-                    for(jj = -size1 ; jj < 0; jj++)
-                        oline[ll] += (iline[jj] - iline[-jj]) * fw[jj];
-                    ++iline;
-                }
-            } else {
-                for(ll = 0; ll < length; ll++) {
-                    oline[ll] = iline[size2] * fw[size2];
-                    for(jj = -size1; jj < size2; jj++)
-                        oline[ll] += iline[jj] * fw[jj];
-                    ++iline;
-                }
-            }
-        }
-        /* copy lines from buffer to array: */
-        if (!NI_LineBufferToArray(&oline_buffer)) {
-            goto exit;
-        }
-    } while(more);
-exit:
-    NPY_END_THREADS;
-    free(ibuffer);
-    free(obuffer);
-    return PyErr_Occurred() ? 0 : 1;
+    data.fw = fw + size1;
+    data.size1 = size1;
+    data.size2 = size2;
+    data.symmetric = symmetric;
+    /* filter batches of lines in parallel: */
+    return NI_FilterLines(input, output, axis, size1 + origin, size2 - origin,
+                          mode, cval, NI_Correlate1DLine, &data, 0);
 }
 
-#define CASE_CORRELATE_POINT(_TYPE, _type, _pi, _weights, _offsets,        \
-                             _filter_size, _cvalue, _res, _mv)             \
-case _TYPE:                                                                \
-{                                                                          \
-    npy_intp _ii, _offset;                                                 \
-    for (_ii = 0; _ii < _filter_size; ++_ii) {                             \
-        _offset = _offsets[_ii];                                           \
-        if (_offset == _mv) {                                              \
-            _res += _weights[_ii] * _cvalue;                               \
-        }                                                                  \
-        else {                                                             \
-            _res += _weights[_ii] * (double)(*((_type *)(_pi + _offset))); \
-        }                                                                  \
-    }                                                                      \
-}                                                                          \
-break
-
 #define CASE_FILTER_OUT(_TYPE, _type, _po, _tmp) \
 case _TYPE:                                      \
     *(_type *)_po = (_type)_tmp;                 \
@@ -162,216 +128,486 @@ case _TYPE:                                                            \
     *(_type *)_po = (_tmp) > -1. ? (_type)(_tmp) : -(_type)(-_tmp);    \
     break
 
+#define CASE_WINDOW_IN(_TYPE, _type, _pi, _stride, _buffer, _length) \
+case _TYPE:                                                         \
+{                                                                   \
+    npy_intp _ii;                                                   \
+    for (_ii = 0; _ii < _length; ++_ii) {                           \
+        _buffer[_ii] = (double)*(_type *)(_pi + _ii * _stride);     \
+    }                                                               \
+}                                                                   \
+break
+
+#define CASE_WINDOW_OUT(_TYPE, _type, _po, _stride, _buffer, _length) \
+case _TYPE:                                                          \
+{                                                                    \
+    npy_intp _ii;                                                    \
+    for (_ii = 0; _ii < _length; ++_ii) {                            \
+        *(_type *)(_po + _ii * _stride) = (_type)_buffer[_ii];       \
+    }                                                                \
+}                                                                    \
+break
+
+/* Avoid undefined behaviour of float -> unsigned conversions. */
+#define CASE_WINDOW_OUT_SAFE(_TYPE, _type, _po, _stride, _buffer, _length) \
+case _TYPE:                                                               \
+{                                                                         \
+    npy_intp _ii;                                                         \
+    for (_ii = 0; _ii < _length; ++_ii) {                                 \
+        double _tmp = _buffer[_ii];                                       \
+        *(_type *)(_po + _ii * _stride) =                                 \
+                        _tmp > -1. ? (_type)_tmp : -(_type)(-_tmp);       \
+    }                                                                     \
+}                                                                         \
+break
+
+/* Filters with a box-shaped window, or a kernel that fits one, may be
+   computed one output line along the last axis at a time. The window is
+   split in rows along the last axis, and the input line that each row
+   covers is converted to double, padded at both ends according to the
+   boundary mode, and kept in a small cache: neighbouring output lines share
+   most of their input lines. */
+typedef struct {
+    char *pi, *po;
+    /* number, shape and strides of the axes over the lines: */
+    int rank;
+    npy_intp shape[NPY_MAXDIMS];
+    npy_intp istrides[NPY_MAXDIMS], ostrides[NPY_MAXDIMS];
+    /* the lines along the last axis: */
+    npy_intp length, istride, ostride, lines;
+    int itype, otype;
+    /* padding of the cached input lines: */
+    npy_intp size1, size2;
+    /* rows of the window and their offsets along the other axes: */
+    npy_intp n_rows, *row_offsets;
+    NI_ExtendMode mode;
+    double cval;
+} NI_LineWindow;
+
+/* the line cache and scratch space of one thread: */
+typedef struct {
+    double *cache;
+    /* the key of the input line in each cache slot, and the last output
+       line that used it: */
+    npy_intp *keys, *stamps;
+    /* the cached input line of each row of the window: */
+    double **rows;
+    void *scratch;
+} NI_WindowWork;
+
+static int NI_LineWindowType(int type)
+{
+    switch (type) {
+    case NPY_BOOL:
+    case NPY_UBYTE:
+    case NPY_USHORT:
+    case NPY_UINT:
+    case NPY_ULONG:
+    case NPY_ULONGLONG:
+    case NPY_BYTE:
+    case NPY_SHORT:
+    case NPY_INT:
+    case NPY_LONG:
+    case NPY_LONGLONG:
+    case NPY_FLOAT:
+    case NPY_DOUBLE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Initialize the lines of an array for a window of the given length and
+   origin along the last axis. The rows of the window are set by the
+   caller: */
+static int NI_InitLineWindow(PyArrayObject *input, PyArrayObject *output,
+                             npy_intp flength, npy_intp origin,
+                             NI_ExtendMode mode, double cval,
+                             NI_LineWindow *window)
+{
+    int ii, rank = PyArray_NDIM(input);
+    npy_intp size1 = flength / 2 + origin, size2 = flength - size1 - 1;
+
+    memset(window, 0, sizeof(NI_LineWindow));
+    if (!NI_LineWindowType(PyArray_TYPE(input)) ||
+            !NI_LineWindowType(PyArray_TYPE(output))) {
+        PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+        return 0;
+    }
+    if ((int)mode < NI_EXTEND_FIRST || (int)mode > NI_EXTEND_GRID_CONSTANT) {
+        PyErr_SetString(PyExc_RuntimeError, "boundary mode not supported");
+        return 0;
+    }
+    /* a 0-d array is a single line: */
+    window->rank = rank > 0 ? rank - 1 : 0;
+    for(ii = 0; ii < window->rank; ii++) {
+        window->shape[ii] = PyArray_DIM(input, ii);
+        window->istrides[ii] = PyArray_STRIDE(input, ii);
+        window->ostrides[ii] = PyArray_STRIDE(output, ii);
+    }
+    window->length = rank > 0 ? PyArray_DIM(input, rank - 1) : 1;
+    window->istride = rank > 0 ? PyArray_STRIDE(input, rank - 1) : 0;
+    window->ostride = rank > 0 ? PyArray_STRIDE(output, rank - 1) : 0;
+    window->lines = window->length > 0 ?
+                    PyArray_SIZE(input) / window->length : 0;
+    window->pi = (void *)PyArray_DATA(input);
+    window->po = (void *)PyArray_DATA(output);
+    window->itype = PyArray_TYPE(input);
+    window->otype = PyArray_TYPE(output);
+    window->size1 = size1 > 0 ? size1 : 0;
+    window->size2 = size2 > 0 ? size2 : 0;
+    window->mode = mode;
+    window->cval = cval;
+    return 1;
+}
+
+/* Number of threads for a task of the given number of operations: */
+static int NI_LineWindowParts(NI_LineWindow *window, npy_intp work)
+{
+    int n_parts = NI_NumThreads(work);
+
+    if (n_parts > window->lines)
+        n_parts = (int)window->lines;
+    return n_parts < 1 ? 1 : n_parts;
+}
+
+static int NI_AllocateWindowWork(NI_LineWindow *window, size_t scratch_size,
+                                 NI_WindowWork *work)
+{
+    npy_intp ii, n_rows = window->n_rows;
+
+    work->cache = malloc((n_rows * (window->size1 + window->length +
+                          window->size2) + 1) * sizeof(double));
+    work->keys = malloc((2 * n_rows + 1) * sizeof(npy_intp));
+    work->rows = malloc((n_rows + 1) * sizeof(double *));
+    work->scratch = malloc(scratch_size + 1);
+    if (!work->cache || !work->keys || !work->rows || !work->scratch) {
+        PyErr_NoMemory();
+        return 0;
+    }
+    work->stamps = work->keys + n_rows;
+    for(ii = 0; ii < n_rows; ii++) {
+        work->keys[ii] = -2;
+        work->stamps[ii] = -1;
+    }
+    return 1;
+}
+
+static void NI_FreeWindowWork(NI_WindowWork *work)
+{
+    free(work->cache);
+    free(work->keys);
+    free(work->rows);
+    free(work->scratch);
+}
+
+/* Convert an input line to double and pad it: */
+static void NI_LoadWindowLine(NI_LineWindow *window, char *pi,
+                              double *buffer)
+{
+    npy_intp ii, cc, length = window->length, stride = window->istride;
+    double *line = buffer + window->size1;
+
+    switch (window->itype) {
+        CASE_WINDOW_IN(NPY_BOOL, npy_bool, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_UBYTE, npy_ubyte, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_USHORT, npy_ushort, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_UINT, npy_uint, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_ULONG, npy_ulong, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_ULONGLONG, npy_ulonglong,
+                       pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_BYTE, npy_byte, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_SHORT, npy_short, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_INT, npy_int, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_LONG, npy_long, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_LONGLONG, npy_longlong,
+                       pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_FLOAT, npy_float, pi, stride, line, length);
+        CASE_WINDOW_IN(NPY_DOUBLE, npy_double, pi, stride, line, length);
+    }
+    for(ii = 0; ii < window->size1; ii++) {
+        cc = NI_ExtendCoordinate(ii - window->size1, length, window->mode);
+        buffer[ii] = cc < 0 ? window->cval : line[cc];
+    }
+    for(ii = 0; ii < window->size2; ii++) {
+        cc = NI_ExtendCoordinate(length + ii, length, window->mode);
+        line[length + ii] = cc < 0 ? window->cval : line[cc];
+    }
+}
+
+/* Convert (part of) an output line from double: */
+static void NI_StoreWindowLine(NI_LineWindow *window, char *po,
+                               double *line, npy_intp length)
+{
+    npy_intp stride = window->ostride;
+
+    switch (window->otype) {
+        CASE_WINDOW_OUT_SAFE(NPY_BOOL, npy_bool, po, stride, line, length);
+        CASE_WINDOW_OUT_SAFE(NPY_UBYTE, npy_ubyte, po, stride, line, length);
+        CASE_WINDOW_OUT_SAFE(NPY_USHORT, npy_ushort,
+                             po, stride, line, length);
+        CASE_WINDOW_OUT_SAFE(NPY_UINT, npy_uint, po, stride, line, length);
+        CASE_WINDOW_OUT_SAFE(NPY_ULONG, npy_ulong, po, stride, line, length);
+        CASE_WINDOW_OUT_SAFE(NPY_ULONGLONG, npy_ulonglong,
+                             po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_BYTE, npy_byte, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_SHORT, npy_short, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_INT, npy_int, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_LONG, npy_long, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_LONGLONG, npy_longlong, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_FLOAT, npy_float, po, stride, line, length);
+        CASE_WINDOW_OUT(NPY_DOUBLE, npy_double, po, stride, line, length);
+    }
+}
+
+/* Find the padded input line of each row of the window around an output
+   line, loading the lines that are not cached, and return a pointer to the
+   output line. The lines processed by one thread must increase: */
+static char *NI_GetWindowRows(NI_LineWindow *window, npy_intp line,
+                              NI_WindowWork *work)
+{
+    npy_intp coordinates[NPY_MAXDIMS], rr, ss, jj, ii, n_rows = window->n_rows;
+    npy_intp line_size = window->size1 + window->length + window->size2;
+    npy_intp ll = line;
+    char *po = window->po;
+
+    for(jj = window->rank - 1; jj >= 0; jj--) {
+        coordinates[jj] = ll % window->shape[jj];
+        ll /= window->shape[jj];
+        po += coordinates[jj] * window->ostrides[jj];
+    }
+    for(rr = 0; rr < n_rows; rr++) {
+        npy_intp *offsets = window->row_offsets + rr * window->rank;
+        npy_intp key = 0, victim = -1;
+        char *pi = window->pi;
+
+        /* the key is the index of the input line, or -1 for a line outside
+           the array in constant mode: */
+        for(jj = 0; jj < window->rank; jj++) {
+            npy_intp cc = NI_ExtendCoordinate(coordinates[jj] + offsets[jj],
+                                              window->shape[jj], window->mode);
+            if (cc < 0) {
+                key = -1;
+                break;
+            }
+            key = key * window->shape[jj] + cc;
+            pi += cc * window->istrides[jj];
+        }
+        for(ss = 0; ss < n_rows; ss++) {
+            if (work->keys[ss] == key)
+                break;
+            /* replace the least recently used line not used by this output
+               line, there is always one: */
+            if (work->stamps[ss] < line && (victim < 0 ||
+                    work->stamps[ss] < work->stamps[victim]))
+                victim = ss;
+        }
+        if (ss == n_rows) {
+            double *buffer = work->cache + victim * line_size;
+            ss = victim;
+            work->keys[ss] = key;
+            if (key < 0) {
+                for(ii = 0; ii < line_size; ii++)
+                    buffer[ii] = window->cval;
+            } else {
+                NI_LoadWindowLine(window, pi, buffer);
+            }
+        }
+        work->stamps[ss] = line;
+        work->rows[rr] = work->cache + ss * line_size;
+    }
+    return po;
+}
+
+/* number of output points of a line that are accumulated at a time: */
+#define CORRELATE_TILE 1024
+
+/* The weights of each row of the kernel, with zeros skipped, are applied to
+   a tile of output points at once, which the compiler vectorizes. Each
+   output point adds the same products in the same order as a point by
+   point correlation. */
+typedef struct {
+    NI_LineWindow window;
+    /* the range of the weights of each row in ww and wo: */
+    npy_intp *row_weights;
+    /* non-zero weights and their offsets into a cached input line: */
+    double *ww;
+    npy_intp *wo;
+    NI_WindowWork *work;
+} NI_CorrelateTask;
+
+static int NI_CorrelateLines(void *data, int part, int n_parts)
+{
+    NI_CorrelateTask *task = (NI_CorrelateTask *)data;
+    NI_LineWindow *window = &task->window;
+    NI_WindowWork *work = task->work + part;
+    npy_intp first = window->lines * part / n_parts;
+    npy_intp last = window->lines * (part + 1) / n_parts;
+    npy_intp ll, rr, kk, ii, jj;
+    double *tile = (double *)work->scratch;
+
+    for(ll = first; ll < last; ll++) {
+        char *po = NI_GetWindowRows(window, ll, work);
+
+        /* apply the kernel to each tile of output points: */
+        for(ii = 0; ii < window->length; ii += CORRELATE_TILE) {
+            npy_intp size = window->length - ii;
+            if (size > CORRELATE_TILE)
+                size = CORRELATE_TILE;
+            for(jj = 0; jj < size; jj++)
+                tile[jj] = 0.0;
+            for(rr = 0; rr < window->n_rows; rr++) {
+                double *buffer = work->rows[rr] + ii;
+                npy_intp *wo = task->wo;
+                double *ww = task->ww;
+                /* three weights per pass, adding in the same order: */
+                for(kk = task->row_weights[rr];
+                        kk + 2 < task->row_weights[rr + 1]; kk += 3) {
+                    double *s0 = buffer + wo[kk], w0 = ww[kk];
+                    double *s1 = buffer + wo[kk + 1], w1 = ww[kk + 1];
+                    double *s2 = buffer + wo[kk + 2], w2 = ww[kk + 2];
+                    for(jj = 0; jj < size; jj++)
+                        tile[jj] = tile[jj] + w0 * s0[jj] + w1 * s1[jj] +
+                                   w2 * s2[jj];
+                }
+                for(; kk < task->row_weights[rr + 1]; kk++) {
+                    double *src = buffer + wo[kk], weight = ww[kk];
+                    for(jj = 0; jj < size; jj++)
+                        tile[jj] += weight * src[jj];
+                }
+            }
+            NI_StoreWindowLine(window, po + ii * window->ostride, tile, size);
+        }
+    }
+    return 1;
+}
+
 int NI_Correlate(PyArrayObject* input, PyArrayObject* weights,
                  PyArrayObject* output, NI_ExtendMode mode,
                  double cvalue, npy_intp *origins)
 {
-    npy_bool *pf = NULL;
-    npy_intp fsize, jj, kk, filter_size = 0, border_flag_value;
-    npy_intp *offsets = NULL, *oo, size;
-    NI_FilterIterator fi;
-    NI_Iterator ii, io;
-    char *pi, *po;
+    NI_CorrelateTask task;
+    NI_LineWindow *window = &task.window;
+    npy_intp fsize, filter_size = 0, flength, row_length, n_rows, jj, kk;
+    npy_intp fshape[NPY_MAXDIMS], forigins[NPY_MAXDIMS];
     npy_double *pw;
-    npy_double *ww = NULL;
-    int err = 0;
+    int rank, ii, n_parts = 0;
     NPY_BEGIN_THREADS_DEF;
 
-    /* get the footprint: */
+    memset(&task, 0, sizeof(task));
+    rank = PyArray_NDIM(input);
+    for(ii = 0; ii < rank; ii++) {
+        fshape[ii] = PyArray_DIM(weights, ii);
+        forigins[ii] = origins ? origins[ii] : 0;
+    }
+    /* the kernel covers input points [-row_length, flength - row_length)
+       around each output point along the last axis: */
+    flength = rank > 0 ? fshape[rank - 1] : 1;
+    row_length = flength / 2 + (rank > 0 ? forigins[rank - 1] : 0);
+    if (!NI_InitLineWindow(input, output, flength,
+                           rank > 0 ? forigins[rank - 1] : 0, mode, cvalue,
+                           window))
+        goto exit;
+
+    /* split the non-zero weights in rows along the last axis: */
     fsize = PyArray_SIZE(weights);
     pw = (npy_double*)PyArray_DATA(weights);
-    pf = malloc(fsize * sizeof(npy_bool));
-    if (!pf) {
-        PyErr_NoMemory();
-        goto exit;
-    }
-    for(jj = 0; jj < fsize; jj++) {
-        if (fabs(pw[jj]) > DBL_EPSILON) {
-            pf[jj] = 1;
+    for(kk = 0; kk < fsize; kk++) {
+        if (fabs(pw[kk]) > DBL_EPSILON)
             ++filter_size;
-        } else {
-            pf[jj] = 0;
-        }
     }
-    /* copy the weights to contiguous memory: */
-    ww = malloc(filter_size * sizeof(npy_double));
-    if (!ww) {
+    n_rows = flength > 0 ? fsize / flength : 0;
+    task.ww = malloc((filter_size + 1) * sizeof(double));
+    task.wo = malloc((filter_size + 1) * sizeof(npy_intp));
+    task.row_weights = malloc((n_rows + 1) * sizeof(npy_intp));
+    window->row_offsets = malloc((n_rows * window->rank + 1) *
+                                 sizeof(npy_intp));
+    if (!task.ww || !task.wo || !task.row_weights || !window->row_offsets) {
         PyErr_NoMemory();
         goto exit;
     }
     jj = 0;
-    for(kk = 0; kk < fsize; kk++) {
-        if (pf[kk]) {
-            ww[jj++] = pw[kk];
+    for(kk = 0; kk < fsize; kk += flength) {
+        npy_intp ll, row = kk / flength, start = jj;
+        for(ll = 0; ll < flength; ll++) {
+            if (fabs(pw[kk + ll]) > DBL_EPSILON) {
+                task.ww[jj] = pw[kk + ll];
+                task.wo[jj] = ll - row_length + window->size1;
+                ++jj;
+            }
+        }
+        if (jj > start) {
+            npy_intp *offsets = window->row_offsets +
+                                window->n_rows * window->rank;
+            for(ii = window->rank - 1; ii >= 0; ii--) {
+                offsets[ii] = row % fshape[ii] - fshape[ii] / 2 - forigins[ii];
+                row /= fshape[ii];
+            }
+            task.row_weights[window->n_rows++] = start;
         }
     }
-    /* initialize filter offsets: */
-    if (!NI_InitFilterOffsets(input, pf, PyArray_DIMS(weights), origins,
-                              mode, &offsets, &border_flag_value, NULL)) {
+    task.row_weights[window->n_rows] = jj;
+
+    /* allocate the line cache and tile of each thread: */
+    n_parts = NI_LineWindowParts(window, PyArray_SIZE(input) * filter_size);
+    task.work = calloc(n_parts, sizeof(NI_WindowWork));
+    if (!task.work) {
+        PyErr_NoMemory();
         goto exit;
     }
-    /* initialize filter iterator: */
-    if (!NI_InitFilterIterator(PyArray_NDIM(input), PyArray_DIMS(weights),
-                               filter_size, PyArray_DIMS(input), origins,
-                               &fi)) {
-        goto exit;
+    for(ii = 0; ii < n_parts; ii++) {
+        if (!NI_AllocateWindowWork(window, CORRELATE_TILE * sizeof(double),
+                                   task.work + ii))
+            goto exit;
     }
-    /* initialize input element iterator: */
-    if (!NI_InitPointIterator(input, &ii))
-        goto exit;
-    /* initialize output element iterator: */
-    if (!NI_InitPointIterator(output, &io))
-        goto exit;
 
     NPY_BEGIN_THREADS;
-    /* get data pointers an array size: */
-    pi = (void *)PyArray_DATA(input);
-    po = (void *)PyArray_DATA(output);
-    size = PyArray_SIZE(input);
-    /* iterator over the elements: */
-    oo = offsets;
-    for(jj = 0; jj < size; jj++) {
-        double tmp = 0.0;
-        switch (PyArray_TYPE(input)) {
-            CASE_CORRELATE_POINT(NPY_BOOL, npy_bool,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_UBYTE, npy_ubyte,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_USHORT, npy_ushort,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_UINT, npy_uint,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_ULONG, npy_ulong,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_ULONGLONG, npy_ulonglong,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_BYTE, npy_byte,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_SHORT, npy_short,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_INT, npy_int,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_LONG, npy_long,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_LONGLONG, npy_longlong,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_FLOAT, npy_float,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            CASE_CORRELATE_POINT(NPY_DOUBLE, npy_double,
-                                 pi, ww, oo, filter_size, cvalue, tmp,
-                                 border_flag_value);
-            default:
-                err = 1;
-                goto exit;
-        }
-        switch (PyArray_TYPE(output)) {
-            CASE_FILTER_OUT_SAFE(NPY_BOOL, npy_bool, po, tmp);
-            CASE_FILTER_OUT_SAFE(NPY_UBYTE, npy_ubyte, po, tmp);
-            CASE_FILTER_OUT_SAFE(NPY_USHORT, npy_ushort, po, tmp);
-            CASE_FILTER_OUT_SAFE(NPY_UINT, npy_uint, po, tmp);
-            CASE_FILTER_OUT_SAFE(NPY_ULONG, npy_ulong, po, tmp);
-            CASE_FILTER_OUT_SAFE(NPY_ULONGLONG, npy_ulonglong, po, tmp);
-            CASE_FILTER_OUT(NPY_BYTE, npy_byte, po, tmp);
-            CASE_FILTER_OUT(NPY_SHORT, npy_short, po, tmp);
-            CASE_FILTER_OUT(NPY_INT, npy_int, po, tmp);
-            CASE_FILTER_OUT(NPY_LONG, npy_long, po, tmp);
-            CASE_FILTER_OUT(NPY_LONGLONG, npy_longlong, po, tmp);
-            CASE_FILTER_OUT(NPY_FLOAT, npy_float, po, tmp);
-            CASE_FILTER_OUT(NPY_DOUBLE, npy_double, po, tmp);
-            default:
-                err = 1;
-                goto exit;
-        }
-        NI_FILTER_NEXT2(fi, ii, io, oo, pi, po);
-    }
-exit:
+    NI_ParallelFor(n_parts, NI_CorrelateLines, &task);
     NPY_END_THREADS;
-    if (err == 1) {
-        PyErr_SetString(PyExc_RuntimeError, "array type not supported");
+exit:
+    if (task.work) {
+        for(ii = 0; ii < n_parts; ii++)
+            NI_FreeWindowWork(task.work + ii);
     }
-    free(offsets);
-    free(ww);
-    free(pf);
+    free(task.work);
+    free(task.ww);
+    free(task.wo);
+    free(task.row_weights);
+    free(window->row_offsets);
     return PyErr_Occurred() ? 0 : 1;
 }
 
+static int NI_UniformFilter1DLine(double *iline, double *oline,
+                                  npy_intp length, void *data, void *scratch)
+{
+    npy_intp ll, filter_size = *(npy_intp *)data;
+    /* do the uniform filter: */
+    double tmp = 0.0;
+    double *l1 = iline;
+    double *l2 = iline + filter_size;
+    for (ll = 0; ll < filter_size; ++ll) {
+        tmp += iline[ll];
+    }
+    oline[0] = tmp / filter_size;
+    for (ll = 1; ll < length; ++ll) {
+        tmp += *l2++ - *l1++;
+        oline[ll] = tmp / filter_size;
+    }
+    return 1;
+}
+
 int
 NI_UniformFilter1D(PyArrayObject *input, npy_intp filter_size,
                    int axis, PyArrayObject *output, NI_ExtendMode mode,
                    double cval, npy_intp origin)
 {
-    npy_intp lines, kk, ll, length, size1, size2;
-    int more;
-    double *ibuffer = NULL, *obuffer = NULL;
-    NI_LineBuffer iline_buffer, oline_buffer;
-    NPY_BEGIN_THREADS_DEF;
+    npy_intp size1, size2;
 
     size1 = filter_size / 2;
     size2 = filter_size - size1 - 1;
-    /* allocate and initialize the line buffers: */
-    lines = -1;
-    if (!NI_AllocateLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                                         &lines, BUFFER_SIZE, &ibuffer))
-        goto exit;
-    if (!NI_AllocateLineBuffer(output, axis, 0, 0, &lines, BUFFER_SIZE,
-                                                         &obuffer))
-        goto exit;
-    if (!NI_InitLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                                            lines, ibuffer, mode, cval, &iline_buffer))
-        goto exit;
-    if (!NI_InitLineBuffer(output, axis, 0, 0, lines, obuffer, mode, 0.0,
-                                                 &oline_buffer))
-        goto exit;
-    NPY_BEGIN_THREADS;
-    length = PyArray_NDIM(input) > 0 ? PyArray_DIM(input, axis) : 1;
-
-    /* iterate over all the array lines: */
-    do {
-        /* copy lines from array to buffer: */
-        if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more)) {
-            goto exit;
-        }
-        /* iterate over the lines in the buffers: */
-        for(kk = 0; kk < lines; kk++) {
-            /* get lines: */
-            double *iline = NI_GET_LINE(iline_buffer, kk);
-            double *oline = NI_GET_LINE(oline_buffer, kk);
-            /* do the uniform filter: */
-            double tmp = 0.0;
-            double *l1 = iline;
-            double *l2 = iline + filter_size;
-            for (ll = 0; ll < filter_size; ++ll) {
-                tmp += iline[ll];
-            }
-            oline[0] = tmp / filter_size;
-            for (ll = 1; ll < length; ++ll) {
-                tmp += *l2++ - *l1++;
-                oline[ll] = tmp / filter_size;
-            }
-        }
-        /* copy lines from buffer to array: */
-        if (!NI_LineBufferToArray(&oline_buffer)) {
-            goto exit;
-        }
-    } while(more);
-
- exit:
-    NPY_END_THREADS;
-    free(ibuffer);
-    free(obuffer);
-    return PyErr_Occurred() ? 0 : 1;
+    /* filter batches of lines in parallel: */
+    return NI_FilterLines(input, output, axis, size1 + origin, size2 - origin,
+                          mode, cval, NI_UniformFilter1DLine, &filter_size, 0);
 }
 
 #define INCREASE_RING_PTR(ptr) \
@@ -386,114 +622,83 @@ NI_UniformFilter1D(PyArrayObject *input, npy_intp filter_size,
     }                          \
     (ptr)--;
 
-int
-NI_MinOrMaxFilter1D(PyArrayObject *input, npy_intp filter_size,
-                    int axis, PyArrayObject *output, NI_ExtendMode mode,
-                    double cval, npy_intp origin, int minimum)
-{
-    npy_intp lines, kk, ll, length, size1, size2;
-    int more;
-    double *ibuffer = NULL, *obuffer = NULL;
-    NI_LineBuffer iline_buffer, oline_buffer;
-
-    struct pairs {
-        double value;
-        npy_intp death;
-    } *ring = NULL, *minpair, *end, *last;
+struct pairs {
+    double value;
+    npy_intp death;
+};
 
-    NPY_BEGIN_THREADS_DEF;
-
-    size1 = filter_size / 2;
-    size2 = filter_size - size1 - 1;
-    /* allocate and initialize the line buffers: */
-    lines = -1;
-    if (!NI_AllocateLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                            &lines, BUFFER_SIZE, &ibuffer))
-        goto exit;
-    if (!NI_AllocateLineBuffer(output, axis, 0, 0, &lines, BUFFER_SIZE,
-                                                                &obuffer))
-        goto exit;
-    if (!NI_InitLineBuffer(input, axis, size1 + origin, size2 - origin,
-                                lines, ibuffer, mode, cval, &iline_buffer))
-        goto exit;
-    if (!NI_InitLineBuffer(output, axis, 0, 0, lines, obuffer, mode, 0.0,
-                                                            &oline_buffer))
-        goto exit;
-
-    NPY_BEGIN_THREADS;
-    length = PyArray_NDIM(input) > 0 ? PyArray_DIM(input, axis) : 1;
+typedef struct {
+    npy_intp filter_size;
+    int minimum;
+} NI_MinOrMaxFilter1DData;
 
+static int NI_MinOrMaxFilter1DLine(double *iline, double *oline,
+                                   npy_intp length, void *data, void *scratch)
+{
+    NI_MinOrMaxFilter1DData *d = (NI_MinOrMaxFilter1DData *)data;
+    npy_intp ll, filter_size = d->filter_size;
+    int minimum = d->minimum;
     /* ring is a dequeue of pairs implemented as a circular array */
-    ring = malloc(filter_size * sizeof(struct pairs));
-    if (!ring) {
-        goto exit;
+    struct pairs *ring = (struct pairs *)scratch, *minpair, *last;
+    struct pairs *end = ring + filter_size;
+
+    /* This check could be moved out to the Python wrapper */
+    if (filter_size == 1) {
+        memcpy(oline, iline, sizeof(double) * length);
+        return 1;
     }
-    end = ring + filter_size;
+    /*
+     * Original code by Richard Harter, adapted from:
+     * http://www.richardhartersworld.com/cri/2001/slidingmin.html
+     */
+    minpair = ring;
+    minpair->value = *iline++;
+    minpair->death = filter_size;
+    last = ring;
 
-    /* iterate over all the array lines: */
-    do {
-        /* copy lines from array to buffer: */
-        if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more)) {
-            goto exit;
+    for (ll = 1; ll < filter_size + length - 1; ll++) {
+        double val = *iline++;
+        if (minpair->death == ll) {
+            INCREASE_RING_PTR(minpair)
         }
-        /* iterate over the lines in the buffers: */
-        for(kk = 0; kk < lines; kk++) {
-            /* get lines: */
-            double *iline = NI_GET_LINE(iline_buffer, kk);
-            double *oline = NI_GET_LINE(oline_buffer, kk);
-
-            /* This check could be moved out to the Python wrapper */
-            if (filter_size == 1) {
-                memcpy(oline, iline, sizeof(double) * length);
-            }
-            else {
-                /*
-                 * Original code by Richard Harter, adapted from:
-                 * http://www.richardhartersworld.com/cri/2001/slidingmin.html
-                 */
-                minpair = ring;
-                minpair->value = *iline++;
-                minpair->death = filter_size;
-                last = ring;
-
-                for (ll = 1; ll < filter_size + length - 1; ll++) {
-                    double val = *iline++;
-                    if (minpair->death == ll) {
-                        INCREASE_RING_PTR(minpair)
-                    }
-                    if ((minimum && val <= minpair->value) ||
-                        (!minimum && val >= minpair->value)) {
-                        minpair->value = val;
-                        minpair->death = ll + filter_size;
-                        last = minpair;
-                    }
-                    else {
-                        while ((minimum && last->value >= val) ||
-                               (!minimum && last->value <= val)) {
-                            DECREASE_RING_PTR(last)
-                        }
-                        INCREASE_RING_PTR(last)
-                        last->value = val;
-                        last->death = ll + filter_size;
-                    }
-                    if (ll >= filter_size - 1) {
-                        *oline++ = minpair->value;
-                    }
-                }
+        if ((minimum && val <= minpair->value) ||
+            (!minimum && val >= minpair->value)) {
+            minpair->value = val;
+            minpair->death = ll + filter_size;
+            last = minpair;
+        }
+        else {
+            while ((minimum && last->value >= val) ||
+                   (!minimum && last->value <= val)) {
+                DECREASE_RING_PTR(last)
             }
+            INCREASE_RING_PTR(last)
+            last->value = val;
+            last->death = ll + filter_size;
         }
-        /* copy lines from buffer to array: */
-        if (!NI_LineBufferToArray(&oline_buffer)) {
-            goto exit;
+        if (ll >= filter_size - 1) {
+            *oline++ = minpair->value;
         }
-    } while(more);
+    }
+    return 1;
+}
 
- exit:
-    NPY_END_THREADS;
-    free(ibuffer);
-    free(obuffer);
-    free(ring);
-    return PyErr_Occurred() ? 0 : 1;
+int
+NI_MinOrMaxFilter1D(PyArrayObject *input, npy_intp filter_size,
+                    int axis, PyArrayObject *output, NI_ExtendMode mode,
+                    double cval, npy_intp origin, int minimum)
+{
+    npy_intp size1, size2;
+    NI_MinOrMaxFilter1DData data;
+
+    size1 = filter_size / 2;
+    size2 = filter_size - size1 - 1;
+    data.filter_size = filter_size;
+    data.minimum = minimum;
+    /* filter batches of lines in parallel, each with its own ring: */
+    return NI_FilterLines(input, output, axis, size1 + origin, size2 - origin,
+                          mode, cval, NI_MinOrMaxFilter1DLine, &data,
+                          filter_size * sizeof(struct pairs));
 }
 
 #undef DECREASE_RING_PTR
@@ -727,6 +932,375 @@ break
 
 
 
+/* Rank filters with a box-shaped footprint slide the window along the last
+   axis, replacing one column of the window per output point. Integers of at
+   most 16 bits are counted in a histogram with one bin per value, grouped
+   in blocks of RANK_BLOCK bins, and the bin holding the rank is tracked as
+   the window moves. Other types keep the window sorted. */
+#define RANK_BLOCK_SHIFT 8
+#define RANK_BLOCK (1 << RANK_BLOCK_SHIFT)
+
+typedef struct {
+    NI_LineWindow window;
+    npy_intp rank, flength;
+    /* the number of histogram bins and the value of the first one, or no
+       bins for a sorted window: */
+    npy_intp bins, first_bin;
+    NI_WindowWork *work;
+} NI_RankTask;
+
+#define CASE_RANK_CVAL(_TYPE, _type, _min, _max, _cval, _value, _ok) \
+case _TYPE:                                                         \
+    _ok = _cval > (double)(_min) - 1.0 && _cval < (double)(_max) + 1.0; \
+    if (_ok) {                                                      \
+        _value = (double)(_type)_cval;                              \
+    }                                                               \
+    break
+
+/* The value of the border in constant mode, as the point by point rank
+   filter uses it. Returns 0 if it is not defined: */
+static int NI_RankCval(int type, double cval, double *value)
+{
+    int ok = 0;
+
+    switch (type) {
+        CASE_RANK_CVAL(NPY_BOOL, npy_bool, 0, NPY_MAX_UBYTE, cval, *value, ok);
+        CASE_RANK_CVAL(NPY_UBYTE, npy_ubyte, 0, NPY_MAX_UBYTE,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_USHORT, npy_ushort, 0, NPY_MAX_USHORT,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_UINT, npy_uint, 0, NPY_MAX_UINT, cval, *value, ok);
+        CASE_RANK_CVAL(NPY_ULONG, npy_ulong, 0, NPY_MAX_ULONG,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_ULONGLONG, npy_ulonglong, 0, NPY_MAX_ULONGLONG,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_BYTE, npy_byte, NPY_MIN_BYTE, NPY_MAX_BYTE,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_SHORT, npy_short, NPY_MIN_SHORT, NPY_MAX_SHORT,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_INT, npy_int, NPY_MIN_INT, NPY_MAX_INT,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_LONG, npy_long, NPY_MIN_LONG, NPY_MAX_LONG,
+                       cval, *value, ok);
+        CASE_RANK_CVAL(NPY_LONGLONG, npy_longlong, NPY_MIN_LONGLONG,
+                       NPY_MAX_LONGLONG, cval, *value, ok);
+    case NPY_FLOAT:
+        ok = cval == cval;
+        *value = (double)(npy_float)cval;
+        break;
+    case NPY_DOUBLE:
+        ok = cval == cval;
+        *value = cval;
+        break;
+    }
+    return ok;
+}
+
+/* Whether a floating point array holds a NaN, which has no rank: */
+static int NI_HasNaN(PyArrayObject *array)
+{
+    NI_Iterator ii;
+    npy_intp jj, size = PyArray_SIZE(array);
+    char *pa = (void *)PyArray_DATA(array);
+    int type = PyArray_TYPE(array);
+
+    if (type != NPY_FLOAT && type != NPY_DOUBLE)
+        return 0;
+    if (!NI_InitPointIterator(array, &ii))
+        return -1;
+    for(jj = 0; jj < size; jj++) {
+        double value = type == NPY_FLOAT ? *(npy_float *)pa :
+                                           *(npy_double *)pa;
+        if (value != value)
+            return 1;
+        NI_ITERATOR_NEXT(ii, pa);
+    }
+    return 0;
+}
+
+static void NI_RankHistogramLine(NI_RankTask *task, double **rows,
+                                 double *oline, npy_intp *fine)
+{
+    npy_intp n_rows = task->window.n_rows, length = task->window.length;
+    npy_intp flength = task->flength, rank = task->rank;
+    npy_intp first_bin = task->first_bin;
+    npy_intp *blocks = fine + task->bins;
+    /* the bin of the rank, and the number of values in lower bins: */
+    npy_intp bin = 0, below = 0;
+    npy_intp ll, rr, kk;
+
+    for(rr = 0; rr < n_rows; rr++) {
+        for(kk = 0; kk < flength; kk++) {
+            npy_intp vv = (npy_intp)rows[rr][kk] - first_bin;
+            ++fine[vv];
+            ++blocks[vv >> RANK_BLOCK_SHIFT];
+        }
+    }
+    for(ll = 0; ll < length; ll++) {
+        if (ll > 0) {
+            for(rr = 0; rr < n_rows; rr++) {
+                npy_intp out = (npy_intp)rows[rr][ll - 1] - first_bin;
+                npy_intp in = (npy_intp)rows[rr][ll + flength - 1] - first_bin;
+                --fine[out];
+                --blocks[out >> RANK_BLOCK_SHIFT];
+                if (out < bin)
+                    --below;
+                ++fine[in];
+                ++blocks[in >> RANK_BLOCK_SHIFT];
+                if (in < bin)
+                    ++below;
+            }
+        }
+        /* move to the bin of the rank, skipping whole blocks if possible: */
+        while (below > rank) {
+            if ((bin & (RANK_BLOCK - 1)) == 0 &&
+                    below - blocks[(bin >> RANK_BLOCK_SHIFT) - 1] > rank) {
+                bin -= RANK_BLOCK;
+                below -= blocks[bin >> RANK_BLOCK_SHIFT];
+            } else {
+                --bin;
+                below -= fine[bin];
+            }
+        }
+        while (below + fine[bin] <= rank) {
+            if ((bin & (RANK_BLOCK - 1)) == 0 &&
+                    below + blocks[bin >> RANK_BLOCK_SHIFT] <= rank) {
+                below += blocks[bin >> RANK_BLOCK_SHIFT];
+                bin += RANK_BLOCK;
+            } else {
+                below += fine[bin];
+                ++bin;
+            }
+        }
+        oline[ll] = (double)(bin + first_bin);
+    }
+    /* leave the histogram empty for the next line: */
+    for(rr = 0; rr < n_rows; rr++) {
+        for(kk = length - 1; kk < length - 1 + flength; kk++) {
+            npy_intp vv = (npy_intp)rows[rr][kk] - first_bin;
+            --fine[vv];
+            --blocks[vv >> RANK_BLOCK_SHIFT];
+        }
+    }
+}
+
+static int NI_CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Sort a few values: */
+static void NI_SortDoubles(double *values, npy_intp size)
+{
+    npy_intp ii, jj;
+
+    if (size > 64) {
+        qsort(values, size, sizeof(double), NI_CompareDoubles);
+        return;
+    }
+    for(ii = 1; ii < size; ii++) {
+        double value = values[ii];
+        for(jj = ii; jj > 0 && values[jj - 1] > value; jj--)
+            values[jj] = values[jj - 1];
+        values[jj] = value;
+    }
+}
+
+/* The sorted window is updated by merging it with the sorted column of
+   values that enter the window, leaving out the sorted column of values
+   that leave it. The scratch space holds two windows and two columns: */
+static void NI_RankSortedLine(NI_RankTask *task, double **rows,
+                              double *oline, double *scratch)
+{
+    npy_intp n_rows = task->window.n_rows, length = task->window.length;
+    npy_intp flength = task->flength, size = n_rows * flength;
+    double *sorted = scratch, *merged = scratch + size;
+    double *outs = merged + size, *ins = outs + n_rows;
+    npy_intp ll, rr, kk;
+
+    for(rr = 0; rr < n_rows; rr++) {
+        for(kk = 0; kk < flength; kk++)
+            sorted[rr * flength + kk] = rows[rr][kk];
+    }
+    qsort(sorted, size, sizeof(double), NI_CompareDoubles);
+    oline[0] = sorted[task->rank];
+    for(ll = 1; ll < length; ll++) {
+        npy_intp ii = 0, jj = 0, mm = 0;
+        double *tmp;
+
+        for(rr = 0; rr < n_rows; rr++) {
+            outs[rr] = rows[rr][ll - 1];
+            ins[rr] = rows[rr][ll + flength - 1];
+        }
+        NI_SortDoubles(outs, n_rows);
+        NI_SortDoubles(ins, n_rows);
+        for(kk = 0; kk < size; kk++) {
+            double value = sorted[kk];
+            if (ii < n_rows && value == outs[ii]) {
+                ++ii;
+                continue;
+            }
+            while (jj < n_rows && ins[jj] < value)
+                merged[mm++] = ins[jj++];
+            merged[mm++] = value;
+        }
+        while (jj < n_rows)
+            merged[mm++] = ins[jj++];
+        tmp = sorted;
+        sorted = merged;
+        merged = tmp;
+        oline[ll] = sorted[task->rank];
+    }
+}
+
+static int NI_RankLines(void *data, int part, int n_parts)
+{
+    NI_RankTask *task = (NI_RankTask *)data;
+    NI_LineWindow *window = &task->window;
+    NI_WindowWork *work = task->work + part;
+    npy_intp first = window->lines * part / n_parts;
+    npy_intp last = window->lines * (part + 1) / n_parts;
+    double *oline = (double *)work->scratch;
+    void *state = oline + window->length;
+    npy_intp ll;
+
+    if (task->bins > 0) {
+        memset(state, 0, (task->bins + (task->bins >> RANK_BLOCK_SHIFT)) *
+                         sizeof(npy_intp));
+    }
+    for(ll = first; ll < last; ll++) {
+        char *po = NI_GetWindowRows(window, ll, work);
+        if (task->bins > 0) {
+            NI_RankHistogramLine(task, work->rows, oline, state);
+        } else {
+            NI_RankSortedLine(task, work->rows, oline, state);
+        }
+        NI_StoreWindowLine(window, po, oline, window->length);
+    }
+    return 1;
+}
+
+/* Rank filter with a box-shaped footprint, sliding the window along the
+   last axis. Sets *done to 0 without an error if the filter does not
+   qualify, to leave it to the point by point filter: */
+static int NI_RankFilterWindow(PyArrayObject* input, int rank,
+                               PyArrayObject* footprint,
+                               PyArrayObject* output, NI_ExtendMode mode,
+                               double cvalue, npy_intp *origins, int *done)
+{
+    NI_RankTask task;
+    NI_LineWindow *window = &task.window;
+    npy_intp fsize, jj, row, flength, origin;
+    int ndim, ii, has_nan, n_parts = 0;
+    size_t scratch_size;
+    double cval = 0.0;
+    npy_bool *pf;
+    NPY_BEGIN_THREADS_DEF;
+
+    memset(&task, 0, sizeof(task));
+    *done = 0;
+    ndim = PyArray_NDIM(input);
+    if (ndim < 1 || PyArray_SIZE(input) == 0 ||
+            !NI_LineWindowType(PyArray_TYPE(input)) ||
+            !NI_LineWindowType(PyArray_TYPE(output)))
+        return 1;
+    fsize = PyArray_SIZE(footprint);
+    pf = (npy_bool*)PyArray_DATA(footprint);
+    for(jj = 0; jj < fsize; jj++) {
+        if (!pf[jj])
+            return 1;
+    }
+    /* a window of one point per row does not slide: */
+    flength = PyArray_DIM(footprint, ndim - 1);
+    origin = origins ? origins[ndim - 1] : 0;
+    if (flength < 2 || flength / 2 + origin < 0 ||
+            flength / 2 + origin >= flength)
+        return 1;
+    if ((mode == NI_EXTEND_CONSTANT || mode == NI_EXTEND_GRID_CONSTANT) &&
+            !NI_RankCval(PyArray_TYPE(input), cvalue, &cval))
+        return 1;
+    has_nan = NI_HasNaN(input);
+    if (has_nan)
+        return has_nan < 0 ? 0 : 1;
+
+    *done = 1;
+    if (!NI_InitLineWindow(input, output, flength, origin, mode, cval,
+                           window))
+        goto exit;
+    task.rank = rank;
+    task.flength = flength;
+    switch (PyArray_TYPE(input)) {
+    case NPY_BOOL:
+    case NPY_UBYTE:
+        task.bins = 1 << 8;
+        break;
+    case NPY_BYTE:
+        task.bins = 1 << 8;
+        task.first_bin = NPY_MIN_BYTE;
+        break;
+    case NPY_USHORT:
+        task.bins = 1 << 16;
+        break;
+    case NPY_SHORT:
+        task.bins = 1 << 16;
+        task.first_bin = NPY_MIN_SHORT;
+        break;
+    }
+
+    /* the rows of the window are all combinations of offsets along the
+       other axes: */
+    window->n_rows = fsize / flength;
+    window->row_offsets = malloc((window->n_rows * window->rank + 1) *
+                                 sizeof(npy_intp));
+    if (!window->row_offsets) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for(row = 0; row < window->n_rows; row++) {
+        npy_intp *offsets = window->row_offsets + row * window->rank;
+        npy_intp rr = row;
+        for(ii = window->rank - 1; ii >= 0; ii--) {
+            npy_intp size = PyArray_DIM(footprint, ii);
+            offsets[ii] = rr % size - size / 2 - (origins ? origins[ii] : 0);
+            rr /= size;
+        }
+    }
+
+    /* each thread needs an output line, and a histogram or a sorted
+       window: */
+    scratch_size = window->length * sizeof(double);
+    if (task.bins > 0) {
+        scratch_size += (task.bins + (task.bins >> RANK_BLOCK_SHIFT)) *
+                        sizeof(npy_intp);
+    } else {
+        scratch_size += 2 * (fsize + window->n_rows) * sizeof(double);
+    }
+    n_parts = NI_LineWindowParts(window, PyArray_SIZE(input) *
+                                 (window->n_rows + 1));
+    task.work = calloc(n_parts, sizeof(NI_WindowWork));
+    if (!task.work) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for(ii = 0; ii < n_parts; ii++) {
+        if (!NI_AllocateWindowWork(window, scratch_size, task.work + ii))
+            goto exit;
+    }
+
+    NPY_BEGIN_THREADS;
+    NI_ParallelFor(n_parts, NI_RankLines, &task);
+    NPY_END_THREADS;
+exit:
+    if (task.work) {
+        for(ii = 0; ii < n_parts; ii++)
+            NI_FreeWindowWork(task.work + ii);
+    }
+    free(task.work);
+    free(window->row_offsets);
+    return PyErr_Occurred() ? 0 : 1;
+}
+
 int NI_RankFilter(PyArrayObject* input, int rank,
                   PyArrayObject* footprint, PyArrayObject* output,
                   NI_ExtendMode mode, double cvalue, npy_intp *origins)
@@ -738,9 +1312,16 @@ int NI_RankFilter(PyArrayObject* input, int rank,
     char *pi, *po;
     npy_bool *pf = NULL;
     double *buffer = NULL;
-    int err = 0;
+    int err = 0, done;
     NPY_BEGIN_THREADS_DEF;
 
+    /* a box-shaped footprint slides along the last axis: */
+    if (!NI_RankFilterWindow(input, rank, footprint, output, mode, cvalue,
+                             origins, &done))
+        return 0;
+    if (done)
+        return 1;
+
     /* get the footprint: */
     fsize = PyArray_SIZE(footprint);
     pf = (npy_bool*)PyArray_DATA(footprint);
@@ -34,6 +34,7 @@
 #include "ni_splines.h"
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 
 /* map a coordinate outside the borders, according to the requested
@@ -137,71 +138,259 @@ map_coordinate(double in, npy_intp len, int mode)
     return in;
 }
 
-#define BUFFER_SIZE 256000
 #define TOLERANCE 1e-15
 
 
-/* one-dimensional spline filter: */
+/* the number of lines that are spline filtered together: */
+#define NI_SPLINE_LINES 16
+
+/* copy a block of lines at _pi to a buffer, interleaved: */
+#define CASE_SPLINE_READ_LINES(_TYPE, _type, _pi, _stride, _lstride, \
+                               _len, _nlines, _buffer)               \
+case _TYPE:                                                          \
+{                                                                    \
+    npy_intp _ii, _ll;                                               \
+    for (_ii = 0; _ii < _len; ++_ii) {                               \
+        const char *_p = _pi + _ii * _stride;                        \
+        double *_b = _buffer + _ii * _nlines;                        \
+        for (_ll = 0; _ll < _nlines; ++_ll)                          \
+            _b[_ll] = *(_type *)(_p + _ll * _lstride);               \
+    }                                                                \
+}                                                                    \
+break
+
+/* copy interleaved lines from a buffer to a block of lines at _po: */
+#define CASE_SPLINE_WRITE_LINES(_TYPE, _type, _po, _stride, _lstride, \
+                                _len, _nlines, _buffer)               \
+case _TYPE:                                                           \
+{                                                                     \
+    npy_intp _ii, _ll;                                                \
+    for (_ii = 0; _ii < _len; ++_ii) {                                \
+        char *_p = _po + _ii * _stride;                               \
+        const double *_b = _buffer + _ii * _nlines;                   \
+        for (_ll = 0; _ll < _nlines; ++_ll)                           \
+            *(_type *)(_p + _ll * _lstride) = (_type)_b[_ll];         \
+    }                                                                 \
+}                                                                     \
+break
+
+typedef struct {
+    char *pi, *po;
+    int rank, axis, inner, itype, otype, npoles;
+    NI_ExtendMode mode;
+    /* the number of lines in a full block, and of blocks: */
+    npy_intp len, block_lines, blocks, inner_blocks;
+    npy_intp shape[NPY_MAXDIMS];
+    npy_intp istrides[NPY_MAXDIMS], ostrides[NPY_MAXDIMS];
+    double poles[MAX_SPLINE_FILTER_POLES];
+    double *buffers;
+} NI_SplineFilterTask;
+
+/* Spline filter blocks of neighboring lines: */
+static int NI_SplineFilterLines(void *data, int part, int n_parts)
+{
+    NI_SplineFilterTask *task = (NI_SplineFilterTask *)data;
+    const npy_intp first = task->blocks * part / n_parts;
+    const npy_intp last = task->blocks * (part + 1) / n_parts;
+    const npy_intp len = task->len;
+    double *buffer = task->buffers + part * (len + 1) * task->block_lines;
+    double *scratch = buffer + len * task->block_lines;
+    npy_intp block;
+
+    for(block = first; block < last; block++) {
+        npy_intp outer = block / task->inner_blocks, nlines = 1;
+        npy_intp ioffset = 0, ooffset = 0, istride = 0, ostride = 0;
+        char *pi, *po;
+        int ll;
+
+        /* the position of the first line of the block: */
+        for(ll = task->rank - 1; ll >= 0; ll--) {
+            npy_intp coordinate;
+            if (ll == task->axis) {
+                continue;
+            } else if (ll == task->inner) {
+                coordinate = block % task->inner_blocks * NI_SPLINE_LINES;
+                nlines = task->shape[ll] - coordinate;
+                if (nlines > NI_SPLINE_LINES)
+                    nlines = NI_SPLINE_LINES;
+                istride = task->istrides[ll];
+                ostride = task->ostrides[ll];
+            } else {
+                coordinate = outer % task->shape[ll];
+                outer /= task->shape[ll];
+            }
+            ioffset += coordinate * task->istrides[ll];
+            ooffset += coordinate * task->ostrides[ll];
+        }
+        pi = task->pi + ioffset;
+        po = task->po + ooffset;
+
+        switch (task->itype) {
+            CASE_SPLINE_READ_LINES(NPY_BOOL, npy_bool, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_UBYTE, npy_ubyte, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_USHORT, npy_ushort, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_UINT, npy_uint, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_ULONG, npy_ulong, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_ULONGLONG, npy_ulonglong, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_BYTE, npy_byte, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_SHORT, npy_short, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_INT, npy_int, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_LONG, npy_long, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_LONGLONG, npy_longlong, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_FLOAT, npy_float, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+            CASE_SPLINE_READ_LINES(NPY_DOUBLE, npy_double, pi,
+                task->istrides[task->axis], istride, len, nlines, buffer);
+        default:
+            return 0;
+        }
+        if (len > 1) {
+            apply_filter_lines(buffer, len, nlines, task->poles,
+                               task->npoles, task->mode, scratch);
+        }
+        switch (task->otype) {
+            CASE_SPLINE_WRITE_LINES(NPY_BOOL, npy_bool, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_UBYTE, npy_ubyte, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_USHORT, npy_ushort, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_UINT, npy_uint, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_ULONG, npy_ulong, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_ULONGLONG, npy_ulonglong, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_BYTE, npy_byte, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_SHORT, npy_short, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_INT, npy_int, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_LONG, npy_long, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_LONGLONG, npy_longlong, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_FLOAT, npy_float, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+            CASE_SPLINE_WRITE_LINES(NPY_DOUBLE, npy_double, po,
+                task->ostrides[task->axis], ostride, len, nlines, buffer);
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int NI_SplineTypeSupported(int type)
+{
+    switch (type) {
+    case NPY_BOOL: case NPY_UBYTE: case NPY_USHORT: case NPY_UINT:
+    case NPY_ULONG: case NPY_ULONGLONG: case NPY_BYTE: case NPY_SHORT:
+    case NPY_INT: case NPY_LONG: case NPY_LONGLONG: case NPY_FLOAT:
+    case NPY_DOUBLE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* one-dimensional spline filter, the lines are filtered in blocks of
+     neighbors, so that the recursions run along all lines of a block at
+     once, and the blocks are split over the threads: */
 int NI_SplineFilter1D(PyArrayObject *input, int order, int axis,
                       NI_ExtendMode mode, PyArrayObject *output)
 {
-    int npoles = 0, more;
-    npy_intp kk, lines, len;
-    double *buffer = NULL, poles[MAX_SPLINE_FILTER_POLES];
-    NI_LineBuffer iline_buffer, oline_buffer;
+    NI_SplineFilterTask task;
+    npy_intp size, outer_lines = 1, inner_stride = 0;
+    int ll, n_parts;
     NPY_BEGIN_THREADS_DEF;
 
-    len = PyArray_NDIM(input) > 0 ? PyArray_DIM(input, axis) : 1;
-    if (len < 1)
+    memset(&task, 0, sizeof(task));
+    size = PyArray_SIZE(input);
+    task.rank = PyArray_NDIM(input);
+    task.axis = task.rank > 0 ? axis : 0;
+    task.len = task.rank > 0 ? PyArray_DIM(input, axis) : 1;
+    if (size < 1 || task.len < 1)
         goto exit;
 
     /* these are used in the spline filter calculation below: */
-    if (get_filter_poles(order, &npoles, poles)) {
+    if (get_filter_poles(order, &task.npoles, task.poles)) {
         goto exit;
     }
-
-    /* allocate an initialize the line buffer, only a single one is used,
-         because the calculation is in-place: */
-    lines = -1;
-    if (!NI_AllocateLineBuffer(input, axis, 0, 0, &lines, BUFFER_SIZE,
-                               &buffer)) {
-        goto exit;
-    }
-    if (!NI_InitLineBuffer(input, axis, 0, 0, lines, buffer,
-                           NI_EXTEND_DEFAULT, 0.0, &iline_buffer)) {
+    task.itype = PyArray_TYPE(input);
+    task.otype = PyArray_TYPE(output);
+    if (!NI_SplineTypeSupported(task.itype) ||
+        !NI_SplineTypeSupported(task.otype)) {
+        PyErr_SetString(PyExc_RuntimeError, "array type not supported");
         goto exit;
     }
-    if (!NI_InitLineBuffer(output, axis, 0, 0, lines, buffer,
-                           NI_EXTEND_DEFAULT, 0.0, &oline_buffer)) {
+    switch (mode) {
+    case NI_EXTEND_GRID_CONSTANT: case NI_EXTEND_CONSTANT:
+    case NI_EXTEND_MIRROR: case NI_EXTEND_WRAP: case NI_EXTEND_GRID_WRAP:
+    case NI_EXTEND_NEAREST: case NI_EXTEND_REFLECT:
+        break;
+    default:
+        PyErr_Format(PyExc_RuntimeError, "mode %d not supported", mode);
         goto exit;
     }
-    NPY_BEGIN_THREADS;
+    task.mode = mode;
+    task.pi = (void *)PyArray_DATA(input);
+    task.po = (void *)PyArray_DATA(output);
 
-    /* iterate over all the array lines: */
-    do {
-        /* copy lines from array to buffer: */
-        if (!NI_ArrayToLineBuffer(&iline_buffer, &lines, &more)) {
-            goto exit;
-        }
-        /* iterate over the lines in the buffer: */
-        for(kk = 0; kk < lines; kk++) {
-            /* get line: */
-            double *ln = NI_GET_LINE(iline_buffer, kk);
-            /* spline filter: */
-            if (len > 1) {
-                apply_filter(ln, len, poles, npoles, mode);
-            }
+    /* the lines of a block are neighbors along the axis with the
+       smallest stride, other than the filtered axis: */
+    task.inner = -1;
+    for(ll = 0; ll < task.rank; ll++) {
+        npy_intp stride = PyArray_STRIDE(input, ll);
+        task.shape[ll] = PyArray_DIM(input, ll);
+        task.istrides[ll] = stride;
+        task.ostrides[ll] = PyArray_STRIDE(output, ll);
+        if (stride < 0)
+            stride = -stride;
+        if (ll != task.axis && task.shape[ll] > 1 &&
+            (task.inner < 0 || stride < inner_stride)) {
+            task.inner = ll;
+            inner_stride = stride;
         }
+    }
+    for(ll = 0; ll < task.rank; ll++)
+        if (ll != task.axis && ll != task.inner)
+            outer_lines *= task.shape[ll];
+    task.block_lines = task.inner < 0 ? 1 : task.shape[task.inner];
+    if (task.block_lines > NI_SPLINE_LINES)
+        task.block_lines = NI_SPLINE_LINES;
+    task.inner_blocks = task.inner < 0 ? 1 :
+            (task.shape[task.inner] + NI_SPLINE_LINES - 1) / NI_SPLINE_LINES;
+    task.blocks = outer_lines * task.inner_blocks;
 
-        /* copy lines from buffer to array: */
-        if (!NI_LineBufferToArray(&oline_buffer)) {
-            goto exit;
-        }
-    } while(more);
+    n_parts = NI_NumThreads(size * (task.npoles + 1));
+    if (n_parts > task.blocks)
+        n_parts = (int)task.blocks;
+    task.buffers = malloc(n_parts * (task.len + 1) * task.block_lines *
+                          sizeof(double));
+    if (!task.buffers) {
+        PyErr_NoMemory();
+        goto exit;
+    }
 
- exit:
+    NPY_BEGIN_THREADS;
+    NI_ParallelFor(n_parts, NI_SplineFilterLines, &task);
     NPY_END_THREADS;
-    free(buffer);
+
+ exit:
+    free(task.buffers);
     return PyErr_Occurred() ? 0 : 1;
 }
 
@@ -222,6 +411,16 @@ case _TYPE:                                                \
     _coeff = *(_type *)(_pi + _idx);                       \
     break
 
+/* copy all values under the spline filter at _pi to _values */
+#define CASE_INTERP_VALUES(_TYPE, _type, _values, _pi, _offsets, _size) \
+case _TYPE:                                                             \
+{                                                                       \
+    npy_intp _hh;                                                       \
+    for (_hh = 0; _hh < _size; ++_hh)                                   \
+        _values[_hh] = *(_type *)(_pi + _offsets[_hh]);                 \
+}                                                                       \
+break
+
 #define CASE_INTERP_OUT(_TYPE, _type, _po, _t) \
 case _TYPE:                                    \
     *(_type *)_po = (_type)_t;                 \
@@ -252,411 +451,808 @@ int _get_spline_boundary_mode(int mode)
     return mode;
 }
 
-int
-NI_GeometricTransform(PyArrayObject *input, int (*map)(npy_intp*, double*,
-                int, int, void*), void* map_data, PyArrayObject* matrix_ar,
-                PyArrayObject* shift_ar, PyArrayObject *coordinates,
-                PyArrayObject *output, int order, int mode, double cval,
-                int nprepad)
-{
-    char *po, *pi, *pc = NULL;
-    npy_intp **edge_offsets = NULL, **data_offsets = NULL, filter_size;
-    char **edge_grid_const = NULL;
-    npy_intp ftmp[NPY_MAXDIMS], *fcoordinates = NULL, *foffsets = NULL;
-    npy_intp cstride = 0, kk, hh, ll, jj;
-    npy_intp size;
-    double **splvals = NULL, icoor[NPY_MAXDIMS];
+/* the spline filter and the arrays of an interpolation, shared by all
+     threads: */
+typedef struct {
+    char *pi, *po;
+    int itype, otype, rank, order;
+    double cval;
     npy_intp idimensions[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
-    NI_Iterator io, ic;
-    npy_double *matrix = matrix_ar ? (npy_double*)PyArray_DATA(matrix_ar) : NULL;
-    npy_double *shift = shift_ar ? (npy_double*)PyArray_DATA(shift_ar) : NULL;
-    int irank = 0, orank, spline_mode;
-    NPY_BEGIN_THREADS_DEF;
-
-    NPY_BEGIN_THREADS;
+    npy_intp filter_size, *fcoordinates, *foffsets, size;
+    NI_Iterator io;
+} NI_Interpolator;
 
-    for(kk = 0; kk < PyArray_NDIM(input); kk++) {
-        idimensions[kk] = PyArray_DIM(input, kk);
-        istrides[kk] = PyArray_STRIDE(input, kk);
+static int
+NI_InterpolationTypeSupported(int type_num)
+{
+    switch (type_num) {
+    case NPY_BOOL:
+    case NPY_UBYTE:
+    case NPY_USHORT:
+    case NPY_UINT:
+    case NPY_ULONG:
+    case NPY_ULONGLONG:
+    case NPY_BYTE:
+    case NPY_SHORT:
+    case NPY_INT:
+    case NPY_LONG:
+    case NPY_LONGLONG:
+    case NPY_FLOAT:
+    case NPY_DOUBLE:
+        return 1;
+    default:
+        return 0;
     }
-    irank = PyArray_NDIM(input);
-    orank = PyArray_NDIM(output);
+}
 
-    /* if the mapping is from array coordinates: */
-    if (coordinates) {
-        /* initialize a line iterator along the first axis: */
-        if (!NI_InitPointIterator(coordinates, &ic))
-            goto exit;
-        cstride = ic.strides[0];
-        if (!NI_LineIterator(&ic, 0))
-            goto exit;
-        pc = (void *)(PyArray_DATA(coordinates));
+static int
+NI_InitInterpolator(PyArrayObject *input, PyArrayObject *output, int order,
+                    double cval, NI_Interpolator *ip)
+{
+    npy_intp ftmp[NPY_MAXDIMS], hh, jj, kk;
+
+    /* the data types are checked here, the threads can not report
+       errors: */
+    if (!NI_InterpolationTypeSupported(PyArray_TYPE(input)) ||
+        !NI_InterpolationTypeSupported(PyArray_TYPE(output))) {
+        PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+        return 0;
+    }
+    ip->pi = (void *)PyArray_DATA(input);
+    ip->po = (void *)PyArray_DATA(output);
+    ip->itype = PyArray_TYPE(input);
+    ip->otype = PyArray_TYPE(output);
+    ip->rank = PyArray_NDIM(input);
+    ip->order = order;
+    ip->cval = cval;
+    for(kk = 0; kk < ip->rank; kk++) {
+        ip->idimensions[kk] = PyArray_DIM(input, kk);
+        ip->istrides[kk] = PyArray_STRIDE(input, kk);
     }
+    ip->size = PyArray_SIZE(output);
+    if (!NI_InitPointIterator(output, &ip->io))
+        return 0;
 
-    /* offsets used at the borders: */
-    edge_offsets = malloc(irank * sizeof(npy_intp*));
-    data_offsets = malloc(irank * sizeof(npy_intp*));
-    if (NPY_UNLIKELY(!edge_offsets || !data_offsets)) {
-        NPY_END_THREADS;
+    ip->filter_size = 1;
+    for(jj = 0; jj < ip->rank; jj++)
+        ip->filter_size *= order + 1;
+
+    /* make a table of all possible coordinates within the spline filter: */
+    ip->fcoordinates = malloc((ip->rank * ip->filter_size + 1) *
+                              sizeof(npy_intp));
+    /* make a table of all offsets within the spline filter: */
+    ip->foffsets = malloc(ip->filter_size * sizeof(npy_intp));
+    if (NPY_UNLIKELY(!ip->fcoordinates || !ip->foffsets)) {
         PyErr_NoMemory();
-        goto exit;
+        return 0;
+    }
+    for(jj = 0; jj < ip->rank; jj++)
+        ftmp[jj] = 0;
+    kk = 0;
+    for(hh = 0; hh < ip->filter_size; hh++) {
+        for(jj = 0; jj < ip->rank; jj++)
+            ip->fcoordinates[jj + hh * ip->rank] = ftmp[jj];
+        ip->foffsets[hh] = kk;
+        for(jj = ip->rank - 1; jj >= 0; jj--) {
+            if (ftmp[jj] < order) {
+                ftmp[jj]++;
+                kk += ip->istrides[jj];
+                break;
+            } else {
+                ftmp[jj] = 0;
+                kk -= ip->istrides[jj] * order;
+            }
+        }
     }
+    return 1;
+}
 
-    if (mode == NI_EXTEND_GRID_CONSTANT) {
-        // boolean indicating if the current point in the filter footprint is
-        // outside the bounds
-        edge_grid_const = malloc(irank * sizeof(char*));
-        if (NPY_UNLIKELY(!edge_grid_const)) {
-            NPY_END_THREADS;
-            PyErr_NoMemory();
-            goto exit;
+static void
+NI_FreeInterpolator(NI_Interpolator *ip)
+{
+    free(ip->fcoordinates);
+    free(ip->foffsets);
+}
+
+/* the output points are split in contiguous blocks, one per part: place
+     the output iterator at the first point of a part: */
+static void
+NI_InterpolatorStart(const NI_Interpolator *ip, npy_intp index,
+                     NI_Iterator *io, char **po)
+{
+    int ii;
+
+    *io = ip->io;
+    *po = ip->po;
+    for(ii = io->rank_m1; ii >= 0; ii--) {
+        npy_intp dim = io->dimensions[ii] + 1;
+        io->coordinates[ii] = index % dim;
+        index /= dim;
+        *po += io->coordinates[ii] * io->strides[ii];
+    }
+}
+
+/* interpolate at one point: offset is the offset of the start of the
+     filter, edge_offsets the offsets at the borders of the axes that need
+     them and edge_grid_const the filter points that fall outside the
+     input in grid-constant mode. Both are NULL if not needed at this
+     point. The input values are gathered into values first, so that the
+     type of the input is only checked once per point: */
+static double
+NI_Interpolate(const NI_Interpolator *ip, npy_intp offset,
+               npy_intp **edge_offsets, char **edge_grid_const,
+               double **splvals, double *values)
+{
+    const int rank = ip->rank, order = ip->order;
+    const npy_intp filter_size = ip->filter_size;
+    npy_intp *ff = ip->fcoordinates, hh, ll;
+    double t = 0.0;
+
+    if (!edge_offsets && !edge_grid_const) {
+        char *pi = ip->pi + offset;
+        switch (ip->itype) {
+            CASE_INTERP_VALUES(NPY_BOOL, npy_bool,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_UBYTE, npy_ubyte,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_USHORT, npy_ushort,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_UINT, npy_uint,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_ULONG, npy_ulong,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_ULONGLONG, npy_ulonglong,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_BYTE, npy_byte,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_SHORT, npy_short,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_INT, npy_int,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_LONG, npy_long,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_LONGLONG, npy_longlong,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_FLOAT, npy_float,
+                               values, pi, ip->foffsets, filter_size);
+            CASE_INTERP_VALUES(NPY_DOUBLE, npy_double,
+                               values, pi, ip->foffsets, filter_size);
+        default:
+            break;
         }
-        for(jj = 0; jj < irank; jj++)
-            edge_grid_const[jj] = NULL;
-        for(jj = 0; jj < irank; jj++) {
-            edge_grid_const[jj] = malloc((order + 1) * sizeof(char));
-            if (NPY_UNLIKELY(!edge_grid_const[jj])) {
-                NPY_END_THREADS;
-                PyErr_NoMemory();
-                goto exit;
+    } else {
+        for(hh = 0; hh < filter_size; hh++) {
+            npy_intp idx = 0;
+            char is_cval = 0;
+            if (edge_grid_const) {
+                for(ll = 0; ll < rank; ll++) {
+                    if (edge_grid_const[ll] && edge_grid_const[ll][ff[ll]])
+                        is_cval = 1;
+                }
             }
+            if (is_cval) {
+                values[hh] = ip->cval;
+            } else {
+                if (edge_offsets) {
+                    /* use precalculated edge offsets: */
+                    for(ll = 0; ll < rank; ll++) {
+                        if (edge_offsets[ll])
+                            idx += edge_offsets[ll][ff[ll]];
+                        else
+                            idx += ff[ll] * ip->istrides[ll];
+                    }
+                } else {
+                    idx = ip->foffsets[hh];
+                }
+                idx += offset;
+                switch (ip->itype) {
+                    CASE_INTERP_COEFF(NPY_BOOL, npy_bool,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_UBYTE, npy_ubyte,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_USHORT, npy_ushort,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_UINT, npy_uint,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_ULONG, npy_ulong,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_ULONGLONG, npy_ulonglong,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_BYTE, npy_byte,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_SHORT, npy_short,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_INT, npy_int,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_LONG, npy_long,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_LONGLONG, npy_longlong,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_FLOAT, npy_float,
+                                      values[hh], ip->pi, idx);
+                    CASE_INTERP_COEFF(NPY_DOUBLE, npy_double,
+                                      values[hh], ip->pi, idx);
+                default:
+                    break;
+                }
+            }
+            ff += rank;
         }
+        ff = ip->fcoordinates;
     }
 
-    for(jj = 0; jj < irank; jj++)
-        data_offsets[jj] = NULL;
-    for(jj = 0; jj < irank; jj++) {
-        data_offsets[jj] = malloc((order + 1) * sizeof(npy_intp));
-        if (NPY_UNLIKELY(!data_offsets[jj])) {
-            NPY_END_THREADS;
-            PyErr_NoMemory();
-            goto exit;
+    /* calculate the interpolated value, in the same order for all ranks: */
+    if (order > 0 && rank == 1) {
+        for(hh = 0; hh <= order; hh++)
+            t += values[hh] * splvals[0][hh];
+    } else if (order > 0 && rank == 2) {
+        for(hh = 0; hh <= order; hh++)
+            for(ll = 0; ll <= order; ll++)
+                t += *values++ * splvals[0][hh] * splvals[1][ll];
+    } else if (order > 0) {
+        for(hh = 0; hh < filter_size; hh++) {
+            double coeff = values[hh];
+            for(ll = 0; ll < rank; ll++)
+                coeff *= splvals[ll][ff[ll]];
+            t += coeff;
+            ff += rank;
         }
+    } else {
+        for(hh = 0; hh < filter_size; hh++)
+            t += values[hh];
     }
-    /* will hold the spline coefficients: */
-    splvals = malloc(irank * sizeof(double*));
-    if (NPY_UNLIKELY(!splvals)) {
-        NPY_END_THREADS;
-        PyErr_NoMemory();
-        goto exit;
+    return t;
+}
+
+static void
+NI_StoreInterpolated(int type_num, char *po, double t)
+{
+    switch (type_num) {
+        CASE_INTERP_OUT(NPY_BOOL, npy_bool, po, t);
+        CASE_INTERP_OUT_UINT(UBYTE, npy_ubyte, po, t);
+        CASE_INTERP_OUT_UINT(USHORT, npy_ushort, po, t);
+        CASE_INTERP_OUT_UINT(UINT, npy_uint, po, t);
+        CASE_INTERP_OUT_UINT(ULONG, npy_ulong, po, t);
+        CASE_INTERP_OUT_UINT(ULONGLONG, npy_ulonglong, po, t);
+        CASE_INTERP_OUT_INT(BYTE, npy_byte, po, t);
+        CASE_INTERP_OUT_INT(SHORT, npy_short, po, t);
+        CASE_INTERP_OUT_INT(INT, npy_int, po, t);
+        CASE_INTERP_OUT_INT(LONG, npy_long, po, t);
+        CASE_INTERP_OUT_INT(LONGLONG, npy_longlong, po, t);
+        CASE_INTERP_OUT(NPY_FLOAT, npy_float, po, t);
+        CASE_INTERP_OUT(NPY_DOUBLE, npy_double, po, t);
+    default:
+        break;
     }
-    for(jj = 0; jj < irank; jj++)
-        splvals[jj] = NULL;
-    for(jj = 0; jj < irank; jj++) {
-        splvals[jj] = malloc((order + 1) * sizeof(double));
-        if (NPY_UNLIKELY(!splvals[jj])) {
-            NPY_END_THREADS;
-            PyErr_NoMemory();
-            goto exit;
+}
+
+/* the spline filter along one input axis at one input coordinate: */
+typedef struct {
+    /* the point is outside the input, under the constant border
+       condition: */
+    int constant;
+    /* offset of the start of the filter: */
+    npy_intp offset;
+    /* offsets at a border, and filter points outside the input in
+       grid-constant mode, or NULL if not needed: */
+    npy_intp *edge_offsets;
+    char *grid_const;
+    double *splvals;
+    /* storage of edge_offsets, grid_const and splvals: */
+    npy_intp *edge_buffer;
+    char *grid_buffer;
+} NI_AxisFilter;
+
+static void
+NI_AxisFilterAt(const NI_Interpolator *ip, int axis, double cc, int mode,
+                int spline_mode, NI_AxisFilter *af)
+{
+    const int order = ip->order;
+    const npy_intp dim = ip->idimensions[axis];
+    npy_intp start, idx, ll;
+
+    af->edge_offsets = NULL;
+    af->grid_const = NULL;
+    if ((mode != NI_EXTEND_GRID_CONSTANT) && (mode != NI_EXTEND_NEAREST)) {
+        /* if the input coordinate is outside the borders, map it: */
+        cc = map_coordinate(cc, dim, mode);
+    }
+    af->constant = !(cc > -1.0 || mode == NI_EXTEND_GRID_CONSTANT ||
+                     mode == NI_EXTEND_NEAREST);
+    if (af->constant)
+        return;
+
+    /* find the filter location along this axis: */
+    if (order & 1) {
+        start = (npy_intp)floor(cc) - order / 2;
+    } else {
+        start = (npy_intp)floor(cc + 0.5) - order / 2;
+    }
+    /* get the offset to the start of the filter: */
+    af->offset = ip->istrides[axis] * start;
+
+    if (mode == NI_EXTEND_GRID_CONSTANT) {
+        // Determine locations in the filter footprint that are
+        // outside the range.
+        for(ll = 0; ll <= order; ll++) {
+            idx = start + ll;
+            af->grid_buffer[ll] = (idx < 0 || idx >= dim);
+            if (af->grid_buffer[ll])
+                af->grid_const = af->grid_buffer;
+        }
+    } else if (start < 0 || start + order >= dim) {
+        /* implement border mapping, if outside border: */
+        af->edge_offsets = af->edge_buffer;
+        for(ll = 0; ll <= order; ll++) {
+            idx = start + ll;
+            idx = (npy_intp)map_coordinate(idx, dim, spline_mode);
+
+            /* calculate and store the offsets at this edge: */
+            af->edge_offsets[ll] = ip->istrides[axis] * (idx - start);
         }
     }
+    get_spline_interpolation_weights(cc, order, af->splvals);
+}
+
+/* point the storage of af at the slot-th filter in the given buffers: */
+static void
+NI_AxisFilterStorage(NI_AxisFilter *af, int order, npy_intp slot,
+                     npy_intp *edge_offsets, char *grid_const,
+                     double *splvals)
+{
+    af->edge_buffer = edge_offsets + slot * (order + 1);
+    af->grid_buffer = grid_const ? grid_const + slot * (order + 1) : NULL;
+    af->splvals = splvals + slot * (order + 1);
+}
 
-    filter_size = 1;
-    for(jj = 0; jj < irank; jj++)
-        filter_size *= order + 1;
+typedef struct {
+    NI_Interpolator ip;
+    int (*map)(npy_intp*, double*, int, int, void*);
+    void *map_data;
+    npy_double *matrix, *shift;
+    char *pc;
+    npy_intp cstride;
+    int ctype, orank, mode, spline_mode, nprepad;
+    NI_Iterator ic;
+    /* affine transforms: the input axes whose coordinate does not change
+       along the last output axis, and the filters of the input axes
+       whose coordinate only depends on the last output coordinate, per
+       output coordinate (NULL for the other axes): */
+    int row_constant[NPY_MAXDIMS];
+    NI_AxisFilter *columns[NPY_MAXDIMS];
+    npy_intp *column_offsets;
+    char *column_grid_const;
+    double *column_splvals;
+    /* per part: offsets and flags at the borders, spline coefficients and
+       the input values under the filter: */
+    npy_intp *data_offsets;
+    char *grid_const;
+    double *splvals, *values;
+} NI_TransformTask;
 
-    /* initialize output iterator: */
-    if (!NI_InitPointIterator(output, &io))
-        goto exit;
+/* input coordinate along axis hh of the affine transform at the output
+   coordinates oc: */
+static double
+NI_AffineCoordinate(const NI_TransformTask *task, int hh, const npy_intp *oc)
+{
+    const npy_double *p = task->matrix + hh * task->orank;
+    double cc = 0.0;
+    int ll;
 
-    /* get data pointers: */
-    pi = (void *)PyArray_DATA(input);
-    po = (void *)PyArray_DATA(output);
+    for(ll = 0; ll < task->orank; ll++)
+        cc += oc[ll] * p[ll];
+    return cc + task->shift[hh];
+}
 
-    /* make a table of all possible coordinates within the spline filter: */
-    fcoordinates = malloc(irank * filter_size * sizeof(npy_intp));
-    /* make a table of all offsets within the spline filter: */
-    foffsets = malloc(filter_size * sizeof(npy_intp));
-    if (NPY_UNLIKELY(!fcoordinates || !foffsets)) {
-        NPY_END_THREADS;
+/* the input coordinate along axis hh does not change along the output
+   rows: */
+static int
+NI_AffineRowConstant(const NI_TransformTask *task, int hh)
+{
+    return task->matrix[hh * task->orank + task->orank - 1] == 0.0;
+}
+
+/* the input coordinate along axis hh only depends on the last output
+   coordinate: */
+static int
+NI_AffineColumnOnly(const NI_TransformTask *task, int hh)
+{
+    const npy_double *p = task->matrix + hh * task->orank;
+    int ll;
+
+    for(ll = 0; ll < task->orank - 1; ll++)
+        if (p[ll] != 0.0)
+            return 0;
+    return !NI_AffineRowConstant(task, hh);
+}
+
+/* the filters of an affine transform that are the same for all points of
+   an output row, or for all points of an output column, are computed
+   once: */
+static int
+NI_InitAffineFilters(NI_TransformTask *task)
+{
+    const NI_Interpolator *ip = &task->ip;
+    const int irank = ip->rank, orank = task->orank, order = ip->order;
+    npy_intp ncolumns, oc[NPY_MAXDIMS], kk, nn = 0;
+    int hh, ll;
+
+    if (orank < 1)
+        return 1;
+    ncolumns = task->ip.io.dimensions[orank - 1] + 1;
+    for(ll = 0; ll < orank; ll++)
+        oc[ll] = 0;
+    for(hh = 0; hh < irank; hh++) {
+        task->row_constant[hh] = NI_AffineRowConstant(task, hh);
+        if (NI_AffineColumnOnly(task, hh))
+            ++nn;
+    }
+    if (nn == 0)
+        return 1;
+
+    task->column_offsets = malloc(nn * ncolumns * (order + 1) *
+                                  sizeof(npy_intp));
+    task->column_splvals = malloc(nn * ncolumns * (order + 1) *
+                                  sizeof(double));
+    if (task->mode == NI_EXTEND_GRID_CONSTANT)
+        task->column_grid_const = malloc(nn * ncolumns * (order + 1));
+    if (NPY_UNLIKELY(!task->column_offsets || !task->column_splvals ||
+                     (task->mode == NI_EXTEND_GRID_CONSTANT &&
+                      !task->column_grid_const))) {
         PyErr_NoMemory();
-        goto exit;
+        return 0;
     }
-    for(jj = 0; jj < irank; jj++)
-        ftmp[jj] = 0;
-    kk = 0;
-    for(hh = 0; hh < filter_size; hh++) {
-        for(jj = 0; jj < irank; jj++)
-            fcoordinates[jj + hh * irank] = ftmp[jj];
-        foffsets[hh] = kk;
-        for(jj = irank - 1; jj >= 0; jj--) {
-            if (ftmp[jj] < order) {
-                ftmp[jj]++;
-                kk += istrides[jj];
-                break;
-            } else {
-                ftmp[jj] = 0;
-                kk -= istrides[jj] * order;
-            }
+
+    nn = 0;
+    for(hh = 0; hh < irank; hh++) {
+        if (!NI_AffineColumnOnly(task, hh))
+            continue;
+        task->columns[hh] = malloc(ncolumns * sizeof(NI_AxisFilter));
+        if (NPY_UNLIKELY(!task->columns[hh])) {
+            PyErr_NoMemory();
+            return 0;
         }
+        for(kk = 0; kk < ncolumns; kk++) {
+            NI_AxisFilter *af = task->columns[hh] + kk;
+            NI_AxisFilterStorage(af, order, nn * ncolumns + kk,
+                                 task->column_offsets,
+                                 task->column_grid_const,
+                                 task->column_splvals);
+            oc[orank - 1] = kk;
+            NI_AxisFilterAt(ip, hh, NI_AffineCoordinate(task, hh, oc) +
+                            task->nprepad, task->mode, task->spline_mode, af);
+        }
+        ++nn;
     }
+    return 1;
+}
 
-    spline_mode = _get_spline_boundary_mode(mode);
+static int
+NI_TransformPoints(void *data, int part, int n_parts)
+{
+    NI_TransformTask *task = (NI_TransformTask*)data;
+    const NI_Interpolator *ip = &task->ip;
+    const int irank = ip->rank, orank = task->orank, order = ip->order;
+    const int mode = task->mode, spline_mode = task->spline_mode;
+    const npy_intp first = ip->size * part / n_parts;
+    const npy_intp last = ip->size * (part + 1) / n_parts;
+    const npy_intp nsplvals = irank * (order + 1) + 1;
+    npy_intp *edge_offsets[NPY_MAXDIMS];
+    char *edge_grid_const[NPY_MAXDIMS];
+    double *splvals[NPY_MAXDIMS], icoor[NPY_MAXDIMS];
+    double *values = task->values + part * ip->filter_size;
+    NI_AxisFilter filters[NPY_MAXDIMS];
+    const NI_AxisFilter *axes[NPY_MAXDIMS];
+    npy_intp kk, hh;
+    NI_Iterator io;
+    char *po, *pc = NULL;
+
+    if (first >= last)
+        return 1;
+    for(hh = 0; hh < irank; hh++)
+        NI_AxisFilterStorage(filters + hh, order, hh,
+                             task->data_offsets + part * nsplvals,
+                             task->grid_const ?
+                                 task->grid_const + part * nsplvals : NULL,
+                             task->splvals + part * nsplvals);
+    NI_InterpolatorStart(ip, first, &io, &po);
+    if (task->pc) {
+        pc = task->pc;
+        for(hh = 0; hh < orank; hh++)
+            pc += io.coordinates[hh] * task->ic.strides[hh];
+    }
 
-    size = PyArray_SIZE(output);
-    for(kk = 0; kk < size; kk++) {
+    for(kk = first; kk < last; kk++) {
         double t = 0.0;
-        int constant = 0, edge = 0;
+        int constant = 0, edge = 0, grid_edge = 0;
         npy_intp offset = 0;
-        if (mode == NI_EXTEND_GRID_CONSTANT) {
-            // reset edge flags for each location in the filter footprint
-            for (hh = 0; hh < irank; hh++) {
-                for(ll = 0; ll <= order; ll++) {
-                    edge_grid_const[hh][ll] = 0;
-                }
-            }
-        }
-        if (map) {
-            NPY_END_THREADS;
-            /* call mappint functions: */
-            if (!map(io.coordinates, icoor, orank, irank, map_data)) {
+        if (task->map) {
+            /* call mapping function, this only happens on the calling
+               thread: */
+            if (!task->map(io.coordinates, icoor, orank, irank,
+                           task->map_data)) {
                 if (!PyErr_Occurred())
                     PyErr_SetString(PyExc_RuntimeError,
                                     "unknown error in mapping function");
-                goto exit;
+                return 0;
             }
-            NPY_BEGIN_THREADS;
-        } else if (matrix) {
-            /* do an affine transformation: */
-            npy_double *p = matrix;
+        } else if (task->matrix) {
+            /* do an affine transformation, the filters of the axes that
+               only depend on the last output coordinate are tabulated, and
+               those that do not depend on it are computed at the start of
+               each output row: */
+            const int new_row = kk == first || io.coordinates[orank - 1] == 0;
             for(hh = 0; hh < irank; hh++) {
-                icoor[hh] = 0.0;
-                for(ll = 0; ll < orank; ll++)
-                    icoor[hh] += io.coordinates[ll] * *p++;
-                icoor[hh] += shift[hh];
+                if (task->columns[hh]) {
+                    axes[hh] = task->columns[hh] + io.coordinates[orank - 1];
+                } else {
+                    axes[hh] = filters + hh;
+                    if (new_row || !task->row_constant[hh])
+                        NI_AxisFilterAt(ip, hh, NI_AffineCoordinate(task, hh,
+                                        io.coordinates) + task->nprepad,
+                                        mode, spline_mode, filters + hh);
+                }
             }
-        } else if (coordinates) {
+        } else if (pc) {
             /* mapping is from an coordinates array: */
             char *p = pc;
-            switch (PyArray_TYPE(coordinates)) {
+            switch (task->ctype) {
                 CASE_MAP_COORDINATES(NPY_BOOL, npy_bool,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_UBYTE, npy_ubyte,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_USHORT, npy_ushort,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_UINT, npy_uint,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_ULONG, npy_ulong,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_ULONGLONG, npy_ulonglong,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_BYTE, npy_byte,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_SHORT, npy_short,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_INT, npy_int,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_LONG, npy_long,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_LONGLONG, npy_longlong,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_FLOAT, npy_float,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
                 CASE_MAP_COORDINATES(NPY_DOUBLE, npy_double,
-                                     p, icoor, irank, cstride);
+                                     p, icoor, irank, task->cstride);
             default:
-                NPY_END_THREADS;
-                PyErr_SetString(PyExc_RuntimeError,
-                                "coordinate array data type not supported");
-                goto exit;
+                break;
             }
         }
 
-        /* iterate over axes: */
-        for(hh = 0; hh < irank; hh++) {
-            double cc = icoor[hh] + nprepad;
-            if ((mode != NI_EXTEND_GRID_CONSTANT) && (mode != NI_EXTEND_NEAREST)) {
-                /* if the input coordinate is outside the borders, map it: */
-                cc = map_coordinate(cc, idimensions[hh], mode);
+        if (!task->matrix) {
+            /* find the filters along the axes: */
+            for(hh = 0; hh < irank; hh++) {
+                axes[hh] = filters + hh;
+                NI_AxisFilterAt(ip, hh, icoor[hh] + task->nprepad, mode,
+                                spline_mode, filters + hh);
+                if (axes[hh]->constant)
+                    break;
             }
-            if (cc > -1.0 || mode == NI_EXTEND_GRID_CONSTANT || mode == NI_EXTEND_NEAREST) {
-                /* find the filter location along this axis: */
-                npy_intp start;
-                if (order & 1) {
-                    start = (npy_intp)floor(cc) - order / 2;
-                } else {
-                    start = (npy_intp)floor(cc + 0.5) - order / 2;
-                }
-                /* get the offset to the start of the filter: */
-                offset += istrides[hh] * start;
-                npy_intp idx = 0;
-
-                if (mode == NI_EXTEND_GRID_CONSTANT) {
-                    // Determine locations in the filter footprint that are
-                    // outside the range.
-                    for(ll = 0; ll <= order; ll++) {
-                        idx = start + ll;
-                        edge_grid_const[hh][ll] = (idx < 0 || idx >= idimensions[hh]);
-                    }
-                } else {
-
-                    if (start < 0 || start + order >= idimensions[hh]) {
-                        /* implement border mapping, if outside border: */
-                        edge = 1;
-                        edge_offsets[hh] = data_offsets[hh];
-
-                        for(ll = 0; ll <= order; ll++) {
-                            idx = start + ll;
-                            idx = (npy_intp)map_coordinate(idx, idimensions[hh], spline_mode);
+        }
 
-                            /* calculate and store the offsets at this edge: */
-                            edge_offsets[hh][ll] = istrides[hh] * (idx - start);
-                        }
-                    } else {
-                        /* we are not at the border, use precalculated offsets: */
-                        edge_offsets[hh] = NULL;
-                    }
-                }
-                get_spline_interpolation_weights(cc, order, splvals[hh]);
-            } else {
+        /* iterate over axes: */
+        for(hh = 0; hh < irank; hh++) {
+            const NI_AxisFilter *af = axes[hh];
+            if (af->constant) {
                 /* we use the constant border condition: */
                 constant = 1;
                 break;
             }
+            offset += af->offset;
+            edge_offsets[hh] = af->edge_offsets;
+            edge_grid_const[hh] = af->grid_const;
+            splvals[hh] = af->splvals;
+            edge |= af->edge_offsets != NULL;
+            grid_edge |= af->grid_const != NULL;
         }
 
         if (!constant) {
-            npy_intp *ff = fcoordinates;
-            const int type_num = PyArray_TYPE(input);
-            t = 0.0;
-            for(hh = 0; hh < filter_size; hh++) {
-                double coeff = 0.0;
-                npy_intp idx = 0;
-                char is_cval = 0;
-                if (mode == NI_EXTEND_GRID_CONSTANT) {
-                    for(ll = 0; ll < irank; ll++) {
-                        if (edge_grid_const[ll][ff[ll]]) {
-                            is_cval = 1;
-                        }
-                    }
-                }
-                if (is_cval) {
-                    coeff = cval;
-                } else {
-                    if (NPY_UNLIKELY(edge)) {
-                        for(ll = 0; ll < irank; ll++) {
-                            if (edge_offsets[ll])
-                                idx += edge_offsets[ll][ff[ll]];
-                            else
-                                idx += ff[ll] * istrides[ll];
-                        }
-                    } else {
-                        idx = foffsets[hh];
-                    }
-                    idx += offset;
-                    switch (type_num) {
-                        CASE_INTERP_COEFF(NPY_BOOL, npy_bool,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_UBYTE, npy_ubyte,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_USHORT, npy_ushort,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_UINT, npy_uint,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_ULONG, npy_ulong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_ULONGLONG, npy_ulonglong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_BYTE, npy_byte,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_SHORT, npy_short,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_INT, npy_int,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_LONG, npy_long,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_LONGLONG, npy_longlong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_FLOAT, npy_float,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_DOUBLE, npy_double,
-                                          coeff, pi, idx);
-                    default:
-                        NPY_END_THREADS;
-                        PyErr_SetString(PyExc_RuntimeError,
-                                        "data type not supported");
-                        goto exit;
-                    }
-                }
-                /* calculate the interpolated value: */
-                for(ll = 0; ll < irank; ll++)
-                    if (order > 0)
-                        coeff *= splvals[ll][ff[ll]];
-                t += coeff;
-                ff += irank;
-            }
+            t = NI_Interpolate(ip, offset, edge ? edge_offsets : NULL,
+                               grid_edge ? edge_grid_const : NULL,
+                               splvals, values);
         } else {
-            t = cval;
+            t = ip->cval;
         }
         /* store output value: */
-        switch (PyArray_TYPE(output)) {
-            CASE_INTERP_OUT(NPY_BOOL, npy_bool, po, t);
-            CASE_INTERP_OUT_UINT(UBYTE, npy_ubyte, po, t);
-            CASE_INTERP_OUT_UINT(USHORT, npy_ushort, po, t);
-            CASE_INTERP_OUT_UINT(UINT, npy_uint, po, t);
-            CASE_INTERP_OUT_UINT(ULONG, npy_ulong, po, t);
-            CASE_INTERP_OUT_UINT(ULONGLONG, npy_ulonglong, po, t);
-            CASE_INTERP_OUT_INT(BYTE, npy_byte, po, t);
-            CASE_INTERP_OUT_INT(SHORT, npy_short, po, t);
-            CASE_INTERP_OUT_INT(INT, npy_int, po, t);
-            CASE_INTERP_OUT_INT(LONG, npy_long, po, t);
-            CASE_INTERP_OUT_INT(LONGLONG, npy_longlong, po, t);
-            CASE_INTERP_OUT(NPY_FLOAT, npy_float, po, t);
-            CASE_INTERP_OUT(NPY_DOUBLE, npy_double, po, t);
-        default:
-            NPY_END_THREADS;
-            PyErr_SetString(PyExc_RuntimeError, "data type not supported");
-            goto exit;
-        }
-        if (coordinates) {
-            NI_ITERATOR_NEXT2(io, ic, po, pc);
+        NI_StoreInterpolated(ip->otype, po, t);
+        if (pc) {
+            NI_ITERATOR_NEXT2(io, task->ic, po, pc);
         } else {
             NI_ITERATOR_NEXT(io, po);
         }
     }
+    return 1;
+}
 
- exit:
-    NPY_END_THREADS;
-    free(edge_offsets);
-    if (edge_grid_const) {
-        for(jj = 0; jj < irank; jj++)
-            free(edge_grid_const[jj]);
-        free(edge_grid_const);
+int
+NI_GeometricTransform(PyArrayObject *input, int (*map)(npy_intp*, double*,
+                int, int, void*), void* map_data, PyArrayObject* matrix_ar,
+                PyArrayObject* shift_ar, PyArrayObject *coordinates,
+                PyArrayObject *output, int order, int mode, double cval,
+                int nprepad)
+{
+    NI_TransformTask task;
+    npy_intp nsplvals;
+    int n_parts = 1, hh;
+    NPY_BEGIN_THREADS_DEF;
+
+    memset(&task, 0, sizeof(task));
+    if (!NI_InitInterpolator(input, output, order, cval, &task.ip))
+        goto exit;
+    task.map = map;
+    task.map_data = map_data;
+    task.matrix = matrix_ar ? (npy_double*)PyArray_DATA(matrix_ar) : NULL;
+    task.shift = shift_ar ? (npy_double*)PyArray_DATA(shift_ar) : NULL;
+    task.orank = PyArray_NDIM(output);
+    task.mode = mode;
+    task.spline_mode = _get_spline_boundary_mode(mode);
+    task.nprepad = nprepad;
+
+    /* if the mapping is from array coordinates: */
+    if (coordinates) {
+        task.ctype = PyArray_TYPE(coordinates);
+        if (!NI_InterpolationTypeSupported(task.ctype)) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "coordinate array data type not supported");
+            goto exit;
+        }
+        /* initialize a line iterator along the first axis: */
+        if (!NI_InitPointIterator(coordinates, &task.ic))
+            goto exit;
+        task.cstride = task.ic.strides[0];
+        if (!NI_LineIterator(&task.ic, 0))
+            goto exit;
+        task.pc = (void *)(PyArray_DATA(coordinates));
+    }
+
+    /* a mapping function needs the GIL, it is called on this thread only: */
+    if (!map)
+        n_parts = NI_NumThreads(task.ip.size * task.ip.filter_size);
+    nsplvals = task.ip.rank * (order + 1) + 1;
+    task.data_offsets = malloc(n_parts * nsplvals * sizeof(npy_intp));
+    task.splvals = malloc(n_parts * nsplvals * sizeof(double));
+    task.values = malloc(n_parts * task.ip.filter_size * sizeof(double));
+    if (NPY_UNLIKELY(!task.data_offsets || !task.splvals || !task.values)) {
+        PyErr_NoMemory();
+        goto exit;
     }
-    if (data_offsets) {
-        for(jj = 0; jj < irank; jj++)
-            free(data_offsets[jj]);
-        free(data_offsets);
+    if (mode == NI_EXTEND_GRID_CONSTANT) {
+        // boolean indicating if the current point in the filter footprint is
+        // outside the bounds
+        task.grid_const = malloc(n_parts * nsplvals * sizeof(char));
+        if (NPY_UNLIKELY(!task.grid_const)) {
+            PyErr_NoMemory();
+            goto exit;
+        }
     }
-    if (splvals) {
-        for(jj = 0; jj < irank; jj++)
-            free(splvals[jj]);
-        free(splvals);
+
+    if (task.matrix && !NI_InitAffineFilters(&task))
+        goto exit;
+
+    if (map) {
+        NI_TransformPoints(&task, 0, 1);
+    } else {
+        NPY_BEGIN_THREADS;
+        NI_ParallelFor(n_parts, NI_TransformPoints, &task);
+        NPY_END_THREADS;
     }
-    free(foffsets);
-    free(fcoordinates);
+
+ exit:
+    for(hh = 0; hh < NPY_MAXDIMS; hh++)
+        free(task.columns[hh]);
+    free(task.column_offsets);
+    free(task.column_grid_const);
+    free(task.column_splvals);
+    free(task.data_offsets);
+    free(task.grid_const);
+    free(task.splvals);
+    free(task.values);
+    NI_FreeInterpolator(&task.ip);
     return PyErr_Occurred() ? 0 : 1;
 }
 
+typedef struct {
+    NI_Interpolator ip;
+    /* per axis and output coordinate: */
+    npy_intp **zeros, **offsets, ***edge_offsets;
+    char ***edge_grid_const;
+    double ***splvals;
+    /* per part, the input values under the filter: */
+    double *values;
+} NI_ZoomShiftTask;
+
+static int
+NI_ZoomShiftPoints(void *data, int part, int n_parts)
+{
+    NI_ZoomShiftTask *task = (NI_ZoomShiftTask*)data;
+    const NI_Interpolator *ip = &task->ip;
+    const int rank = ip->rank;
+    const npy_intp first = ip->size * part / n_parts;
+    const npy_intp last = ip->size * (part + 1) / n_parts;
+    npy_intp *edge_offsets[NPY_MAXDIMS];
+    char *edge_grid_const[NPY_MAXDIMS];
+    double *splvals[NPY_MAXDIMS];
+    double *values = task->values + part * ip->filter_size;
+    npy_intp kk, hh;
+    NI_Iterator io;
+    char *po;
+
+    if (first >= last)
+        return 1;
+    NI_InterpolatorStart(ip, first, &io, &po);
+
+    for(kk = first; kk < last; kk++) {
+        double t = 0.0;
+        npy_intp edge = 0, grid_edge = 0, oo = 0, zero = 0;
+
+        for(hh = 0; hh < rank; hh++) {
+            const npy_intp cc = io.coordinates[hh];
+            if (task->zeros && task->zeros[hh][cc]) {
+                /* we use constant border condition */
+                zero = 1;
+                break;
+            }
+            oo += task->offsets[hh][cc];
+            if (task->edge_offsets) {
+                edge_offsets[hh] = task->edge_offsets[hh][cc];
+                if (edge_offsets[hh])
+                    edge = 1;
+            } else {
+                edge_grid_const[hh] = task->edge_grid_const[hh][cc];
+                if (edge_grid_const[hh])
+                    grid_edge = 1;
+            }
+            splvals[hh] = task->splvals[hh][cc];
+        }
+
+        if (!zero) {
+            t = NI_Interpolate(ip, oo, edge ? edge_offsets : NULL,
+                               grid_edge ? edge_grid_const : NULL,
+                               splvals, values);
+        } else {
+            t = ip->cval;
+        }
+        /* store output: */
+        NI_StoreInterpolated(ip->otype, po, t);
+        NI_ITERATOR_NEXT(io, po);
+    }
+    return 1;
+}
+
 int NI_ZoomShift(PyArrayObject *input, PyArrayObject* zoom_ar,
                  PyArrayObject* shift_ar, PyArrayObject *output,
                  int order, int mode, double cval, int nprepad, int grid_mode)
 {
-    char *po, *pi;
+    NI_ZoomShiftTask task;
     npy_intp **zeros = NULL, **offsets = NULL, ***edge_offsets = NULL;
-    npy_intp ftmp[NPY_MAXDIMS], *fcoordinates = NULL, *foffsets = NULL;
-    npy_intp jj, hh, kk, filter_size, odimensions[NPY_MAXDIMS];
+    npy_intp jj, hh, kk, odimensions[NPY_MAXDIMS];
     npy_intp idimensions[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
-    npy_intp size;
     char ***edge_grid_const = NULL;
     double ***splvals = NULL;
-    NI_Iterator io;
     npy_double *zooms = zoom_ar ? (npy_double*)PyArray_DATA(zoom_ar) : NULL;
     npy_double *shifts = shift_ar ? (npy_double*)PyArray_DATA(shift_ar) : NULL;
-    int rank = 0;
+    int rank = 0, n_parts = 0;
     NPY_BEGIN_THREADS_DEF;
 
+    memset(&task, 0, sizeof(task));
+    if (!NI_InitInterpolator(input, output, order, cval, &task.ip))
+        goto exit;
+    n_parts = NI_NumThreads(task.ip.size * task.ip.filter_size);
+    task.values = malloc(n_parts * task.ip.filter_size * sizeof(double));
+    if (NPY_UNLIKELY(!task.values)) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+
     NPY_BEGIN_THREADS;
 
     for (kk = 0; kk < PyArray_NDIM(input); kk++) {
@@ -840,160 +1436,13 @@ int NI_ZoomShift(PyArrayObject *input, PyArrayObject* zoom_ar,
         }
     }
 
-    filter_size = 1;
-    for(jj = 0; jj < rank; jj++)
-        filter_size *= order + 1;
-
-    if (!NI_InitPointIterator(output, &io))
-        goto exit;
-
-    pi = (void *)PyArray_DATA(input);
-    po = (void *)PyArray_DATA(output);
-
-    /* store all coordinates and offsets with filter: */
-    fcoordinates = malloc(rank * filter_size * sizeof(npy_intp));
-    foffsets = malloc(filter_size * sizeof(npy_intp));
-    if (NPY_UNLIKELY(!fcoordinates || !foffsets)) {
-        NPY_END_THREADS;
-        PyErr_NoMemory();
-        goto exit;
-    }
-
-    for(jj = 0; jj < rank; jj++)
-        ftmp[jj] = 0;
-    kk = 0;
-    for(hh = 0; hh < filter_size; hh++) {
-        for(jj = 0; jj < rank; jj++)
-            fcoordinates[jj + hh * rank] = ftmp[jj];
-        foffsets[hh] = kk;
-        for(jj = rank - 1; jj >= 0; jj--) {
-            if (ftmp[jj] < order) {
-                ftmp[jj]++;
-                kk += istrides[jj];
-                break;
-            } else {
-                ftmp[jj] = 0;
-                kk -= istrides[jj] * order;
-            }
-        }
-    }
-    size = PyArray_SIZE(output);
-    for(kk = 0; kk < size; kk++) {
-        double t = 0.0;
-        npy_intp edge = 0, oo = 0, zero = 0;
-
-        for(hh = 0; hh < rank; hh++) {
-            if (zeros && zeros[hh][io.coordinates[hh]]) {
-                /* we use constant border condition */
-                zero = 1;
-                break;
-            }
-            oo += offsets[hh][io.coordinates[hh]];
-            if (mode != NI_EXTEND_GRID_CONSTANT) {
-                if (edge_offsets[hh][io.coordinates[hh]])
-                    edge = 1;
-            }         }
-
-        if (!zero) {
-            npy_intp *ff = fcoordinates;
-            const int type_num = PyArray_TYPE(input);
-            t = 0.0;
-            for(hh = 0; hh < filter_size; hh++) {
-                npy_intp idx = 0;
-                double coeff = 0.0;
-                int is_cval = 0;
-                if (mode == NI_EXTEND_GRID_CONSTANT)
-                {
-                    for(jj = 0; jj < rank; jj++) {
-                        if (edge_grid_const[jj][io.coordinates[jj]])
-                        {
-                            if (edge_grid_const[jj][io.coordinates[jj]][ff[jj]])
-                                is_cval = 1;
-                        }
-                    }
-                }
-                if (is_cval) {
-                    coeff = cval;
-                } else {
-                    if (NPY_UNLIKELY(edge)) {
-                        /* use precalculated edge offsets: */
-                        for(jj = 0; jj < rank; jj++) {
-                            if (edge_offsets[jj][io.coordinates[jj]])
-                                idx += edge_offsets[jj][io.coordinates[jj]][ff[jj]];
-                            else
-                                idx += ff[jj] * istrides[jj];
-                        }
-                        idx += oo;
-                    } else {
-                        /* use normal offsets: */
-                        idx += oo + foffsets[hh];
-                    }
-                    switch (type_num) {
-                        CASE_INTERP_COEFF(NPY_BOOL, npy_bool,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_UBYTE, npy_ubyte,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_USHORT, npy_ushort,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_UINT, npy_uint,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_ULONG, npy_ulong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_ULONGLONG, npy_ulonglong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_BYTE, npy_byte,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_SHORT, npy_short,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_INT, npy_int,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_LONG, npy_long,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_LONGLONG, npy_longlong,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_FLOAT, npy_float,
-                                          coeff, pi, idx);
-                        CASE_INTERP_COEFF(NPY_DOUBLE, npy_double,
-                                          coeff, pi, idx);
-                    default:
-                        NPY_END_THREADS;
-                        PyErr_SetString(PyExc_RuntimeError,
-                                        "data type not supported");
-                        goto exit;
-                    }
-                }
-                /* calculate interpolated value: */
-                for(jj = 0; jj < rank; jj++)
-                    if (order > 0)
-                        coeff *= splvals[jj][io.coordinates[jj]][ff[jj]];
-                t += coeff;
-                ff += rank;
-            }
-        } else {
-            t = cval;
-        }
-        /* store output: */
-        switch (PyArray_TYPE(output)) {
-            CASE_INTERP_OUT(NPY_BOOL, npy_bool, po, t);
-            CASE_INTERP_OUT_UINT(UBYTE, npy_ubyte, po, t);
-            CASE_INTERP_OUT_UINT(USHORT, npy_ushort, po, t);
-            CASE_INTERP_OUT_UINT(UINT, npy_uint, po, t);
-            CASE_INTERP_OUT_UINT(ULONG, npy_ulong, po, t);
-            CASE_INTERP_OUT_UINT(ULONGLONG, npy_ulonglong, po, t);
-            CASE_INTERP_OUT_INT(BYTE, npy_byte, po, t);
-            CASE_INTERP_OUT_INT(SHORT, npy_short, po, t);
-            CASE_INTERP_OUT_INT(INT, npy_int, po, t);
-            CASE_INTERP_OUT_INT(LONG, npy_long, po, t);
-            CASE_INTERP_OUT_INT(LONGLONG, npy_longlong, po, t);
-            CASE_INTERP_OUT(NPY_FLOAT, npy_float, po, t);
-            CASE_INTERP_OUT(NPY_DOUBLE, npy_double, po, t);
-        default:
-            NPY_END_THREADS;
-            PyErr_SetString(PyExc_RuntimeError, "data type not supported");
-            goto exit;
-        }
-        NI_ITERATOR_NEXT(io, po);
-    }
+    /* the tables are shared by all threads: */
+    task.zeros = zeros;
+    task.offsets = offsets;
+    task.edge_offsets = edge_offsets;
+    task.edge_grid_const = edge_grid_const;
+    task.splvals = splvals;
+    NI_ParallelFor(n_parts, NI_ZoomShiftPoints, &task);
 
  exit:
     NPY_END_THREADS;
@@ -1037,7 +1486,7 @@ int NI_ZoomShift(PyArrayObject *input, PyArrayObject* zoom_ar,
         }
         free(edge_grid_const);
     }
-    free(foffsets);
-    free(fcoordinates);
+    free(task.values);
+    NI_FreeInterpolator(&task.ip);
     return PyErr_Occurred() ? 0 : 1;
 }
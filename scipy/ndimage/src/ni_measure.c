@@ -31,10 +31,12 @@
 
 #include "ni_support.h"
 #include "ni_measure.h"
+#include <numpy/npy_math.h>
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
 #include <assert.h>
+#include <string.h>
 
 
 #define CASE_FIND_OBJECT_POINT(_TYPE, _type, _pi, _regions, _array,  \
@@ -138,24 +140,784 @@ int NI_FindObjects(PyArrayObject* input, npy_intp max_label,
 }
 
 
-#define WS_GET_INDEX(_TYPE, _type, _index, _c_strides,      \
-                     _b_strides, _rank, _out,  _contiguous) \
-do {                                                        \
-    if (_contiguous) {                                      \
-        _out = _index * sizeof(_type);                      \
-    }                                                       \
-    else {                                                  \
-        int _qq;                                            \
-        npy_intp _cc;                                       \
-        npy_intp _idx = _index;                             \
-        _out = 0;                                           \
-        for (_qq = 0; _qq < _rank; _qq++) {                 \
-            _cc = _idx / _c_strides[_qq];                   \
-            _idx -= _cc * _c_strides[_qq];                  \
-            _out += _b_strides[_qq] * _cc;                  \
-        }                                                   \
-    }                                                       \
-} while(0)
+/* Connected component labelling. The array is scanned line by line along
+     the axis with the smallest stride of the output, and cut in tiles
+     along the first of the other axes. The tiles are labelled in parallel,
+     each with its own provisional labels and union-find table, and the
+     labels are then merged across the borders of the tiles. The final
+     labels are numbered in the order of the first element of each object
+     in the scan, and the bounding box, size and centroid of each object
+     are gathered while labelling. */
+
+#define NI_LABEL_FOREGROUND 1
+/* the first provisional label: */
+#define NI_LABEL_FIRST 2
+
+#define CASE_LABEL_READ_LINE(_TYPE, _type, _pi, _stride, _length, _line) \
+case _TYPE:                                                              \
+{                                                                        \
+    npy_intp _ii;                                                        \
+    for(_ii = 0; _ii < _length; _ii++) {                                 \
+        _line[_ii] = *(_type *)_pi ? NI_LABEL_FOREGROUND : 0;            \
+        _pi += _stride;                                                  \
+    }                                                                    \
+}                                                                        \
+break
+
+#define CASE_LABEL_FITS(_TYPE, _type, _label, _fits)        \
+case _TYPE:                                                 \
+    _fits = (npy_uintp)(_type)(_label) == (npy_uintp)(_label); \
+    break
+
+#define CASE_LABEL_WRITE_LINE(_TYPE, _type, _po, _stride, _length, _line) \
+case _TYPE:                                                               \
+{                                                                         \
+    npy_intp _ii;                                                         \
+    for(_ii = 0; _ii < _length; _ii++) {                                  \
+        *(_type *)_po = (_type)_line[_ii];                                \
+        _po += _stride;                                                   \
+    }                                                                     \
+}                                                                         \
+break
+
+/* Provisional labels and union-find table of a tile: */
+typedef struct {
+    npy_uintp *parent, next;
+    npy_intp allocated;
+    /* if requested, the size, the regions as in NI_FindObjects, and the
+       sum of the coordinates of each provisional label: */
+    npy_intp *counts, *regions;
+    double *sums;
+} NI_LabelTile;
+
+typedef struct {
+    char *pi, *pl, *po;
+    int rank, axis, outer, itype, otype, wide, stats, use_previous;
+    npy_intp shape[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
+    npy_intp lstrides[NPY_MAXDIMS], ostrides[NPY_MAXDIMS];
+    /* the length and number of lines, and the lines per element along the
+       outer axis: */
+    npy_intp length, lines, outer_lines;
+    /* the neighbour lines that precede a line in the scan, their distance
+       in lines, and which of their elements are connected: */
+    npy_intp n_neighbors, *deltas, *distances;
+    int *flags;
+    /* the first outer coordinate of each tile: */
+    npy_intp *tile_starts;
+    NI_LabelTile *tiles;
+    /* per tile, the line buffers, and the neighbour lines in the tile: */
+    npy_uintp *buffers;
+    const npy_uintp **views;
+    npy_intp *valid;
+    npy_uintp *goffsets, *final;
+    int *failed;
+} NI_LabelTask;
+
+static void _ReadLabelLine(const char *pl, npy_intp stride, int wide,
+                           npy_uintp *line, npy_intp length)
+{
+    npy_intp ii;
+
+    if (wide) {
+        for(ii = 0; ii < length; ii++, pl += stride)
+            line[ii] = (npy_uintp)*(npy_uint64*)pl;
+    } else {
+        for(ii = 0; ii < length; ii++, pl += stride)
+            line[ii] = (npy_uintp)*(npy_uint32*)pl;
+    }
+}
+
+static void _WriteLabelLine(char *pl, npy_intp stride, int wide,
+                            const npy_uintp *line, npy_intp length)
+{
+    npy_intp ii;
+
+    if (wide) {
+        for(ii = 0; ii < length; ii++, pl += stride)
+            *(npy_uint64*)pl = line[ii];
+    } else {
+        for(ii = 0; ii < length; ii++, pl += stride)
+            *(npy_uint32*)pl = (npy_uint32)line[ii];
+    }
+}
+
+/* Coordinates of the other axes of a line, and offsets of its first
+     element in the input and in the labels: */
+static void _LabelLineStart(const NI_LabelTask *task, npy_intp line,
+                            npy_intp *coor, npy_intp *ioffset,
+                            npy_intp *loffset)
+{
+    int jj;
+
+    *ioffset = *loffset = 0;
+    for(jj = task->rank - 1; jj >= 0; jj--) {
+        if (jj == task->axis) {
+            coor[jj] = 0;
+        } else {
+            coor[jj] = line % task->shape[jj];
+            line /= task->shape[jj];
+            *ioffset += coor[jj] * task->istrides[jj];
+            *loffset += coor[jj] * task->lstrides[jj];
+        }
+    }
+}
+
+/* Merge two labels, the root of both is the smallest root: */
+static npy_uintp _MergeLabels(npy_uintp a, npy_uintp b, npy_uintp *parent)
+{
+    npy_uintp ra = a, rb = b, root, tmp;
+
+    while (ra != parent[ra])
+        ra = parent[ra];
+    while (rb != parent[rb])
+        rb = parent[rb];
+    root = ra < rb ? ra : rb;
+    parent[ra] = parent[rb] = root;
+    while (a != root) {
+        tmp = parent[a];
+        parent[a] = root;
+        a = tmp;
+    }
+    while (b != root) {
+        tmp = parent[b];
+        parent[b] = root;
+        b = tmp;
+    }
+    return root;
+}
+
+static npy_uintp _TakeLabel(npy_uintp label, npy_uintp neighbor,
+                            npy_uintp *parent)
+{
+    if (neighbor == 0)
+        return label;
+    if (label == NI_LABEL_FOREGROUND)
+        return neighbor;
+    if (label != neighbor)
+        return _MergeLabels(neighbor, label, parent);
+    return label;
+}
+
+/* Make room for length new labels in a tile: */
+static int _GrowLabelTile(NI_LabelTile *tile, npy_intp length, int rank,
+                          int stats)
+{
+    npy_intp size = tile->allocated;
+    void *tmp;
+
+    if ((npy_intp)tile->next + length <= size)
+        return 1;
+    while ((npy_intp)tile->next + length > size)
+        size = 2 * size > 64 ? 2 * size : 64;
+    tmp = realloc(tile->parent, size * sizeof(npy_uintp));
+    if (!tmp)
+        return 0;
+    tile->parent = tmp;
+    if (stats) {
+        tmp = realloc(tile->counts, size * sizeof(npy_intp));
+        if (!tmp)
+            return 0;
+        tile->counts = tmp;
+        tmp = realloc(tile->regions, 2 * rank * size * sizeof(npy_intp));
+        if (!tmp)
+            return 0;
+        tile->regions = tmp;
+        tmp = realloc(tile->sums, rank * size * sizeof(double));
+        if (!tmp)
+            return 0;
+        tile->sums = tmp;
+    }
+    tile->allocated = size;
+    return 1;
+}
+
+/* Add a run of elements with the same label to its statistics: */
+static void _AddLabelRun(NI_LabelTile *tile, const NI_LabelTask *task,
+                         npy_uintp label, const npy_intp *coor,
+                         npy_intp start, npy_intp length)
+{
+    const int rank = task->rank;
+    npy_intp *regions = tile->regions + 2 * rank * label;
+    double *sums = tile->sums + rank * label;
+    int jj;
+
+    tile->counts[label] += length;
+    for(jj = 0; jj < rank; jj++) {
+        npy_intp lo = coor[jj], hi = coor[jj] + 1;
+        if (jj == task->axis) {
+            lo = start;
+            hi = start + length;
+            sums[jj] += (double)length * start +
+                        0.5 * (double)length * (length - 1);
+        } else {
+            sums[jj] += (double)length * coor[jj];
+        }
+        if (lo < regions[jj])
+            regions[jj] = lo;
+        if (hi > regions[jj + rank])
+            regions[jj + rank] = hi;
+    }
+}
+
+static int _LabelTiles(void *data, int part, int n_parts)
+{
+    NI_LabelTask *task = (NI_LabelTask*)data;
+    NI_LabelTile *tile = task->tiles + part;
+    const npy_intp length = task->length, rank = task->rank;
+    const npy_intp first = task->tile_starts[part] * task->outer_lines;
+    const npy_intp last = task->tile_starts[part + 1] * task->outer_lines;
+    const npy_intp n_buffers = task->n_neighbors + 2;
+    /* the line buffers alternate, the neighbour buffers are fixed: */
+    npy_uintp *base = task->buffers + part * n_buffers * (length + 2) + 1;
+    npy_uintp *line = base, *previous = base + length + 2, *tmp;
+    const npy_uintp **views = task->views + part * task->n_neighbors;
+    npy_intp *valid = task->valid + part * task->n_neighbors;
+    npy_intp coor[NPY_MAXDIMS], ll, nn, ii, jj, kk;
+
+    for(nn = 0; nn < n_buffers; nn++)
+        base[nn * (length + 2) - 1] = base[nn * (length + 2) + length] = 0;
+    for(ll = first; ll < last; ll++) {
+        npy_uintp *parent, next;
+        npy_intp ioffset, loffset, n_valid = 0;
+        char *pi;
+
+        _LabelLineStart(task, ll, coor, &ioffset, &loffset);
+        if (!_GrowLabelTile(tile, length, rank, task->stats)) {
+            task->failed[part] = 1;
+            return 0;
+        }
+        parent = tile->parent;
+        pi = task->pi + ioffset;
+        switch (task->itype) {
+            CASE_LABEL_READ_LINE(NPY_BOOL, npy_bool,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_UBYTE, npy_ubyte,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_USHORT, npy_ushort,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_UINT, npy_uint,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_ULONG, npy_ulong,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_ULONGLONG, npy_ulonglong,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_BYTE, npy_byte,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_SHORT, npy_short,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_INT, npy_int,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_LONG, npy_long,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_LONGLONG, npy_longlong,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_FLOAT, npy_float,
+                                 pi, task->istrides[task->axis], length, line);
+            CASE_LABEL_READ_LINE(NPY_DOUBLE, npy_double,
+                                 pi, task->istrides[task->axis], length, line);
+        default:
+            break;
+        }
+        /* the labels of the preceding neighbour lines in the tile: */
+        for(nn = 0; nn < task->n_neighbors; nn++) {
+            const npy_intp *deltas = task->deltas + nn * rank;
+            npy_intp noffset = loffset;
+            for(jj = 0; jj < rank; jj++) {
+                npy_intp cc = coor[jj] + deltas[jj];
+                if (cc < 0 || cc >= task->shape[jj] ||
+                    (jj == task->outer && cc < task->tile_starts[part]))
+                    break;
+                noffset += deltas[jj] * task->lstrides[jj];
+            }
+            if (jj < rank)
+                continue;
+            if (task->distances[nn] == 1 && ll > first) {
+                /* the previous line is still in its buffer: */
+                views[n_valid] = previous;
+            } else {
+                npy_uintp *buffer = base + (n_valid + 2) * (length + 2);
+                _ReadLabelLine(task->pl + noffset, task->lstrides[task->axis],
+                               task->wide, buffer, length);
+                views[n_valid] = buffer;
+            }
+            valid[n_valid++] = nn;
+        }
+        /* take the labels of the neighbours, or a new label: */
+        next = tile->next;
+        for(ii = 0; ii < length; ii++) {
+            npy_uintp label = line[ii];
+            if (!label)
+                continue;
+            for(kk = 0; kk < n_valid; kk++) {
+                const npy_uintp *labels = views[kk] + ii;
+                const int *flags = task->flags + 3 * valid[kk];
+                if (flags[0])
+                    label = _TakeLabel(label, labels[-1], parent);
+                if (flags[1])
+                    label = _TakeLabel(label, labels[0], parent);
+                if (flags[2])
+                    label = _TakeLabel(label, labels[1], parent);
+            }
+            if (task->use_previous)
+                label = _TakeLabel(label, line[ii - 1], parent);
+            if (label == NI_LABEL_FOREGROUND) {
+                label = next++;
+                parent[label] = label;
+            }
+            line[ii] = label;
+        }
+        if (task->stats) {
+            npy_uintp label;
+            for(label = tile->next; label < next; label++) {
+                tile->counts[label] = 0;
+                for(jj = 0; jj < rank; jj++) {
+                    tile->regions[2 * rank * label + jj] = NPY_MAX_INTP;
+                    tile->regions[2 * rank * label + jj + rank] = -1;
+                    tile->sums[rank * label + jj] = 0.0;
+                }
+            }
+            for(ii = 0; ii < length; ii = jj) {
+                for(jj = ii + 1; jj < length && line[jj] == line[ii]; jj++)
+                    ;
+                if (line[ii])
+                    _AddLabelRun(tile, task, line[ii], coor, ii, jj - ii);
+            }
+        }
+        tile->next = next;
+        _WriteLabelLine(task->pl + loffset, task->lstrides[task->axis],
+                        task->wide, line, length);
+        tmp = previous;
+        previous = line;
+        line = tmp;
+    }
+    return 1;
+}
+
+/* Merge the labels along the border of a tile with the previous tile: */
+static void _MergeLabelTiles(NI_LabelTask *task, int tt, npy_uintp *parent)
+{
+    const npy_intp length = task->length, rank = task->rank;
+    const npy_intp first = task->tile_starts[tt] * task->outer_lines;
+    const npy_uintp goffset = task->goffsets[tt] - NI_LABEL_FIRST;
+    const npy_uintp poffset = task->goffsets[tt - 1] - NI_LABEL_FIRST;
+    npy_uintp *line = task->buffers + 1, *neighbor = line + length + 2;
+    npy_intp coor[NPY_MAXDIMS], ll, nn, ii, jj;
+
+    line[-1] = line[length] = neighbor[-1] = neighbor[length] = 0;
+    for(ll = first; ll < first + task->outer_lines; ll++) {
+        npy_intp ioffset, loffset;
+
+        _LabelLineStart(task, ll, coor, &ioffset, &loffset);
+        _ReadLabelLine(task->pl + loffset, task->lstrides[task->axis],
+                       task->wide, line, length);
+        for(nn = 0; nn < task->n_neighbors; nn++) {
+            const npy_intp *deltas = task->deltas + nn * rank;
+            const int *flags = task->flags + 3 * nn;
+            npy_intp noffset = loffset;
+            if (deltas[task->outer] >= 0)
+                continue;
+            for(jj = 0; jj < rank; jj++) {
+                npy_intp cc = coor[jj] + deltas[jj];
+                if (cc < 0 || cc >= task->shape[jj])
+                    break;
+                noffset += deltas[jj] * task->lstrides[jj];
+            }
+            if (jj < rank)
+                continue;
+            _ReadLabelLine(task->pl + noffset, task->lstrides[task->axis],
+                           task->wide, neighbor, length);
+            for(ii = 0; ii < length; ii++) {
+                if (!line[ii])
+                    continue;
+                for(jj = 0; jj < 3; jj++) {
+                    npy_uintp label = neighbor[ii + jj - 1];
+                    if (flags[jj] && label)
+                        _MergeLabels(line[ii] + goffset, label + poffset,
+                                     parent);
+                }
+            }
+        }
+    }
+}
+
+/* Write the final labels: */
+static int _WriteLabels(void *data, int part, int n_parts)
+{
+    NI_LabelTask *task = (NI_LabelTask*)data;
+    const npy_intp first = task->tile_starts[part] * task->outer_lines;
+    const npy_intp last = task->tile_starts[part + 1] * task->outer_lines;
+    const npy_intp length = task->length, stride = task->ostrides[task->axis];
+    const npy_uintp *final = task->final + task->goffsets[part] -
+                                                            NI_LABEL_FIRST;
+    npy_uintp *line = task->buffers +
+                        part * (task->n_neighbors + 2) * (length + 2) + 1;
+    npy_intp coor[NPY_MAXDIMS], ll, ii;
+
+    for(ll = first; ll < last; ll++) {
+        npy_intp ioffset, loffset, ooffset = 0;
+        char *po;
+        int jj;
+
+        _LabelLineStart(task, ll, coor, &ioffset, &loffset);
+        for(jj = 0; jj < task->rank; jj++)
+            ooffset += coor[jj] * task->ostrides[jj];
+        _ReadLabelLine(task->pl + loffset, task->lstrides[task->axis],
+                       task->wide, line, length);
+        for(ii = 0; ii < length; ii++) {
+            /* final[0] is in bounds, but not the background: */
+            npy_uintp label = final[line[ii]];
+            line[ii] = line[ii] ? label : 0;
+        }
+        po = task->po + ooffset;
+        switch (task->otype) {
+            CASE_LABEL_WRITE_LINE(NPY_BOOL, npy_bool,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_UBYTE, npy_ubyte,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_USHORT, npy_ushort,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_UINT, npy_uint,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_ULONG, npy_ulong,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_ULONGLONG, npy_ulonglong,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_BYTE, npy_byte,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_SHORT, npy_short,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_INT, npy_int,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_LONG, npy_long,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_LONGLONG, npy_longlong,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_FLOAT, npy_float,
+                                  po, stride, length, line);
+            CASE_LABEL_WRITE_LINE(NPY_DOUBLE, npy_double,
+                                  po, stride, length, line);
+        default:
+            break;
+        }
+    }
+    return 1;
+}
+
+static int _LabelTypeSupported(int type)
+{
+    switch (type) {
+    case NPY_BOOL: case NPY_UBYTE: case NPY_USHORT: case NPY_UINT:
+    case NPY_ULONG: case NPY_ULONGLONG: case NPY_BYTE: case NPY_SHORT:
+    case NPY_INT: case NPY_LONG: case NPY_LONGLONG: case NPY_FLOAT:
+    case NPY_DOUBLE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Label the connected components of the non-zero elements of input with
+     a 3 x 3 x ... structuring element. If regions is not NULL, the bounding
+     boxes in the format of NI_FindObjects, the sizes and the centroids of
+     the objects are returned in newly allocated arrays. */
+int NI_Label(PyArrayObject* input, PyArrayObject* strct,
+             PyArrayObject* output, npy_intp *max_label, npy_intp **regions,
+             npy_intp **counts, double **centroids)
+{
+    NI_LabelTask task;
+    const npy_bool *ps = (npy_bool*)PyArray_DATA(strct);
+    npy_intp size = PyArray_SIZE(input), ssize = PyArray_SIZE(strct);
+    npy_intp jj, kk, n_labels = 0, n_final = 0, minstride = 0, astride = 1;
+    char *storage = NULL;
+    int ii, tt, n_tiles = 1, fits = 0;
+    NPY_BEGIN_THREADS_DEF;
+
+    memset(&task, 0, sizeof(task));
+    *max_label = 0;
+    if (regions) {
+        *regions = *counts = NULL;
+        *centroids = NULL;
+    }
+    task.rank = PyArray_NDIM(input);
+    task.itype = PyArray_TYPE(input);
+    task.otype = PyArray_TYPE(output);
+    task.stats = regions != NULL;
+    if (!_LabelTypeSupported(task.itype) ||
+        !_LabelTypeSupported(task.otype)) {
+        PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+        return 0;
+    }
+    if (task.rank < 1 || size == 0) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "cannot label scalars or empty arrays");
+        return 0;
+    }
+    /* scan along the axis with the smallest stride of the output, as
+       PyArray_IterAllButAxis does: */
+    for(ii = 0; ii < task.rank && minstride == 0; ii++)
+        minstride = PyArray_STRIDE(output, ii);
+    for(ii = 1; ii < task.rank; ii++) {
+        if (PyArray_STRIDE(output, ii) > 0 &&
+            PyArray_STRIDE(output, ii) < minstride) {
+            task.axis = ii;
+            minstride = PyArray_STRIDE(output, ii);
+        }
+    }
+    task.outer = task.axis == 0 ? 1 : 0;
+    for(ii = 0; ii < task.rank; ii++) {
+        task.shape[ii] = PyArray_DIM(input, ii);
+        task.istrides[ii] = PyArray_STRIDE(input, ii);
+        task.ostrides[ii] = PyArray_STRIDE(output, ii);
+    }
+    task.length = task.shape[task.axis];
+    task.lines = size / task.length;
+    task.outer_lines = task.rank > 1 ? task.lines / task.shape[task.outer] :
+                                       1;
+    task.pi = (void *)PyArray_DATA(input);
+    task.po = (void *)PyArray_DATA(output);
+
+    /* the neighbour lines: the lines of the structuring element before its
+       center, and whether the previous element is connected: */
+    task.deltas = malloc((ssize / 3 * task.rank + 1) * sizeof(npy_intp));
+    task.distances = malloc((ssize / 3 + 1) * sizeof(npy_intp));
+    task.flags = malloc((ssize + 1) * sizeof(int));
+    if (!task.deltas || !task.distances || !task.flags) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for(ii = task.rank - 1; ii > task.axis; ii--)
+        astride *= 3;
+    for(jj = 0; jj < ssize / 3 / 2; jj++) {
+        npy_intp tmp = jj, offset = 0, stride = 1, distance = 0, lstride = 1;
+        int any = 0;
+        for(ii = task.rank - 1; ii >= 0; ii--) {
+            if (ii == task.axis) {
+                task.deltas[task.n_neighbors * task.rank + ii] = 0;
+            } else {
+                task.deltas[task.n_neighbors * task.rank + ii] = tmp % 3 - 1;
+                offset += (tmp % 3) * stride;
+                distance -= (tmp % 3 - 1) * lstride;
+                lstride *= task.shape[ii];
+                tmp /= 3;
+            }
+            stride *= 3;
+        }
+        task.distances[task.n_neighbors] = distance;
+        for(kk = 0; kk < 3; kk++) {
+            int flag = ps[offset + kk * astride];
+            task.flags[3 * task.n_neighbors + kk] = flag;
+            any = any || flag;
+        }
+        if (any)
+            ++task.n_neighbors;
+    }
+    task.use_previous = ps[ssize / 2 - astride];
+
+    /* store the provisional labels in the output, if it can hold them: */
+    if (PyTypeNum_ISINTEGER(task.otype) &&
+        (PyArray_ITEMSIZE(output) == 4 || PyArray_ITEMSIZE(output) == 8) &&
+        (npy_uint64)size + NI_LABEL_FIRST <=
+                (((npy_uint64)1 << (8 * PyArray_ITEMSIZE(output) - 1)) - 1)) {
+        task.pl = task.po;
+        task.wide = PyArray_ITEMSIZE(output) == 8;
+        for(ii = 0; ii < task.rank; ii++)
+            task.lstrides[ii] = task.ostrides[ii];
+    } else {
+        npy_intp stride;
+        task.wide = (npy_uintp)size + NI_LABEL_FIRST >= NPY_MAX_UINT32;
+        stride = task.wide ? sizeof(npy_uint64) : sizeof(npy_uint32);
+        storage = malloc(size * stride);
+        if (!storage) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        task.pl = storage;
+        for(ii = task.rank - 1; ii >= 0; ii--) {
+            task.lstrides[ii] = stride;
+            stride *= task.shape[ii];
+        }
+    }
+
+    /* the tiles: */
+    if (task.rank > 1) {
+        n_tiles = NI_NumThreads(size);
+        if (n_tiles > task.shape[task.outer])
+            n_tiles = task.shape[task.outer];
+    }
+    task.tile_starts = malloc((n_tiles + 1) * sizeof(npy_intp));
+    task.tiles = calloc(n_tiles, sizeof(NI_LabelTile));
+    task.buffers = malloc(n_tiles * (task.n_neighbors + 2) *
+                          (task.length + 2) * sizeof(npy_uintp));
+    task.views = malloc((n_tiles * task.n_neighbors + 1) *
+                        sizeof(npy_uintp*));
+    task.valid = malloc((n_tiles * task.n_neighbors + 1) * sizeof(npy_intp));
+    task.goffsets = malloc((n_tiles + 1) * sizeof(npy_uintp));
+    task.failed = calloc(n_tiles, sizeof(int));
+    if (!task.tile_starts || !task.tiles || !task.buffers || !task.views ||
+        !task.valid || !task.goffsets || !task.failed) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for(tt = 0; tt <= n_tiles; tt++)
+        task.tile_starts[tt] = task.rank > 1 ?
+                                task.shape[task.outer] * tt / n_tiles : tt;
+    for(tt = 0; tt < n_tiles; tt++)
+        task.tiles[tt].next = NI_LABEL_FIRST;
+
+    NPY_BEGIN_THREADS;
+    NI_ParallelFor(n_tiles, _LabelTiles, &task);
+    NPY_END_THREADS;
+    for(tt = 0; tt < n_tiles; tt++) {
+        if (task.failed[tt]) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+    }
+
+    /* number the provisional labels of all tiles in the order of the scan,
+       and merge them along the borders of the tiles: */
+    task.goffsets[0] = NI_LABEL_FIRST;
+    for(tt = 0; tt < n_tiles; tt++)
+        task.goffsets[tt + 1] = task.goffsets[tt] + task.tiles[tt].next -
+                                                            NI_LABEL_FIRST;
+    n_labels = task.goffsets[n_tiles];
+    if (n_tiles == 1) {
+        /* the labels of a single tile are already global: */
+        task.final = task.tiles[0].parent;
+        task.tiles[0].parent = NULL;
+    } else {
+        task.final = malloc(n_labels * sizeof(npy_uintp));
+        if (!task.final) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+    }
+
+    NPY_BEGIN_THREADS;
+    for(tt = 0; tt < n_tiles; tt++) {
+        NI_LabelTile *tile = task.tiles + tt;
+        npy_uintp *parent = tile->parent ? tile->parent : task.final;
+        npy_uintp *tparent = task.final + task.goffsets[tt] - NI_LABEL_FIRST;
+        npy_uintp label;
+        /* the labels point to smaller labels, that already point to their
+           root: */
+        for(label = NI_LABEL_FIRST; label < tile->next; label++) {
+            npy_uintp up = parent[label];
+            tparent[label] = up == label ? label + task.goffsets[tt] -
+                                           NI_LABEL_FIRST : tparent[up];
+        }
+        if (tt > 0)
+            _MergeLabelTiles(&task, tt, task.final);
+    }
+    /* the labels point to smaller labels, the roots are numbered in order,
+       in place: */
+    for(jj = NI_LABEL_FIRST; jj < n_labels; jj++) {
+        npy_uintp up = task.final[jj];
+        task.final[jj] = up == (npy_uintp)jj ? ++n_final : task.final[up];
+    }
+    NPY_END_THREADS;
+
+    switch (task.otype) {
+        CASE_LABEL_FITS(NPY_BOOL, npy_bool, n_final, fits);
+        CASE_LABEL_FITS(NPY_UBYTE, npy_ubyte, n_final, fits);
+        CASE_LABEL_FITS(NPY_USHORT, npy_ushort, n_final, fits);
+        CASE_LABEL_FITS(NPY_UINT, npy_uint, n_final, fits);
+        CASE_LABEL_FITS(NPY_ULONG, npy_ulong, n_final, fits);
+        CASE_LABEL_FITS(NPY_ULONGLONG, npy_ulonglong, n_final, fits);
+        CASE_LABEL_FITS(NPY_BYTE, npy_byte, n_final, fits);
+        CASE_LABEL_FITS(NPY_SHORT, npy_short, n_final, fits);
+        CASE_LABEL_FITS(NPY_INT, npy_int, n_final, fits);
+        CASE_LABEL_FITS(NPY_LONG, npy_long, n_final, fits);
+        CASE_LABEL_FITS(NPY_LONGLONG, npy_longlong, n_final, fits);
+        CASE_LABEL_FITS(NPY_FLOAT, npy_float, n_final, fits);
+        CASE_LABEL_FITS(NPY_DOUBLE, npy_double, n_final, fits);
+    default:
+        break;
+    }
+    if (!fits) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "insufficient bit-depth in requested output type");
+        goto exit;
+    }
+
+    if (task.stats) {
+        const int rank = task.rank;
+        *regions = malloc((2 * rank * n_final + 1) * sizeof(npy_intp));
+        *counts = malloc((n_final + 1) * sizeof(npy_intp));
+        *centroids = malloc((rank * n_final + 1) * sizeof(double));
+        if (!*regions || !*counts || !*centroids) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        for(jj = 0; jj < n_final; jj++) {
+            (*counts)[jj] = 0;
+            for(ii = 0; ii < rank; ii++) {
+                (*regions)[2 * rank * jj + ii] = NPY_MAX_INTP;
+                (*regions)[2 * rank * jj + ii + rank] = -1;
+                (*centroids)[rank * jj + ii] = 0.0;
+            }
+        }
+        for(tt = 0; tt < n_tiles; tt++) {
+            NI_LabelTile *tile = task.tiles + tt;
+            npy_uintp label;
+            for(label = NI_LABEL_FIRST; label < tile->next; label++) {
+                const npy_intp *tregions = tile->regions + 2 * rank * label;
+                npy_intp *fregions;
+                jj = task.final[task.goffsets[tt] + label - NI_LABEL_FIRST] - 1;
+                fregions = *regions + 2 * rank * jj;
+                (*counts)[jj] += tile->counts[label];
+                for(ii = 0; ii < rank; ii++) {
+                    (*centroids)[rank * jj + ii] += tile->sums[rank * label + ii];
+                    if (tregions[ii] < fregions[ii])
+                        fregions[ii] = tregions[ii];
+                    if (tregions[ii + rank] > fregions[ii + rank])
+                        fregions[ii + rank] = tregions[ii + rank];
+                }
+            }
+        }
+        for(jj = 0; jj < n_final; jj++)
+            for(ii = 0; ii < rank; ii++)
+                (*centroids)[rank * jj + ii] /= (*counts)[jj];
+    }
+
+    NPY_BEGIN_THREADS;
+    NI_ParallelFor(n_tiles, _WriteLabels, &task);
+    NPY_END_THREADS;
+    *max_label = n_final;
+
+ exit:
+    if (task.tiles) {
+        for(tt = 0; tt < n_tiles; tt++) {
+            free(task.tiles[tt].parent);
+            free(task.tiles[tt].counts);
+            free(task.tiles[tt].regions);
+            free(task.tiles[tt].sums);
+        }
+    }
+    free(task.deltas);
+    free(task.distances);
+    free(task.flags);
+    free(task.tile_starts);
+    free(task.tiles);
+    free(task.buffers);
+    free(task.views);
+    free(task.valid);
+    free(task.goffsets);
+    free(task.failed);
+    free(task.final);
+    free(storage);
+    if (PyErr_Occurred()) {
+        if (regions) {
+            free(*regions);
+            free(*counts);
+            free(*centroids);
+            *regions = *counts = NULL;
+            *centroids = NULL;
+        }
+        return 0;
+    }
+    return 1;
+}
 
 #define CASE_GET_INPUT(_TYPE, _type, _ival, _pi) \
 case _TYPE:                                      \
@@ -172,121 +934,84 @@ case _TYPE:                                       \
     *(_type *)_pl = _label;                       \
     break
 
-#define CASE_WINDEX1(_TYPE, _type, _v_index, _p_index, _strides, _istrides, \
-                     _irank, _icont, _p_idx, _v_idx, _pi, _vval, _pval)     \
-case _TYPE:                                                                 \
-    WS_GET_INDEX(_TYPE, _type, _v_index, _strides, _istrides, _irank,       \
-                 _p_idx, _icont);                                           \
-    WS_GET_INDEX(_TYPE, _type, _p_index, _strides, _istrides, _irank,       \
-                 _v_idx, _icont);                                           \
-    _vval = *(_type *)(_pi + _v_idx);                                       \
-    _pval = *(_type *)(_pi + _p_idx);                                       \
-    break
+/* The watershed keeps the queued elements in a radix heap on the bits of
+   their costs, which do not decrease while the queue is processed. The
+   elements of the current cost are taken in the order in which they were
+   queued: elements with an object label before the elements that are
+   already waiting, elements with a background label after them. An element
+   whose cost is lowered is queued again, its old entry is skipped: */
+typedef struct {
+    npy_intp index, order;
+} NI_WatershedElement;
 
-#define CASE_WINDEX2(_TYPE, _type, _v_index, _strides, _ostrides, \
-                     _irank, _idx, _ocont, _label, _pl)           \
-case _TYPE:                                                       \
-    WS_GET_INDEX(_TYPE, _type, _v_index, _strides, _ostrides,     \
-                 _irank, _idx, _ocont);                           \
-    _label = *(_type *)(_pl + _idx);                              \
-    break
+typedef struct {
+    NI_WatershedElement *elements;
+    npy_intp size, allocated;
+} NI_WatershedBucket;
 
-#define CASE_WINDEX3(_TYPE, _type, _p_index, _strides, _ostrides, \
-                     _irank, _idx, _ocont, _label, _pl)           \
-case _TYPE:                                                       \
-    WS_GET_INDEX(_TYPE, _type, _p_index, _strides, _ostrides,     \
-                 _irank, _idx, _ocont);                           \
-    *(_type *)(_pl + _idx) = _label;                              \
-break
+/* orders of the elements that are not queued: */
+#define NI_WS_UNREACHED 0
+#define NI_WS_DONE NPY_MIN_INTP
 
-#define WS_MAXDIM 7
+#define NI_WS_BUCKETS 65
 
 typedef struct {
-    npy_intp index;
-    void *next, *prev;
-    npy_uint16 cost;
-    npy_uint8 done;
-} NI_WatershedElement;
+    char *pi, *pm, *po;
+    int rank, itype, mtype, otype;
+    npy_intp size;
+    npy_intp shape[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
+    npy_intp mstrides[NPY_MAXDIMS], ostrides[NPY_MAXDIMS];
+    double *values, *costs;
+    npy_intp *labels, *orders;
+    npy_uint8 *borders;
+    /* the elements of the current cost, last queued first or in order: */
+    NI_WatershedBucket stack, queue;
+    npy_intp head;
+    NI_WatershedBucket buckets[NI_WS_BUCKETS];
+    npy_uint64 last;
+} NI_WatershedTask;
 
-int NI_WatershedIFT(PyArrayObject* input, PyArrayObject* markers,
-                                        PyArrayObject* strct, PyArrayObject* output)
+/* Read the input and the markers, initialize the output and find the
+   elements on the border of the array: */
+static int _WatershedSetup(void *data, int part, int n_parts)
 {
-    char *pl, *pm, *pi;
+    NI_WatershedTask *task = (NI_WatershedTask*)data;
+    const npy_intp first = task->size * part / n_parts;
+    const npy_intp last = task->size * (part + 1) / n_parts;
+    npy_intp coor[NPY_MAXDIMS], idx = first, jj;
+    char *pi = task->pi, *pm = task->pm, *po = task->po;
     int ll;
-    npy_intp size, jj, hh, kk, maxval;
-    npy_intp strides[WS_MAXDIM], coordinates[WS_MAXDIM];
-    npy_intp *nstrides = NULL, nneigh, ssize;
-    int i_contiguous, o_contiguous;
-    NI_WatershedElement *temp = NULL, **first = NULL, **last = NULL;
-    npy_bool *ps = NULL;
-    NI_Iterator mi, ii, li;
-    NPY_BEGIN_THREADS_DEF;
 
-    i_contiguous = PyArray_ISCONTIGUOUS(input);
-    o_contiguous = PyArray_ISCONTIGUOUS(output);
-    ssize = PyArray_SIZE(strct);
-    if (PyArray_NDIM(input) > WS_MAXDIM) {
-        PyErr_SetString(PyExc_RuntimeError, "too many dimensions");
-        goto exit;
-    }
-    size = PyArray_SIZE(input);
-    /* Storage for the temporary queue data. */
-    temp = malloc(size * sizeof(NI_WatershedElement));
-    if (!temp) {
-        PyErr_NoMemory();
-        goto exit;
+    for(ll = task->rank - 1; ll >= 0; ll--) {
+        coor[ll] = idx % task->shape[ll];
+        idx /= task->shape[ll];
+        pi += coor[ll] * task->istrides[ll];
+        pm += coor[ll] * task->mstrides[ll];
+        po += coor[ll] * task->ostrides[ll];
     }
+    for(jj = first; jj < last; jj++) {
+        double value = 0.0;
+        npy_intp label = 0;
+        npy_uint8 border = 0;
 
-    NPY_BEGIN_THREADS;
-
-    pi = (void *)PyArray_DATA(input);
-    if (!NI_InitPointIterator(input, &ii))
-        goto exit;
-    /* Initialization and find the maximum of the input. */
-    maxval = 0;
-    for(jj = 0; jj < size; jj++) {
-        npy_intp ival = 0;
-        switch (PyArray_TYPE(input)) {
-            CASE_GET_INPUT(NPY_UINT8, npy_uint8, ival, pi);
-            CASE_GET_INPUT(NPY_UINT16, npy_uint16, ival, pi);
+        switch (task->itype) {
+            CASE_GET_INPUT(NPY_BOOL, npy_bool, value, pi);
+            CASE_GET_INPUT(NPY_UBYTE, npy_ubyte, value, pi);
+            CASE_GET_INPUT(NPY_USHORT, npy_ushort, value, pi);
+            CASE_GET_INPUT(NPY_UINT, npy_uint, value, pi);
+            CASE_GET_INPUT(NPY_ULONG, npy_ulong, value, pi);
+            CASE_GET_INPUT(NPY_ULONGLONG, npy_ulonglong, value, pi);
+            CASE_GET_INPUT(NPY_BYTE, npy_byte, value, pi);
+            CASE_GET_INPUT(NPY_SHORT, npy_short, value, pi);
+            CASE_GET_INPUT(NPY_INT, npy_int, value, pi);
+            CASE_GET_INPUT(NPY_LONG, npy_long, value, pi);
+            CASE_GET_INPUT(NPY_LONGLONG, npy_longlong, value, pi);
+            CASE_GET_INPUT(NPY_FLOAT, npy_float, value, pi);
+            CASE_GET_INPUT(NPY_DOUBLE, npy_double, value, pi);
         default:
-            NPY_END_THREADS;
-            PyErr_SetString(PyExc_RuntimeError, "data type not supported");
-            goto exit;
+            break;
         }
-        temp[jj].index = jj;
-        temp[jj].done = 0;
-        if (ival > maxval)
-            maxval = ival;
-        NI_ITERATOR_NEXT(ii, pi);
-    }
-    pi = (void *)PyArray_DATA(input);
-    /* Allocate and initialize the storage for the queue. */
-    first = malloc((maxval + 1) * sizeof(NI_WatershedElement*));
-    last = malloc((maxval + 1) * sizeof(NI_WatershedElement*));
-    if (NPY_UNLIKELY(!first || !last)) {
-        NPY_END_THREADS;
-        PyErr_NoMemory();
-        goto exit;
-    }
-    for(hh = 0; hh <= maxval; hh++) {
-        first[hh] = NULL;
-        last[hh] = NULL;
-    }
-    if (!NI_InitPointIterator(markers, &mi))
-        goto exit;
-    if (!NI_InitPointIterator(output, &li))
-        goto exit;
-    pm = (void *)PyArray_DATA(markers);
-    pl = (void *)PyArray_DATA(output);
-    /* initialize all nodes */
-    for (ll = 0; ll < PyArray_NDIM(input); ll++) {
-        coordinates[ll] = 0;
-    }
-    for(jj = 0; jj < size; jj++) {
-        /* get marker */
-        int label = 0;
-        switch (PyArray_TYPE(markers)) {
+        switch (task->mtype) {
             CASE_GET_LABEL(NPY_UBYTE, npy_ubyte, label, pm);
             CASE_GET_LABEL(NPY_USHORT, npy_ushort, label, pm);
             CASE_GET_LABEL(NPY_UINT, npy_uint, label, pm);
@@ -298,100 +1023,327 @@ int NI_WatershedIFT(PyArrayObject* input, PyArrayObject* markers,
             CASE_GET_LABEL(NPY_LONG, npy_long, label, pm);
             CASE_GET_LABEL(NPY_LONGLONG, npy_longlong, label, pm);
         default:
-            NPY_END_THREADS;
-            PyErr_SetString(PyExc_RuntimeError, "data type not supported");
-            goto exit;
+            break;
         }
-        switch (PyArray_TYPE(output)) {
-            CASE_PUT_LABEL(NPY_UBYTE, npy_ubyte, label, pl);
-            CASE_PUT_LABEL(NPY_USHORT, npy_ushort, label, pl);
-            CASE_PUT_LABEL(NPY_UINT, npy_uint, label, pl);
-            CASE_PUT_LABEL(NPY_ULONG, npy_ulong, label, pl);
-            CASE_PUT_LABEL(NPY_ULONGLONG, npy_ulonglong, label, pl);
-            CASE_PUT_LABEL(NPY_BYTE, npy_byte, label, pl);
-            CASE_PUT_LABEL(NPY_SHORT, npy_short, label, pl);
-            CASE_PUT_LABEL(NPY_INT, npy_int, label, pl);
-            CASE_PUT_LABEL(NPY_LONG, npy_long, label, pl);
-            CASE_PUT_LABEL(NPY_LONGLONG, npy_longlong, label, pl);
+        /* the markers are queued first, in order of their sign: */
+        task->orders[jj] = label > 0 ? -1 : label < 0 ? 1 : NI_WS_UNREACHED;
+        /* the label that is propagated is the one stored in the output: */
+        switch (task->otype) {
+            CASE_PUT_LABEL(NPY_UBYTE, npy_ubyte, label, po);
+            CASE_PUT_LABEL(NPY_USHORT, npy_ushort, label, po);
+            CASE_PUT_LABEL(NPY_UINT, npy_uint, label, po);
+            CASE_PUT_LABEL(NPY_ULONG, npy_ulong, label, po);
+            CASE_PUT_LABEL(NPY_ULONGLONG, npy_ulonglong, label, po);
+            CASE_PUT_LABEL(NPY_BYTE, npy_byte, label, po);
+            CASE_PUT_LABEL(NPY_SHORT, npy_short, label, po);
+            CASE_PUT_LABEL(NPY_INT, npy_int, label, po);
+            CASE_PUT_LABEL(NPY_LONG, npy_long, label, po);
+            CASE_PUT_LABEL(NPY_LONGLONG, npy_longlong, label, po);
         default:
-            NPY_END_THREADS;
-            PyErr_SetString(PyExc_RuntimeError, "data type not supported");
-            goto exit;
+            break;
+        }
+        switch (task->otype) {
+            CASE_GET_LABEL(NPY_UBYTE, npy_ubyte, label, po);
+            CASE_GET_LABEL(NPY_USHORT, npy_ushort, label, po);
+            CASE_GET_LABEL(NPY_UINT, npy_uint, label, po);
+            CASE_GET_LABEL(NPY_ULONG, npy_ulong, label, po);
+            CASE_GET_LABEL(NPY_ULONGLONG, npy_ulonglong, label, po);
+            CASE_GET_LABEL(NPY_BYTE, npy_byte, label, po);
+            CASE_GET_LABEL(NPY_SHORT, npy_short, label, po);
+            CASE_GET_LABEL(NPY_INT, npy_int, label, po);
+            CASE_GET_LABEL(NPY_LONG, npy_long, label, po);
+            CASE_GET_LABEL(NPY_LONGLONG, npy_longlong, label, po);
+        default:
+            break;
         }
-        NI_ITERATOR_NEXT2(mi, li, pm, pl);
-        if (label != 0) {
-            /* This node is a marker */
-            temp[jj].cost = 0;
-            if (!first[0]) {
-                first[0] = &(temp[jj]);
-                first[0]->next = NULL;
-                first[0]->prev = NULL;
-                last[0] = first[0];
+        task->values[jj] = value;
+        task->labels[jj] = label;
+        for(ll = 0; ll < task->rank; ll++)
+            if (coor[ll] == 0 || coor[ll] == task->shape[ll] - 1)
+                border = 1;
+        task->borders[jj] = border;
+
+        for(ll = task->rank - 1; ll >= 0; ll--) {
+            if (coor[ll] < task->shape[ll] - 1) {
+                coor[ll]++;
+                pi += task->istrides[ll];
+                pm += task->mstrides[ll];
+                po += task->ostrides[ll];
+                break;
             } else {
-                if (label > 0) {
-                    /* object markers are enqueued at the beginning, so they
-                       are processed first. */
-                    temp[jj].next = first[0];
-                    temp[jj].prev = NULL;
-                    first[0]->prev = &(temp[jj]);
-                    first[0] = &(temp[jj]);
-                } else {
-                    /* background markers are enqueued at the end, so they are
-                         processed after the object markers. */
-                    temp[jj].next = NULL;
-                    temp[jj].prev = last[0];
-                    last[0]->next = &(temp[jj]);
-                    last[0] = &(temp[jj]);
-                }
+                pi -= coor[ll] * task->istrides[ll];
+                pm -= coor[ll] * task->mstrides[ll];
+                po -= coor[ll] * task->ostrides[ll];
+                coor[ll] = 0;
             }
-        } else {
-            /* This node is not a marker */
-            temp[jj].cost = maxval + 1;
-            temp[jj].next = NULL;
-            temp[jj].prev = NULL;
         }
-        for (ll = PyArray_NDIM(input) - 1; ll >= 0; ll--) {
-            if (coordinates[ll] < PyArray_DIMS(input)[ll] - 1) {
-                coordinates[ll]++;
+    }
+    return 1;
+}
+
+/* Write the labels to the output: */
+static int _WatershedWrite(void *data, int part, int n_parts)
+{
+    NI_WatershedTask *task = (NI_WatershedTask*)data;
+    const npy_intp first = task->size * part / n_parts;
+    const npy_intp last = task->size * (part + 1) / n_parts;
+    npy_intp coor[NPY_MAXDIMS], idx = first, jj;
+    char *po = task->po;
+    int ll;
+
+    for(ll = task->rank - 1; ll >= 0; ll--) {
+        coor[ll] = idx % task->shape[ll];
+        idx /= task->shape[ll];
+        po += coor[ll] * task->ostrides[ll];
+    }
+    for(jj = first; jj < last; jj++) {
+        npy_intp label = task->labels[jj];
+
+        switch (task->otype) {
+            CASE_PUT_LABEL(NPY_UBYTE, npy_ubyte, label, po);
+            CASE_PUT_LABEL(NPY_USHORT, npy_ushort, label, po);
+            CASE_PUT_LABEL(NPY_UINT, npy_uint, label, po);
+            CASE_PUT_LABEL(NPY_ULONG, npy_ulong, label, po);
+            CASE_PUT_LABEL(NPY_ULONGLONG, npy_ulonglong, label, po);
+            CASE_PUT_LABEL(NPY_BYTE, npy_byte, label, po);
+            CASE_PUT_LABEL(NPY_SHORT, npy_short, label, po);
+            CASE_PUT_LABEL(NPY_INT, npy_int, label, po);
+            CASE_PUT_LABEL(NPY_LONG, npy_long, label, po);
+            CASE_PUT_LABEL(NPY_LONGLONG, npy_longlong, label, po);
+        default:
+            break;
+        }
+        for(ll = task->rank - 1; ll >= 0; ll--) {
+            if (coor[ll] < task->shape[ll] - 1) {
+                coor[ll]++;
+                po += task->ostrides[ll];
                 break;
             } else {
-                coordinates[ll] = 0;
+                po -= coor[ll] * task->ostrides[ll];
+                coor[ll] = 0;
             }
         }
     }
+    return 1;
+}
+
+/* The key of a cost, non-negative costs sort as their bits: */
+static npy_uint64 _WatershedKey(double cost)
+{
+    npy_uint64 key;
 
-    pl = (void *)PyArray_DATA(output);
+    memcpy(&key, &cost, sizeof(key));
+    return key;
+}
+
+/* The bucket of a key: one more than the highest bit in which it differs
+   from the last key taken from the heap: */
+static int _WatershedBucket(npy_uint64 key, npy_uint64 last)
+{
+    npy_uint64 diff = key ^ last;
+    int bucket = 0, shift;
+
+    for(shift = 32; shift > 0; shift /= 2) {
+        if (diff >> shift) {
+            diff >>= shift;
+            bucket += shift;
+        }
+    }
+    return bucket + (int)diff;
+}
+
+static int _WatershedAppend(NI_WatershedBucket *bucket, npy_intp index,
+                            npy_intp order)
+{
+    if (bucket->size == bucket->allocated) {
+        npy_intp allocated = bucket->allocated > 0 ?
+                                            2 * bucket->allocated : 256;
+        NI_WatershedElement *elements = realloc(bucket->elements,
+                                    allocated * sizeof(NI_WatershedElement));
+        if (!elements)
+            return 0;
+        bucket->elements = elements;
+        bucket->allocated = allocated;
+    }
+    bucket->elements[bucket->size].index = index;
+    bucket->elements[bucket->size].order = order;
+    ++bucket->size;
+    return 1;
+}
+
+/* Queue an element with a cost that is not less than the last cost: */
+static int _WatershedQueue(NI_WatershedTask *task, npy_intp index,
+                           double cost, npy_intp order)
+{
+    npy_uint64 key = _WatershedKey(cost);
+    NI_WatershedBucket *bucket;
+
+    task->costs[index] = cost;
+    task->orders[index] = order;
+    if (key == task->last)
+        bucket = order < 0 ? &task->stack : &task->queue;
+    else
+        bucket = task->buckets + _WatershedBucket(key, task->last);
+    return _WatershedAppend(bucket, index, order);
+}
+
+static int _CompareWatershedOrders(const void *a, const void *b)
+{
+    npy_intp oa = ((const NI_WatershedElement*)a)->order;
+    npy_intp ob = ((const NI_WatershedElement*)b)->order;
+
+    return oa < ob ? -1 : oa > ob;
+}
+
+/* Move the elements of the lowest cost in the first bucket that is not
+   empty to the queue, and the others to lower buckets. Returns 0 if the
+   heap is empty, -1 if out of memory: */
+static int _WatershedRefill(NI_WatershedTask *task)
+{
+    int bb;
+
+    task->queue.size = task->head = 0;
+    for(bb = 1; bb < NI_WS_BUCKETS; bb++) {
+        NI_WatershedBucket *bucket = task->buckets + bb;
+        npy_uint64 last = 0;
+        npy_intp jj, kk = 0;
+        int found = 0;
+
+        /* drop the old entries, and find the lowest key: */
+        for(jj = 0; jj < bucket->size; jj++) {
+            NI_WatershedElement element = bucket->elements[jj];
+            if (task->orders[element.index] == element.order) {
+                npy_uint64 key = _WatershedKey(task->costs[element.index]);
+                if (!found || key < last)
+                    last = key;
+                found = 1;
+                bucket->elements[kk++] = element;
+            }
+        }
+        bucket->size = kk;
+        if (!found)
+            continue;
+        task->last = last;
+        for(jj = 0; jj < bucket->size; jj++) {
+            NI_WatershedElement element = bucket->elements[jj];
+            npy_uint64 key = _WatershedKey(task->costs[element.index]);
+            NI_WatershedBucket *target = key == last ? &task->queue :
+                            task->buckets + _WatershedBucket(key, last);
+            if (!_WatershedAppend(target, element.index, element.order))
+                return -1;
+        }
+        bucket->size = 0;
+        qsort(task->queue.elements, task->queue.size,
+              sizeof(NI_WatershedElement), _CompareWatershedOrders);
+        return 1;
+    }
+    return 0;
+}
+
+/* Take the next element from the heap. Returns 0 if the heap is empty, -1
+   if out of memory: */
+static int _WatershedNext(NI_WatershedTask *task, npy_intp *index)
+{
+    for(;;) {
+        NI_WatershedElement element;
+
+        if (task->stack.size > 0) {
+            element = task->stack.elements[--task->stack.size];
+        } else if (task->head < task->queue.size) {
+            element = task->queue.elements[task->head++];
+        } else {
+            int status = _WatershedRefill(task);
+            if (status <= 0)
+                return status;
+            continue;
+        }
+        if (task->orders[element.index] == element.order) {
+            *index = element.index;
+            return 1;
+        }
+    }
+}
+
+int NI_WatershedIFT(PyArrayObject* input, PyArrayObject* markers,
+                                        PyArrayObject* strct, PyArrayObject* output)
+{
+    NI_WatershedTask task;
+    npy_intp *offsets = NULL, ssize, nneigh, order = 0, jj, kk;
+    npy_intp cstrides[NPY_MAXDIMS], coordinates[NPY_MAXDIMS];
+    int *deltas = NULL, n_parts, ll, bb, status = 1;
+    npy_bool *ps = NULL;
+    NPY_BEGIN_THREADS_DEF;
+
+    memset(&task, 0, sizeof(task));
+    task.rank = PyArray_NDIM(input);
+    task.size = PyArray_SIZE(input);
+    task.itype = PyArray_TYPE(input);
+    task.mtype = PyArray_TYPE(markers);
+    task.otype = PyArray_TYPE(output);
+    switch (task.itype) {
+    case NPY_BOOL: case NPY_UBYTE: case NPY_USHORT: case NPY_UINT:
+    case NPY_ULONG: case NPY_ULONGLONG: case NPY_BYTE: case NPY_SHORT:
+    case NPY_INT: case NPY_LONG: case NPY_LONGLONG: case NPY_FLOAT:
+    case NPY_DOUBLE:
+        break;
+    default:
+        PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+        goto exit;
+    }
+    if (!PyTypeNum_ISINTEGER(task.mtype) ||
+        !PyTypeNum_ISINTEGER(task.otype)) {
+        PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+        goto exit;
+    }
+    if (task.size == 0)
+        goto exit;
+    task.pi = (void *)PyArray_DATA(input);
+    task.pm = (void *)PyArray_DATA(markers);
+    task.po = (void *)PyArray_DATA(output);
+    for(ll = 0; ll < task.rank; ll++) {
+        task.shape[ll] = PyArray_DIM(input, ll);
+        task.istrides[ll] = PyArray_STRIDE(input, ll);
+        task.mstrides[ll] = PyArray_STRIDE(markers, ll);
+        task.ostrides[ll] = PyArray_STRIDE(output, ll);
+    }
+    if (task.rank > 0) {
+        cstrides[task.rank - 1] = 1;
+        for(ll = task.rank - 2; ll >= 0; ll--)
+            cstrides[ll] = task.shape[ll + 1] * cstrides[ll + 1];
+    }
+
+    /* the offsets of the neighbors in the structure: */
     ps = (npy_bool*)PyArray_DATA(strct);
+    ssize = PyArray_SIZE(strct);
     nneigh = 0;
-    for (kk = 0; kk < ssize; kk++)
-        if (ps[kk] && kk != (ssize / 2))
+    for(kk = 0; kk < ssize; kk++)
+        if (ps[kk] && kk != ssize / 2)
             ++nneigh;
-    nstrides = malloc(nneigh * sizeof(npy_intp));
-    if (NPY_UNLIKELY(!nstrides)) {
-        NPY_END_THREADS;
+    offsets = malloc((nneigh + 1) * sizeof(npy_intp));
+    deltas = malloc((nneigh + 1) * (task.rank + 1) * sizeof(int));
+    task.values = malloc(task.size * sizeof(double));
+    task.labels = malloc(task.size * sizeof(npy_intp));
+    task.costs = malloc(task.size * sizeof(double));
+    task.orders = malloc(task.size * sizeof(npy_intp));
+    task.borders = malloc(task.size);
+    if (!offsets || !deltas || !task.values || !task.labels ||
+        !task.costs || !task.orders || !task.borders) {
         PyErr_NoMemory();
         goto exit;
     }
-    strides[PyArray_NDIM(input) - 1] = 1;
-    for (ll = PyArray_NDIM(input) - 2; ll >= 0; ll--) {
-        strides[ll] = PyArray_DIM(input, ll + 1) * strides[ll + 1];
-    }
-    for (ll = 0; ll < PyArray_NDIM(input); ll++) {
+    for(ll = 0; ll < task.rank; ll++)
         coordinates[ll] = -1;
-    }
-    for(kk = 0; kk < nneigh; kk++)
-        nstrides[kk] = 0;
     jj = 0;
     for(kk = 0; kk < ssize; kk++) {
-        if (ps[kk]) {
-            int offset = 0;
-            for (ll = 0; ll < PyArray_NDIM(input); ll++) {
-                offset += coordinates[ll] * strides[ll];
+        if (ps[kk] && kk != ssize / 2) {
+            offsets[jj] = 0;
+            for(ll = 0; ll < task.rank; ll++) {
+                offsets[jj] += coordinates[ll] * cstrides[ll];
+                deltas[jj * task.rank + ll] = coordinates[ll];
             }
-            if (offset != 0)
-                nstrides[jj++] += offset;
+            ++jj;
         }
-        for (ll = PyArray_NDIM(input) - 1; ll >= 0; ll--) {
+        for(ll = task.rank - 1; ll >= 0; ll--) {
             if (coordinates[ll] < 1) {
                 coordinates[ll]++;
                 break;
@@ -400,221 +1352,91 @@ int NI_WatershedIFT(PyArrayObject* input, PyArrayObject* markers,
             }
         }
     }
-    /* Propagation phase: */
-    for(jj = 0; jj <= maxval; jj++) {
-        while (first[jj]) {
-            /* dequeue first element: */
-            NI_WatershedElement *v = first[jj];
-            first[jj] = first[jj]->next;
-            if (first[jj])
-                first[jj]->prev = NULL;
-            v->prev = NULL;
-            v->next = NULL;
-            /* Mark element as done: */
-            v->done = 1;
-            /* Iterate over the neighbors of the element: */
-            for(hh = 0; hh < nneigh; hh++) {
-                npy_intp v_index = v->index, p_index = v->index, idx, cc;
-                int qq, outside = 0;
-                p_index += nstrides[hh];
+
+    n_parts = NI_NumThreads(task.size);
+
+    NPY_BEGIN_THREADS;
+
+    NI_ParallelFor(n_parts, _WatershedSetup, &task);
+
+    /* queue the markers: */
+    for(jj = 0; jj < task.size && status > 0; jj++) {
+        if (task.orders[jj] != NI_WS_UNREACHED &&
+            !_WatershedQueue(&task, jj, 0.0, task.orders[jj] < 0 ?
+                                                    -(++order) : ++order))
+            status = -1;
+    }
+
+    /* propagation phase: */
+    while (status > 0 && (status = _WatershedNext(&task, &jj)) > 0) {
+        npy_intp label = task.labels[jj];
+        double vval = task.values[jj], vcost = task.costs[jj];
+        int border = task.borders[jj];
+
+        task.orders[jj] = NI_WS_DONE;
+        if (border) {
+            npy_intp idx = jj;
+            for(ll = task.rank - 1; ll >= 0; ll--) {
+                coordinates[ll] = idx % task.shape[ll];
+                idx /= task.shape[ll];
+            }
+        }
+        /* iterate over the neighbors of the element: */
+        for(kk = 0; kk < nneigh; kk++) {
+            npy_intp p_index = jj + offsets[kk], p_order;
+            double wvp, max;
+
+            if (border) {
                 /* check if the neighbor is within the extent of the array: */
-                idx = p_index;
-                for (qq = 0; qq < PyArray_NDIM(input); qq++) {
-                    cc = idx / strides[qq];
-                    if (cc < 0 || cc >= PyArray_DIM(input, qq)) {
-                        outside = 1;
+                const int *delta = deltas + kk * task.rank;
+                for(ll = 0; ll < task.rank; ll++) {
+                    npy_intp cc = coordinates[ll] + delta[ll];
+                    if (cc < 0 || cc >= task.shape[ll])
                         break;
-                    }
-                    idx -= cc * strides[qq];
-                }
-                if (!outside) {
-                    NI_WatershedElement *p = &(temp[p_index]);
-                    if (!(p->done)) {
-                        /* If the neighbor was not processed yet: */
-                        int max, pval, vval, wvp, pcost, label, p_idx, v_idx;
-                        switch (PyArray_TYPE(input)) {
-                            CASE_WINDEX1(NPY_UBYTE, npy_ubyte,
-                                v_index, p_index, strides,
-                                PyArray_STRIDES(input), PyArray_NDIM(input),
-                                i_contiguous, p_idx, v_idx, pi, vval, pval);
-                            CASE_WINDEX1(NPY_USHORT, npy_ushort,
-                                v_index, p_index, strides,
-                                PyArray_STRIDES(input), PyArray_NDIM(input),
-                                i_contiguous, p_idx, v_idx, pi, vval, pval);
-                        default:
-                            NPY_END_THREADS;
-                            PyErr_SetString(PyExc_RuntimeError,
-                                            "data type not supported");
-                            goto exit;
-                        }
-                        /* Calculate cost: */
-                        wvp = pval - vval;
-                        if (wvp < 0)
-                            wvp = -wvp;
-                        /* Find the maximum of this cost and the current
-                             element cost: */
-                        pcost = p->cost;
-                        max = v->cost > wvp ? v->cost : wvp;
-                        if (max < pcost) {
-                            /* If this maximum is less than the neighbors cost,
-                                 adapt the cost and the label of the neighbor: */
-                            int idx;
-                            p->cost = max;
-                            switch (PyArray_TYPE(output)) {
-                                CASE_WINDEX2(NPY_UBYTE, npy_ubyte,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_USHORT, npy_ushort,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_UINT, npy_uint,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_ULONG, npy_ulong,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_ULONGLONG, npy_ulonglong,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_BYTE, npy_byte,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_SHORT, npy_short,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_INT, npy_int,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_LONG, npy_long,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX2(NPY_LONGLONG, npy_longlong,
-                                             v_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                            default:
-                                NPY_END_THREADS;
-                                PyErr_SetString(PyExc_RuntimeError,
-                                                "data type not supported");
-                                goto exit;
-                            }
-                            switch (PyArray_TYPE(output)) {
-                                CASE_WINDEX3(NPY_UBYTE, npy_ubyte,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_USHORT, npy_ushort,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_UINT, npy_uint,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_ULONG, npy_ulong,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_ULONGLONG, npy_ulonglong,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_BYTE, npy_byte,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_SHORT, npy_short,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_INT, npy_int,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_LONG, npy_long,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                                CASE_WINDEX3(NPY_LONGLONG, npy_longlong,
-                                             p_index, strides,
-                                             PyArray_STRIDES(output),
-                                             PyArray_NDIM(input),
-                                             idx, o_contiguous, label, pl);
-                            default:
-                                NPY_END_THREADS;
-                                PyErr_SetString(PyExc_RuntimeError,
-                                                "data type not supported");
-                                goto exit;
-                            }
-                            /* If the neighbor is in a queue, remove it: */
-                            if (p->next || p->prev) {
-                                NI_WatershedElement *prev = p->prev, *next = p->next;
-                                if (first[pcost] == p)
-                                    first[pcost] = next;
-                                if (last[pcost] == p)
-                                    last[pcost] = prev;
-                                if (prev)
-                                    prev->next = next;
-                                if (next)
-                                    next->prev = prev;
-                            }
-                            /* Insert the neighbor in the appropriate queue: */
-                            if (label < 0) {
-                                p->prev = last[max];
-                                p->next = NULL;
-                                if (last[max])
-                                    last[max]->next = p;
-                                last[max] = p;
-                                if (!first[max])
-                                    first[max] = p;
-                            } else {
-                                p->next = first[max];
-                                p->prev = NULL;
-                                if (first[max])
-                                    first[max]->prev = p;
-                                first[max] = p;
-                                if (!last[max])
-                                    last[max] = p;
-                            }
-                        }
-                    }
                 }
+                if (ll < task.rank)
+                    continue;
+            }
+            p_order = task.orders[p_index];
+            if (p_order == NI_WS_DONE)
+                continue;
+            /* calculate the cost, NaN differences are infinitely costly: */
+            wvp = fabs(task.values[p_index] - vval);
+            if (npy_isnan(wvp))
+                wvp = NPY_INFINITY;
+            /* find the maximum of this cost and the current element cost: */
+            max = vcost > wvp ? vcost : wvp;
+            if (p_order != NI_WS_UNREACHED && !(max < task.costs[p_index]))
+                continue;
+            /* if this maximum is less than the neighbors cost, adapt the
+               cost and the label of the neighbor: */
+            task.labels[p_index] = label;
+            if (!_WatershedQueue(&task, p_index, max,
+                                 label < 0 ? ++order : -(++order))) {
+                status = -1;
+                break;
             }
         }
     }
- exit:
+
+    if (status == 0)
+        NI_ParallelFor(n_parts, _WatershedWrite, &task);
+
     NPY_END_THREADS;
-    free(temp);
-    free(first);
-    free(last);
-    free(nstrides);
+
+    if (status != 0)
+        PyErr_NoMemory();
+ exit:
+    free(offsets);
+    free(deltas);
+    free(task.values);
+    free(task.labels);
+    free(task.costs);
+    free(task.orders);
+    free(task.borders);
+    free(task.stack.elements);
+    free(task.queue.elements);
+    for(bb = 0; bb < NI_WS_BUCKETS; bb++)
+        free(task.buckets[bb].elements);
     return PyErr_Occurred() ? 0 : 1;
 }
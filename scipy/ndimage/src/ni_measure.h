@@ -34,6 +34,9 @@
 
 int NI_FindObjects(PyArrayObject*, npy_intp, npy_intp*);
 
+int NI_Label(PyArrayObject*, PyArrayObject*, PyArrayObject*, npy_intp*,
+             npy_intp**, npy_intp**, double**);
+
 int NI_WatershedIFT(PyArrayObject*, PyArrayObject*, PyArrayObject*,
                     PyArrayObject*);
 
@@ -35,6 +35,7 @@
 #include <math.h>
 #include <limits.h>
 #include <float.h>
+#include <string.h>
 
 #define LIST_SIZE 100000
 
@@ -87,6 +88,663 @@ case _TYPE:                                                           \
 }                                                                     \
 break
 
+/* Binary erosion without mask on masks packed to bits, 64 elements per
+     word: the lines along the last axis are the rows of the packed masks,
+     and the erosion is the AND of shifted rows. Each row of the structuring
+     element is split in runs of consecutive elements, a run of length n is
+     applied to a whole row of words in log2(n) steps. A structuring element
+     that is the product of a line along each axis, such as a box, is
+     decomposed in those lines, and each is applied as a separate pass. The
+     bits past the end of a row, and outside of the mask, are equal to the
+     border value. */
+
+#define NI_BITS 64
+
+#define CASE_PACK_BITS(_TYPE, _type, _pi, _stride, _length, _invert, _row) \
+case _TYPE:                                                                \
+{                                                                          \
+    npy_intp _ii;                                                          \
+    for(_ii = 0; _ii < _length; _ii++) {                                   \
+        if ((*(_type *)_pi ? 1 : 0) != _invert)                            \
+            _row[_ii / NI_BITS] |= (npy_uint64)1 << (_ii % NI_BITS);       \
+        _pi += _stride;                                                    \
+    }                                                                      \
+}                                                                          \
+break
+
+#define CASE_UNPACK_BITS(_TYPE, _type, _po, _stride, _length, _invert, \
+                         _row)                                         \
+case _TYPE:                                                            \
+{                                                                      \
+    npy_intp _ii;                                                      \
+    for(_ii = 0; _ii < _length; _ii++) {                               \
+        int _bit = (int)(_row[_ii / NI_BITS] >> (_ii % NI_BITS)) & 1;  \
+        *(_type *)_po = (_type)(_bit != _invert);                      \
+        _po += _stride;                                                \
+    }                                                                  \
+}                                                                      \
+break
+
+typedef struct {
+    char *pi, *po;
+    int rank, axis, itype, otype, invert;
+    npy_intp shape[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
+    npy_intp ostrides[NPY_MAXDIMS];
+    /* the length of the rows, in elements and words, and their number: */
+    npy_intp length, words, rows;
+    npy_uint64 fill, *in, *out, *src, *dst;
+    /* the rows of the structuring element, with their offsets along the
+       other axes, and the start and length of their runs: */
+    npy_intp n_srows, *srow_offsets, *srow_runs, *run_starts, *run_lengths;
+    /* the start and size of the structuring element along each axis, and
+       if it is separable, the runs of its line along each axis: */
+    npy_intp fstarts[NPY_MAXDIMS], fshape[NPY_MAXDIMS];
+    npy_intp axis_runs[NPY_MAXDIMS + 1], *axis_run_starts, *axis_run_lengths;
+    /* per part, a scratch row and the changed flag: */
+    npy_intp scratch_size;
+    npy_uint64 *scratch;
+    int *changed;
+} NI_BitErosionTask;
+
+static npy_intp _BitRowOffset(npy_intp row, int rank, const npy_intp *shape,
+                              const npy_intp *strides)
+{
+    npy_intp offset = 0;
+    int jj;
+
+    for(jj = rank - 2; jj >= 0; jj--) {
+        offset += (row % shape[jj]) * strides[jj];
+        row /= shape[jj];
+    }
+    return offset;
+}
+
+/* Set the bits past the end of a row to the fill value: */
+static void _FillBitPadding(npy_uint64 *row, npy_intp words,
+                            npy_intp length, npy_uint64 fill)
+{
+    if (length % NI_BITS) {
+        npy_uint64 valid = ((npy_uint64)1 << (length % NI_BITS)) - 1;
+        row[words - 1] = (row[words - 1] & valid) | (fill & ~valid);
+    }
+}
+
+/* AND each bit of dst with the bit of src that is shift bits further,
+     the bits outside of src are equal to fill. With a positive shift, src
+     may be equal to dst. */
+static void _AndShiftedBits(npy_uint64 *dst, npy_intp dwords,
+                            const npy_uint64 *src, npy_intp swords,
+                            npy_intp shift, npy_uint64 fill)
+{
+    npy_intp ii;
+
+    if (shift >= 0) {
+        const npy_intp q = shift / NI_BITS;
+        const int r = shift % NI_BITS;
+        for(ii = 0; ii < dwords; ii++) {
+            npy_uint64 lo = ii + q < swords ? src[ii + q] : fill;
+            if (r) {
+                npy_uint64 hi = ii + q + 1 < swords ? src[ii + q + 1] : fill;
+                lo = (lo >> r) | (hi << (NI_BITS - r));
+            }
+            dst[ii] &= lo;
+        }
+    } else {
+        const npy_intp q = -shift / NI_BITS;
+        const int r = -shift % NI_BITS;
+        for(ii = 0; ii < dwords; ii++) {
+            npy_uint64 hi = ii - q >= 0 && ii - q < swords ? src[ii - q] : fill;
+            if (r) {
+                npy_uint64 lo = ii - q - 1 >= 0 && ii - q - 1 < swords ?
+                                                        src[ii - q - 1] : fill;
+                hi = (hi << r) | (lo >> (NI_BITS - r));
+            }
+            dst[ii] &= hi;
+        }
+    }
+}
+
+/* AND each bit of a row with the next length - 1 bits, in place: */
+static void _ErodeBitRun(npy_uint64 *row, npy_intp words, npy_intp length,
+                         npy_uint64 fill)
+{
+    npy_intp covered = 1;
+
+    while (covered < length) {
+        npy_intp step = 2 * covered <= length ? covered : length - covered;
+        _AndShiftedBits(row, words, row, words, step, fill);
+        covered += step;
+    }
+}
+
+/* Store in scratch the AND of the length bits of a row starting at each
+     bit shifted by start. The scratch row is long enough to not cut the
+     runs of the bits of the row. */
+static void _BitRun(npy_uint64 *scratch, const npy_uint64 *row,
+                    npy_intp words, npy_intp start, npy_intp length,
+                    npy_uint64 fill)
+{
+    const npy_intp swords = words + (length + NI_BITS - 1) / NI_BITS;
+    npy_intp jj;
+
+    for(jj = 0; jj < swords; jj++)
+        scratch[jj] = ~(npy_uint64)0;
+    _AndShiftedBits(scratch, swords, row, words, start, fill);
+    _ErodeBitRun(scratch, swords, length, fill);
+}
+
+static int _PackBitRows(void *data, int part, int n_parts)
+{
+    NI_BitErosionTask *task = (NI_BitErosionTask*)data;
+    const npy_intp first = task->rows * part / n_parts;
+    const npy_intp last = task->rows * (part + 1) / n_parts;
+    const npy_intp stride = task->istrides[task->rank - 1];
+    const npy_intp length = task->length, words = task->words;
+    const int invert = task->invert;
+    npy_intp row;
+
+    for(row = first; row < last; row++) {
+        npy_uint64 *prow = task->in + row * words;
+        char *pi = task->pi + _BitRowOffset(row, task->rank, task->shape,
+                                            task->istrides);
+        memset(prow, 0, words * sizeof(npy_uint64));
+        switch (task->itype) {
+            CASE_PACK_BITS(NPY_BOOL, npy_bool,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_UBYTE, npy_ubyte,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_USHORT, npy_ushort,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_UINT, npy_uint,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_ULONG, npy_ulong,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_ULONGLONG, npy_ulonglong,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_BYTE, npy_byte,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_SHORT, npy_short,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_INT, npy_int,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_LONG, npy_long,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_LONGLONG, npy_longlong,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_FLOAT, npy_float,
+                           pi, stride, length, invert, prow);
+            CASE_PACK_BITS(NPY_DOUBLE, npy_double,
+                           pi, stride, length, invert, prow);
+        default:
+            break;
+        }
+        _FillBitPadding(prow, words, length, task->fill);
+    }
+    return 1;
+}
+
+static int _UnpackBitRows(void *data, int part, int n_parts)
+{
+    NI_BitErosionTask *task = (NI_BitErosionTask*)data;
+    const npy_intp first = task->rows * part / n_parts;
+    const npy_intp last = task->rows * (part + 1) / n_parts;
+    const npy_intp stride = task->ostrides[task->rank - 1];
+    const npy_intp length = task->length, words = task->words;
+    const int invert = task->invert;
+    npy_intp row, jj;
+
+    for(row = first; row < last; row++) {
+        npy_uint64 *prow = task->out + row * words;
+        npy_uint64 *irow = task->in + row * words;
+        char *po = task->po + _BitRowOffset(row, task->rank, task->shape,
+                                            task->ostrides);
+        switch (task->otype) {
+            CASE_UNPACK_BITS(NPY_BOOL, npy_bool,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_UBYTE, npy_ubyte,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_USHORT, npy_ushort,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_UINT, npy_uint,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_ULONG, npy_ulong,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_ULONGLONG, npy_ulonglong,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_BYTE, npy_byte,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_SHORT, npy_short,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_INT, npy_int,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_LONG, npy_long,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_LONGLONG, npy_longlong,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_FLOAT, npy_float,
+                             po, stride, length, invert, prow);
+            CASE_UNPACK_BITS(NPY_DOUBLE, npy_double,
+                             po, stride, length, invert, prow);
+        default:
+            break;
+        }
+        if (!task->changed[part]) {
+            for(jj = 0; jj < words; jj++) {
+                npy_uint64 diff = prow[jj] ^ irow[jj];
+                if (jj == words - 1 && length % NI_BITS)
+                    diff &= ((npy_uint64)1 << (length % NI_BITS)) - 1;
+                if (diff) {
+                    task->changed[part] = 1;
+                    break;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/* Erode each row by the runs of all rows of the structuring element: */
+static int _ErodeBitRows(void *data, int part, int n_parts)
+{
+    NI_BitErosionTask *task = (NI_BitErosionTask*)data;
+    const npy_intp first = task->rows * part / n_parts;
+    const npy_intp last = task->rows * (part + 1) / n_parts;
+    const npy_intp words = task->words;
+    const npy_uint64 fill = task->fill;
+    const int lrank = task->rank - 1;
+    npy_uint64 *scratch = task->scratch + part * task->scratch_size;
+    npy_intp coor[NPY_MAXDIMS], row, rr, jj, kk;
+
+    for(row = first; row < last; row++) {
+        npy_uint64 *prow = task->out + row * words;
+        npy_intp tmp = row;
+        for(kk = lrank - 1; kk >= 0; kk--) {
+            coor[kk] = tmp % task->shape[kk];
+            tmp /= task->shape[kk];
+        }
+        for(jj = 0; jj < words; jj++)
+            prow[jj] = ~(npy_uint64)0;
+        for(rr = 0; rr < task->n_srows; rr++) {
+            const npy_intp *soffsets = task->srow_offsets + rr * lrank;
+            npy_intp srow = 0;
+            const npy_uint64 *psrc;
+            for(kk = 0; kk < lrank; kk++) {
+                npy_intp cc = coor[kk] + soffsets[kk];
+                if (cc < 0 || cc >= task->shape[kk])
+                    break;
+                srow = srow * task->shape[kk] + cc;
+            }
+            if (kk < lrank) {
+                /* the row is in the border: */
+                if (fill)
+                    continue;
+                memset(prow, 0, words * sizeof(npy_uint64));
+                break;
+            }
+            psrc = task->in + srow * words;
+            for(jj = task->srow_runs[rr]; jj < task->srow_runs[rr + 1]; jj++) {
+                const npy_intp start = task->run_starts[jj];
+                const npy_intp length = task->run_lengths[jj];
+                if (length == 1) {
+                    _AndShiftedBits(prow, words, psrc, words, start, fill);
+                } else {
+                    _BitRun(scratch, psrc, words, start, length, fill);
+                    for(kk = 0; kk < words; kk++)
+                        prow[kk] &= scratch[kk];
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/* Erode by the line of a separable structuring element along one of the
+     axes before the last, word by word: */
+static int _ErodeBitColumns(void *data, int part, int n_parts)
+{
+    NI_BitErosionTask *task = (NI_BitErosionTask*)data;
+    const int axis = task->axis;
+    const npy_intp len = task->shape[axis], words = task->words;
+    const npy_intp lines = task->rows / len * words;
+    const npy_intp first = lines * part / n_parts;
+    const npy_intp last = lines * (part + 1) / n_parts;
+    const npy_uint64 fill = task->fill;
+    npy_uint64 *scratch = task->scratch + part * task->scratch_size;
+    npy_uint64 *column = scratch + len + task->fshape[axis];
+    npy_intp stride = 1, line, jj, rr;
+    int kk;
+
+    for(kk = axis + 1; kk < task->rank - 1; kk++)
+        stride *= task->shape[kk];
+    for(line = first; line < last; line++) {
+        const npy_intp outer = line / words;
+        const npy_intp base = ((outer / stride) * len * stride +
+                               outer % stride) * words + line % words;
+        for(jj = 0; jj < len; jj++)
+            column[jj] = ~(npy_uint64)0;
+        for(rr = task->axis_runs[axis]; rr < task->axis_runs[axis + 1]; rr++) {
+            const npy_intp start = task->axis_run_starts[rr];
+            const npy_intp length = task->axis_run_lengths[rr];
+            npy_intp covered = 1;
+            for(jj = 0; jj < len + length; jj++) {
+                npy_intp idx = jj + start;
+                scratch[jj] = idx >= 0 && idx < len ?
+                                task->src[base + idx * stride * words] : fill;
+            }
+            while (covered < length) {
+                npy_intp step = 2 * covered <= length ? covered :
+                                                        length - covered;
+                for(jj = 0; jj < len + length; jj++)
+                    scratch[jj] &= jj + step < len + length ?
+                                                    scratch[jj + step] : fill;
+                covered += step;
+            }
+            for(jj = 0; jj < len; jj++)
+                column[jj] &= scratch[jj];
+        }
+        for(jj = 0; jj < len; jj++)
+            task->dst[base + jj * stride * words] = column[jj];
+    }
+    return 1;
+}
+
+/* Erode by the line of a separable structuring element along the last
+     axis: */
+static int _ErodeBitLines(void *data, int part, int n_parts)
+{
+    NI_BitErosionTask *task = (NI_BitErosionTask*)data;
+    const npy_intp first = task->rows * part / n_parts;
+    const npy_intp last = task->rows * (part + 1) / n_parts;
+    const npy_intp words = task->words, axis = task->rank - 1;
+    npy_uint64 *scratch = task->scratch + part * task->scratch_size;
+    npy_uint64 *result = scratch + words +
+                         (task->fshape[axis] + NI_BITS - 1) / NI_BITS;
+    npy_intp row, rr, jj;
+
+    for(row = first; row < last; row++) {
+        npy_uint64 *prow = task->dst + row * words;
+        for(jj = 0; jj < words; jj++)
+            result[jj] = ~(npy_uint64)0;
+        for(rr = task->axis_runs[axis]; rr < task->axis_runs[axis + 1]; rr++) {
+            _BitRun(scratch, task->src + row * words, words,
+                    task->axis_run_starts[rr], task->axis_run_lengths[rr],
+                    task->fill);
+            for(jj = 0; jj < words; jj++)
+                result[jj] &= scratch[jj];
+        }
+        memcpy(prow, result, words * sizeof(npy_uint64));
+        _FillBitPadding(prow, words, task->length, task->fill);
+    }
+    return 1;
+}
+
+/* Find if the structuring element is the product of its projections on
+     the axes, and if so, store the runs of each projection. lines is a
+     buffer for the projections, of the sum of the sizes of the axes. */
+static int _SeparableBitRuns(NI_BitErosionTask *task, const npy_bool *ps,
+                             npy_intp ssize, npy_bool *lines)
+{
+    npy_intp loffsets[NPY_MAXDIMS + 1], jj, kk, nruns = 0;
+    int ii;
+
+    loffsets[0] = 0;
+    for(ii = 0; ii < task->rank; ii++)
+        loffsets[ii + 1] = loffsets[ii] + task->fshape[ii];
+    memset(lines, 0, loffsets[task->rank]);
+    for(jj = 0; jj < ssize; jj++) {
+        npy_intp tmp = jj;
+        if (!ps[jj])
+            continue;
+        for(ii = task->rank - 1; ii >= 0; ii--) {
+            lines[loffsets[ii] + tmp % task->fshape[ii]] = 1;
+            tmp /= task->fshape[ii];
+        }
+    }
+    for(jj = 0; jj < ssize; jj++) {
+        npy_intp tmp = jj;
+        npy_bool in = 1;
+        for(ii = task->rank - 1; ii >= 0; ii--) {
+            in = in && lines[loffsets[ii] + tmp % task->fshape[ii]];
+            tmp /= task->fshape[ii];
+        }
+        if (in != (ps[jj] ? 1 : 0))
+            return 0;
+    }
+    for(ii = 0; ii < task->rank; ii++) {
+        const npy_bool *line = lines + loffsets[ii];
+        task->axis_runs[ii] = nruns;
+        for(kk = 0; kk < task->fshape[ii]; kk++) {
+            if (line[kk] && (kk == 0 || !line[kk - 1])) {
+                task->axis_run_starts[nruns] = kk + task->fstarts[ii];
+                task->axis_run_lengths[nruns++] = 1;
+            } else if (line[kk]) {
+                ++task->axis_run_lengths[nruns - 1];
+            }
+        }
+    }
+    task->axis_runs[task->rank] = nruns;
+    return 1;
+}
+
+/* The number of coordinates per block of a coordinate list: */
+static npy_intp _CoordinateBlockSize(int rank, npy_intp size)
+{
+    npy_intp block_size = LIST_SIZE / rank / sizeof(int);
+
+    if (block_size < 1)
+        block_size = 1;
+    if (block_size > size)
+        block_size = size;
+    return block_size;
+}
+
+/* Store the coordinates of the elements changed by the erosion in a new
+     coordinate list, in the order of the element-wise loop: */
+static int _ListChangedBits(NI_BitErosionTask *task,
+                            NI_CoordinateList **coordinate_list)
+{
+    const int lrank = task->rank - 1;
+    const npy_intp words = task->words, length = task->length;
+    NI_CoordinateBlock *block = NULL;
+    npy_intp *current = NULL, block_size, row, jj, kk;
+    int bb;
+
+    block_size = _CoordinateBlockSize(task->rank, task->rows * length);
+    *coordinate_list = NI_InitCoordinateList(block_size, task->rank);
+    if (NPY_UNLIKELY(!*coordinate_list))
+        return 0;
+    for(row = 0; row < task->rows; row++) {
+        const npy_uint64 *prow = task->out + row * words;
+        const npy_uint64 *irow = task->in + row * words;
+        for(jj = 0; jj < words; jj++) {
+            npy_uint64 diff = prow[jj] ^ irow[jj];
+            if (jj == words - 1 && length % NI_BITS)
+                diff &= ((npy_uint64)1 << (length % NI_BITS)) - 1;
+            for(bb = 0; diff; bb++, diff >>= 1) {
+                npy_intp tmp = row;
+                if (!(diff & 1))
+                    continue;
+                if (block == NULL || block->size == block_size) {
+                    block = NI_CoordinateListAddBlock(*coordinate_list);
+                    if (NPY_UNLIKELY(block == NULL))
+                        return 0;
+                    current = block->coordinates;
+                }
+                for(kk = lrank - 1; kk >= 0; kk--) {
+                    current[kk] = tmp % task->shape[kk];
+                    tmp /= task->shape[kk];
+                }
+                current[lrank] = jj * NI_BITS + bb;
+                current += task->rank;
+                block->size++;
+            }
+        }
+    }
+    return 1;
+}
+
+static int _BitsTypeSupported(int type)
+{
+    switch (type) {
+    case NPY_BOOL: case NPY_UBYTE: case NPY_USHORT: case NPY_UINT:
+    case NPY_ULONG: case NPY_ULONGLONG: case NPY_BYTE: case NPY_SHORT:
+    case NPY_INT: case NPY_LONG: case NPY_LONGLONG: case NPY_FLOAT:
+    case NPY_DOUBLE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Returns 0 if the erosion can not be done on bits, otherwise does the
+     erosion and returns 1, or -1 on error. If coordinate_list is not NULL,
+     it is set to a list of the changed elements. */
+static int _BinaryErosionBits(PyArrayObject* input, PyArrayObject* strct,
+                              PyArrayObject* output, int bdr_value,
+                              npy_intp *origins, int invert, int *changed,
+                              NI_CoordinateList **coordinate_list)
+{
+    NI_BitErosionTask task;
+    const npy_bool *ps = (npy_bool*)PyArray_DATA(strct);
+    const npy_intp *fshape = PyArray_DIMS(strct);
+    npy_intp size = PyArray_SIZE(input), ssize = PyArray_SIZE(strct);
+    npy_intp jj, kk, nruns = 0, nlines = 0;
+    npy_bool *lines = NULL;
+    int ii, lrank, separable, n_parts;
+    NPY_BEGIN_THREADS_DEF;
+
+    if (PyArray_NDIM(input) < 1 || size == 0 || ssize == 0 ||
+        !_BitsTypeSupported(PyArray_TYPE(input)) ||
+        !_BitsTypeSupported(PyArray_TYPE(output))) {
+        return 0;
+    }
+    memset(&task, 0, sizeof(task));
+    task.pi = (void *)PyArray_DATA(input);
+    task.po = (void *)PyArray_DATA(output);
+    task.rank = PyArray_NDIM(input);
+    task.itype = PyArray_TYPE(input);
+    task.otype = PyArray_TYPE(output);
+    task.invert = invert ? 1 : 0;
+    for(ii = 0; ii < task.rank; ii++) {
+        task.shape[ii] = PyArray_DIM(input, ii);
+        task.istrides[ii] = PyArray_STRIDE(input, ii);
+        task.ostrides[ii] = PyArray_STRIDE(output, ii);
+        task.fshape[ii] = fshape[ii];
+        task.fstarts[ii] = -(fshape[ii] / 2 + (origins ? origins[ii] : 0));
+    }
+    lrank = task.rank - 1;
+    task.length = task.shape[lrank];
+    task.words = (task.length + NI_BITS - 1) / NI_BITS;
+    task.rows = size / task.length;
+    /* with invert, the dilation is the erosion of the inverted masks: */
+    task.fill = (bdr_value ? 1 : 0) != task.invert ? ~(npy_uint64)0 : 0;
+
+    /* decompose the structuring element in lines along the axes, if it is
+       separable: */
+    for(ii = 0; ii < task.rank; ii++)
+        nlines += fshape[ii];
+    lines = malloc(nlines * sizeof(npy_bool));
+    task.axis_run_starts = malloc(nlines * sizeof(npy_intp));
+    task.axis_run_lengths = malloc(nlines * sizeof(npy_intp));
+    if (!lines || !task.axis_run_starts || !task.axis_run_lengths) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    separable = _SeparableBitRuns(&task, ps, ssize, lines);
+
+    /* otherwise split it in rows and runs: */
+    task.n_srows = separable ? 0 : ssize / fshape[lrank];
+    task.srow_offsets = malloc((task.n_srows * lrank + 1) * sizeof(npy_intp));
+    task.srow_runs = malloc((task.n_srows + 1) * sizeof(npy_intp));
+    task.run_starts = malloc(ssize * sizeof(npy_intp));
+    task.run_lengths = malloc(ssize * sizeof(npy_intp));
+    if (!task.srow_offsets || !task.srow_runs || !task.run_starts ||
+        !task.run_lengths) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    task.n_srows = 0;
+    for(jj = 0; jj < ssize && !separable; jj += fshape[lrank]) {
+        const npy_intp first_run = nruns;
+        npy_intp tmp = jj / fshape[lrank];
+        for(kk = 0; kk < fshape[lrank]; kk++) {
+            if (ps[jj + kk] && (kk == 0 || !ps[jj + kk - 1])) {
+                task.run_starts[nruns] = kk + task.fstarts[lrank];
+                task.run_lengths[nruns++] = 1;
+            } else if (ps[jj + kk]) {
+                ++task.run_lengths[nruns - 1];
+            }
+        }
+        if (nruns == first_run)
+            continue;
+        for(ii = lrank - 1; ii >= 0; ii--) {
+            task.srow_offsets[task.n_srows * lrank + ii] =
+                                        tmp % fshape[ii] + task.fstarts[ii];
+            tmp /= fshape[ii];
+        }
+        task.srow_runs[task.n_srows++] = first_run;
+    }
+    task.srow_runs[task.n_srows] = nruns;
+
+    n_parts = NI_NumThreads(size);
+    task.scratch_size = 0;
+    for(ii = 0; ii < task.rank; ii++) {
+        npy_intp tmp = ii < lrank ? 2 * task.shape[ii] + fshape[ii] :
+                        2 * task.words + (fshape[ii] + NI_BITS - 1) / NI_BITS;
+        if (tmp > task.scratch_size)
+            task.scratch_size = tmp;
+    }
+    task.in = malloc(task.rows * task.words * sizeof(npy_uint64));
+    task.out = malloc(task.rows * task.words * sizeof(npy_uint64));
+    task.scratch = malloc(n_parts * task.scratch_size * sizeof(npy_uint64));
+    task.changed = calloc(n_parts, sizeof(int));
+    if (!task.in || !task.out || !task.scratch || !task.changed) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+
+    NPY_BEGIN_THREADS;
+    NI_ParallelFor(n_parts, _PackBitRows, &task);
+    if (separable) {
+        task.src = task.in;
+        task.dst = task.out;
+        for(ii = 0; ii < lrank; ii++) {
+            task.axis = ii;
+            NI_ParallelFor(n_parts, _ErodeBitColumns, &task);
+            task.src = task.out;
+        }
+        NI_ParallelFor(n_parts, _ErodeBitLines, &task);
+    } else {
+        NI_ParallelFor(n_parts, _ErodeBitRows, &task);
+    }
+    NI_ParallelFor(n_parts, _UnpackBitRows, &task);
+    NPY_END_THREADS;
+
+    *changed = 0;
+    for(ii = 0; ii < n_parts; ii++)
+        if (task.changed[ii])
+            *changed = 1;
+    if (coordinate_list && !_ListChangedBits(&task, coordinate_list)) {
+        NI_FreeCoordinateList(*coordinate_list);
+        *coordinate_list = NULL;
+        PyErr_NoMemory();
+    }
+
+ exit:
+    free(lines);
+    free(task.axis_run_starts);
+    free(task.axis_run_lengths);
+    free(task.srow_offsets);
+    free(task.srow_runs);
+    free(task.run_starts);
+    free(task.run_lengths);
+    free(task.in);
+    free(task.out);
+    free(task.scratch);
+    free(task.changed);
+    return PyErr_Occurred() ? -1 : 1;
+}
+
 int NI_BinaryErosion(PyArrayObject* input, PyArrayObject* strct,
                 PyArrayObject* mask, PyArrayObject* output, int bdr_value,
                      npy_intp *origins, int invert, int center_is_true,
@@ -106,6 +764,13 @@ int NI_BinaryErosion(PyArrayObject* input, PyArrayObject* strct,
     ssize = PyArray_SIZE(strct);
     for(jj = 0; jj < ssize; jj++)
         if (ps[jj]) ++struct_size;
+    if (!mask) {
+        /* erode the masks packed to bits, if possible: */
+        if (_BinaryErosionBits(input, strct, output, bdr_value, origins,
+                               invert, changed, coordinate_list)) {
+            return PyErr_Occurred() ? 0 : 1;
+        }
+    }
     if (mask) {
         if (!NI_InitPointIterator(mask, &mi))
             return 0;
@@ -146,11 +811,7 @@ int NI_BinaryErosion(PyArrayObject* input, PyArrayObject* strct,
         _false = 0;
     }
     if (coordinate_list) {
-        block_size = LIST_SIZE / PyArray_NDIM(input) / sizeof(int);
-        if (block_size < 1)
-            block_size = 1;
-        if (block_size > size)
-            block_size = size;
+        block_size = _CoordinateBlockSize(PyArray_NDIM(input), size);
         *coordinate_list = NI_InitCoordinateList(block_size,
                                                  PyArray_NDIM(input));
         if (NPY_UNLIKELY(!*coordinate_list)) {
@@ -940,65 +1601,82 @@ static void _VoronoiFT(char *pf, npy_intp len, npy_intp *coor, int rank,
 }
 
 
-/* Recursive feature transform */
-static void _ComputeFT(char *pi, char *pf, npy_intp *ishape,
-                       const npy_intp *istrides, const npy_intp *fstrides,
-                       int rank, int d, npy_intp *coor, npy_intp **f,
-                       npy_intp *g, PyArrayObject *features,
-                       const npy_double *sampling)
+/* Find the start of line number line along the given axis, in the order
+     of the other axes: stores the coordinates of the line in coor and
+     returns the offsets of its first element in two arrays. */
+static void _LineStart(npy_intp line, int rank, int axis,
+                       const npy_intp *shape, const npy_intp *strides1,
+                       const npy_intp *strides2, npy_intp *coor,
+                       npy_intp *offset1, npy_intp *offset2)
 {
-    npy_intp kk;
-    npy_intp jj;
+    int jj;
 
-    if (d == 0) {
-        char *tf1 = pf;
-        for(jj = 0; jj < ishape[0]; jj++) {
-            if (*(npy_int8*)pi) {
-                *(npy_int32*)tf1 = -1;
-            } else {
-                char *tf2 = tf1;
-                *(npy_int32*)tf2 = jj;
-                for(kk = 1; kk < rank; kk++) {
-                    tf2 += fstrides[0];
-                    *(npy_int32*)tf2 = coor[kk];
-                }
-            }
-            pi += istrides[0];
-            tf1 += fstrides[1];
-        }
-        _VoronoiFT(pf, ishape[0], coor, rank, 0, fstrides[1], fstrides[0], f,
-                             g, sampling);
-    } else {
-        npy_uint32 axes = 0;
-        char *tf = pf;
-        npy_intp size = 1;
-        NI_Iterator ii;
-
-        for(jj = 0; jj < ishape[d]; jj++) {
-            coor[d] = jj;
-            _ComputeFT(pi, tf, ishape, istrides, fstrides, rank, d - 1, coor, f,
-                                 g, features, sampling);
-            pi += istrides[d];
-            tf += fstrides[d + 1];
+    *offset1 = *offset2 = 0;
+    for(jj = rank - 1; jj >= 0; jj--) {
+        if (jj == axis) {
+            coor[jj] = 0;
+        } else {
+            coor[jj] = line % shape[jj];
+            line /= shape[jj];
+            *offset1 += coor[jj] * strides1[jj];
+            *offset2 += coor[jj] * strides2[jj];
         }
+    }
+}
 
-        for(jj = 0; jj < d; jj++) {
-            axes |= (npy_uint32)1 << (jj + 1);
-            size *= ishape[jj];
-        }
-        NI_InitPointIterator(features, &ii);
-        NI_SubspaceIterator(&ii, axes);
-        tf = pf;
-        for(jj = 0; jj < size; jj++) {
-            for(kk = 0; kk < d; kk++)
-                coor[kk] = ii.coordinates[kk];
-            _VoronoiFT(tf, ishape[d], coor, rank, d, fstrides[d + 1],
-                                 fstrides[0], f, g, sampling);
-            NI_ITERATOR_NEXT(ii, tf);
+/* The feature transform is separable: the lines along an axis only
+     depend on the result along the previous axes, and are independent of
+     each other. */
+typedef struct {
+    char *pi, *pf;
+    int rank, axis;
+    npy_intp size, shape[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
+    npy_intp fstrides[NPY_MAXDIMS + 1];
+    const npy_double *sampling;
+    /* per part, the temporaries of _VoronoiFT: */
+    npy_intp mx, **f, *g;
+} NI_FeatureTask;
+
+static int _FeatureTransformLines(void *data, int part, int n_parts)
+{
+    NI_FeatureTask *task = (NI_FeatureTask*)data;
+    const int rank = task->rank, d = task->axis;
+    const npy_intp *fstrides = task->fstrides;
+    const npy_intp len = task->shape[d], lines = task->size / len;
+    const npy_intp first = lines * part / n_parts;
+    const npy_intp last = lines * (part + 1) / n_parts;
+    npy_intp **f = task->f + part * task->mx, *g = task->g + part * task->mx;
+    npy_intp coor[NPY_MAXDIMS], line, jj, kk;
+
+    for(line = first; line < last; line++) {
+        npy_intp ioffset, foffset;
+        char *pf;
+
+        _LineStart(line, rank, d, task->shape, task->istrides, fstrides + 1,
+                   coor, &ioffset, &foffset);
+        pf = task->pf + foffset;
+        if (d == 0) {
+            /* initialize the features from the input: */
+            char *pi = task->pi + ioffset, *tf1 = pf;
+            for(jj = 0; jj < len; jj++) {
+                if (*(npy_int8*)pi) {
+                    *(npy_int32*)tf1 = -1;
+                } else {
+                    char *tf2 = tf1;
+                    *(npy_int32*)tf2 = jj;
+                    for(kk = 1; kk < rank; kk++) {
+                        tf2 += fstrides[0];
+                        *(npy_int32*)tf2 = coor[kk];
+                    }
+                }
+                pi += task->istrides[0];
+                tf1 += fstrides[1];
+            }
         }
-        for(kk = 0; kk < d; kk++)
-            coor[kk] = 0;
+        _VoronoiFT(pf, len, coor, rank, d, fstrides[d + 1], fstrides[0], f,
+                   g, task->sampling);
     }
+    return 1;
 }
 
 /* Exact euclidean feature transform, as described in: C. R. Maurer,
@@ -1009,45 +1687,270 @@ int NI_EuclideanFeatureTransform(PyArrayObject* input,
                                                                  PyArrayObject *sampling_arr,
                                                                  PyArrayObject* features)
 {
-    int ii;
-    npy_intp coor[NPY_MAXDIMS], mx = 0, jj;
-    npy_intp *tmp = NULL, **f = NULL, *g = NULL;
-    char *pi, *pf;
-    npy_double *sampling = sampling_arr ? ((void *)PyArray_DATA(sampling_arr)) : NULL;
+    NI_FeatureTask task;
+    int ii, n_parts = 0;
+    npy_intp *tmp = NULL, jj;
     NPY_BEGIN_THREADS_DEF;
 
-    pi = (void *)PyArray_DATA(input);
-    pf = (void *)PyArray_DATA(features);
-    for (ii = 0; ii < PyArray_NDIM(input); ii++) {
-        coor[ii] = 0;
-        if (PyArray_DIMS(input)[ii] > mx) {
-            mx = PyArray_DIM(input, ii);
-        }
+    memset(&task, 0, sizeof(task));
+    task.pi = (void *)PyArray_DATA(input);
+    task.pf = (void *)PyArray_DATA(features);
+    task.rank = PyArray_NDIM(input);
+    task.size = PyArray_SIZE(input);
+    task.sampling = sampling_arr ? ((void *)PyArray_DATA(sampling_arr)) : NULL;
+    for(ii = 0; ii < task.rank; ii++) {
+        task.shape[ii] = PyArray_DIM(input, ii);
+        task.istrides[ii] = PyArray_STRIDE(input, ii);
+        if (task.shape[ii] > task.mx)
+            task.mx = task.shape[ii];
     }
+    for(ii = 0; ii <= task.rank; ii++)
+        task.fstrides[ii] = PyArray_STRIDE(features, ii);
+    if (task.size == 0)
+        goto exit;
 
-    /* Some temporaries */
-    f = malloc(mx * sizeof(npy_intp*));
-    g = malloc(mx * sizeof(npy_intp));
-    tmp = malloc(mx * PyArray_NDIM(input) * sizeof(npy_intp));
-    if (!f || !g || !tmp) {
+    /* Some temporaries, for each thread */
+    n_parts = NI_NumThreads(task.size * task.rank);
+    task.f = malloc(n_parts * task.mx * sizeof(npy_intp*));
+    task.g = malloc(n_parts * task.mx * sizeof(npy_intp));
+    tmp = malloc(n_parts * task.mx * task.rank * sizeof(npy_intp));
+    if (!task.f || !task.g || !tmp) {
         PyErr_NoMemory();
         goto exit;
     }
-    for(jj = 0; jj < mx; jj++) {
-        f[jj] = tmp + jj * PyArray_NDIM(input);
+    for(jj = 0; jj < n_parts * task.mx; jj++) {
+        task.f[jj] = tmp + jj * task.rank;
     }
 
-    /* First call of recursive feature transform */
+    /* Transform all lines along each axis in turn */
     NPY_BEGIN_THREADS;
-    _ComputeFT(pi, pf, PyArray_DIMS(input), PyArray_STRIDES(input),
-               PyArray_STRIDES(features), PyArray_NDIM(input),
-               PyArray_NDIM(input) - 1, coor, f, g, features, sampling);
+    for(ii = 0; ii < task.rank; ii++) {
+        task.axis = ii;
+        NI_ParallelFor(n_parts, _FeatureTransformLines, &task);
+    }
     NPY_END_THREADS;
 
  exit:
-    free(f);
-    free(g);
+    free(task.f);
+    free(task.g);
     free(tmp);
 
     return PyErr_Occurred() ? 0 : 1;
 }
+
+/* Squared distance transform of a sampled function f along a line, with
+     infinite values where there is no feature, as described in:
+     P. F. Felzenszwalb, D. P. Huttenlocher, "Distance Transforms of
+     Sampled Functions", Theory of Computing 8, 415-428, 2012. The lower
+     envelope of the parabolas is stored in v and z. */
+static void _ParabolaEnvelope(const double *f, npy_intp len, double sampling,
+                              double *d, npy_intp *v, double *z)
+{
+    const double s2 = sampling * sampling;
+    npy_intp k = -1, q;
+
+    for(q = 0; q < len; q++) {
+        double s = -INFINITY;
+        if (f[q] == INFINITY)
+            continue;
+        while(k >= 0) {
+            const npy_intp p = v[k];
+            s = ((f[q] + s2 * q * q) - (f[p] + s2 * p * p)) /
+                (2.0 * s2 * (q - p));
+            if (s > z[k])
+                break;
+            s = -INFINITY;
+            --k;
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+    }
+    if (k < 0) {
+        for(q = 0; q < len; q++)
+            d[q] = INFINITY;
+    } else {
+        const npy_intp maxk = k;
+        k = 0;
+        for(q = 0; q < len; q++) {
+            double t;
+            while(k < maxk && z[k + 1] < q)
+                ++k;
+            t = (double)(q - v[k]) * sampling;
+            d[q] = f[v[k]] + t * t;
+        }
+    }
+}
+
+#define CASE_EDT_GET(_TYPE, _type, _pd, _stride, _f, _len) \
+case _TYPE:                                               \
+{                                                         \
+    npy_intp _ii;                                         \
+    for(_ii = 0; _ii < _len; _ii++)                       \
+        _f[_ii] = *(_type *)(_pd + _ii * _stride);        \
+}                                                         \
+break
+
+#define CASE_EDT_SET(_TYPE, _type, _pd, _stride, _d, _len) \
+case _TYPE:                                               \
+{                                                         \
+    npy_intp _ii;                                         \
+    for(_ii = 0; _ii < _len; _ii++)                       \
+        *(_type *)(_pd + _ii * _stride) = (_type)_d[_ii];  \
+}                                                         \
+break
+
+/* The distance transform is separable as well: each axis adds the
+     squared distances along it to the result of the previous axes. */
+typedef struct {
+    char *pi, *pd;
+    int rank, axis, type_num, squared;
+    npy_intp size, shape[NPY_MAXDIMS], istrides[NPY_MAXDIMS];
+    npy_intp dstrides[NPY_MAXDIMS];
+    const npy_double *sampling;
+    /* per part, the line buffers and envelope of _ParabolaEnvelope: */
+    npy_intp mx, *v;
+    double *buffer;
+} NI_DistanceTask;
+
+static int _DistanceTransformLines(void *data, int part, int n_parts)
+{
+    NI_DistanceTask *task = (NI_DistanceTask*)data;
+    const int rank = task->rank, d = task->axis;
+    const npy_intp len = task->shape[d], lines = task->size / len;
+    const npy_intp first = lines * part / n_parts;
+    const npy_intp last = lines * (part + 1) / n_parts;
+    const npy_intp dstride = task->dstrides[d];
+    const double sampling = task->sampling ? task->sampling[d] : 1.0;
+    double *f = task->buffer + 3 * part * task->mx;
+    double *dd = f + task->mx, *z = dd + task->mx;
+    npy_intp *v = task->v + part * task->mx;
+    npy_intp coor[NPY_MAXDIMS], line, jj;
+
+    for(line = first; line < last; line++) {
+        npy_intp ioffset, doffset;
+        char *pd;
+
+        _LineStart(line, rank, d, task->shape, task->istrides, task->dstrides,
+                   coor, &ioffset, &doffset);
+        pd = task->pd + doffset;
+        if (d == 0) {
+            /* the background points are the features: */
+            char *pi = task->pi + ioffset;
+            for(jj = 0; jj < len; jj++) {
+                f[jj] = *(npy_int8*)pi ? INFINITY : 0.0;
+                pi += task->istrides[0];
+            }
+        } else {
+            switch (task->type_num) {
+                CASE_EDT_GET(NPY_FLOAT, npy_float, pd, dstride, f, len);
+                CASE_EDT_GET(NPY_DOUBLE, npy_double, pd, dstride, f, len);
+            default:
+                break;
+            }
+        }
+        _ParabolaEnvelope(f, len, sampling, dd, v, z);
+        if (d == rank - 1 && !task->squared) {
+            for(jj = 0; jj < len; jj++)
+                dd[jj] = sqrt(dd[jj]);
+        }
+        switch (task->type_num) {
+            CASE_EDT_SET(NPY_FLOAT, npy_float, pd, dstride, dd, len);
+            CASE_EDT_SET(NPY_DOUBLE, npy_double, pd, dstride, dd, len);
+        default:
+            break;
+        }
+    }
+    return 1;
+}
+
+/* Exact euclidean distance transform, computed directly without the
+     features, by one pass along each axis. The distances may be squared,
+     and of type float32 to save memory. */
+int NI_EuclideanDistanceTransform(PyArrayObject* input,
+                                  PyArrayObject *sampling_arr,
+                                  PyArrayObject* distances, int squared)
+{
+    NI_DistanceTask task;
+    NI_Iterator ii, di;
+    int jj, n_parts = 0, background = 0;
+    npy_intp kk;
+    char *pi, *pd;
+    NPY_BEGIN_THREADS_DEF;
+
+    memset(&task, 0, sizeof(task));
+    task.pi = (void *)PyArray_DATA(input);
+    task.pd = (void *)PyArray_DATA(distances);
+    task.rank = PyArray_NDIM(input);
+    task.size = PyArray_SIZE(input);
+    task.type_num = PyArray_TYPE(distances);
+    task.squared = squared;
+    task.sampling = sampling_arr ? ((void *)PyArray_DATA(sampling_arr)) : NULL;
+    if (task.type_num != NPY_FLOAT && task.type_num != NPY_DOUBLE) {
+        PyErr_SetString(PyExc_RuntimeError, "data type not supported");
+        goto exit;
+    }
+    for(jj = 0; jj < task.rank; jj++) {
+        task.shape[jj] = PyArray_DIM(input, jj);
+        task.istrides[jj] = PyArray_STRIDE(input, jj);
+        task.dstrides[jj] = PyArray_STRIDE(distances, jj);
+        if (task.shape[jj] > task.mx)
+            task.mx = task.shape[jj];
+    }
+    if (task.size == 0 || task.rank == 0)
+        goto exit;
+
+    n_parts = NI_NumThreads(task.size * task.rank);
+    task.buffer = malloc(3 * n_parts * task.mx * sizeof(double));
+    task.v = malloc(n_parts * task.mx * sizeof(npy_intp));
+    if (!task.buffer || !task.v) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+
+    NPY_BEGIN_THREADS;
+
+    /* find out if there are any background points: */
+    NI_InitPointIterator(input, &ii);
+    pi = task.pi;
+    for(kk = 0; kk < task.size && !background; kk++) {
+        background = *(npy_int8*)pi == 0;
+        NI_ITERATOR_NEXT(ii, pi);
+    }
+
+    if (background) {
+        for(jj = 0; jj < task.rank; jj++) {
+            task.axis = jj;
+            NI_ParallelFor(n_parts, _DistanceTransformLines, &task);
+        }
+    } else {
+        /* without background, the feature transform only sets the
+           first coordinate of the features to -1, and the others keep
+           their initial value of zero: */
+        NI_InitPointIterator(distances, &di);
+        pd = task.pd;
+        for(kk = 0; kk < task.size; kk++) {
+            double t, dist = 0.0;
+            for(jj = 0; jj < task.rank; jj++) {
+                t = (double)((jj == 0 ? -1 : 0) - di.coordinates[jj]);
+                if (task.sampling)
+                    t *= task.sampling[jj];
+                dist += t * t;
+            }
+            if (!squared)
+                dist = sqrt(dist);
+            if (task.type_num == NPY_FLOAT)
+                *(npy_float*)pd = (npy_float)dist;
+            else
+                *(npy_double*)pd = dist;
+            NI_ITERATOR_NEXT(di, pd);
+        }
+    }
+    NPY_END_THREADS;
+
+ exit:
+    free(task.buffer);
+    free(task.v);
+
+    return PyErr_Occurred() ? 0 : 1;
+}
@@ -42,5 +42,7 @@ int NI_DistanceTransformOnePass(PyArrayObject*, PyArrayObject *,
                                                                 PyArrayObject*);
 int NI_EuclideanFeatureTransform(PyArrayObject*, PyArrayObject*,
                                                                  PyArrayObject*);
+int NI_EuclideanDistanceTransform(PyArrayObject*, PyArrayObject*,
+                                  PyArrayObject*, int);
 
 #endif
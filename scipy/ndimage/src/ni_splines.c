@@ -153,82 +153,140 @@ get_filter_poles(int order, int *npoles, double *poles)
 }
 
 
-typedef void (init_fn)(npy_double*, const npy_intp, const double);
+/*
+ * The filters below run on `nlines` interleaved lines at once: the
+ * coefficient `i` of line `l` is stored at `c[i * nlines + l]`. Each
+ * line goes through exactly the same operations as if it was filtered
+ * on its own, the inner loops over the lines are left to the compiler
+ * to vectorize.
+ */
+typedef void (init_fn)(npy_double*, const npy_intp, const npy_intp,
+                       const double, double*);
 
 
 static void
-_init_causal_mirror(double *c, const npy_intp n, const double z)
+_init_causal_mirror(double *c, const npy_intp n, const npy_intp nlines,
+                    const double z, double *scratch)
 {
-    npy_intp i;
+    npy_intp i, l;
     double z_i = z;
     const double z_n_1 = pow(z, n - 1);
+    const double *c_n_1 = c + (n - 1) * nlines;
 
-    c[0] = c[0] + z_n_1 * c[n - 1];
+    for (l = 0; l < nlines; ++l) {
+        c[l] = c[l] + z_n_1 * c_n_1[l];
+    }
     for (i = 1; i < n - 1; ++i) {
-        c[0] += z_i * (c[i] + z_n_1 * c[n - 1 - i]);
+        const double *c_i = c + i * nlines;
+        const double *c_n_1_i = c + (n - 1 - i) * nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c[l] += z_i * (c_i[l] + z_n_1 * c_n_1_i[l]);
+        }
         z_i *= z;
     }
-    c[0] /= 1 - z_n_1 * z_n_1;
+    for (l = 0; l < nlines; ++l) {
+        c[l] /= 1 - z_n_1 * z_n_1;
+    }
 }
 
 
 static void
-_init_anticausal_mirror(double *c, const npy_intp n, const double z)
+_init_anticausal_mirror(double *c, const npy_intp n, const npy_intp nlines,
+                        const double z, double *scratch)
 {
-    c[n - 1] = (z * c[n - 2] + c[n - 1]) * z / (z * z - 1);
+    npy_intp l;
+    double *c_n_1 = c + (n - 1) * nlines;
+    const double *c_n_2 = c + (n - 2) * nlines;
+
+    for (l = 0; l < nlines; ++l) {
+        c_n_1[l] = (z * c_n_2[l] + c_n_1[l]) * z / (z * z - 1);
+    }
 }
 
 
 static void
-_init_causal_wrap(double *c, const npy_intp n, const double z)
+_init_causal_wrap(double *c, const npy_intp n, const npy_intp nlines,
+                  const double z, double *scratch)
 {
-    npy_intp i;
+    npy_intp i, l;
     double z_i = z;
 
     for (i = 1; i < n; ++i) {
-        c[0] += z_i * c[n - i];
+        const double *c_n_i = c + (n - i) * nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c[l] += z_i * c_n_i[l];
+        }
         z_i *= z;
     }
-    c[0] /= 1 - z_i; /* z_i = pow(z, n) */
+    for (l = 0; l < nlines; ++l) {
+        c[l] /= 1 - z_i; /* z_i = pow(z, n) */
+    }
 }
 
 
 static void
-_init_anticausal_wrap(double *c, const npy_intp n, const double z)
+_init_anticausal_wrap(double *c, const npy_intp n, const npy_intp nlines,
+                      const double z, double *scratch)
 {
-    npy_intp i;
+    npy_intp i, l;
     double z_i = z;
+    double *c_n_1 = c + (n - 1) * nlines;
 
     for (i = 0; i < n - 1; ++i) {
-        c[n - 1] += z_i * c[i];
+        const double *c_i = c + i * nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c_n_1[l] += z_i * c_i[l];
+        }
         z_i *= z;
     }
-    c[n - 1] *= z / (z_i - 1); /* z_i = pow(z, n) */
+    for (l = 0; l < nlines; ++l) {
+        c_n_1[l] *= z / (z_i - 1); /* z_i = pow(z, n) */
+    }
 }
 
 
 static void
-_init_causal_reflect(double *c, const npy_intp n, const double z)
+_init_causal_reflect(double *c, const npy_intp n, const npy_intp nlines,
+                     const double z, double *c0)
 {
-    npy_intp i;
+    npy_intp i, l;
     double z_i = z;
     const double z_n = pow(z, n);
-    const double c0 = c[0];
+    const double *c_n_1 = c + (n - 1) * nlines;
 
-    c[0] = c[0] + z_n * c[n - 1];
+    for (l = 0; l < nlines; ++l) {
+        c0[l] = c[l];
+        c[l] = c[l] + z_n * c_n_1[l];
+    }
     for (i = 1; i < n; ++i) {
-        c[0] += z_i * (c[i] + z_n * c[n - 1 - i]);
+        const double *c_i = c + i * nlines;
+        const double *c_n_1_i = c + (n - 1 - i) * nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c[l] += z_i * (c_i[l] + z_n * c_n_1_i[l]);
+        }
         z_i *= z;
     }
-    c[0] *= z / (1 - z_n * z_n);
-    c[0] += c0;
+    for (l = 0; l < nlines; ++l) {
+        c[l] *= z / (1 - z_n * z_n);
+        c[l] += c0[l];
+    }
 }
 
 
-void
-_init_anticausal_reflect(double *c, const npy_intp n, const double z)
+static void
+_init_anticausal_reflect(double *c, const npy_intp n, const npy_intp nlines,
+                         const double z, double *scratch)
 {
-    c[n - 1] *= z / (z - 1);
+    npy_intp l;
+    double *c_n_1 = c + (n - 1) * nlines;
+
+    for (l = 0; l < nlines; ++l) {
+        c_n_1[l] *= z / (z - 1);
+    }
 }
 
 
@@ -250,18 +308,29 @@ _init_anticausal_reflect(double *c, const npy_intp n, const double z)
  * obtained from a private communication with Dr. Philippe Thévenaz.
  */
 static void
-_apply_filter(double *c, npy_intp n, double z, init_fn *causal_init,
-              init_fn *anticausal_init)
+_apply_filter(double *c, npy_intp n, npy_intp nlines, double z,
+              init_fn *causal_init, init_fn *anticausal_init,
+              double *scratch)
 {
-    npy_intp i;
+    npy_intp i, l;
 
-    causal_init(c, n, z);
+    causal_init(c, n, nlines, z, scratch);
     for (i = 1; i < n; ++i) {
-        c[i] += z * c[i - 1];
+        double *c_i = c + i * nlines;
+        const double *c_i_1 = c_i - nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c_i[l] += z * c_i_1[l];
+        }
     }
-    anticausal_init(c, n, z);
+    anticausal_init(c, n, nlines, z, scratch);
     for (i = n - 2; i >= 0; --i) {
-        c[i] = z * (c[i + 1] - c[i]);
+        double *c_i = c + i * nlines;
+        const double *c_i_1 = c_i + nlines;
+
+        for (l = 0; l < nlines; ++l) {
+            c_i[l] = z * (c_i_1[l] - c_i[l]);
+        }
     }
 }
 
@@ -283,8 +352,9 @@ _apply_filter_gain(double *c, npy_intp n, const double *zs, int nz)
 
 
 void
-apply_filter(double *coefficients, const npy_intp len, const double *poles,
-             int npoles, NI_ExtendMode mode)
+apply_filter_lines(double *coefficients, const npy_intp len,
+                   const npy_intp nlines, const double *poles, int npoles,
+                   NI_ExtendMode mode, double *scratch)
 {
     init_fn *causal = NULL;
     init_fn *anticausal = NULL;
@@ -312,9 +382,20 @@ apply_filter(double *coefficients, const npy_intp len, const double *poles,
             assert(0); /* We should never get here. */
     }
 
-    _apply_filter_gain(coefficients, len, poles, npoles);
+    _apply_filter_gain(coefficients, len * nlines, poles, npoles);
 
     while (npoles--) {
-        _apply_filter(coefficients, len, *poles++, causal, anticausal);
+        _apply_filter(coefficients, len, nlines, *poles++, causal,
+                      anticausal, scratch);
     }
 }
+
+
+void
+apply_filter(double *coefficients, const npy_intp len, const double *poles,
+             int npoles, NI_ExtendMode mode)
+{
+    double scratch;
+
+    apply_filter_lines(coefficients, len, 1, poles, npoles, mode, &scratch);
+}
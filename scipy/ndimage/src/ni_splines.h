@@ -45,4 +45,15 @@ apply_filter(double *coefficients, const npy_intp len, const double *poles,
              int npoles, NI_ExtendMode mode);
 
 
+/*
+ * Same as `apply_filter`, for `nlines` lines of length `len` stored
+ * interleaved: the coefficient `i` of line `l` is at
+ * `coefficients[i * nlines + l]`. `scratch` should hold `nlines` values.
+ */
+void
+apply_filter_lines(double *coefficients, const npy_intp len,
+                   const npy_intp nlines, const double *poles, int npoles,
+                   NI_ExtendMode mode, double *scratch);
+
+
 #endif
@@ -31,6 +31,18 @@
 
 #include "ni_support.h"
 
+#ifndef NI_NO_MULTITHREADING
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+/* size of the line buffers of NI_FilterLines, per thread: */
+#define LINE_BUFFER_SIZE 256000
+
 /* initialize iterations over single array elements: */
 int NI_InitPointIterator(PyArrayObject *array, NI_Iterator *iterator)
 {
@@ -478,6 +490,165 @@ int NI_LineBufferToArray(NI_LineBuffer *buffer)
     return 1;
 }
 
+/* Restrict a freshly initialized line buffer to the array lines
+     [first, last): */
+int NI_LineBufferRange(NI_LineBuffer *buffer, npy_intp first, npy_intp last)
+{
+    int ii;
+    npy_intp line = first;
+
+    if (buffer->next_line != 0 || first < 0 || first > last ||
+            last > buffer->array_lines) {
+        PyErr_SetString(PyExc_RuntimeError, "invalid line buffer range");
+        return 0;
+    }
+    /* move the iterator to the first line: */
+    if (first < last) {
+        for(ii = buffer->iterator.rank_m1; ii >= 0; ii--) {
+            npy_intp size = buffer->iterator.dimensions[ii] + 1;
+            buffer->iterator.coordinates[ii] = line % size;
+            buffer->array_data +=
+                    buffer->iterator.coordinates[ii] * buffer->iterator.strides[ii];
+            line /= size;
+        }
+    }
+    buffer->next_line = first;
+    buffer->array_lines = last;
+    return 1;
+}
+
+/* the line buffers and scratch space of one batch of lines: */
+typedef struct {
+    double *ibuffer, *obuffer;
+    NI_LineBuffer iline_buffer, oline_buffer;
+    void *scratch;
+} NI_LineBatch;
+
+typedef struct {
+    NI_LineBatch *batches;
+    NI_LineFilterFunc *filter;
+    void *data;
+    npy_intp length;
+} NI_LineTask;
+
+static int NI_FilterLineBatch(void *arg, int part, int n_parts)
+{
+    NI_LineTask *task = (NI_LineTask *)arg;
+    NI_LineBatch *batch = task->batches + part;
+    npy_intp ii, lines;
+    int more;
+
+    do {
+        /* copy lines from array to buffer: */
+        if (!NI_ArrayToLineBuffer(&batch->iline_buffer, &lines, &more)) {
+            return 0;
+        }
+        /* filter the lines in the buffers: */
+        for(ii = 0; ii < lines; ii++) {
+            if (!task->filter(NI_GET_LINE(batch->iline_buffer, ii),
+                              NI_GET_LINE(batch->oline_buffer, ii),
+                              task->length, task->data, batch->scratch)) {
+                return 0;
+            }
+        }
+        /* copy lines from buffer to array: */
+        if (!NI_LineBufferToArray(&batch->oline_buffer)) {
+            return 0;
+        }
+    } while(more);
+    return 1;
+}
+
+/* Apply a line filter to all lines of an array along an axis, in
+     parallel: */
+int NI_FilterLines(PyArrayObject *input, PyArrayObject *output, int axis,
+                   npy_intp size1, npy_intp size2, NI_ExtendMode mode,
+                   double cval, NI_LineFilterFunc *filter, void *data,
+                   size_t scratch_size)
+{
+    NI_LineBatch *batches = NULL;
+    NI_LineTask task;
+    npy_intp array_lines, length;
+    int ii, n_batches = 0, ok;
+    NPY_BEGIN_THREADS_DEF;
+
+    /* extending lines is not allowed to fail on the worker threads: */
+    if (size1 + size2 > 0 && ((int)mode < NI_EXTEND_FIRST ||
+                              (int)mode > NI_EXTEND_GRID_CONSTANT)) {
+        PyErr_Format(PyExc_RuntimeError, "mode %d not supported", mode);
+        return 0;
+    }
+
+    length = PyArray_NDIM(input) > 0 ? PyArray_DIM(input, axis) : 1;
+    array_lines = length > 0 ? PyArray_SIZE(input) / length : 0;
+    n_batches = NI_NumThreads(PyArray_SIZE(input) * (size1 + size2 + 1));
+    if (n_batches > array_lines) {
+        n_batches = (int)array_lines;
+    }
+    if (n_batches < 1) {
+        n_batches = 1;
+    }
+
+    batches = calloc(n_batches, sizeof(NI_LineBatch));
+    if (!batches) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for(ii = 0; ii < n_batches; ii++) {
+        NI_LineBatch *batch = batches + ii;
+        npy_intp first = array_lines * ii / n_batches;
+        npy_intp last = array_lines * (ii + 1) / n_batches;
+        npy_intp lines = -1;
+
+        if (!NI_AllocateLineBuffer(input, axis, size1, size2, &lines,
+                                   LINE_BUFFER_SIZE, &batch->ibuffer))
+            goto exit;
+        if (!NI_AllocateLineBuffer(output, axis, 0, 0, &lines,
+                                   LINE_BUFFER_SIZE, &batch->obuffer))
+            goto exit;
+        if (!NI_InitLineBuffer(input, axis, size1, size2, lines,
+                               batch->ibuffer, mode, cval,
+                               &batch->iline_buffer))
+            goto exit;
+        if (!NI_InitLineBuffer(output, axis, 0, 0, lines, batch->obuffer,
+                               mode, 0.0, &batch->oline_buffer))
+            goto exit;
+        if (!NI_LineBufferRange(&batch->iline_buffer, first, last) ||
+                !NI_LineBufferRange(&batch->oline_buffer, first, last))
+            goto exit;
+        if (scratch_size > 0) {
+            batch->scratch = malloc(scratch_size);
+            if (!batch->scratch) {
+                PyErr_NoMemory();
+                goto exit;
+            }
+        }
+    }
+
+    task.batches = batches;
+    task.filter = filter;
+    task.data = data;
+    task.length = length;
+
+    NPY_BEGIN_THREADS;
+    ok = NI_ParallelFor(n_batches, NI_FilterLineBatch, &task);
+    NPY_END_THREADS;
+    if (!ok && !PyErr_Occurred()) {
+        PyErr_SetString(PyExc_RuntimeError, "line filter failed");
+    }
+
+exit:
+    if (batches) {
+        for(ii = 0; ii < n_batches; ii++) {
+            free(batches[ii].ibuffer);
+            free(batches[ii].obuffer);
+            free(batches[ii].scratch);
+        }
+        free(batches);
+    }
+    return PyErr_Occurred() ? 0 : 1;
+}
+
 /******************************************************************/
 /* Multi-dimensional filter support functions */
 /******************************************************************/
@@ -518,6 +689,65 @@ NI_InitFilterIterator(int rank, npy_intp *filter_shape,
     return 1;
 }
 
+/* Map a coordinate along an axis of the given length into the array,
+     according to the boundary mode. Returns -1 if the coordinate lies
+     outside the array and takes the constant value: */
+npy_intp NI_ExtendCoordinate(npy_intp cc, npy_intp len, NI_ExtendMode mode)
+{
+    if (cc >= 0 && cc < len)
+        return cc;
+    switch (mode) {
+    case NI_EXTEND_MIRROR:
+        if (len <= 1) {
+            cc = 0;
+        } else if (cc < 0) {
+            npy_intp sz2 = 2 * len - 2;
+            cc += sz2 * (-cc / sz2);
+            cc = cc <= 1 - len ? cc + sz2 : -cc;
+        } else {
+            npy_intp sz2 = 2 * len - 2;
+            cc -= sz2 * (cc / sz2);
+            if (cc >= len)
+                cc = sz2 - cc;
+        }
+        break;
+    case NI_EXTEND_REFLECT:
+        if (len <= 1) {
+            cc = 0;
+        } else if (cc < 0) {
+            npy_intp sz2 = 2 * len;
+            cc += sz2 * (-cc / sz2);
+            if (cc < 0)
+                cc = cc < -len ? cc + sz2 : -cc - 1;
+        } else {
+            npy_intp sz2 = 2 * len;
+            cc -= sz2 * (cc / sz2);
+            if (cc >= len)
+                cc = sz2 - cc - 1;
+        }
+        break;
+    case NI_EXTEND_WRAP:
+    case NI_EXTEND_GRID_WRAP:
+        if (len <= 1) {
+            cc = 0;
+        } else if (cc < 0) {
+            cc += len * (-cc / len);
+            if (cc < 0)
+                cc += len;
+        } else {
+            cc -= len * (cc / len);
+        }
+        break;
+    case NI_EXTEND_NEAREST:
+        cc = cc < 0 ? 0 : len - 1;
+        break;
+    default:
+        cc = -1;
+        break;
+    }
+    return cc;
+}
+
 /* Calculate the offsets to the filter points, for all border regions and
      the interior of the array: */
 int NI_InitFilterOffsets(PyArrayObject *array, npy_bool *footprint,
@@ -531,6 +761,10 @@ int NI_InitFilterOffsets(PyArrayObject *array, npy_bool *footprint,
     npy_intp footprint_size = 0, coordinates[NPY_MAXDIMS], position[NPY_MAXDIMS];
     npy_intp fshape[NPY_MAXDIMS], forigins[NPY_MAXDIMS], *po, *pc = NULL;
 
+    if ((int)mode < NI_EXTEND_FIRST || (int)mode > NI_EXTEND_GRID_CONSTANT) {
+        PyErr_SetString(PyExc_RuntimeError, "boundary mode not supported");
+        return 0;
+    }
     rank = PyArray_NDIM(array);
     ashape = PyArray_DIMS(array);
     astrides = PyArray_STRIDES(array);
@@ -599,90 +833,13 @@ int NI_InitFilterOffsets(PyArrayObject *array, npy_bool *footprint,
                 /* find offsets along all axes: */
                 for(ii = 0; ii < rank; ii++) {
                     npy_intp orgn = fshape[ii] / 2 + forigins[ii];
-                    npy_intp cc = coordinates[ii] - orgn + position[ii];
-                    npy_intp len = ashape[ii];
                     /* apply boundary conditions, if necessary: */
-                    switch (mode) {
-                    case NI_EXTEND_MIRROR:
-                        if (cc < 0) {
-                            if (len <= 1) {
-                                cc = 0;
-                            } else {
-                                int sz2 = 2 * len - 2;
-                                cc = sz2 * (int)(-cc / sz2) + cc;
-                                cc = cc <= 1 - len ? cc + sz2 : -cc;
-                            }
-                        } else if (cc >= len) {
-                            if (len <= 1) {
-                                cc = 0;
-                            } else {
-                                int sz2 = 2 * len - 2;
-                                cc -= sz2 * (int)(cc / sz2);
-                                if (cc >= len)
-                                    cc = sz2 - cc;
-                            }
-                        }
-                        break;
-                    case NI_EXTEND_REFLECT:
-                        if (cc < 0) {
-                            if (len <= 1) {
-                                cc = 0;
-                            } else {
-                                int sz2 = 2 * len;
-                                if (cc < -sz2)
-                                    cc = sz2 * (int)(-cc / sz2) + cc;
-                                cc = cc < -len ? cc + sz2 : -cc - 1;
-                            }
-                        } else if (cc >= len) {
-                            if (len <= 1) {cc = 0;
-                            } else {
-                                int sz2 = 2 * len;
-                                cc -= sz2 * (int)(cc / sz2);
-                                if (cc >= len)
-                                    cc = sz2 - cc - 1;
-                            }
-                        }
-                        break;
-                    case NI_EXTEND_WRAP:
-                    case NI_EXTEND_GRID_WRAP:
-                        if (cc < 0) {
-                            if (len <= 1) {
-                                cc = 0;
-                            } else {
-                                int sz = len;
-                                cc += sz * (int)(-cc / sz);
-                                if (cc < 0)
-                                    cc += sz;
-                            }
-                        } else if (cc >= len) {
-                            if (len <= 1) {
-                                cc = 0;
-                            } else {
-                                int sz = len;
-                                cc -= sz * (int)(cc / sz);
-                            }
-                        }
-                        break;
-                    case NI_EXTEND_NEAREST:
-                        if (cc < 0) {
-                            cc = 0;
-                        } else if (cc >= len) {
-                            cc = len - 1;
-                        }
-                        break;
-                    case NI_EXTEND_CONSTANT:
-                    case NI_EXTEND_GRID_CONSTANT:
-                        if (cc < 0 || cc >= len)
-                            cc = *border_flag_value;
-                        break;
-                    default:
-                    PyErr_SetString(PyExc_RuntimeError,
-                                                                                    "boundary mode not supported");
-                        goto exit;
-                    }
+                    npy_intp cc = NI_ExtendCoordinate(
+                            coordinates[ii] - orgn + position[ii], ashape[ii],
+                            mode);
 
                     /* calculate offset along current axis: */
-                    if (cc == *border_flag_value) {
+                    if (cc < 0) {
                         /* just flag that we are outside the border */
                         offset = *border_flag_value;
                         if (coordinate_offsets)
@@ -817,3 +974,162 @@ void NI_FreeCoordinateList(NI_CoordinateList *list)
         free(list);
     }
 }
+
+
+/******************************************************************/
+/* Threads */
+/******************************************************************/
+
+/* Minimum number of elementary operations given to a thread: */
+#define NI_PARALLEL_GRAIN 65536
+
+/* Upper bound on the number of threads used by a single call: */
+#define NI_PARALLEL_MAX_THREADS 64
+
+/* Per thread, so that each caller sets its own limit: */
+#if defined(_MSC_VER)
+#define NI_THREAD_LOCAL __declspec(thread)
+#else
+#define NI_THREAD_LOCAL __thread
+#endif
+
+static NI_THREAD_LOCAL int NI_MaxThreads = 1;
+
+void NI_SetMaxThreads(int n)
+{
+    NI_MaxThreads = n > 1 ? n : 1;
+}
+
+int NI_GetMaxThreads(void)
+{
+    return NI_MaxThreads;
+}
+
+int NI_NumThreads(npy_intp work)
+{
+#ifdef NI_NO_MULTITHREADING
+    return 1;
+#else
+    npy_intp n = work / NI_PARALLEL_GRAIN;
+
+    if (n > NI_MaxThreads)
+        n = NI_MaxThreads;
+    if (n > NI_PARALLEL_MAX_THREADS)
+        n = NI_PARALLEL_MAX_THREADS;
+    return n < 1 ? 1 : (int)n;
+#endif
+}
+
+typedef struct {
+    NI_ParallelFunc *func;
+    void *data;
+    int n_parts;
+} NI_ParallelTask;
+
+#ifndef NI_NO_MULTITHREADING
+/* A part of a task that runs on a thread of its own: */
+typedef struct {
+    const NI_ParallelTask *task;
+    int part, ok;
+} NI_ThreadPart;
+
+#ifdef _WIN32
+typedef HANDLE NI_Thread;
+
+static unsigned __stdcall NI_ThreadMain(void *arg)
+{
+    NI_ThreadPart *part = (NI_ThreadPart *)arg;
+    part->ok = part->task->func(part->task->data, part->part,
+                                part->task->n_parts);
+    return 0;
+}
+
+static int NI_StartThread(NI_Thread *thread, NI_ThreadPart *part)
+{
+    *thread = (HANDLE)_beginthreadex(NULL, 0, NI_ThreadMain, part, 0, NULL);
+    return *thread != 0;
+}
+
+static void NI_JoinThread(NI_Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t NI_Thread;
+
+static void *NI_ThreadMain(void *arg)
+{
+    NI_ThreadPart *part = (NI_ThreadPart *)arg;
+    part->ok = part->task->func(part->task->data, part->part,
+                                part->task->n_parts);
+    return NULL;
+}
+
+static int NI_StartThread(NI_Thread *thread, NI_ThreadPart *part)
+{
+    return pthread_create(thread, NULL, NI_ThreadMain, part) == 0;
+}
+
+static void NI_JoinThread(NI_Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+#endif
+#endif
+
+/* Run all parts of a task. A thread is started for each part but the
+   first one and joined before returning; parts that do not get a thread
+   run on the calling thread: */
+int NI_ParallelFor(int n_parts, NI_ParallelFunc *func, void *data)
+{
+    int ii, first = 1, ok = 1;
+#ifndef NI_NO_MULTITHREADING
+    NI_ParallelTask task;
+    NI_ThreadPart *parts = NULL;
+    NI_Thread *threads = NULL;
+    int n_started = 0;
+#endif
+
+    if (n_parts < 1) {
+        return 1;
+    }
+
+#ifndef NI_NO_MULTITHREADING
+    if (n_parts > 1) {
+        task.func = func;
+        task.data = data;
+        task.n_parts = n_parts;
+        parts = malloc((n_parts - 1) * sizeof(NI_ThreadPart));
+        threads = malloc((n_parts - 1) * sizeof(NI_Thread));
+        while (parts && threads && n_started < n_parts - 1) {
+            parts[n_started].task = &task;
+            parts[n_started].part = n_started + 1;
+            parts[n_started].ok = 0;
+            if (!NI_StartThread(threads + n_started, parts + n_started))
+                break;
+            ++n_started;
+        }
+    }
+    first = n_started + 1;
+#endif
+
+    /* parts that did not get a thread: */
+    for(ii = first; ii < n_parts; ii++) {
+        if (!func(data, ii, n_parts))
+            ok = 0;
+    }
+    if (!func(data, 0, n_parts))
+        ok = 0;
+
+#ifndef NI_NO_MULTITHREADING
+    for(ii = 0; ii < n_started; ii++) {
+        NI_JoinThread(threads[ii]);
+        if (!parts[ii].ok)
+            ok = 0;
+    }
+    free(threads);
+    free(parts);
+#endif
+    return ok;
+}
@@ -194,6 +194,47 @@ int NI_ArrayToLineBuffer(NI_LineBuffer*, npy_intp*, int*);
 /* Copy a line from a buffer to an array: */
 int NI_LineBufferToArray(NI_LineBuffer*);
 
+/* Restrict a freshly initialized line buffer to the array lines
+     [first, last): */
+int NI_LineBufferRange(NI_LineBuffer*, npy_intp, npy_intp);
+
+/* Filter one line: called with the input line (including the boundary
+     extension), the output line, the line length, the user data and
+     per-thread scratch space. Returns 1 on success, 0 on failure, and must
+     not use the Python API: */
+typedef int (NI_LineFilterFunc)(double*, double*, npy_intp, void*, void*);
+
+/* Apply a line filter to all lines of an array along an axis. The lines
+     are split in batches that are filtered in parallel, each with its own
+     line buffers and scratch space of the given size: */
+int NI_FilterLines(PyArrayObject*, PyArrayObject*, int, npy_intp, npy_intp,
+                   NI_ExtendMode, double, NI_LineFilterFunc*, void*, size_t);
+
+/******************************************************************/
+/* Threads */
+/******************************************************************/
+
+/* Set the maximum number of threads of the calling thread's tasks,
+     1 by default: */
+void NI_SetMaxThreads(int);
+
+/* Get the maximum number of threads of the calling thread's tasks: */
+int NI_GetMaxThreads(void);
+
+/* Number of threads worth using for a task of the given number of
+     elementary operations: */
+int NI_NumThreads(npy_intp);
+
+/* One part of a parallel task: called with the user data, the part number
+     and the number of parts. Returns 1 on success, 0 on failure, and must
+     not use the Python API: */
+typedef int (NI_ParallelFunc)(void*, int, int);
+
+/* Run all parts of a task, the first one on the calling thread and the
+     others on threads started for this call. Returns 0 if any part
+     failed: */
+int NI_ParallelFor(int, NI_ParallelFunc*, void*);
+
 /******************************************************************/
 /* Multi-dimensional filter support functions */
 /******************************************************************/
@@ -208,6 +249,11 @@ typedef struct {
 int NI_InitFilterIterator(int, npy_intp*, npy_intp, npy_intp*,
                           npy_intp*, NI_FilterIterator*);
 
+/* Map a coordinate along an axis into the array according to the boundary
+     mode, or to -1 if it lies outside the array and takes the constant
+     value: */
+npy_intp NI_ExtendCoordinate(npy_intp, npy_intp, NI_ExtendMode);
+
 /* Calculate the offsets to the filter points, for all border regions and
      the interior of the array: */
 int NI_InitFilterOffsets(PyArrayObject*, npy_bool*, npy_intp*,
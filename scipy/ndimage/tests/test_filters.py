@@ -2,6 +2,8 @@
 import functools
 import itertools
 import math
+import os
+import threading
 import numpy
 
 from numpy.testing import (assert_equal, assert_allclose,
@@ -13,6 +15,7 @@ from pytest import raises as assert_raises
 
 from scipy import ndimage
 from scipy.ndimage._filters import _gaussian_kernel1d
+from scipy._lib._testutils import check_workers
 
 from . import types, float_types, complex_types
 
@@ -2106,6 +2109,52 @@ class TestThreading:
         self.check_func_thread(4, ndimage.minimum_filter, (d, 3), ot)
         assert_array_equal(os, ot)
 
+    @pytest.mark.parametrize('axis', [0, 1, 2])
+    @pytest.mark.parametrize('mode', ['reflect', 'constant', 'wrap'])
+    def test_filter_lines_workers(self, axis, mode):
+        # lines of a separable filter are split over internal threads
+        d = numpy.random.randn(60, 70, 40)
+        filters = [
+            functools.partial(ndimage.gaussian_filter1d, sigma=2.5),
+            functools.partial(ndimage.uniform_filter1d, size=6, origin=1),
+            functools.partial(ndimage.minimum_filter1d, size=5),
+            functools.partial(ndimage.maximum_filter1d, size=4, origin=-1),
+        ]
+        check_workers(lambda: [f(d, axis=axis, mode=mode) for f in filters],
+                      ndimage.set_workers)
+
+    @pytest.mark.parametrize('mode', ['reflect', 'constant', 'nearest'])
+    def test_correlate_workers(self, mode):
+        # output lines of an n-D correlation are split over internal threads
+        d = numpy.random.randn(50, 60, 40).astype(numpy.float32)
+        k = numpy.random.randn(3, 3, 3)
+        k[1, 0, :] = 0
+        check_workers(
+            lambda: ndimage.correlate(d, k, mode=mode, origin=(0, 1, -1)),
+            ndimage.set_workers)
+
+
+def test_set_workers():
+    assert ndimage.get_workers() == 1
+    with ndimage.set_workers(3):
+        assert ndimage.get_workers() == 3
+        with ndimage.set_workers(-1):
+            assert ndimage.get_workers() == os.cpu_count()
+        assert ndimage.get_workers() == 3
+
+        # the setting is per thread
+        result = []
+        t = threading.Thread(target=lambda: result.append(
+            ndimage.get_workers()))
+        t.start()
+        t.join()
+        assert result == [1]
+    assert ndimage.get_workers() == 1
+
+    with pytest.raises(ValueError):
+        with ndimage.set_workers(0):
+            pass
+
 
 def test_minmaximum_filter1d():
     # Regression gh-3898
@@ -2187,3 +2236,45 @@ def test_byte_order_median():
     b = numpy.arange(9, dtype='>f4').reshape(3, 3)
     t = ndimage.median_filter(b, (3, 3))
     assert_array_almost_equal(ref, t)
+
+
+def test_correlate_reflect_large_kernel():
+    # the kernel extends more than twice the array size past each end
+    a = numpy.array([3., 2., 1.])
+    w = numpy.arange(27.)
+    expected = numpy.correlate(numpy.pad(a, 13, mode='symmetric'), w,
+                               mode='valid')
+    assert_array_equal(ndimage.correlate(a, w, mode='reflect'), expected)
+
+
+@pytest.mark.parametrize('dtype', [numpy.uint8, numpy.int8, numpy.uint16,
+                                   numpy.int16, numpy.int32, numpy.float32,
+                                   numpy.float64])
+@pytest.mark.parametrize('mode, pad_mode', [('reflect', 'symmetric'),
+                                            ('mirror', 'reflect'),
+                                            ('wrap', 'wrap'),
+                                            ('nearest', 'edge'),
+                                            ('constant', 'constant')])
+def test_rank_filter_box_footprint(dtype, mode, pad_mode):
+    # box-shaped footprints slide along the last axis, with a histogram
+    # for small integers and a sorted window otherwise
+    rng = numpy.random.default_rng(1234)
+    if numpy.issubdtype(dtype, numpy.integer):
+        info = numpy.iinfo(dtype)
+        a = rng.integers(max(info.min, -1000), min(info.max, 1000), (23, 41),
+                         endpoint=True).astype(dtype)
+    else:
+        a = rng.standard_normal((23, 41)).astype(dtype)
+    size, origin, rank = (5, 7), (1, -2), 11
+    before = [s // 2 + o for s, o in zip(size, origin)]
+    pad = [(b, s - 1 - b) for s, b in zip(size, before)]
+    kwargs = {'constant_values': 7} if mode == 'constant' else {}
+    windows = numpy.lib.stride_tricks.sliding_window_view(
+        numpy.pad(a, pad, mode=pad_mode, **kwargs), size)
+    expected = numpy.sort(windows.reshape(a.shape + (-1,)), axis=-1)[..., rank]
+    result = ndimage.rank_filter(a, rank, size=size, mode=mode, cval=7,
+                                 origin=origin)
+    assert_array_equal(result, expected)
+    assert_array_equal(
+        ndimage.median_filter(a, size=size, mode=mode, cval=7, origin=origin),
+        numpy.sort(windows.reshape(a.shape + (-1,)), axis=-1)[..., 17])
@@ -8,6 +8,7 @@ import pytest
 from pytest import raises as assert_raises
 import scipy.ndimage as ndimage
 
+from scipy._lib._testutils import check_workers
 from . import types
 
 eps = 1e-12
@@ -1325,3 +1326,130 @@ def test_zoom_output_shape():
     """Ticket #643"""
     x = numpy.arange(12).reshape((3, 4))
     ndimage.zoom(x, 2, output=numpy.zeros((6, 8)))
+
+
+@pytest.mark.parametrize('order', [0, 1, 3])
+@pytest.mark.parametrize('mode', ['constant', 'grid-constant', 'reflect',
+                                  'nearest'])
+def test_interpolation_workers(order, mode):
+    # output points of an interpolation are split over internal threads
+    rng = numpy.random.default_rng(1234)
+    data = rng.standard_normal((70, 90)).astype(numpy.float32)
+    matrix = numpy.array([[0.9, 0.2], [-0.3, 1.1]])
+    swap = numpy.array([[0, 0.7], [1.3, 0]])
+    coords = rng.uniform(-5, 95, (2, 60, 80))
+
+    def transforms():
+        return [
+            ndimage.zoom(data, (1.7, 0.6), order=order, mode=mode,
+                         cval=1.5),
+            ndimage.shift(data, (2.3, -4.1), order=order, mode=mode,
+                          prefilter=False),
+            ndimage.affine_transform(data, matrix, offset=(-3, 7),
+                                     order=order, mode=mode, cval=-1),
+            ndimage.affine_transform(data, swap, offset=(4, -2),
+                                     output_shape=(60, 50), order=order,
+                                     mode=mode),
+            ndimage.map_coordinates(data, coords, order=order, mode=mode),
+        ]
+
+    check_workers(transforms, ndimage.set_workers)
+
+
+def _bspline_matrix(coordinates, n, order):
+    # weights of the B-spline coefficients 0..n-1 at each coordinate, with
+    # the coefficients extended by mirroring
+    def bspline(t):
+        t = numpy.abs(t)
+        if order == 1:
+            return numpy.maximum(1 - t, 0)
+        return numpy.where(t < 1, 2 / 3 - t**2 + t**3 / 2,
+                           numpy.where(t < 2, (2 - t)**3 / 6, 0))
+
+    weights = numpy.zeros((len(coordinates), n))
+    for i, x in enumerate(coordinates):
+        start = int(numpy.floor(x)) - (order // 2)
+        for k in range(start, start + order + 1):
+            j = abs(k)
+            if j > n - 1:
+                j = 2 * (n - 1) - j
+            weights[i, j] += bspline(x - k)
+    return weights
+
+
+@pytest.mark.parametrize('order', [1, 3])
+def test_zoom_shift_weights(order):
+    # zoom and shift compute the spline weights once per output coordinate
+    # along each axis; compare with the tensor product of 1-D weights
+    rng = numpy.random.default_rng(1234)
+    data = rng.standard_normal((23, 31))
+    shape = (40, 17)
+    coords = [numpy.arange(m) * (n - 1) / (m - 1)
+              for m, n in zip(shape, data.shape)]
+    w0, w1 = (_bspline_matrix(c, n, order)
+              for c, n in zip(coords, data.shape))
+    out = ndimage.zoom(data, (40 / 23, 17 / 31), order=order, mode='mirror',
+                       prefilter=False)
+    assert_allclose(out, w0 @ data @ w1.T, rtol=1e-12, atol=1e-12)
+
+    shift = (2.3, -4.6)
+    w0, w1 = (_bspline_matrix(numpy.arange(n) - s, n, order)
+              for s, n in zip(shift, data.shape))
+    out = ndimage.shift(data, shift, order=order, mode='mirror',
+                        prefilter=False)
+    assert_allclose(out, w0 @ data @ w1.T, rtol=1e-12, atol=1e-12)
+
+
+@pytest.mark.parametrize('mode', ['mirror', 'grid-wrap', 'reflect'])
+def test_spline_filter1d_workers(mode):
+    # blocks of neighboring lines are filtered together, and the blocks
+    # are split over internal threads
+    rng = numpy.random.default_rng(1234)
+    data = rng.standard_normal((37, 50, 21))
+    expected = check_workers(
+        lambda: [ndimage.spline_filter1d(data, 3, axis, mode=mode)
+                 for axis in range(data.ndim)], ndimage.set_workers)
+    line = ndimage.spline_filter1d(data[5, :, 7], 3, mode=mode)
+    assert_array_equal(line, expected[1][5, :, 7])
+
+
+@pytest.mark.parametrize('order', [2, 3, 5])
+def test_zoom_float32_spline_coefficients(order):
+    # float32 inputs are prefiltered to float32 spline coefficients for a
+    # float32 output, which stays within a few float32 ulps of the data range
+    rng = numpy.random.default_rng(1234)
+    data = rng.random((30, 40)).astype(numpy.float32)
+    out = ndimage.zoom(data, 1.5, order=order)
+    expected = ndimage.zoom(data.astype(numpy.float64), 1.5, order=order)
+    assert out.dtype == numpy.float32
+    eps = numpy.finfo(numpy.float32).eps
+    assert_allclose(out, expected, rtol=0,
+                    atol=2 * eps * numpy.abs(expected).max())
+
+
+@pytest.mark.parametrize('order', [2, 3, 5])
+def test_float32_input_float64_output(order):
+    # a float64 output keeps float64 spline coefficients
+    rng = numpy.random.default_rng(1234)
+    data = rng.random((30, 40)).astype(numpy.float32)
+    matrix = numpy.array([[0.9, 0.2], [-0.3, 1.1]])
+    coords = rng.uniform(-2, 42, (2, 20, 25))
+
+    def transforms(x, output):
+        return [
+            ndimage.zoom(x, 1.5, order=order, output=output),
+            ndimage.shift(x, (2.3, -4.1), order=order, output=output),
+            ndimage.affine_transform(x, matrix, order=order, output=output),
+            ndimage.map_coordinates(x, coords, order=order, output=output),
+            ndimage.geometric_transform(x, lambda c: (c[0] * 0.9, c[1] + 0.5),
+                                        order=order, output=output),
+        ]
+
+    expected = transforms(data.astype(numpy.float64), None)
+    for out, e in zip(transforms(data, numpy.float64), expected):
+        assert out.dtype == numpy.float64
+        assert_array_equal(out, e)
+    # complex64 input with a complex128 output
+    cdata = (data + 1j * data[::-1]).astype(numpy.complex64)
+    out = ndimage.zoom(cdata, 1.5, order=order, output=numpy.complex128)
+    assert_array_equal(out.real, expected[0])
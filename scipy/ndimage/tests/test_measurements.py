@@ -4,10 +4,11 @@ import numpy as np
 from numpy.testing import (assert_, assert_array_almost_equal, assert_equal,
                            assert_almost_equal, assert_array_equal,
                            suppress_warnings)
+import pytest
 from pytest import raises as assert_raises
 
 import scipy.ndimage as ndimage
-
+from scipy._lib._testutils import check_workers
 
 from . import types
 
@@ -376,6 +377,91 @@ def test_label_default_dtype():
     ndimage.find_objects(label)
 
 
+def test_label_return_objects():
+    rng = np.random.default_rng(1234)
+    data = rng.random((30, 40, 20)) > 0.6
+    for rank in (1, 3):
+        structure = ndimage.generate_binary_structure(3, rank)
+        expected, n = ndimage.label(data, structure)
+        labels, num, objects, sizes, centroids = ndimage.label(
+            data, structure, return_objects=True)
+        assert_array_equal(labels, expected)
+        assert_equal(num, n)
+        assert_equal(objects, ndimage.find_objects(expected))
+        assert_array_equal(sizes, np.bincount(expected.ravel())[1:])
+        assert_array_almost_equal(
+            centroids, ndimage.center_of_mass(data, expected,
+                                              range(1, n + 1)))
+
+
+def _brute_force_label(data, structure):
+    # flood fill in scan order, so the labels are numbered as by label
+    center = np.array(structure.shape) // 2
+    offsets = [tuple(o) for o in np.argwhere(structure) - center if o.any()]
+    labels = np.zeros(data.shape, dtype=int)
+    n = 0
+    for start in zip(*np.nonzero(data)):
+        if labels[start]:
+            continue
+        n += 1
+        labels[start] = n
+        stack = [start]
+        while stack:
+            index = stack.pop()
+            for offset in offsets:
+                neighbor = tuple(np.add(index, offset))
+                if (all(0 <= i < s for i, s in zip(neighbor, data.shape))
+                        and data[neighbor] and not labels[neighbor]):
+                    labels[neighbor] = n
+                    stack.append(neighbor)
+    return labels, n
+
+
+def _axis_structure(axes):
+    structure = np.zeros((3, 3, 3), dtype=bool)
+    structure[1, 1, 1] = True
+    for axis in axes:
+        index = [1, 1, 1]
+        index[axis] = slice(None)
+        structure[tuple(index)] = True
+    return structure
+
+
+@pytest.mark.parametrize('structure', [
+    _axis_structure([0]),
+    _axis_structure([1]),
+    _axis_structure([2]),
+    _axis_structure([0, 1]),
+    _axis_structure([0, 2]),
+    np.eye(3, dtype=bool)[:, :, None] * np.eye(3, dtype=bool)[None, :, :],
+    np.eye(3, dtype=bool)[::-1, :, None] * np.eye(3, dtype=bool)[None, :, :],
+    np.array([[[0, 0, 0], [0, 0, 1], [0, 0, 0]],
+              [[0, 1, 0], [0, 1, 0], [0, 1, 0]],
+              [[0, 0, 0], [1, 0, 0], [0, 0, 0]]], dtype=bool),
+])
+def test_label_structures_3d(structure):
+    # the neighbour lines of a structure without a (0, 0, -1) neighbour are
+    # all read into separate buffers
+    rng = np.random.default_rng(1234)
+    data = rng.random((9, 11, 13)) > 0.5
+    expected, n = _brute_force_label(data, structure)
+    labels, num = ndimage.label(data, structure)
+    assert_equal(num, n)
+    assert_array_equal(labels, expected)
+
+
+def test_label_workers():
+    # the lines are labelled in tiles that are merged afterwards
+    rng = np.random.default_rng(1234)
+    data = rng.random((300, 1000)) > 0.4
+    expected, n = check_workers(lambda: ndimage.label(data),
+                                ndimage.set_workers)
+    with ndimage.set_workers(4):
+        labels_f, num_f = ndimage.label(np.asfortranarray(data))
+    assert_equal(num_f, n)
+    assert_array_equal(labels_f > 0, data)
+
+
 def test_find_objects01():
     data = np.ones([], dtype=int)
     out = ndimage.find_objects(data)
@@ -1390,3 +1476,36 @@ class TestWatershedIft:
         expected = [[1, 1],
                     [1, 1]]
         assert_array_almost_equal(out, expected)
+
+    def test_watershed_ift09(self):
+        # Neighbors do not wrap around the edges of the array.
+        data = np.array([[1, 2],
+                         [2, 0]], np.uint8)
+        markers = np.array([[1, 0],
+                            [2, 0]], np.int8)
+        out = ndimage.watershed_ift(data, markers)
+        expected = [[1, 1],
+                    [2, 2]]
+        assert_array_equal(out, expected)
+
+    @pytest.mark.parametrize('dtype', [np.float32, np.float64])
+    def test_watershed_ift10(self, dtype):
+        # Floating point inputs are not quantized.
+        data = np.array([0.0, 0.1, 0.5, 0.6], dtype)
+        markers = np.array([1, 0, 0, 2], np.int8)
+        out = ndimage.watershed_ift(data, markers)
+        assert_array_equal(out, [1, 1, 2, 2])
+        out = ndimage.watershed_ift((data * 255).astype(np.uint8), markers)
+        assert_array_equal(out, [1, 1, 2, 2])
+        # truncated to integers the input is flat
+        out = ndimage.watershed_ift(data.astype(np.uint8), markers)
+        assert_array_equal(out, [1, 2, 2, 2])
+
+    @pytest.mark.parametrize('dtype', [np.uint8, np.int32, np.float64])
+    def test_watershed_ift_workers(self, dtype):
+        rng = np.random.default_rng(1234)
+        data = (rng.random((300, 400)) * 100).astype(dtype)
+        markers = np.zeros(data.shape, np.int32)
+        markers.flat[rng.integers(0, data.size, 200)] = np.arange(-20, 180)
+        check_workers(lambda: ndimage.watershed_ift(data, markers),
+                      ndimage.set_workers)
@@ -1,11 +1,12 @@
 import numpy
 import numpy as np
 from numpy.testing import (assert_, assert_equal, assert_array_equal,
-                           assert_array_almost_equal)
+                           assert_array_almost_equal, assert_allclose)
 import pytest
 from pytest import raises as assert_raises
 
 from scipy import ndimage
+from scipy._lib._testutils import check_workers
 
 from . import types
 
@@ -586,6 +587,47 @@ class TestNdimageMorphology:
                 distances=distances_out
             )
 
+    @pytest.mark.parametrize('sampling', [None, [2, 1, 0.5]])
+    def test_distance_transform_edt_squared(self, sampling):
+        # squared distances, also in float32, agree with the features
+        rng = np.random.default_rng(1234)
+        data = rng.random((30, 40, 20)) > 0.05
+        dt, ft = ndimage.distance_transform_edt(data, sampling=sampling,
+                                                return_indices=True)
+        ref = ft - np.indices(data.shape)
+        if sampling is not None:
+            ref = ref * np.asarray(sampling)[:, None, None, None]
+        ref = (ref ** 2).sum(axis=0)
+        assert_array_almost_equal(dt, np.sqrt(ref))
+        sq = ndimage.distance_transform_edt(data, sampling=sampling,
+                                            squared=True)
+        assert_array_almost_equal(sq, ref)
+        sq32 = np.zeros(data.shape, dtype=np.float32)
+        ndimage.distance_transform_edt(data, sampling=sampling,
+                                       distances=sq32, squared=True)
+        assert_allclose(sq32, ref, rtol=1e-6)
+        with assert_raises(RuntimeError):
+            ndimage.distance_transform_edt(
+                data, distances=np.zeros(data.shape, dtype=np.int32))
+
+    def test_distance_transform_edt_distances_byteorder(self):
+        # a non-native float64 output goes through a writeback copy
+        rng = np.random.default_rng(1234)
+        data = rng.random((20, 30)) > 0.1
+        expected = ndimage.distance_transform_edt(data)
+        distances = np.zeros(data.shape,
+                             dtype=np.dtype(np.float64).newbyteorder())
+        ndimage.distance_transform_edt(data, distances=distances)
+        assert_array_equal(distances, expected)
+
+    def test_distance_transform_edt_workers(self):
+        # lines along each axis are split over internal threads
+        rng = np.random.default_rng(1234)
+        data = rng.random((50, 60, 40)) > 0.01
+        check_workers(
+            lambda: ndimage.distance_transform_edt(data, return_indices=True),
+            ndimage.set_workers)
+
     def test_generate_structure01(self):
         struct = ndimage.generate_binary_structure(0, 1)
         assert_array_almost_equal(struct, 1)
@@ -1234,6 +1276,45 @@ class TestNdimageMorphology:
                                iterations=iterations, output=out)
         assert_array_almost_equal(out, expected)
 
+    @pytest.mark.parametrize('border_value', [0, 1])
+    @pytest.mark.parametrize('struct_shape',
+                             [(3, 3, 3), (1, 2, 70), None, 'separable'])
+    def test_binary_erosion_packed_bits(self, border_value, struct_shape):
+        # without a mask the masks are eroded as packed bits, compare
+        # with the element by element erosion done with a full mask
+        rng = numpy.random.default_rng(1234)
+        data = rng.random((9, 10, 131)) > 0.2
+        if struct_shape is None:
+            struct = rng.random((3, 4, 5)) > 0.5
+        elif struct_shape == 'separable':
+            # the product of a line with gaps along each axis
+            struct = (numpy.array([1, 0, 1], bool)[:, None, None] &
+                      numpy.array([1, 1, 0, 1], bool)[None, :, None] &
+                      numpy.array([1, 0, 0, 1, 1], bool)[None, None, :])
+        else:
+            struct = numpy.ones(struct_shape, bool)
+        mask = numpy.ones(data.shape, bool)
+        for origin in [0, (0, -1, 1), (0, 0, -1)]:
+            for function in [ndimage.binary_erosion, ndimage.binary_dilation]:
+                expected = function(data, struct, border_value=border_value,
+                                    origin=origin, mask=mask)
+                out = function(data, struct, border_value=border_value,
+                               origin=origin)
+                assert_array_equal(out, expected)
+
+    @pytest.mark.parametrize('iterations', [2, 5, 0])
+    def test_binary_erosion_packed_bits_iterated(self, iterations):
+        # the first pass of an iterated erosion is done on packed bits, and
+        # lists the changed elements for the following passes
+        rng = numpy.random.default_rng(1234)
+        data = rng.random((20, 30, 70)) > 0.1
+        struct = ndimage.generate_binary_structure(3, 1)
+        for function in [ndimage.binary_erosion, ndimage.binary_dilation]:
+            expected = function(data, struct, iterations=iterations,
+                                brute_force=True)
+            out = function(data, struct, iterations=iterations)
+            assert_array_equal(out, expected)
+
     @pytest.mark.parametrize('dtype', types)
     def test_binary_dilation01(self, dtype):
         data = numpy.ones([], dtype)
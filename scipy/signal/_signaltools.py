@@ -3,6 +3,7 @@
 
 import operator
 import math
+from concurrent.futures import ThreadPoolExecutor
 from math import prod as _prod
 import timeit
 import warnings
@@ -14,6 +15,7 @@ from ._upfirdn import upfirdn, _output_len, _upfirdn_modes
 from scipy import linalg, fft as sp_fft
 from scipy import ndimage
 from scipy.fft._helper import _init_nd_shape_and_axes
+from scipy._lib._workers import normalize_workers
 import numpy as np
 from scipy.special import lambertw
 from .windows import get_window
@@ -4241,7 +4243,7 @@ def _validate_x(x):
     return x
 
 
-def sosfilt(sos, x, axis=-1, zi=None):
+def sosfilt(sos, x, axis=-1, zi=None, *, workers=None):
     """
     Filter data along one dimension using cascaded second-order sections.
 
@@ -4270,6 +4272,13 @@ def sosfilt(sos, x, axis=-1, zi=None):
         (i.e. all zeros) is assumed.
         Note that these initial conditions are *not* the same as the initial
         conditions given by `lfiltic` or `lfilter_zi`.
+    workers : int, optional
+        Maximum number of workers to use for filtering the subarrays of `x`
+        in parallel. If negative, the value wraps around from
+        ``os.cpu_count()``. By default, `x` is filtered on the calling
+        thread only. Object arrays are always filtered serially.
+
+        .. versionadded:: 1.12.0
 
     Returns
     -------
@@ -4289,6 +4298,12 @@ def sosfilt(sos, x, axis=-1, zi=None):
     with direct-form II transposed structure. It is designed to minimize
     numerical precision errors for high-order filters.
 
+    Groups of subarrays of `x` are filtered together, so that the
+    independent recursions of several signals are interleaved. Filtering
+    many short or multichannel signals in one call is therefore faster than
+    filtering them one at a time. The result does not depend on the
+    grouping nor on `workers`.
+
     .. versionadded:: 0.16.0
 
     Examples
@@ -4341,7 +4356,8 @@ def sosfilt(sos, x, axis=-1, zi=None):
     x = np.array(x, dtype, order='C')  # make a copy, can modify in place
     zi = np.ascontiguousarray(np.reshape(zi, (-1, n_sections, 2)))
     sos = sos.astype(dtype, copy=False)
-    _sosfilt(sos, x, zi)
+    workers = 1 if workers is None else normalize_workers(workers)
+    _sosfilt_parallel(sos, x, zi, workers)
     x.shape = x_shape
     x = np.moveaxis(x, -1, axis)
     if return_zi:
@@ -4353,6 +4369,25 @@ def sosfilt(sos, x, axis=-1, zi=None):
     return out
 
 
+def _sosfilt_parallel(sos, x, zi, workers):
+    """Filter the rows of `x` in place, splitting them over threads."""
+    # _sosfilt filters groups of 8 rows together, only the last chunk may
+    # hold a partial group
+    n_groups = -(-x.shape[0] // 8)
+    n_chunks = min(workers, n_groups)
+    if n_chunks <= 1 or x.dtype.char == 'O':
+        _sosfilt(sos, x, zi)
+        return
+    bounds = [min(8 * (n_groups * k // n_chunks), x.shape[0])
+              for k in range(n_chunks + 1)]
+    # the compiled kernel releases the GIL
+    with ThreadPoolExecutor(n_chunks) as pool:
+        futures = [pool.submit(_sosfilt, sos, x[start:stop], zi[start:stop])
+                   for start, stop in zip(bounds[:-1], bounds[1:])]
+        for future in futures:
+            future.result()
+
+
 def sosfiltfilt(sos, x, axis=-1, padtype='odd', padlen=None):
     """
     A forward-backward digital filter using cascaded second-order sections.
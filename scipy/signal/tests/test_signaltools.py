@@ -3544,6 +3544,55 @@ class TestSOSFilt:
         _, zf = sosfilt(sos, np.ones(40, dt), zi=zi.tolist())
         assert_allclose_cast(zf, zi, rtol=1e-13)
 
+    def test_multichannel(self, dt):
+        # Groups of channels are filtered together, the partial group at
+        # the end and the blocks of samples must not change the result.
+        rng = np.random.default_rng(1234)
+        sos = signal.butter(5, 0.3, output='sos')
+        x = rng.standard_normal((19, 300)).astype(dt)
+        zi = rng.standard_normal((3, 19, 2))
+        y, zf = sosfilt(sos, x, zi=zi)
+        for i in range(x.shape[0]):
+            y1, zf1 = sosfilt(sos, x[i], zi=zi[:, i])
+            assert_array_equal(y[i], y1)
+            assert_array_equal(zf[:, i], zf1)
+        y0, zf0 = sosfilt(sos, x.T, axis=0, zi=zi.swapaxes(1, 2))
+        assert_array_equal(y0, y.T)
+        assert_array_equal(zf0, zf.swapaxes(1, 2))
+
+    def test_workers(self, dt):
+        rng = np.random.default_rng(1234)
+        sos = signal.butter(4, 0.3, output='sos')
+        x = rng.standard_normal((21, 50)).astype(dt)
+        zi = rng.standard_normal((2, 21, 2))
+        y, zf = sosfilt(sos, x, zi=zi)
+        for workers in [2, 3, 8, -1]:
+            y1, zf1 = sosfilt(sos, x, zi=zi, workers=workers)
+            assert_array_equal(y1, y)
+            assert_array_equal(zf1, zf)
+        with pytest.raises(ValueError, match='workers'):
+            sosfilt(sos, x, workers=0)
+
+    def test_workers_default(self, dt, monkeypatch):
+        # the default is serial; scipy.fft.set_workers does not apply
+        from scipy import fft as sp_fft
+        from scipy.signal import _signaltools
+        used = []
+        sosfilt_parallel = _signaltools._sosfilt_parallel
+
+        def spy(sos, x, zi, workers):
+            used.append(workers)
+            return sosfilt_parallel(sos, x, zi, workers)
+
+        monkeypatch.setattr(_signaltools, '_sosfilt_parallel', spy)
+        sos = signal.butter(4, 0.3, output='sos')
+        x = np.ones((4, 10), dtype=dt)
+        y = sosfilt(sos, x)
+        with sp_fft.set_workers(3):
+            assert_array_equal(sosfilt(sos, x), y)
+            sosfilt(sos, x, workers=2)
+        assert used == [1, 1, 2]
+
 
 class TestDeconvolve:
 
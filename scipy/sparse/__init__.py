@@ -117,6 +117,14 @@ Sparse matrix tools:
 
    find
 
+Parallel execution:
+
+.. autosummary::
+   :toctree: generated/
+
+   set_workers - Context manager to set the number of workers
+   get_workers - Get the current number of workers
+
 Identifying sparse matrices:
 
 .. autosummary::
@@ -290,6 +298,7 @@ from ._construct import *
 from ._extract import *
 from ._matrix import spmatrix
 from ._matrix_io import *
+from ._workers import *
 
 # For backward compatibility with v0.19.
 from . import csgraph
@@ -12,7 +12,8 @@ from ._data import _data_matrix, _minmax_mixin
 from . import _sparsetools
 from ._sparsetools import (get_csr_submatrix, csr_sample_offsets, csr_todense,
                            csr_sample_values, csr_row_index, csr_row_slice,
-                           csr_column_index1, csr_column_index2)
+                           csr_column_index1, csr_column_index_indptr,
+                           csr_column_index2)
 from ._index import IndexMixin
 from ._sputils import (upcast, upcast_char, to_native, isdense, isshape,
                        getdtype, isscalarlike, isintlike, downcast_intp_index, get_sum_dtype, check_shape,
@@ -753,8 +754,21 @@ class _cs_matrix(_data_matrix, _minmax_mixin, IndexMixin):
         return self.__class__((res_data, res_indices, res_indptr),
                               shape=new_shape, copy=False)
 
-    def _minor_index_fancy(self, idx):
+    def _minor_index_lookup(self, idx):
+        """Return the lookup of `_minor_index_fancy` for minor indices idx.
+
+        The lookup only depends on idx and the minor dimension, so it can
+        be passed to repeated selections of the same indices, e.g. out of
+        several batches of rows.
+        """
+        M, N = self._swap(self.shape)
+        return _MinorIndexLookup(idx, N, self.indices.dtype)
+
+    def _minor_index_fancy(self, idx, lookup=None):
         """Index along the minor axis where idx is an array of ints.
+
+        lookup is an optional `_MinorIndexLookup` of idx, as returned by
+        `_minor_index_lookup`.
         """
         idx_dtype = self.indices.dtype
         idx = np.asarray(idx, dtype=idx_dtype).ravel()
@@ -765,14 +779,19 @@ class _cs_matrix(_data_matrix, _minmax_mixin, IndexMixin):
         if k == 0:
             return self.__class__(new_shape, dtype=self.dtype)
 
-        # pass 1: count idx entries and compute new indptr
-        col_offsets = np.zeros(N, dtype=idx_dtype)
+        if lookup is None:
+            lookup = _MinorIndexLookup(idx, N, idx_dtype)
+        elif lookup.col_offsets.size != N or lookup.col_order.size != k:
+            raise ValueError('lookup does not match the indexed dimension')
+        col_offsets = lookup.col_offsets.astype(idx_dtype, copy=False)
+        col_order = lookup.col_order.astype(idx_dtype, copy=False)
+
+        # pass 1: compute new indptr
         res_indptr = np.empty_like(self.indptr)
-        csr_column_index1(k, idx, M, N, self.indptr, self.indices,
-                          col_offsets, res_indptr)
+        csr_column_index_indptr(M, N, col_offsets, self.indptr, self.indices,
+                                res_indptr)
 
         # pass 2: copy indices/data for selected idxs
-        col_order = np.argsort(idx).astype(idx_dtype, copy=False)
         nnz = res_indptr[-1]
         res_indices = np.empty(nnz, dtype=idx_dtype)
         res_data = np.empty(nnz, dtype=self.dtype)
@@ -1240,35 +1259,40 @@ class _cs_matrix(_data_matrix, _minmax_mixin, IndexMixin):
         """apply the binary operation fn to two sparse matrices."""
         other = self.__class__(other)
 
-        # e.g. csr_plus_csr, csr_minus_csr, etc.
-        fn = getattr(_sparsetools, self.format + op + self.format)
+        # e.g. csr_plus_csr_count, csr_plus_csr_fill, etc. CSC operands are
+        # handled by the CSR routines acting on the transposed matrices.
+        count = getattr(_sparsetools, 'csr' + op + 'csr_count')
+        fill = getattr(_sparsetools, 'csr' + op + 'csr_fill')
+        M, N = self._swap(self.shape)
 
         maxnnz = self.nnz + other.nnz
         idx_dtype = self._get_index_dtype((self.indptr, self.indices,
                                      other.indptr, other.indices),
                                     maxval=maxnnz)
+        A_indptr = np.asarray(self.indptr, dtype=idx_dtype)
+        A_indices = np.asarray(self.indices, dtype=idx_dtype)
+        B_indptr = np.asarray(other.indptr, dtype=idx_dtype)
+        B_indices = np.asarray(other.indices, dtype=idx_dtype)
+
+        # First pass computes the exact sparsity structure of the result,
+        # so that the output arrays need no pruning afterwards.
         indptr = np.empty(self.indptr.shape, dtype=idx_dtype)
-        indices = np.empty(maxnnz, dtype=idx_dtype)
+        nnz = count(M, N, A_indptr, A_indices, self.data,
+                    B_indptr, B_indices, other.data, indptr)
+
+        indices = np.empty(nnz, dtype=idx_dtype)
 
         bool_ops = ['_ne_', '_lt_', '_gt_', '_le_', '_ge_']
         if op in bool_ops:
-            data = np.empty(maxnnz, dtype=np.bool_)
+            data = np.empty(nnz, dtype=np.bool_)
         else:
-            data = np.empty(maxnnz, dtype=upcast(self.dtype, other.dtype))
-
-        fn(self.shape[0], self.shape[1],
-           np.asarray(self.indptr, dtype=idx_dtype),
-           np.asarray(self.indices, dtype=idx_dtype),
-           self.data,
-           np.asarray(other.indptr, dtype=idx_dtype),
-           np.asarray(other.indices, dtype=idx_dtype),
-           other.data,
-           indptr, indices, data)
+            data = np.empty(nnz, dtype=upcast(self.dtype, other.dtype))
 
-        A = self.__class__((data, indices, indptr), shape=self.shape)
-        A.prune()
+        fill(M, N, A_indptr, A_indices, self.data,
+             B_indptr, B_indices, other.data,
+             indptr, indices, data)
 
-        return A
+        return self.__class__((data, indices, indptr), shape=self.shape)
 
     def _divide_sparse(self, other):
         """
@@ -1298,6 +1322,24 @@ class _cs_matrix(_data_matrix, _minmax_mixin, IndexMixin):
         return out
 
 
+class _MinorIndexLookup:
+    """Lookup for selecting the minor indices idx out of N.
+
+    ``col_offsets`` is the cumulative count of each minor index in idx and
+    ``col_order`` the argsort of idx. Both are read-only.
+    """
+
+    def __init__(self, idx, N, dtype):
+        idx = np.asarray(idx, dtype=dtype).ravel()
+        col_offsets = np.bincount(idx, minlength=N)
+        if len(col_offsets) > N:
+            raise IndexError('index (%d) out of range' % idx.max())
+        self.col_offsets = np.cumsum(col_offsets).astype(dtype, copy=False)
+        self.col_order = np.argsort(idx).astype(dtype, copy=False)
+        self.col_offsets.flags.writeable = False
+        self.col_order.flags.writeable = False
+
+
 def _process_slice(sl, num):
     if sl is None:
         i0, i1 = 0, num
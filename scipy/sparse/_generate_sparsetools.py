@@ -95,6 +95,28 @@ csr_lt_csr          v iiIITIIT*I*I*B
 csr_gt_csr          v iiIITIIT*I*I*B
 csr_le_csr          v iiIITIIT*I*I*B
 csr_ge_csr          v iiIITIIT*I*I*B
+csr_ne_csr_count    l iiIITIIT*I
+csr_lt_csr_count    l iiIITIIT*I
+csr_gt_csr_count    l iiIITIIT*I
+csr_le_csr_count    l iiIITIIT*I
+csr_ge_csr_count    l iiIITIIT*I
+csr_elmul_csr_count l iiIITIIT*I
+csr_eldiv_csr_count l iiIITIIT*I
+csr_plus_csr_count  l iiIITIIT*I
+csr_minus_csr_count l iiIITIIT*I
+csr_maximum_csr_count l iiIITIIT*I
+csr_minimum_csr_count l iiIITIIT*I
+csr_ne_csr_fill     v iiIITIITI*I*B
+csr_lt_csr_fill     v iiIITIITI*I*B
+csr_gt_csr_fill     v iiIITIITI*I*B
+csr_le_csr_fill     v iiIITIITI*I*B
+csr_ge_csr_fill     v iiIITIITI*I*B
+csr_elmul_csr_fill  v iiIITIITI*I*T
+csr_eldiv_csr_fill  v iiIITIITI*I*T
+csr_plus_csr_fill   v iiIITIITI*I*T
+csr_minus_csr_fill  v iiIITIITI*I*T
+csr_maximum_csr_fill v iiIITIITI*I*T
+csr_minimum_csr_fill v iiIITIITI*I*T
 csr_scale_rows      v iiII*TT
 csr_scale_columns   v iiII*TT
 csr_sort_indices    v iI*I*T
@@ -104,6 +126,7 @@ get_csr_submatrix   v iiIITiiii*V*V*W
 csr_row_index       v iIIIT*I*T
 csr_row_slice       v iiiIIT*I*T
 csr_column_index1   v iIiiII*I*I
+csr_column_index_indptr  v iiIII*I
 csr_column_index2   v IIiIT*I*T
 csr_sample_values   v iiIITiII*T
 csr_count_blocks    i iiiiII
@@ -0,0 +1,46 @@
+"""Number of threads used by the sparsetools kernels."""
+from scipy._lib._workers import workers_context
+from . import _sparsetools
+
+__all__ = ['set_workers', 'get_workers']
+
+
+def set_workers(workers):
+    """Context manager for the number of workers used in `scipy.sparse`
+
+    Large elementwise operations and row/column indexing of CSR and CSC
+    arrays split their work over up to `workers` threads. Outside of this
+    context they run on the calling thread only. The setting applies to
+    the calling thread.
+
+    Parameters
+    ----------
+    workers : int
+        The number of workers to use. Negative values wrap around from
+        ``os.cpu_count()``, as for `scipy.fft`.
+
+    Examples
+    --------
+    >>> from scipy import sparse
+    >>> A = sparse.random(2000, 2000, density=0.05, format='csr',
+    ...                   random_state=1234)
+    >>> with sparse.set_workers(4):
+    ...     B = A + A.T
+
+    """
+    return workers_context(workers, _sparsetools.set_workers)
+
+
+def get_workers():
+    """Returns the number of workers within the current context
+
+    Examples
+    --------
+    >>> from scipy import sparse
+    >>> sparse.get_workers()
+    1
+    >>> with sparse.set_workers(4):
+    ...     sparse.get_workers()
+    4
+    """
+    return _sparsetools.get_workers()
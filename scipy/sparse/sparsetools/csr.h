@@ -6,9 +6,12 @@
 #include <algorithm>
 #include <functional>
 #include <numeric>
+#include <limits>
+#include <stdexcept>
 
 #include "util.h"
 #include "dense.h"
+#include "parallel.h"
 
 /*
  * Extract k-th diagonal of CSR matrix A
@@ -669,6 +672,192 @@ void csr_matmat(const I n_row,
 }
 
 
+/*
+ * Partition rows [0, n_row) of C = A (binary_op) B into pieces of roughly
+ * equal nnz(A) + nnz(B) for the row-parallel loops below.
+ */
+template <class I>
+std::vector<I> csr_binop_csr_partition(const I n_row,
+                                       const I Ap[],
+                                       const I Bp[])
+{
+    const npy_intp work = (npy_intp)(Ap[n_row] - Ap[0])
+                          + (npy_intp)(Bp[n_row] - Bp[0]) + n_row;
+
+    return sptools_partition(n_row, sptools_num_threads(work),
+                             [Ap, Bp](const I i) {
+                                 return (npy_intp)Ap[i] + (npy_intp)Bp[i];
+                             });
+}
+
+
+/*
+ * Compute row i of C = A (binary_op) B for CSR matrices that are not
+ * necessarily canonical, writing it to Cj[0:k], Cx[0:k], and return k.
+ * If fill is false, only k is computed and Cj, Cx are not accessed.
+ *
+ * Work arrays next[n_col] (all -1), A_row[n_col] and B_row[n_col]
+ * (all 0) are left in the same state on return.
+ *
+ * Note:
+ *   Output column indices are not generally in sorted order
+ */
+template <bool fill, class I, class T, class T2, class binary_op>
+I csr_binop_csr_row_general(const I i,
+                            const I Ap[], const I Aj[], const T Ax[],
+                            const I Bp[], const I Bj[], const T Bx[],
+                                  I Cj[],       T2 Cx[],
+                            const binary_op& op,
+                            I next[], T A_row[], T B_row[])
+{
+    I head   = -2;
+    I length =  0;
+    I nnz    =  0;
+
+    //add a row of A to A_row
+    I i_start = Ap[i];
+    I i_end   = Ap[i+1];
+    for(I jj = i_start; jj < i_end; jj++){
+        I j = Aj[jj];
+
+        A_row[j] += Ax[jj];
+
+        if(next[j] == -1){
+            next[j] = head;
+            head = j;
+            length++;
+        }
+    }
+
+    //add a row of B to B_row
+    i_start = Bp[i];
+    i_end   = Bp[i+1];
+    for(I jj = i_start; jj < i_end; jj++){
+        I j = Bj[jj];
+
+        B_row[j] += Bx[jj];
+
+        if(next[j] == -1){
+            next[j] = head;
+            head = j;
+            length++;
+        }
+    }
+
+    // scan through columns where A or B has
+    // contributed a non-zero entry
+    for(I jj = 0; jj < length; jj++){
+        T result = op(A_row[head], B_row[head]);
+
+        if(result != 0){
+            if(fill){
+                Cj[nnz] = head;
+                Cx[nnz] = result;
+            }
+            nnz++;
+        }
+
+        I temp = head;
+        head = next[head];
+
+        next[temp]  = -1;
+        A_row[temp] =  0;
+        B_row[temp] =  0;
+    }
+
+    return nnz;
+}
+
+
+/*
+ * Compute row i of C = A (binary_op) B for CSR matrices in canonical
+ * format, writing it to Cj[0:k], Cx[0:k], and return k.
+ * If fill is false, only k is computed and Cj, Cx are not accessed.
+ *
+ * Note:
+ *   Output column indices will be in sorted order
+ */
+template <bool fill, class I, class T, class T2, class binary_op>
+I csr_binop_csr_row_canonical(const I i,
+                              const I Ap[], const I Aj[], const T Ax[],
+                              const I Bp[], const I Bj[], const T Bx[],
+                                    I Cj[],       T2 Cx[],
+                              const binary_op& op)
+{
+    I A_pos = Ap[i];
+    I B_pos = Bp[i];
+    I A_end = Ap[i+1];
+    I B_end = Bp[i+1];
+    I nnz = 0;
+
+    //while not finished with either row
+    while(A_pos < A_end && B_pos < B_end){
+        I A_j = Aj[A_pos];
+        I B_j = Bj[B_pos];
+
+        if(A_j == B_j){
+            T result = op(Ax[A_pos],Bx[B_pos]);
+            if(result != 0){
+                if(fill){
+                    Cj[nnz] = A_j;
+                    Cx[nnz] = result;
+                }
+                nnz++;
+            }
+            A_pos++;
+            B_pos++;
+        } else if (A_j < B_j) {
+            T result = op(Ax[A_pos],0);
+            if (result != 0){
+                if(fill){
+                    Cj[nnz] = A_j;
+                    Cx[nnz] = result;
+                }
+                nnz++;
+            }
+            A_pos++;
+        } else {
+            //B_j < A_j
+            T result = op(0,Bx[B_pos]);
+            if (result != 0){
+                if(fill){
+                    Cj[nnz] = B_j;
+                    Cx[nnz] = result;
+                }
+                nnz++;
+            }
+            B_pos++;
+        }
+    }
+
+    //tail
+    while(A_pos < A_end){
+        T result = op(Ax[A_pos],0);
+        if (result != 0){
+            if(fill){
+                Cj[nnz] = Aj[A_pos];
+                Cx[nnz] = result;
+            }
+            nnz++;
+        }
+        A_pos++;
+    }
+    while(B_pos < B_end){
+        T result = op(0,Bx[B_pos]);
+        if (result != 0){
+            if(fill){
+                Cj[nnz] = Bj[B_pos];
+                Cx[nnz] = result;
+            }
+            nnz++;
+        }
+        B_pos++;
+    }
+
+    return nnz;
+}
+
+
 /*
  * Compute C = A (binary_op) B for CSR matrices that are not
  * necessarily canonical CSR format.  Specifically, this method
@@ -705,59 +894,9 @@ void csr_binop_csr_general(const I n_row, const I n_col,
     Cp[0] = 0;
 
     for(I i = 0; i < n_row; i++){
-        I head   = -2;
-        I length =  0;
-
-        //add a row of A to A_row
-        I i_start = Ap[i];
-        I i_end   = Ap[i+1];
-        for(I jj = i_start; jj < i_end; jj++){
-            I j = Aj[jj];
-
-            A_row[j] += Ax[jj];
-
-            if(next[j] == -1){
-                next[j] = head;
-                head = j;
-                length++;
-            }
-        }
-
-        //add a row of B to B_row
-        i_start = Bp[i];
-        i_end   = Bp[i+1];
-        for(I jj = i_start; jj < i_end; jj++){
-            I j = Bj[jj];
-
-            B_row[j] += Bx[jj];
-
-            if(next[j] == -1){
-                next[j] = head;
-                head = j;
-                length++;
-            }
-        }
-
-
-        // scan through columns where A or B has
-        // contributed a non-zero entry
-        for(I jj = 0; jj < length; jj++){
-            T result = op(A_row[head], B_row[head]);
-
-            if(result != 0){
-                Cj[nnz] = head;
-                Cx[nnz] = result;
-                nnz++;
-            }
-
-            I temp = head;
-            head = next[head];
-
-            next[temp]  = -1;
-            A_row[temp] =  0;
-            B_row[temp] =  0;
-        }
-
+        nnz += csr_binop_csr_row_general<true>(i, Ap, Aj, Ax, Bp, Bj, Bx,
+                                               Cj + nnz, Cx + nnz, op,
+                                               next.data(), A_row.data(), B_row.data());
         Cp[i + 1] = nnz;
     }
 }
@@ -791,67 +930,121 @@ void csr_binop_csr_canonical(const I n_row, const I n_col,
     I nnz = 0;
 
     for(I i = 0; i < n_row; i++){
-        I A_pos = Ap[i];
-        I B_pos = Bp[i];
-        I A_end = Ap[i+1];
-        I B_end = Bp[i+1];
-
-        //while not finished with either row
-        while(A_pos < A_end && B_pos < B_end){
-            I A_j = Aj[A_pos];
-            I B_j = Bj[B_pos];
-
-            if(A_j == B_j){
-                T result = op(Ax[A_pos],Bx[B_pos]);
-                if(result != 0){
-                    Cj[nnz] = A_j;
-                    Cx[nnz] = result;
-                    nnz++;
-                }
-                A_pos++;
-                B_pos++;
-            } else if (A_j < B_j) {
-                T result = op(Ax[A_pos],0);
-                if (result != 0){
-                    Cj[nnz] = A_j;
-                    Cx[nnz] = result;
-                    nnz++;
-                }
-                A_pos++;
-            } else {
-                //B_j < A_j
-                T result = op(0,Bx[B_pos]);
-                if (result != 0){
-                    Cj[nnz] = B_j;
-                    Cx[nnz] = result;
-                    nnz++;
-                }
-                B_pos++;
-            }
-        }
+        nnz += csr_binop_csr_row_canonical<true>(i, Ap, Aj, Ax, Bp, Bj, Bx,
+                                                 Cj + nnz, Cx + nnz, op);
+        Cp[i+1] = nnz;
+    }
+}
 
-        //tail
-        while(A_pos < A_end){
-            T result = op(Ax[A_pos],0);
-            if (result != 0){
-                Cj[nnz] = Aj[A_pos];
-                Cx[nnz] = result;
-                nnz++;
+
+/*
+ * First pass of C = A (binary_op) B: compute the exact row pointer of C
+ * without forming its entries.  Rows are processed in parallel.
+ *
+ * Input Arguments:
+ *   I    n_row       - number of rows in A (and B)
+ *   I    n_col       - number of columns in A (and B)
+ *   I    Ap[n_row+1] - row pointer
+ *   I    Aj[nnz(A)]  - column indices
+ *   T    Ax[nnz(A)]  - nonzeros
+ *   I    Bp[n_row+1] - row pointer
+ *   I    Bj[nnz(B)]  - column indices
+ *   T    Bx[nnz(B)]  - nonzeros
+ * Output Arguments:
+ *   I    Cp[n_row+1] - row pointer of C
+ *
+ * Returns:
+ *   nnz(C), i.e. Cp[n_row]
+ *
+ * Note:
+ *   The result is exact: entries for which binary_op gives zero are
+ *   not counted.  Use csr_binop_csr_fill() with the same Cp for the
+ *   second pass.
+ *
+ */
+template <class I, class T, class binary_op>
+npy_intp csr_binop_csr_count(const I n_row, const I n_col,
+                             const I Ap[], const I Aj[], const T Ax[],
+                             const I Bp[], const I Bj[], const T Bx[],
+                                   I Cp[],
+                             const binary_op& op)
+{
+    const bool canonical = (csr_has_canonical_format(n_row, Ap, Aj) &&
+                            csr_has_canonical_format(n_row, Bp, Bj));
+    const std::vector<I> bounds = csr_binop_csr_partition(n_row, Ap, Bp);
+
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        if (canonical) {
+            for(I i = lo; i < hi; i++){
+                Cp[i+1] = csr_binop_csr_row_canonical<false>(
+                    i, Ap, Aj, Ax, Bp, Bj, Bx, (I*)NULL, (T*)NULL, op);
             }
-            A_pos++;
-        }
-        while(B_pos < B_end){
-            T result = op(0,Bx[B_pos]);
-            if (result != 0){
-                Cj[nnz] = Bj[B_pos];
-                Cx[nnz] = result;
-                nnz++;
+        } else {
+            std::vector<I>  next(n_col,-1);
+            std::vector<T> A_row(n_col, 0);
+            std::vector<T> B_row(n_col, 0);
+
+            for(I i = lo; i < hi; i++){
+                Cp[i+1] = csr_binop_csr_row_general<false>(
+                    i, Ap, Aj, Ax, Bp, Bj, Bx, (I*)NULL, (T*)NULL, op,
+                    next.data(), A_row.data(), B_row.data());
             }
-            B_pos++;
         }
+    });
 
+    npy_intp nnz = 0;
+    Cp[0] = 0;
+    for(I i = 0; i < n_row; i++){
+        nnz += Cp[i+1];
+        if (nnz > std::numeric_limits<I>::max()) {
+            throw std::overflow_error("nnz of the result is too large");
+        }
         Cp[i+1] = nnz;
     }
+
+    return nnz;
+}
+
+
+/*
+ * Second pass of C = A (binary_op) B: given the row pointer Cp computed
+ * by csr_binop_csr_count(), write the column indices and values of C.
+ * Rows are processed in parallel.
+ *
+ * Note:
+ *   Output arrays Cj and Cx must be preallocated with exactly Cp[n_row]
+ *   entries.  A, B and binary_op must be the same as in the first pass.
+ *
+ */
+template <class I, class T, class T2, class binary_op>
+void csr_binop_csr_fill(const I n_row, const I n_col,
+                        const I Ap[], const I Aj[], const T Ax[],
+                        const I Bp[], const I Bj[], const T Bx[],
+                        const I Cp[],       I Cj[],       T2 Cx[],
+                        const binary_op& op)
+{
+    const bool canonical = (csr_has_canonical_format(n_row, Ap, Aj) &&
+                            csr_has_canonical_format(n_row, Bp, Bj));
+    const std::vector<I> bounds = csr_binop_csr_partition(n_row, Ap, Bp);
+
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        if (canonical) {
+            for(I i = lo; i < hi; i++){
+                csr_binop_csr_row_canonical<true>(
+                    i, Ap, Aj, Ax, Bp, Bj, Bx, Cj + Cp[i], Cx + Cp[i], op);
+            }
+        } else {
+            std::vector<I>  next(n_col,-1);
+            std::vector<T> A_row(n_col, 0);
+            std::vector<T> B_row(n_col, 0);
+
+            for(I i = lo; i < hi; i++){
+                csr_binop_csr_row_general<true>(
+                    i, Ap, Aj, Ax, Bp, Bj, Bx, Cj + Cp[i], Cx + Cp[i], op,
+                    next.data(), A_row.data(), B_row.data());
+            }
+        }
+    });
 }
 
 
@@ -879,6 +1072,8 @@ void csr_binop_csr_canonical(const I n_row, const I n_col,
  *   Output arrays Cp, Cj, and Cx must be preallocated
  *   If nnz(C) is not known a priori, a conservative bound is:
  *          nnz(C) <= nnz(A) + nnz(B)
+ *   To allocate exactly nnz(C) entries, call csr_binop_csr_count()
+ *   and csr_binop_csr_fill() instead.
  *
  * Note:
  *   Input:  A and B column indices are not assumed to be in sorted order.
@@ -900,7 +1095,12 @@ void csr_binop_csr(const I n_row,
                          T2 Cx[],
                    const binary_op& op)
 {
-    if (csr_has_canonical_format(n_row,Ap,Aj) && csr_has_canonical_format(n_row,Bp,Bj))
+    if (csr_binop_csr_partition(n_row, Ap, Bp).size() > 2) {
+        // large enough to be worth the extra counting pass
+        csr_binop_csr_count(n_row, n_col, Ap, Aj, Ax, Bp, Bj, Bx, Cp, op);
+        csr_binop_csr_fill(n_row, n_col, Ap, Aj, Ax, Bp, Bj, Bx, Cp, Cj, Cx, op);
+    }
+    else if (csr_has_canonical_format(n_row,Ap,Aj) && csr_has_canonical_format(n_row,Bp,Bj))
         csr_binop_csr_canonical(n_row, n_col, Ap, Aj, Ax, Bp, Bj, Bx, Cp, Cj, Cx, op);
     else
         csr_binop_csr_general(n_row, n_col, Ap, Aj, Ax, Bp, Bj, Bx, Cp, Cj, Cx, op);
@@ -1007,6 +1207,209 @@ void csr_minimum_csr(const I n_row, const I n_col,
     csr_binop_csr(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,minimum<T>());
 }
 
+/*
+ * Two-pass element-wise binary operations: csr_<op>_csr_count() computes
+ * the exact row pointer of the result, csr_<op>_csr_fill() then writes
+ * its entries into arrays of exactly that size.
+ */
+template <class I, class T>
+npy_intp csr_ne_csr_count(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                                I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::not_equal_to<T>());
+}
+
+template <class I, class T, class T2>
+void csr_ne_csr_fill(const I n_row, const I n_col,
+                     const I Ap[], const I Aj[], const T Ax[],
+                     const I Bp[], const I Bj[], const T Bx[],
+                     const I Cp[],       I Cj[],      T2 Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::not_equal_to<T>());
+}
+
+template <class I, class T>
+npy_intp csr_lt_csr_count(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                                I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::less<T>());
+}
+
+template <class I, class T, class T2>
+void csr_lt_csr_fill(const I n_row, const I n_col,
+                     const I Ap[], const I Aj[], const T Ax[],
+                     const I Bp[], const I Bj[], const T Bx[],
+                     const I Cp[],       I Cj[],      T2 Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::less<T>());
+}
+
+template <class I, class T>
+npy_intp csr_gt_csr_count(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                                I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::greater<T>());
+}
+
+template <class I, class T, class T2>
+void csr_gt_csr_fill(const I n_row, const I n_col,
+                     const I Ap[], const I Aj[], const T Ax[],
+                     const I Bp[], const I Bj[], const T Bx[],
+                     const I Cp[],       I Cj[],      T2 Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::greater<T>());
+}
+
+template <class I, class T>
+npy_intp csr_le_csr_count(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                                I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::less_equal<T>());
+}
+
+template <class I, class T, class T2>
+void csr_le_csr_fill(const I n_row, const I n_col,
+                     const I Ap[], const I Aj[], const T Ax[],
+                     const I Bp[], const I Bj[], const T Bx[],
+                     const I Cp[],       I Cj[],      T2 Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::less_equal<T>());
+}
+
+template <class I, class T>
+npy_intp csr_ge_csr_count(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                                I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::greater_equal<T>());
+}
+
+template <class I, class T, class T2>
+void csr_ge_csr_fill(const I n_row, const I n_col,
+                     const I Ap[], const I Aj[], const T Ax[],
+                     const I Bp[], const I Bj[], const T Bx[],
+                     const I Cp[],       I Cj[],      T2 Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::greater_equal<T>());
+}
+
+template <class I, class T>
+npy_intp csr_elmul_csr_count(const I n_row, const I n_col,
+                             const I Ap[], const I Aj[], const T Ax[],
+                             const I Bp[], const I Bj[], const T Bx[],
+                                   I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::multiplies<T>());
+}
+
+template <class I, class T>
+void csr_elmul_csr_fill(const I n_row, const I n_col,
+                        const I Ap[], const I Aj[], const T Ax[],
+                        const I Bp[], const I Bj[], const T Bx[],
+                        const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::multiplies<T>());
+}
+
+template <class I, class T>
+npy_intp csr_eldiv_csr_count(const I n_row, const I n_col,
+                             const I Ap[], const I Aj[], const T Ax[],
+                             const I Bp[], const I Bj[], const T Bx[],
+                                   I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,safe_divides<T>());
+}
+
+template <class I, class T>
+void csr_eldiv_csr_fill(const I n_row, const I n_col,
+                        const I Ap[], const I Aj[], const T Ax[],
+                        const I Bp[], const I Bj[], const T Bx[],
+                        const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,safe_divides<T>());
+}
+
+template <class I, class T>
+npy_intp csr_plus_csr_count(const I n_row, const I n_col,
+                            const I Ap[], const I Aj[], const T Ax[],
+                            const I Bp[], const I Bj[], const T Bx[],
+                                  I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::plus<T>());
+}
+
+template <class I, class T>
+void csr_plus_csr_fill(const I n_row, const I n_col,
+                       const I Ap[], const I Aj[], const T Ax[],
+                       const I Bp[], const I Bj[], const T Bx[],
+                       const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::plus<T>());
+}
+
+template <class I, class T>
+npy_intp csr_minus_csr_count(const I n_row, const I n_col,
+                             const I Ap[], const I Aj[], const T Ax[],
+                             const I Bp[], const I Bj[], const T Bx[],
+                                   I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,std::minus<T>());
+}
+
+template <class I, class T>
+void csr_minus_csr_fill(const I n_row, const I n_col,
+                        const I Ap[], const I Aj[], const T Ax[],
+                        const I Bp[], const I Bj[], const T Bx[],
+                        const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,std::minus<T>());
+}
+
+template <class I, class T>
+npy_intp csr_maximum_csr_count(const I n_row, const I n_col,
+                               const I Ap[], const I Aj[], const T Ax[],
+                               const I Bp[], const I Bj[], const T Bx[],
+                                     I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,maximum<T>());
+}
+
+template <class I, class T>
+void csr_maximum_csr_fill(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                          const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,maximum<T>());
+}
+
+template <class I, class T>
+npy_intp csr_minimum_csr_count(const I n_row, const I n_col,
+                               const I Ap[], const I Aj[], const T Ax[],
+                               const I Bp[], const I Bj[], const T Bx[],
+                                     I Cp[])
+{
+    return csr_binop_csr_count(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,minimum<T>());
+}
+
+template <class I, class T>
+void csr_minimum_csr_fill(const I n_row, const I n_col,
+                          const I Ap[], const I Aj[], const T Ax[],
+                          const I Bp[], const I Bj[], const T Bx[],
+                          const I Cp[],       I Cj[],       T Cx[])
+{
+    csr_binop_csr_fill(n_row,n_col,Ap,Aj,Ax,Bp,Bj,Bx,Cp,Cj,Cx,minimum<T>());
+}
+
 
 /*
  * Sum together duplicate column entries in each row of CSR matrix A
@@ -1177,6 +1580,17 @@ void csr_matvecs(const I n_row,
 
 
 
+/*
+ * Extract the submatrix A[ir0:ir1, ic0:ic1] of CSR matrix A.
+ *
+ * Rows are counted and then copied in parallel.
+ *
+ * Output Arguments:
+ *   std::vector<I>  Bp - row pointer
+ *   std::vector<I>  Bj - column indices, shifted by -ic0
+ *   std::vector<T>  Bx - data
+ *
+ */
 template<class I, class T>
 void get_csr_submatrix(const I n_row,
                        const I n_col,
@@ -1193,41 +1607,58 @@ void get_csr_submatrix(const I n_row,
 {
     I new_n_row = ir1 - ir0;
     //I new_n_col = ic1 - ic0;  //currently unused
-    I new_nnz = 0;
-    I kk = 0;
 
-    // Count nonzeros total/per row.
-    for(I i = 0; i < new_n_row; i++){
-        I row_start = Ap[ir0+i];
-        I row_end   = Ap[ir0+i+1];
+    const npy_intp work = (npy_intp)(Ap[ir1] - Ap[ir0]) + new_n_row;
+    const std::vector<I> bounds = sptools_partition(
+        new_n_row, sptools_num_threads(work),
+        [Ap, ir0](const I i) { return (npy_intp)Ap[ir0+i] + i; });
+
+    Bp->resize(new_n_row+1);
+    I * const Bp_ = Bp->data();
 
-        for(I jj = row_start; jj < row_end; jj++){
-            if ((Aj[jj] >= ic0) && (Aj[jj] < ic1)) {
-                new_nnz++;
+    // Count nonzeros per row.
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        for(I i = lo; i < hi; i++){
+            I row_start = Ap[ir0+i];
+            I row_end   = Ap[ir0+i+1];
+            I row_nnz = 0;
+
+            for(I jj = row_start; jj < row_end; jj++){
+                if ((Aj[jj] >= ic0) && (Aj[jj] < ic1)) {
+                    row_nnz++;
+                }
             }
+            Bp_[i+1] = row_nnz;
         }
+    });
+
+    Bp_[0] = 0;
+    for(I i = 0; i < new_n_row; i++){
+        Bp_[i+1] += Bp_[i];
     }
 
     // Allocate.
-    Bp->resize(new_n_row+1);
-    Bj->resize(new_nnz);
-    Bx->resize(new_nnz);
+    Bj->resize(Bp_[new_n_row]);
+    Bx->resize(Bp_[new_n_row]);
+    I * const Bj_ = Bj->data();
+    T * const Bx_ = Bx->data();
 
     // Assign.
-    (*Bp)[0] = 0;
-    for(I i = 0; i < new_n_row; i++){
-        I row_start = Ap[ir0+i];
-        I row_end   = Ap[ir0+i+1];
-
-        for(I jj = row_start; jj < row_end; jj++){
-            if ((Aj[jj] >= ic0) && (Aj[jj] < ic1)) {
-                (*Bj)[kk] = Aj[jj] - ic0;
-                (*Bx)[kk] = Ax[jj];
-                kk++;
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        for(I i = lo; i < hi; i++){
+            I row_start = Ap[ir0+i];
+            I row_end   = Ap[ir0+i+1];
+            I kk = Bp_[i];
+
+            for(I jj = row_start; jj < row_end; jj++){
+                if ((Aj[jj] >= ic0) && (Aj[jj] < ic1)) {
+                    Bj_[kk] = Aj[jj] - ic0;
+                    Bx_[kk] = Ax[jj];
+                    kk++;
+                }
             }
         }
-        (*Bp)[i+1] = kk;
-    }
+    });
 }
 
 
@@ -1255,13 +1686,29 @@ void csr_row_index(const I n_row_idx,
                    I Bj[],
                    T Bx[])
 {
+    // output offset of every selected row
+    std::vector<npy_intp> Bp(n_row_idx + 1);
+    Bp[0] = 0;
     for(I i = 0; i < n_row_idx; i++){
         const I row = rows[i];
-        const I row_start = Ap[row];
-        const I row_end   = Ap[row+1];
-        Bj = std::copy(Aj + row_start, Aj + row_end, Bj);
-        Bx = std::copy(Ax + row_start, Ax + row_end, Bx);
+        Bp[i+1] = Bp[i] + (Ap[row+1] - Ap[row]);
     }
+
+    const std::vector<I> bounds = sptools_partition(
+        n_row_idx, sptools_num_threads(Bp[n_row_idx] + n_row_idx),
+        [&Bp](const I i) { return Bp[i] + i; });
+
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        I * Bj_ = Bj + Bp[lo];
+        T * Bx_ = Bx + Bp[lo];
+        for(I i = lo; i < hi; i++){
+            const I row = rows[i];
+            const I row_start = Ap[row];
+            const I row_end   = Ap[row+1];
+            Bj_ = std::copy(Aj + row_start, Aj + row_end, Bj_);
+            Bx_ = std::copy(Ax + row_start, Ax + row_end, Bx_);
+        }
+    });
 }
 
 
@@ -1309,6 +1756,58 @@ void csr_row_slice(const I start,
 }
 
 
+/*
+ * Slice columns given as an array of indices (pass 1, given the column
+ * offsets).  This pass computes the new indptr.
+ *
+ * Input Arguments:
+ *   I  n_row              - major axis dimension
+ *   I  n_col              - minor axis dimension
+ *   I  col_offsets[n_col] - cumsum of index repeats, i.e.
+ *                           cumsum(bincount(col_idxs, minlength=n_col))
+ *   I  Ap[n_row+1]        - indptr
+ *   I  Aj[nnz(A)]         - indices
+ *
+ * Output Arguments:
+ *   I  Bp[n_row+1]        - new indptr
+ *
+ * Note:
+ *   col_offsets only depends on the selected indices, so it can be
+ *   reused for slicing the same columns out of several matrices.
+ *   Rows are counted in parallel.
+ *
+ */
+template<class I>
+void csr_column_index_indptr(const I n_row,
+                             const I n_col,
+                             const I col_offsets[],
+                             const I Ap[],
+                             const I Aj[],
+                             I Bp[])
+{
+    const npy_intp work = (npy_intp)(Ap[n_row] - Ap[0]) + n_row;
+    const std::vector<I> bounds = sptools_partition(
+        n_row, sptools_num_threads(work),
+        [Ap](const I i) { return (npy_intp)Ap[i] + i; });
+
+    sptools_parallel_for(bounds, [&](const int, const I lo, const I hi) {
+        for(I i = lo; i < hi; i++){
+            I row_nnz = 0;
+            for(I jj = Ap[i]; jj < Ap[i+1]; jj++){
+                const I j = Aj[jj];
+                row_nnz += col_offsets[j] - (j == 0 ? 0 : col_offsets[j-1]);
+            }
+            Bp[i+1] = row_nnz;
+        }
+    });
+
+    Bp[0] = 0;
+    for(I i = 0; i < n_row; i++){
+        Bp[i+1] += Bp[i];
+    }
+}
+
+
 /*
  * Slice columns given as an array of indices (pass 1).
  * This pass counts idx entries and computes a new indptr.
@@ -1342,20 +1841,13 @@ void csr_column_index1(const I n_idx,
         col_offsets[j]++;
     }
 
-    // Compute new indptr
-    I new_nnz = 0;
-    Bp[0] = 0;
-    for(I i = 0; i < n_row; i++){
-        for(I jj = Ap[i]; jj < Ap[i+1]; jj++){
-            new_nnz += col_offsets[Aj[jj]];
-        }
-        Bp[i+1] = new_nnz;
-    }
-
     // cumsum in-place
     for(I j = 1; j < n_col; j++){
         col_offsets[j] += col_offsets[j - 1];
     }
+
+    // Compute new indptr
+    csr_column_index_indptr(n_row, n_col, col_offsets, Ap, Aj, Bp);
 }
 
 
@@ -1384,20 +1876,43 @@ void csr_column_index2(const I col_order[],
                        I Bj[],
                        T Bx[])
 {
-    I n = 0;
-    for(I jj = 0; jj < nnz; jj++){
-        const I j = Aj[jj];
-        const I offset = col_offsets[j];
-        const I prev_offset = j == 0 ? 0 : col_offsets[j-1];
-        if (offset != prev_offset) {
-            const T v = Ax[jj];
-            for(I k = prev_offset; k < offset; k++){
-                Bj[n] = col_order[k];
-                Bx[n] = v;
-                n++;
+    // Split A's entries into pieces; the output offset of each piece is
+    // found by counting the entries of all previous pieces first.
+    const std::vector<I> bounds = sptools_partition(
+        nnz, sptools_num_threads(2 * (npy_intp)nnz),
+        [](const I jj) { return jj; });
+    std::vector<npy_intp> piece_offsets(bounds.size(), 0);
+
+    if (bounds.size() > 2) {
+        sptools_parallel_for(bounds, [&](const int k, const I lo, const I hi) {
+            npy_intp n = 0;
+            for(I jj = lo; jj < hi; jj++){
+                const I j = Aj[jj];
+                n += col_offsets[j] - (j == 0 ? 0 : col_offsets[j-1]);
             }
+            piece_offsets[k+1] = n;
+        });
+        for(size_t k = 1; k < piece_offsets.size(); k++){
+            piece_offsets[k] += piece_offsets[k-1];
         }
     }
+
+    sptools_parallel_for(bounds, [&](const int k, const I lo, const I hi) {
+        npy_intp n = piece_offsets[k];
+        for(I jj = lo; jj < hi; jj++){
+            const I j = Aj[jj];
+            const I offset = col_offsets[j];
+            const I prev_offset = j == 0 ? 0 : col_offsets[j-1];
+            if (offset != prev_offset) {
+                const T v = Ax[jj];
+                for(I kk = prev_offset; kk < offset; kk++){
+                    Bj[n] = col_order[kk];
+                    Bx[n] = v;
+                    n++;
+                }
+            }
+        }
+    });
 }
 
 
@@ -0,0 +1,186 @@
+#ifndef __SPTOOLS_PARALLEL_H__
+#define __SPTOOLS_PARALLEL_H__
+
+/*
+ * Minimal row-partitioned threading for sparsetools kernels.
+ *
+ * The kernels are called from call_thunk() with the GIL released, so plain
+ * std::thread workers are safe as long as they only touch the raw arrays.
+ * Loops run serially on the calling thread unless more workers were allowed
+ * for that thread with sptools_set_max_workers() (scipy.sparse.set_workers).
+ * Building with SPTOOLS_NO_MULTITHREADING defined makes every loop serial.
+ */
+
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+#ifndef SPTOOLS_NO_MULTITHREADING
+#include <thread>
+#endif
+
+/*
+ * Minimum amount of work (roughly: number of stored entries touched) given
+ * to a single thread.  Smaller problems are not worth the thread start-up.
+ */
+#define SPTOOLS_PARALLEL_GRAIN 65536
+
+/*
+ * Upper bound on the number of threads used by a single kernel call.
+ */
+#define SPTOOLS_PARALLEL_MAX_THREADS 64
+
+
+/*
+ * Maximum number of threads of a kernel called from the current thread.
+ * Defaults to 1, i.e. kernels run serially unless the caller opts in.
+ */
+inline int& sptools_max_workers()
+{
+    static thread_local int max_workers = 1;
+    return max_workers;
+}
+
+
+/*
+ * Set the maximum number of threads of the kernels called from the current
+ * thread and return the previous maximum.
+ */
+inline int sptools_set_max_workers(const int n)
+{
+    const int previous = sptools_max_workers();
+    sptools_max_workers() = std::max(n, 1);
+    return previous;
+}
+
+
+/*
+ * Number of threads to use for a loop touching `work` entries.
+ */
+inline int sptools_num_threads(const npy_intp work)
+{
+#ifdef SPTOOLS_NO_MULTITHREADING
+    (void)work;
+    return 1;
+#else
+    npy_intp n = work / SPTOOLS_PARALLEL_GRAIN;
+
+    n = std::min(n, (npy_intp)sptools_max_workers());
+    n = std::min(n, (npy_intp)SPTOOLS_PARALLEL_MAX_THREADS);
+    return n < 1 ? 1 : (int)n;
+#endif
+}
+
+
+/*
+ * Split the range [0, n) into at most `n_parts` contiguous pieces of
+ * roughly equal work.
+ *
+ * `cumwork(i)` must be non-decreasing in i and give the total work in
+ * [0, i); e.g. Ap[i] + Bp[i] for row ranges of two CSR matrices.
+ *
+ * Returns the piece boundaries: bounds[0] = 0, ..., bounds.back() = n.
+ */
+template <class I, class CumWork>
+std::vector<I> sptools_partition(const I n, const int n_parts,
+                                 const CumWork& cumwork)
+{
+    std::vector<I> bounds(1, 0);
+
+    if (n_parts > 1 && n > 0) {
+        const npy_intp w0 = cumwork(0);
+        const npy_intp total = (npy_intp)cumwork(n) - w0;
+
+        for (int k = 1; k < n_parts; k++) {
+            const npy_intp target = w0 + (total / n_parts) * k;
+
+            // first i with cumwork(i) >= target
+            I lo = bounds.back(), hi = n;
+            while (lo < hi) {
+                I mid = lo + (hi - lo) / 2;
+                if ((npy_intp)cumwork(mid) < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo > bounds.back() && lo < n) {
+                bounds.push_back(lo);
+            }
+        }
+    }
+
+    bounds.push_back(n);
+    return bounds;
+}
+
+
+/*
+ * Call f(part, lo, hi) for every piece [bounds[part], bounds[part+1]).
+ *
+ * The first piece runs on the calling thread.  An exception thrown by any
+ * piece is re-raised on the calling thread after all pieces finished.
+ */
+template <class I, class F>
+void sptools_parallel_for(const std::vector<I>& bounds, const F& f)
+{
+    const int n_parts = (int)bounds.size() - 1;
+
+    if (n_parts <= 0) {
+        return;
+    }
+
+#ifdef SPTOOLS_NO_MULTITHREADING
+    for (int k = 0; k < n_parts; k++) {
+        f(k, bounds[k], bounds[k + 1]);
+    }
+#else
+    if (n_parts == 1) {
+        f(0, bounds[0], bounds[1]);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(n_parts);
+    std::vector<std::thread> workers;
+    workers.reserve(n_parts - 1);
+
+    try {
+        for (int k = 1; k < n_parts; k++) {
+            workers.emplace_back([&f, &bounds, &errors, k]() {
+                try {
+                    f(k, bounds[k], bounds[k + 1]);
+                } catch (...) {
+                    errors[k] = std::current_exception();
+                }
+            });
+        }
+    } catch (...) {
+        // could not start a thread: run the remaining pieces here
+        for (int k = (int)workers.size() + 1; k < n_parts; k++) {
+            try {
+                f(k, bounds[k], bounds[k + 1]);
+            } catch (...) {
+                errors[k] = std::current_exception();
+            }
+        }
+    }
+
+    try {
+        f(0, bounds[0], bounds[1]);
+    } catch (...) {
+        errors[0] = std::current_exception();
+    }
+
+    for (std::thread& w : workers) {
+        w.join();
+    }
+
+    for (int k = 0; k < n_parts; k++) {
+        if (errors[k]) {
+            std::rethrow_exception(errors[k]);
+        }
+    }
+#endif
+}
+
+#endif
@@ -35,6 +35,7 @@
 
 #include "sparsetools.h"
 #include "util.h"
+#include "parallel.h"
 
 #define MAX_ARGS 16
 
@@ -533,6 +534,41 @@ static PyObject *c_array_from_object(PyObject *obj, int typenum, int is_output)
 }
 
 
+/*
+ * Maximum number of threads of the kernels called from the calling thread,
+ * see parallel.h.  set_workers returns the previous value.
+ */
+
+static PyObject *
+set_workers_method(PyObject *self, PyObject *args)
+{
+    int workers;
+
+    if (!PyArg_ParseTuple(args, "i", &workers)) {
+        return NULL;
+    }
+    if (workers < 1) {
+        PyErr_SetString(PyExc_ValueError, "workers must be positive");
+        return NULL;
+    }
+    return PyLong_FromLong(sptools_set_max_workers(workers));
+}
+
+
+static PyObject *
+get_workers_method(PyObject *self, PyObject *args)
+{
+    return PyLong_FromLong(sptools_max_workers());
+}
+
+
+static struct PyMethodDef workers_methods[] = {
+    {"set_workers", (PyCFunction)set_workers_method, METH_VARARGS, NULL},
+    {"get_workers", (PyCFunction)get_workers_method, METH_NOARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+
 /*
  * Python module initialization
  */
@@ -556,8 +592,15 @@ static struct PyModuleDef moduledef = {
 PyMODINIT_FUNC
 PyInit__sparsetools(void)
 {
+    PyObject *module;
+
     import_array();
-    return PyModule_Create(&moduledef);
+    module = PyModule_Create(&moduledef);
+    if (module != NULL && PyModule_AddFunctions(module, workers_methods) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
 }
 
 } /* extern "C" */
@@ -6,7 +6,7 @@ import threading
 import numpy as np
 from numpy.testing import assert_equal, assert_, assert_allclose
 from scipy.sparse import (_sparsetools, coo_matrix, csr_matrix, csc_matrix,
-                          bsr_matrix, dia_matrix)
+                          bsr_matrix, dia_matrix, set_workers, get_workers)
 from scipy.sparse._sputils import supported_dtypes
 from scipy._lib._testutils import check_free_memory
 
@@ -56,6 +56,169 @@ def test_threads():
         assert_(np.all(b.toarray() == 2))
 
 
+@pytest.fixture(params=[1, 4])
+def workers(request):
+    # run the kernels serially and on several threads
+    with set_workers(request.param):
+        yield request.param
+
+
+def test_set_workers():
+    assert_equal(get_workers(), 1)
+    with set_workers(3):
+        assert_equal(get_workers(), 3)
+        with set_workers(-1):
+            assert_equal(get_workers(), os.cpu_count())
+        assert_equal(get_workers(), 3)
+
+        # the setting is per thread
+        result = []
+        t = threading.Thread(target=lambda: result.append(get_workers()))
+        t.start()
+        t.join()
+        assert_equal(result, [1])
+    assert_equal(get_workers(), 1)
+
+    assert_raises(ValueError, set_workers(0).__enter__)
+    assert_raises(ValueError, set_workers(-os.cpu_count() - 1).__enter__)
+
+
+@pytest.mark.parametrize("canonical", [True, False])
+@pytest.mark.parametrize("op", ["plus", "elmul", "maximum", "ne"])
+def test_binop_count_fill(op, canonical, workers):
+    # Large enough for the row-parallel code path; compare the two-pass
+    # routines and the single-call routine against each other.
+    rng = np.random.RandomState(1234)
+    n = 1000
+    nnz = 150000
+
+    def random_csr():
+        # unsorted column indices with duplicates
+        rows = np.sort(rng.randint(0, n, nnz))
+        indptr = np.searchsorted(rows, np.arange(n + 1)).astype(np.int32)
+        indices = rng.randint(0, n, nnz).astype(np.int32)
+        data = rng.randint(-2, 3, nnz).astype(np.float64)
+        m = csr_matrix((data, indices, indptr), shape=(n, n))
+        if canonical:
+            m.sum_duplicates()
+        return m
+
+    a = random_csr()
+    b = random_csr()
+    out_dtype = np.bool_ if op == "ne" else np.float64
+
+    indptr = np.empty(n + 1, dtype=a.indptr.dtype)
+    count = getattr(_sparsetools, f"csr_{op}_csr_count")
+    fill = getattr(_sparsetools, f"csr_{op}_csr_fill")
+    nnz_c = count(n, n, a.indptr, a.indices, a.data,
+                  b.indptr, b.indices, b.data, indptr)
+    assert_equal(nnz_c, indptr[-1])
+    indices = np.empty(nnz_c, dtype=a.indices.dtype)
+    data = np.empty(nnz_c, dtype=out_dtype)
+    fill(n, n, a.indptr, a.indices, a.data, b.indptr, b.indices, b.data,
+         indptr, indices, data)
+    c = csr_matrix((data, indices, indptr), shape=(n, n))
+    assert_(np.all(c.data != 0))
+
+    indptr2 = np.empty(n + 1, dtype=a.indptr.dtype)
+    indices2 = np.empty(a.nnz + b.nnz, dtype=a.indices.dtype)
+    data2 = np.empty(a.nnz + b.nnz, dtype=out_dtype)
+    getattr(_sparsetools, f"csr_{op}_csr")(
+        n, n, a.indptr, a.indices, a.data, b.indptr, b.indices, b.data,
+        indptr2, indices2, data2)
+    assert_equal(indptr2, indptr)
+    assert_equal(indices2[:nnz_c], indices)
+    assert_equal(data2[:nnz_c], data)
+
+    ad = a.toarray()
+    bd = b.toarray()
+    expected = {"plus": ad + bd, "elmul": ad * bd,
+                "maximum": np.maximum(ad, bd), "ne": ad != bd}[op]
+    assert_equal(c.toarray(), expected)
+
+
+def test_cs_graph_components(workers):
+    from scipy.sparse.csgraph import connected_components
+
+    rng = np.random.RandomState(1234)
+    n = 20000
+    m = 15000
+    row = rng.randint(0, n, m)
+    col = rng.randint(0, n, m)
+    g = coo_matrix((np.ones(m), (row, col)), shape=(n, n)).tocsr()
+    g = (g + g.T).tocsr()
+
+    flag = np.empty(n, dtype=g.indptr.dtype)
+    n_comp = _sparsetools.cs_graph_components(n, g.indptr, g.indices, flag)
+
+    # nodes without edges are flagged with -2 and not counted
+    isolated = np.diff(g.indptr) == 0
+    assert_equal(flag[isolated], -2)
+
+    n_ref, ref = connected_components(g, directed=False)
+    assert_equal(n_comp, n_ref - isolated.sum())
+    # same partition, numbered in the order of the smallest node
+    assert_equal(flag[~isolated], np.unique(ref[~isolated],
+                                            return_inverse=True)[1])
+
+    bad = np.array([0, 1], dtype=g.indptr.dtype)
+    assert_equal(_sparsetools.cs_graph_components(
+        1, bad, np.array([5], dtype=bad.dtype), flag[:1]), -1)
+
+
+@pytest.mark.parametrize("fmt", [csr_matrix, csc_matrix])
+def test_fancy_index_large(fmt, workers):
+    # Large enough for the parallel row/column selection kernels.
+    rng = np.random.RandomState(1234)
+    n = 2000
+    a = fmt(rng.randint(-3, 4, size=(n, n)).astype(np.float64))
+    ad = a.toarray()
+
+    cols = rng.randint(0, n, 700)
+    for _ in range(2):
+        rows = rng.randint(0, n, 900)
+        assert_equal(a[rows][:, cols].toarray(), ad[rows][:, cols])
+        assert_equal(a[rows, :].toarray(), ad[rows, :])
+        assert_equal(a[:, cols].toarray(), ad[:, cols])
+
+    # same length, different columns
+    cols2 = cols.copy()
+    cols2[0] = (cols2[0] + 1) % n
+    assert_equal(a[:, cols2].toarray(), ad[:, cols2])
+    assert_equal(a[10:1500, 20:1800].toarray(), ad[10:1500, 20:1800])
+
+
+@pytest.mark.parametrize("fmt", [csr_matrix, csc_matrix])
+def test_minor_index_lookup_reuse(fmt, monkeypatch):
+    from scipy.sparse import _compressed
+
+    rng = np.random.RandomState(1234)
+    n = 300
+    a = fmt(rng.randint(-3, 4, size=(n, n)).astype(np.float64))
+    ad = a.toarray()
+    idx = rng.randint(0, n, 100)
+    lookup = a._minor_index_lookup(idx)
+
+    # selections given the lookup must not build a new one
+    def fail(*args):
+        raise AssertionError("column lookup rebuilt")
+    monkeypatch.setattr(_compressed, "_MinorIndexLookup", fail)
+
+    for _ in range(3):
+        major = rng.randint(0, n, 50)
+        if fmt is csr_matrix:
+            b = a[major]._minor_index_fancy(idx, lookup)
+            assert_equal(b.toarray(), ad[major][:, idx])
+        else:
+            b = a[:, major]._minor_index_fancy(idx, lookup)
+            assert_equal(b.toarray(), ad[:, major][idx])
+
+    with assert_raises(ValueError, match="lookup"):
+        a._minor_index_fancy(idx[:-1], lookup)
+    with assert_raises(AssertionError, match="rebuilt"):
+        a._minor_index_fancy(idx)
+
+
 def test_regression_std_vector_dtypes():
     # Regression test for gh-3780, checking the std::vector typemaps
     # in sparsetools.cxx are complete.